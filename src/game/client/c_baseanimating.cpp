@@ -2921,13 +2921,40 @@ ConVar cl_warn_thread_contested_bone_setup("cl_warn_thread_contested_bone_setup"
 ConVar cl_threaded_bone_setup("cl_threaded_bone_setup", "0", 0, "Enable parallel processing of C_BaseAnimating::SetupBones()" );
 
 //-----------------------------------------------------------------------------
-// Purpose: Do the default sequence blending rules as done in HL1
+// Threaded bone setup works on whole hierarchies.  A child reads its parent's
+// bones to place itself (attachments, bone merging), so each hierarchy is set
+// up parents first on one thread, and different hierarchies run in parallel.
 //-----------------------------------------------------------------------------
 
-static void SetupBonesOnBaseAnimating( C_BaseAnimating *&pBaseAnimating )
+struct BoneSetupEntry_t
 {
-	if ( !pBaseAnimating->GetMoveParent() )
-		pBaseAnimating->SetupBones( NULL, -1, -1, gpGlobals->curtime );
+	C_BaseAnimating	*pAnimating;
+	C_BaseEntity	*pRoot;			// topmost move parent, or the entity itself
+	int				depth;			// number of move parents
+};
+
+struct BoneSetupHierarchy_t
+{
+	BoneSetupEntry_t	*pFirst;
+	int					count;
+};
+
+static int BoneSetupEntryCompare( const BoneSetupEntry_t *pLeft, const BoneSetupEntry_t *pRight )
+{
+	if ( pLeft->pRoot != pRight->pRoot )
+		return ( pLeft->pRoot < pRight->pRoot ) ? -1 : 1;
+	return pLeft->depth - pRight->depth;
+}
+
+static CUtlVector<BoneSetupEntry_t> g_BoneSetupEntries;
+static CUtlVector<BoneSetupHierarchy_t> g_BoneSetupHierarchies;
+
+static void SetupBonesOnHierarchy( BoneSetupHierarchy_t &hierarchy )
+{
+	for ( int i = 0; i < hierarchy.count; i++ )
+	{
+		hierarchy.pFirst[i].pAnimating->SetupBones( NULL, -1, -1, gpGlobals->curtime );
+	}
 }
 
 static void PreThreadedBoneSetup()
@@ -2951,20 +2978,70 @@ void C_BaseAnimating::ShutdownBoneSetupThreadPool()
 {
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Set up the bones of everything whose bones were used last frame, and
+//			the animating parents they depend on, before rendering starts.
+//-----------------------------------------------------------------------------
 void C_BaseAnimating::ThreadedBoneSetup()
 {
 	g_bDoThreadedBoneSetup = cl_threaded_bone_setup.GetBool();
-	if ( g_bDoThreadedBoneSetup )
+	if ( g_bDoThreadedBoneSetup && g_PreviousBoneSetups.Count() > 1 )
 	{
-		int nCount = g_PreviousBoneSetups.Count();
-		if ( nCount > 1 )
+		g_BoneSetupEntries.RemoveAll();
+		g_BoneSetupHierarchies.RemoveAll();
+
+		for ( int i = 0; i < g_PreviousBoneSetups.Count(); i++ )
+		{
+			C_BaseAnimating *pAnimating = g_PreviousBoneSetups[i];
+
+			BoneSetupEntry_t &entry = g_BoneSetupEntries[ g_BoneSetupEntries.AddToTail() ];
+			entry.pAnimating = pAnimating;
+			entry.pRoot = pAnimating;
+			entry.depth = 0;
+
+			// Parents are set up with their children even if nothing asked for their bones,
+			// since the children will.  Entries for them are filled in below.
+			for ( C_BaseEntity *pParent = pAnimating->GetMoveParent(); pParent; pParent = pParent->GetMoveParent() )
+			{
+				C_BaseAnimating *pParentAnimating = pParent->GetBaseAnimating();
+				if ( pParentAnimating && !pParentAnimating->IsDormant() && pParentAnimating->m_iMostRecentBoneSetupRequest != g_iPreviousBoneCounter )
+				{
+					pParentAnimating->m_iMostRecentBoneSetupRequest = g_iPreviousBoneCounter;
+					g_BoneSetupEntries[ g_BoneSetupEntries.AddToTail() ].pAnimating = pParentAnimating;
+				}
+			}
+		}
+
+		for ( int i = 0; i < g_BoneSetupEntries.Count(); i++ )
 		{
-			g_bInThreadedBoneSetup = true;
+			BoneSetupEntry_t &entry = g_BoneSetupEntries[i];
+			entry.pRoot = entry.pAnimating;
+			entry.depth = 0;
+			while ( entry.pRoot->GetMoveParent() )
+			{
+				entry.pRoot = entry.pRoot->GetMoveParent();
+				++entry.depth;
+			}
+		}
 
-			ParallelProcess( "C_BaseAnimating::ThreadedBoneSetup", g_PreviousBoneSetups.Base(), nCount, &SetupBonesOnBaseAnimating, &PreThreadedBoneSetup, &PostThreadedBoneSetup );
+		g_BoneSetupEntries.Sort( BoneSetupEntryCompare );
 
-			g_bInThreadedBoneSetup = false;
+		for ( int i = 0; i < g_BoneSetupEntries.Count(); i++ )
+		{
+			if ( i == 0 || g_BoneSetupEntries[i].pRoot != g_BoneSetupEntries[i - 1].pRoot )
+			{
+				BoneSetupHierarchy_t &hierarchy = g_BoneSetupHierarchies[ g_BoneSetupHierarchies.AddToTail() ];
+				hierarchy.pFirst = &g_BoneSetupEntries[i];
+				hierarchy.count = 0;
+			}
+			++g_BoneSetupHierarchies.Tail().count;
 		}
+
+		g_bInThreadedBoneSetup = true;
+
+		ParallelProcess( "C_BaseAnimating::ThreadedBoneSetup", g_BoneSetupHierarchies.Base(), g_BoneSetupHierarchies.Count(), &SetupBonesOnHierarchy, &PreThreadedBoneSetup, &PostThreadedBoneSetup );
+
+		g_bInThreadedBoneSetup = false;
 	}
 	g_iPreviousBoneCounter++;
 	g_PreviousBoneSetups.RemoveAll();
@@ -3071,7 +3148,7 @@ bool C_BaseAnimating::SetupBones( matrix3x4_t *pBoneToWorldOut, int nMaxBones, i
 	}
 
 	int nBoneCount = m_CachedBoneData.Count();
-	if ( g_bDoThreadedBoneSetup && !g_bInThreadedBoneSetup && ( nBoneCount >= 16 ) && !GetMoveParent() && m_iMostRecentBoneSetupRequest != g_iPreviousBoneCounter )
+	if ( g_bDoThreadedBoneSetup && !g_bInThreadedBoneSetup && ( nBoneCount >= 16 ) && m_iMostRecentBoneSetupRequest != g_iPreviousBoneCounter )
 	{
 		m_iMostRecentBoneSetupRequest = g_iPreviousBoneCounter;
 		Assert( g_PreviousBoneSetups.Find( this ) == -1 );
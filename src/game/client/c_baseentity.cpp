@@ -84,6 +84,7 @@ void cc_cl_interp_all_changed( IConVar *pConVar, const char *pOldString, float f
 static ConVar  cl_extrapolate( "cl_extrapolate", "1", FCVAR_CHEAT, "Enable/disable extrapolation if interpolation history runs out." );
 static ConVar  cl_interp_npcs( "cl_interp_npcs", "0.0", FCVAR_USERINFO, "Interpolate NPC positions starting this many seconds in past (or cl_interp, if greater)" );  
 static ConVar  cl_interp_all( "cl_interp_all", "0", 0, "Disable interpolation list optimizations.", 0, 0, 0, 0, cc_cl_interp_all_changed );
+static ConVar  cl_interp_batch( "cl_interp_batch", "1", 0, "Work out the lerps of all interpolated float and vector vars together each frame." );
 ConVar  r_drawmodeldecals( "r_drawmodeldecals", "1" );
 extern ConVar	cl_showerror;
 int C_BaseEntity::m_nPredictionRandomSeed = -1;
@@ -1004,6 +1005,21 @@ void C_BaseEntity::Interp_HierarchyUpdateInterpolationAmounts()
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Calls the var through its concrete type, skipping the vtable.
+//-----------------------------------------------------------------------------
+template< class T >
+inline int InterpolateVarDirect( IInterpolatedVar *watcher, float currentTime )
+{
+	return static_cast< T * >( watcher )->T::Interpolate( currentTime );
+}
+
+template< class T >
+inline void QueueInterpolateVar( IInterpolatedVar *watcher, float currentTime )
+{
+	static_cast< T * >( watcher )->QueueInterpolate( currentTime, &g_InterpolatedVarBatch );
+}
+
 inline int C_BaseEntity::Interp_Interpolate( VarMapping_t *map, float currentTime )
 {
 	int bNoMoreChanges = 1;
@@ -1028,8 +1044,27 @@ inline int C_BaseEntity::Interp_Interpolate( VarMapping_t *map, float currentTim
 		IInterpolatedVar *watcher = e->watcher;
 		Assert( !( watcher->GetType() & EXCLUDE_AUTO_INTERPOLATE ) );
 
+		int bVarNoMoreChanges;
+		switch ( e->m_nVarKind )
+		{
+		case INTERPOLATEDVAR_FLOAT:
+			bVarNoMoreChanges = InterpolateVarDirect< CInterpolatedVarArrayBase< float, false > >( watcher, currentTime );
+			break;
+		case INTERPOLATEDVAR_VECTOR:
+			bVarNoMoreChanges = InterpolateVarDirect< CInterpolatedVarArrayBase< Vector, false > >( watcher, currentTime );
+			break;
+		case INTERPOLATEDVAR_FLOAT_ARRAY:
+			bVarNoMoreChanges = InterpolateVarDirect< CInterpolatedVarArrayBase< float, true > >( watcher, currentTime );
+			break;
+		case INTERPOLATEDVAR_VECTOR_ARRAY:
+			bVarNoMoreChanges = InterpolateVarDirect< CInterpolatedVarArrayBase< Vector, true > >( watcher, currentTime );
+			break;
+		default:
+			bVarNoMoreChanges = watcher->Interpolate( currentTime );
+			break;
+		}
 
-		if ( watcher->Interpolate( currentTime ) )
+		if ( bVarNoMoreChanges )
 			e->m_bNeedsToInterpolate = false;
 		else
 			bNoMoreChanges = 0;
@@ -1038,6 +1073,39 @@ inline int C_BaseEntity::Interp_Interpolate( VarMapping_t *map, float currentTim
 	return bNoMoreChanges;
 }
 
+void C_BaseEntity::Interp_QueueInterpolate( VarMapping_t *map, float currentTime )
+{
+	if ( !GetInterpolationTime( currentTime ) )
+		return;
+
+	// Interp_Interpolate interpolates everything again when time goes backwards
+	bool bAll = ( currentTime < map->m_lastInterpolationTime );
+
+	for ( int i = 0; i < map->m_nInterpolatedEntries; i++ )
+	{
+		VarMapEntry_t *e = &map->m_Entries[ i ];
+
+		if ( !bAll && !e->m_bNeedsToInterpolate )
+			continue;
+
+		switch ( e->m_nVarKind )
+		{
+		case INTERPOLATEDVAR_FLOAT:
+			QueueInterpolateVar< CInterpolatedVarArrayBase< float, false > >( e->watcher, currentTime );
+			break;
+		case INTERPOLATEDVAR_VECTOR:
+			QueueInterpolateVar< CInterpolatedVarArrayBase< Vector, false > >( e->watcher, currentTime );
+			break;
+		case INTERPOLATEDVAR_FLOAT_ARRAY:
+			QueueInterpolateVar< CInterpolatedVarArrayBase< float, true > >( e->watcher, currentTime );
+			break;
+		case INTERPOLATEDVAR_VECTOR_ARRAY:
+			QueueInterpolateVar< CInterpolatedVarArrayBase< Vector, true > >( e->watcher, currentTime );
+			break;
+		}
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Functions.
 //-----------------------------------------------------------------------------
@@ -2992,14 +3060,29 @@ int CBaseEntity::BaseInterpolatePart1( float &currentTime, Vector &oldOrigin, QA
 	bNoMoreChanges = 1;
 	
 
-	// These get moved to the parent position automatically
-	if ( IsFollowingEntity() || !IsInterpolationEnabled() )
+	if ( !GetInterpolationTime( currentTime ) )
 	{
 		// Assume current origin ( no interpolation )
 		MoveToLastReceivedPosition();
 		return INTERPOLATE_STOP;
 	}
 
+	oldOrigin = m_vecOrigin;
+	oldAngles = m_angRotation;
+	oldVel = m_vecVelocity;
+
+	bNoMoreChanges = Interp_Interpolate( GetVarMapping(), currentTime );
+	if ( cl_interp_all.GetInt() || (m_EntClientFlags & ENTCLIENTFLAG_ALWAYS_INTERPOLATE) )
+		bNoMoreChanges = 0;
+
+	return INTERPOLATE_CONTINUE;
+}
+
+bool C_BaseEntity::GetInterpolationTime( float &currentTime )
+{
+	// These get moved to the parent position automatically
+	if ( IsFollowingEntity() || !IsInterpolationEnabled() )
+		return false;
 
 	if ( GetPredictable() || IsClientCreated() )
 	{
@@ -3012,15 +3095,7 @@ int CBaseEntity::BaseInterpolatePart1( float &currentTime, Vector &oldOrigin, QA
 		}
 	}
 
-	oldOrigin = m_vecOrigin;
-	oldAngles = m_angRotation;
-	oldVel = m_vecVelocity;
-
-	bNoMoreChanges = Interp_Interpolate( GetVarMapping(), currentTime );
-	if ( cl_interp_all.GetInt() || (m_EntClientFlags & ENTCLIENTFLAG_ALWAYS_INTERPOLATE) )
-		bNoMoreChanges = 0;
-
-	return INTERPOLATE_CONTINUE;
+	return true;
 }
 
 #if 0
@@ -3275,6 +3350,21 @@ void C_BaseEntity::ProcessInterpolatedList()
 {
 	CheckInterpolatedVarParanoidMeasurement();
 
+	// Queue up the lerps of every entity's float and vector vars and work them out in one go.
+	// Each entity's Interpolate() below takes its results from the batch.
+	if ( cl_interp_batch.GetBool() )
+	{
+		VPROF( "C_BaseEntity::ProcessInterpolatedList batch" );
+
+		g_InterpolatedVarBatch.Begin();
+		for ( int iCur=g_InterpolationList.Head(); iCur != g_InterpolationList.InvalidIndex(); iCur=g_InterpolationList.Next( iCur ) )
+		{
+			C_BaseEntity *pCur = g_InterpolationList[iCur];
+			pCur->Interp_QueueInterpolate( pCur->GetVarMapping(), gpGlobals->curtime );
+		}
+		g_InterpolatedVarBatch.Run();
+	}
+
 	// Interpolate the minimal set of entities that need it.
 	int iNext;
 	for ( int iCur=g_InterpolationList.Head(); iCur != g_InterpolationList.InvalidIndex(); iCur=iNext )
@@ -6554,6 +6644,7 @@ void C_BaseEntity::AddVar( void *data, IInterpolatedVar *watcher, int type, bool
 		map.watcher = watcher;
 		map.type = type;
 		map.m_bNeedsToInterpolate = true;
+		map.m_nVarKind = watcher->GetVarKind();
 		if ( type & EXCLUDE_AUTO_INTERPOLATE )
 		{
 			m_VarMap.m_Entries.AddToTail( map );
@@ -86,6 +86,7 @@ public:
 	unsigned short		type;
 	unsigned short		m_bNeedsToInterpolate;	// Set to false when this var doesn't
 												// need Interpolate() called on it anymore.
+	int					m_nVarKind;				// watcher->GetVarKind(), so it can be called without the vtable.
 	void				*data;
 	IInterpolatedVar	*watcher;
 };
@@ -244,6 +245,10 @@ public:
 	
 	// Returns 1 if there are no more changes (ie: we could call RemoveFromInterpolationList).
 	int								Interp_Interpolate( VarMapping_t *map, float currentTime );
+
+	// Queue the vars Interp_Interpolate would interpolate in g_InterpolatedVarBatch.
+	void							Interp_QueueInterpolate( VarMapping_t *map, float currentTime );
+	
 	
 	void							Interp_RestoreToLastNetworked( VarMapping_t *map );
 	void							Interp_UpdateInterpolationAmounts( VarMapping_t *map );
@@ -1325,6 +1330,10 @@ protected:
 	// Returns INTERPOLATE_STOP or INTERPOLATE_CONTINUE.
 	// bNoMoreChanges is set to 1 if you can call RemoveFromInterpolationList on the entity.
 	int BaseInterpolatePart1( float &currentTime, Vector &oldOrigin, QAngle &oldAngles, Vector &oldVel, int &bNoMoreChanges );
+
+	// Adjusts currentTime to the time this entity's vars are interpolated to.
+	// Returns false if the entity isn't interpolated at all.
+	bool GetInterpolationTime( float &currentTime );
 	void BaseInterpolatePart2( Vector &oldOrigin, QAngle &oldAngles, Vector &oldVel, int nChangeFlags );
 
 
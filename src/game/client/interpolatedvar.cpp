@@ -6,6 +6,7 @@
 
 #include "cbase.h"
 #include "interpolatedvar.h"
+#include "mathlib/ssemath.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -28,3 +29,122 @@ float g_flLastPacketTimestamp = 0;
 
 ConVar cl_extrapolate_amount( "cl_extrapolate_amount", "0.25", FCVAR_CHEAT, "Set how many seconds the client will extrapolate entities for." );
 
+
+
+CInterpolatedVarBatch g_InterpolatedVarBatch;
+
+
+CInterpolatedVarBatch::CInterpolatedVarBatch()
+{
+	m_nSerial = 0;
+	m_bRan = false;
+}
+
+void CInterpolatedVarBatch::Begin()
+{
+	m_Prev.RemoveAll();
+	m_Start.RemoveAll();
+	m_End.RemoveAll();
+	m_Frac.RemoveAll();
+	m_HermiteMask.RemoveAll();
+	m_Result.RemoveAll();
+
+	++m_nSerial;
+	m_bRan = false;
+}
+
+int CInterpolatedVarBatch::AddLanes( int nLanes, float frac, int nHermiteMask )
+{
+	Assert( !m_bRan );
+
+	int iFirst = m_Start.Count();
+	m_Prev.AddMultipleToTail( nLanes );
+	m_Start.AddMultipleToTail( nLanes );
+	m_End.AddMultipleToTail( nLanes );
+	m_Frac.AddMultipleToTail( nLanes );
+	m_HermiteMask.AddMultipleToTail( nLanes );
+
+	for ( int i = iFirst; i < iFirst + nLanes; i++ )
+	{
+		m_Frac[i] = frac;
+		m_HermiteMask[i] = nHermiteMask;
+	}
+
+	return iFirst;
+}
+
+int CInterpolatedVarBatch::AddLerp( const float *pStart, const float *pEnd, float frac, int nLanes )
+{
+	int iFirst = AddLanes( nLanes, frac, 0 );
+
+	memcpy( &m_Start[iFirst], pStart, nLanes * sizeof( float ) );
+	memcpy( &m_End[iFirst], pEnd, nLanes * sizeof( float ) );
+	memset( &m_Prev[iFirst], 0, nLanes * sizeof( float ) );
+
+	return iFirst;
+}
+
+int CInterpolatedVarBatch::AddHermite( const float *pPrev, const float *pStart, const float *pEnd, float frac, int nLanes )
+{
+	int iFirst = AddLanes( nLanes, frac, ~0 );
+
+	memcpy( &m_Prev[iFirst], pPrev, nLanes * sizeof( float ) );
+	memcpy( &m_Start[iFirst], pStart, nLanes * sizeof( float ) );
+	memcpy( &m_End[iFirst], pEnd, nLanes * sizeof( float ) );
+
+	return iFirst;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Lerp_Hermite and Lerp for every queued lane, keeping whichever the lane asked for.
+//			The math is done in the same order as the scalar versions so results match them.
+//-----------------------------------------------------------------------------
+void CInterpolatedVarBatch::Run()
+{
+	int nLanes = m_Start.Count();
+	if ( !nLanes )
+	{
+		m_bRan = true;
+		return;
+	}
+
+	// Pad out to whole groups of four so there's no scalar tail
+	int nPad = ( 4 - ( nLanes & 3 ) ) & 3;
+	if ( nPad )
+	{
+		static const float s_Zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		AddLerp( s_Zero, s_Zero, 0.0f, nPad );
+	}
+
+	int nCount = m_Start.Count();
+	m_Result.SetCount( nCount );
+
+	const fltx4 fourNegativeTwos = ReplicateX4( -2.0f );
+
+	for ( int i = 0; i < nCount; i += 4 )
+	{
+		fltx4 p0 = LoadUnalignedSIMD( &m_Prev[i] );
+		fltx4 p1 = LoadUnalignedSIMD( &m_Start[i] );
+		fltx4 p2 = LoadUnalignedSIMD( &m_End[i] );
+		fltx4 t = LoadUnalignedSIMD( &m_Frac[i] );
+		fltx4 hermiteMask = LoadUnalignedSIMD( &m_HermiteMask[i] );
+
+		// Lerp
+		fltx4 lerp = AddSIMD( p1, MulSIMD( SubSIMD( p2, p1 ), t ) );
+
+		// Lerp_Hermite
+		fltx4 d1 = SubSIMD( p1, p0 );
+		fltx4 d2 = SubSIMD( p2, p1 );
+		fltx4 tSqr = MulSIMD( t, t );
+		fltx4 tCube = MulSIMD( t, tSqr );
+
+		fltx4 hermite = MulSIMD( p1, AddSIMD( SubSIMD( MulSIMD( Four_Twos, tCube ), MulSIMD( Four_Threes, tSqr ) ), Four_Ones ) );
+		hermite = AddSIMD( hermite, MulSIMD( p2, AddSIMD( MulSIMD( fourNegativeTwos, tCube ), MulSIMD( Four_Threes, tSqr ) ) ) );
+		hermite = AddSIMD( hermite, MulSIMD( d1, AddSIMD( SubSIMD( tCube, MulSIMD( Four_Twos, tSqr ) ), t ) ) );
+		hermite = AddSIMD( hermite, MulSIMD( d2, SubSIMD( tCube, tSqr ) ) );
+
+		StoreUnalignedSIMD( &m_Result[i], MaskedAssign( hermiteMask, hermite, lerp ) );
+	}
+
+	m_bRan = true;
+}
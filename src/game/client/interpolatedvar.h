@@ -15,6 +15,7 @@
 #include "lerp_functions.h"
 #include "animationlayer.h"
 #include "convar.h"
+#include "utlvector.h"
 
 
 #include "tier0/memdbgon.h"
@@ -145,6 +146,88 @@ inline QAngle ExtrapolateInterpolatedVarType( const QAngle &oldVal, const QAngle
 }
 
 
+// -------------------------------------------------------------------------------------------------------------- //
+// Batched interpolation.
+// -------------------------------------------------------------------------------------------------------------- //
+
+// The concrete type behind an IInterpolatedVar, so the per-frame loops can call it without going through the vtable.
+enum InterpolatedVarKind_t
+{
+	INTERPOLATEDVAR_OTHER = 0,
+	INTERPOLATEDVAR_FLOAT,				// CInterpolatedVar< float >
+	INTERPOLATEDVAR_VECTOR,				// CInterpolatedVar< Vector >
+	INTERPOLATEDVAR_FLOAT_ARRAY,		// CInterpolatedVarArray< float, N >
+	INTERPOLATEDVAR_VECTOR_ARRAY,		// CInterpolatedVarArray< Vector, N >
+};
+
+// How many floats make up one value of the type, for types that interpolate as plain floats. 0 for the others
+// (angles slerp, animation layers and range checked vars have their own lerps).
+// CopyResult writes 'count' values back out of the batch's floats; only the types with lanes ever get results.
+template< class T >
+struct CInterpolatedVarLanes
+{
+	enum { COUNT = 0, KIND = INTERPOLATEDVAR_OTHER, ARRAY_KIND = INTERPOLATEDVAR_OTHER };
+
+	static void CopyResult( T *pOut, const float *pResult, int count )	{ Assert( !"CInterpolatedVarLanes::CopyResult on a type without lanes" ); }
+};
+
+template<>
+struct CInterpolatedVarLanes< float >
+{
+	enum { COUNT = 1, KIND = INTERPOLATEDVAR_FLOAT, ARRAY_KIND = INTERPOLATEDVAR_FLOAT_ARRAY };
+
+	static void CopyResult( float *pOut, const float *pResult, int count )	{ memcpy( pOut, pResult, COUNT * count * sizeof( float ) ); }
+};
+
+template<>
+struct CInterpolatedVarLanes< Vector >
+{
+	enum { COUNT = 3, KIND = INTERPOLATEDVAR_VECTOR, ARRAY_KIND = INTERPOLATEDVAR_VECTOR_ARRAY };
+
+	static void CopyResult( Vector *pOut, const float *pResult, int count )	{ memcpy( pOut->Base(), pResult, COUNT * count * sizeof( float ) ); }
+};
+
+
+// The lerps and hermite splines of every interpolated var in the frame, worked out together.
+// C_BaseEntity::ProcessInterpolatedList has each var pick its samples and queue their floats here, runs the
+// batch four floats at a time, and then the vars' Interpolate() calls take their results back out.
+class CInterpolatedVarBatch
+{
+public:
+	CInterpolatedVarBatch();
+
+	// Throw away the last frame's lanes. Results queued before this are no longer valid.
+	void Begin();
+
+	// Queue 'nLanes' floats and return where their results will be.
+	int AddLerp( const float *pStart, const float *pEnd, float frac, int nLanes );
+	int AddHermite( const float *pPrev, const float *pStart, const float *pEnd, float frac, int nLanes );
+
+	void Run();
+
+	int GetSerial() const								{ return m_nSerial; }
+	int GetLaneCount() const							{ return m_Start.Count(); }
+	bool IsResultValid( int nSerial ) const				{ return m_bRan && nSerial == m_nSerial; }
+	const float *GetResult( int iResult ) const			{ return &m_Result[ iResult ]; }
+
+private:
+	int AddLanes( int nLanes, float frac, int nHermiteMask );
+
+	// One entry per float, in the order they were queued.
+	CUtlVector< float > m_Prev;
+	CUtlVector< float > m_Start;
+	CUtlVector< float > m_End;
+	CUtlVector< float > m_Frac;
+	CUtlVector< int > m_HermiteMask;					// all bits set for hermite lanes, 0 for lerps
+	CUtlVector< float > m_Result;
+
+	int m_nSerial;
+	bool m_bRan;
+};
+
+extern CInterpolatedVarBatch g_InterpolatedVarBatch;
+
+
 // -------------------------------------------------------------------------------------------------------------- //
 // IInterpolatedVar interface.
 // -------------------------------------------------------------------------------------------------------------- //
@@ -173,6 +256,9 @@ public:
 	virtual void SetDebugName( const char* pName )	= 0;
 
 	virtual void SetDebug( bool bDebug ) = 0;
+
+	// Returns an InterpolatedVarKind_t.
+	virtual int GetVarKind() const = 0;
 };
 
 template< typename Type, bool IS_ARRAY >
@@ -455,6 +541,7 @@ public:
 	virtual void RestoreToLastNetworked();
 	virtual void Copy( IInterpolatedVar *pInSrc );
 	virtual const char *GetDebugName() { return m_pDebugName; }
+	virtual int GetVarKind() const;
 
 
 public:
@@ -463,6 +550,10 @@ public:
 	bool NoteChanged( float changetime, float interpolation_amount, bool bUpdateLastNetworkedValue );
 	int Interpolate( float currentTime, float interpolation_amount );
 
+	// Pick the samples Interpolate( currentTime ) would use and, if it's a plain lerp or hermite spline,
+	// queue it in the batch. Interpolate() then takes the result instead of working it out again.
+	void QueueInterpolate( float currentTime, CInterpolatedVarBatch *pBatch );
+
 	void DebugInterpolate( Type *pOut, float currentTime );
 
 	void GetDerivative( Type *pOut, float currentTime );
@@ -559,6 +650,9 @@ protected:
 	
 	bool ValidOrder();
 
+	// Returns the index of a result queued by QueueInterpolate for this time, or -1.
+	int TakeBatchedResult( float currentTime, float interpolation_amount, int *pNoMoreChanges );
+
 protected:
 	// The underlying data element
 	Type								*m_pValue;
@@ -572,6 +666,12 @@ protected:
 	float								m_InterpolationAmount;
 	const char *						m_pDebugName;
 	bool								m_bDebug : 1;
+	bool								m_bBatchNoMoreChanges : 1;
+	// Set by QueueInterpolate.
+	int									m_iBatchResult;
+	int									m_nBatchSerial;
+	float								m_flBatchTime;
+	float								m_flBatchAmount;
 };
 
 
@@ -587,6 +687,11 @@ inline CInterpolatedVarArrayBase<Type, IS_ARRAY>::CInterpolatedVarArrayBase( con
 	m_LastNetworkedValue = NULL;
 	m_bLooping = NULL;
 	m_bDebug = false;
+	m_bBatchNoMoreChanges = false;
+	m_iBatchResult = -1;
+	m_nBatchSerial = 0;
+	m_flBatchTime = 0.0f;
+	m_flBatchAmount = 0.0f;
 }
 
 template< typename Type, bool IS_ARRAY >
@@ -616,6 +721,12 @@ inline int CInterpolatedVarArrayBase<Type, IS_ARRAY>::GetType() const
 	return m_fType;
 }
 
+template< typename Type, bool IS_ARRAY >
+inline int CInterpolatedVarArrayBase<Type, IS_ARRAY>::GetVarKind() const
+{
+	return IS_ARRAY ? CInterpolatedVarLanes<Type>::ARRAY_KIND : CInterpolatedVarLanes<Type>::KIND;
+}
+
 template< typename Type, bool IS_ARRAY >
 void CInterpolatedVarArrayBase<Type, IS_ARRAY>::NoteLastNetworkedValue()
 {
@@ -693,6 +804,7 @@ inline void CInterpolatedVarArrayBase<Type, IS_ARRAY>::ClearHistory()
 		m_VarHistory[i].DeleteEntry();
 	}
 	m_VarHistory.RemoveAll();
+	m_iBatchResult = -1;
 }
 
 template< typename Type, bool IS_ARRAY >
@@ -700,6 +812,9 @@ inline void CInterpolatedVarArrayBase<Type, IS_ARRAY>::AddToHead( float changeTi
 {
 	MEM_ALLOC_CREDIT_CLASS();
 	int newslot;
+
+	// Any queued result was worked out from the old samples
+	m_iBatchResult = -1;
 	
 	if ( bFlushNewer )
 	{
@@ -968,9 +1083,10 @@ template< typename Type, bool IS_ARRAY >
 inline int CInterpolatedVarArrayBase<Type, IS_ARRAY>::Interpolate( float currentTime, float interpolation_amount )
 {
 	int noMoreChanges = 0;
+	int iBatchResult = TakeBatchedResult( currentTime, interpolation_amount, &noMoreChanges );
 	
 	CInterpolationInfo info;
-	if (!GetInterpolationInfo( &info, currentTime, interpolation_amount, &noMoreChanges ))
+	if ( iBatchResult < 0 && !GetInterpolationInfo( &info, currentTime, interpolation_amount, &noMoreChanges ) )
 		return noMoreChanges;
 
 	
@@ -989,7 +1105,12 @@ inline int CInterpolatedVarArrayBase<Type, IS_ARRAY>::Interpolate( float current
 	memcpy( backupValues, m_pValue, sizeof( Type ) * m_nMaxCount );
 #endif
 
-	if ( info.m_bHermite )
+	if ( iBatchResult >= 0 )
+	{
+		// Worked out in this frame's batch
+		CInterpolatedVarLanes<Type>::CopyResult( m_pValue, g_InterpolatedVarBatch.GetResult( iBatchResult ), m_nMaxCount );
+	}
+	else if ( info.m_bHermite )
 	{
 		// base cast, we have 3 valid sample point
 		_Interpolate_Hermite( m_pValue, info.frac, &history[info.oldest], &history[info.older], &history[info.newer] );
@@ -1153,6 +1274,81 @@ inline int CInterpolatedVarArrayBase<Type, IS_ARRAY>::Interpolate( float current
 	return Interpolate( currentTime, m_InterpolationAmount );
 }
 
+template< typename Type, bool IS_ARRAY >
+inline void CInterpolatedVarArrayBase<Type, IS_ARRAY>::QueueInterpolate( float currentTime, CInterpolatedVarBatch *pBatch )
+{
+	m_iBatchResult = -1;
+
+	int nLanes = CInterpolatedVarLanes<Type>::COUNT * m_nMaxCount;
+	if ( !nLanes || m_bDebug )
+		return;
+
+	// Looping values wrap, which the batch doesn't do
+	for ( int i = 0; i < m_nMaxCount; i++ )
+	{
+		if ( m_bLooping[i] )
+			return;
+	}
+
+	int noMoreChanges = 0;
+	CInterpolationInfo info;
+	if ( !GetInterpolationInfo( &info, currentTime, m_InterpolationAmount, &noMoreChanges ) )
+		return;
+
+	CVarHistory &history = m_VarHistory;
+
+	if ( info.m_bHermite )
+	{
+		CInterpolatedVarEntry *prev = &history[info.oldest];
+		CInterpolatedVarEntry *start = &history[info.older];
+		CInterpolatedVarEntry *end = &history[info.newer];
+
+		CInterpolatedVarEntry fixup;
+		fixup.Init(m_nMaxCount);
+		TimeFixup_Hermite( fixup, prev, start, end );
+
+		m_iBatchResult = pBatch->AddHermite( (const float *)prev->GetValue(), (const float *)start->GetValue(), (const float *)end->GetValue(), info.frac, nLanes );
+	}
+	else if ( info.newer == info.older )
+	{
+		// Out of samples, Interpolate() decides whether to extrapolate
+		return;
+	}
+	else
+	{
+		m_iBatchResult = pBatch->AddLerp( (const float *)history[info.older].GetValue(), (const float *)history[info.newer].GetValue(), info.frac, nLanes );
+	}
+
+	m_nBatchSerial = pBatch->GetSerial();
+	m_flBatchTime = currentTime;
+	m_flBatchAmount = m_InterpolationAmount;
+	m_bBatchNoMoreChanges = ( noMoreChanges != 0 );
+}
+
+template< typename Type, bool IS_ARRAY >
+inline int CInterpolatedVarArrayBase<Type, IS_ARRAY>::TakeBatchedResult( float currentTime, float interpolation_amount, int *pNoMoreChanges )
+{
+	if ( m_iBatchResult < 0 )
+		return -1;
+
+	// A result is only used once
+	int iResult = m_iBatchResult;
+	m_iBatchResult = -1;
+
+	if ( !g_InterpolatedVarBatch.IsResultValid( m_nBatchSerial ) || m_flBatchTime != currentTime || m_flBatchAmount != interpolation_amount )
+		return -1;
+
+	// Looping may have been turned on since the result was queued
+	for ( int i = 0; i < m_nMaxCount; i++ )
+	{
+		if ( m_bLooping[i] )
+			return -1;
+	}
+
+	*pNoMoreChanges = m_bBatchNoMoreChanges;
+	return iResult;
+}
+
 template< typename Type, bool IS_ARRAY >
 inline void CInterpolatedVarArrayBase<Type, IS_ARRAY>::Copy( IInterpolatedVar *pInSrc )
 {
@@ -1846,3 +1846,117 @@ bool CPrediction::InPrediction( void ) const
 	return false;
 #endif
 }
+
+#if !defined( NO_ENTITY_PREDICTION )
+//-----------------------------------------------------------------------------
+// Purpose: The copies prediction makes per command for each entity: storing the
+//  results, restoring the entity from a frame, and the error check against the
+//  network data.
+// Output : seconds taken
+//-----------------------------------------------------------------------------
+static double TimePredictionCopies( const CUtlVector< C_BaseEntity * > &entities, const CUtlVector< unsigned char * > &frames, int nCommands, int nPasses )
+{
+	double start = Plat_FloatTime();
+
+	for ( int pass = 0; pass < nPasses; pass++ )
+	{
+		for ( int i = 0; i < entities.Count(); i++ )
+		{
+			C_BaseEntity *ent = entities[ i ];
+			datamap_t *map = ent->GetPredDescMap();
+
+			for ( int cmd = 0; cmd < nCommands; cmd++ )
+			{
+				unsigned char *frame = frames[ i * nCommands + cmd ];
+
+				CPredictionCopy saveHelper( PC_EVERYTHING, frame, PC_DATA_PACKED, ent, PC_DATA_NORMAL );
+				saveHelper.TransferData( "", -1, map );
+
+				CPredictionCopy restoreHelper( PC_EVERYTHING, ent, PC_DATA_NORMAL, frame, PC_DATA_PACKED );
+				restoreHelper.TransferData( "", -1, map );
+
+				CPredictionCopy errorCheckHelper( PC_NETWORKED_ONLY, frame, PC_DATA_PACKED, frames[ i * nCommands ], PC_DATA_PACKED, true, false, false );
+				errorCheckHelper.TransferData( "", -1, map );
+			}
+		}
+	}
+
+	return Plat_FloatTime() - start;
+}
+
+CON_COMMAND_F( cl_pred_copy_benchmark, "Times the prediction data copies for the local player and its weapons with and without copy plans, and reports us per command.\nUsage: cl_pred_copy_benchmark [commands] [passes]", FCVAR_CHEAT )
+{
+	C_BasePlayer *player = C_BasePlayer::GetLocalPlayer();
+	if ( !player || !player->GetPredictable() )
+	{
+		Msg( "cl_pred_copy_benchmark: the local player isn't being predicted\n" );
+		return;
+	}
+
+	int nCommands = ( args.ArgC() > 1 ) ? clamp( atoi( args[1] ), 1, MULTIPLAYER_BACKUP ) : 64;
+	int nPasses = ( args.ArgC() > 2 ) ? MAX( atoi( args[2] ), 1 ) : 100;
+
+	CUtlVector< C_BaseEntity * > entities;
+	entities.AddToTail( player );
+	for ( int i = 0; i < MAX_WEAPONS; i++ )
+	{
+		C_BaseCombatWeapon *weapon = player->GetWeapon( i );
+		if ( weapon && weapon->GetPredictable() )
+		{
+			entities.AddToTail( weapon );
+		}
+	}
+
+	// A set of frames for each way of copying, so the results can be compared
+	CUtlVector< unsigned char * > frames[ 2 ];
+	CUtlVector< int > frameSizes;
+	for ( int i = 0; i < entities.Count(); i++ )
+	{
+		int size = MAX( entities[ i ]->GetPredDescMap()->packed_size, 4 );
+		for ( int cmd = 0; cmd < nCommands; cmd++ )
+		{
+			frameSizes.AddToTail( size );
+			for ( int set = 0; set < 2; set++ )
+			{
+				unsigned char *frame = new unsigned char[ size ];
+				Q_memset( frame, 0, size );
+				frames[ set ].AddToTail( frame );
+			}
+		}
+	}
+
+	static ConVarRef cl_pred_copyplan( "cl_pred_copyplan" );
+	bool bOldValue = cl_pred_copyplan.GetBool();
+
+	cl_pred_copyplan.SetValue( false );
+	double flWalk = TimePredictionCopies( entities, frames[ 0 ], nCommands, nPasses );
+
+	// Build the plans before timing them
+	cl_pred_copyplan.SetValue( true );
+	TimePredictionCopies( entities, frames[ 1 ], nCommands, 1 );
+	double flPlan = TimePredictionCopies( entities, frames[ 1 ], nCommands, nPasses );
+
+	cl_pred_copyplan.SetValue( bOldValue );
+
+	int nMismatches = 0;
+	for ( int i = 0; i < frameSizes.Count(); i++ )
+	{
+		if ( Q_memcmp( frames[ 0 ][ i ], frames[ 1 ][ i ], frameSizes[ i ] ) )
+		{
+			++nMismatches;
+		}
+
+		delete[] frames[ 0 ][ i ];
+		delete[] frames[ 1 ][ i ];
+	}
+
+	double flScale = 1000000.0 / ( nPasses * nCommands );
+	Msg( "%d entities, %d commands x %d passes\n", entities.Count(), nCommands, nPasses );
+	Msg( "  walking fields: %.2f us/command\n", flWalk * flScale );
+	Msg( "  copy plans:     %.2f us/command (%.1fx)\n", flPlan * flScale, flPlan > 0.0 ? flWalk / flPlan : 0.0 );
+	if ( nMismatches )
+	{
+		Warning( "  %d of %d frames differ between the two\n", nMismatches, frameSizes.Count() );
+	}
+}
+#endif
@@ -539,6 +539,46 @@ void CBaseAnimatingOverlay::GetSkeleton( CStudioHdr *pStudioHdr, Vector pos[], Q
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: add the layers GetSkeleton() blends in, in the order it blends them
+//-----------------------------------------------------------------------------
+bool CBaseAnimatingOverlay::GetPoseCacheKey( CStudioHdr *pStudioHdr, int boneMask, CPoseCacheKey &key )
+{
+	if ( !pStudioHdr->SequencesAvailable() )
+		return false;
+
+	if ( !BaseClass::GetPoseCacheKey( pStudioHdr, boneMask, key ) )
+		return false;
+
+	int layer[MAX_OVERLAYS] = {};
+	int i;
+	for (i = 0; i < m_AnimOverlay.Count(); i++)
+	{
+		layer[i] = MAX_OVERLAYS;
+	}
+	for (i = 0; i < m_AnimOverlay.Count(); i++)
+	{
+		CAnimationLayer &pLayer = m_AnimOverlay[i];
+		if( (pLayer.m_flWeight > 0) && pLayer.IsActive() && pLayer.m_nOrder >= 0 && pLayer.m_nOrder < m_AnimOverlay.Count())
+		{
+			layer[pLayer.m_nOrder] = i;
+		}
+	}
+	for (i = 0; i < m_AnimOverlay.Count(); i++)
+	{
+		if (layer[i] >= 0 && layer[i] < m_AnimOverlay.Count())
+		{
+			CAnimationLayer &pLayer = m_AnimOverlay[layer[i]];
+			key.AddInt( pLayer.m_nSequence );
+			key.AddQuantized( pLayer.m_flCycle );
+			key.AddQuantized( pLayer.m_flWeight );
+		}
+	}
+
+	return key.IsValid();
+}
+
+
 
 //-----------------------------------------------------------------------------
 // Purpose: zero's out all non-restore safe fields
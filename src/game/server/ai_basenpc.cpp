@@ -275,6 +275,7 @@ int CAI_Manager::NumAIs()
 void CAI_Manager::AddAI( CAI_BaseNPC *pAI )
 {
 	m_AIs.AddToTail( pAI );
+	g_AI_SensingGrid.Invalidate();
 }
 
 //-------------------------------------
@@ -284,7 +285,10 @@ void CAI_Manager::RemoveAI( CAI_BaseNPC *pAI )
 	int i = m_AIs.Find( pAI );
 
 	if ( i != -1 )
+	{
 		m_AIs.FastRemove( i );
+		g_AI_SensingGrid.Invalidate();
+	}
 }
 
 
@@ -330,26 +334,148 @@ CPostFrameNavigationHook *PostFrameNavigationSystem( void )
 	return &g_PostFrameNavigationHook;
 }
 
+ConVar ai_post_frame_navigation_budget( "ai_post_frame_navigation_budget", "2", FCVAR_NONE, "Milliseconds of deferred navigation queries to run per frame. Queries over budget wait for the next frame. 0 runs them all." );
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
 bool CPostFrameNavigationHook::Init( void )
 {
-	m_Functors.Purge();
+	m_Queries.Purge();
+	m_pJob = NULL;
+	m_nQueriesRun = 0;
+	m_flLastRunTime = 0;
+	m_iNextSequence = 0;
 	m_bGameFrameRunning = false;
+	ResetStats();
 	return true;
 }
 
-// Main query job
-CJob *g_pQueuedNavigationQueryJob = NULL;
+//-----------------------------------------------------------------------------
+// Purpose: Drop anything still queued, the NPCs are about to go away
+//-----------------------------------------------------------------------------
+void CPostFrameNavigationHook::LevelShutdownPreEntity( void )
+{
+	FinishQueries();
+	ReleaseQueries();
+	m_bGameFrameRunning = false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Enemy chasing goes before everything else, idle wandering last
+//-----------------------------------------------------------------------------
+int CPostFrameNavigationHook::GetQueryPriority( CAI_BaseNPC *pNPC )
+{
+	if ( pNPC->GetEnemy() && pNPC->GetState() == NPC_STATE_COMBAT )
+		return NAV_QUERY_PRIORITY_HIGH;
+
+	if ( pNPC->GetState() == NPC_STATE_IDLE )
+		return NAV_QUERY_PRIORITY_LOW;
+
+	return NAV_QUERY_PRIORITY_NORMAL;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Each frame a query waits counts as one priority level, so low
+//			priority queries can't starve
+//-----------------------------------------------------------------------------
+int CPostFrameNavigationHook::QueryLessFunc( const NavigationQuery_t *pLeft, const NavigationQuery_t *pRight )
+{
+	int leftPriority = pLeft->iPriority - pLeft->nFramesWaited;
+	int rightPriority = pRight->iPriority - pRight->nFramesWaited;
+	if ( leftPriority != rightPriority )
+		return ( leftPriority < rightPriority ) ? -1 : 1;
+
+	return ( pLeft->iSequence - pRight->iSequence );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs queued queries in priority order.  When budgeted, stops once
+//			the frame's budget is used, but always runs at least one.
+//-----------------------------------------------------------------------------
+void CPostFrameNavigationHook::RunQueries( bool bBudgeted )
+{
+	CFastTimer timer;
+	timer.Start();
+
+	float flBudget = ( bBudgeted ) ? ai_post_frame_navigation_budget.GetFloat() * 0.001f : 0;
+
+	int i;
+	for ( i = 0; i < m_Queries.Count(); i++ )
+	{
+		if ( i > 0 && flBudget > 0 && timer.GetDurationInProgress().GetSeconds() > flBudget )
+			break;
+
+		(*m_Queries[i].pFunctor)();
+	}
+
+	timer.End();
+	m_nQueriesRun = i;
+	m_flLastRunTime = timer.GetDuration().GetSeconds();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Waits for the job, then hands the finished queries back to their
+//			NPCs.  Anything over budget stays queued for the next frame.
+//-----------------------------------------------------------------------------
+void CPostFrameNavigationHook::FinishQueries( void )
+{
+	if ( m_pJob )
+	{
+		m_pJob->WaitForFinishAndRelease();
+		m_pJob = NULL;
+	}
+
+	if ( !m_nQueriesRun )
+		return;
+
+	int i;
+	for ( i = 0; i < m_nQueriesRun; i++ )
+	{
+		NavigationQuery_t &query = m_Queries[i];
+		m_nCompleted[query.iPriority]++;
+		query.pFunctor->Release();
+
+		// Only clear the flag if the NPC has no newer query waiting
+		bool bStillQueued = false;
+		for ( int j = m_nQueriesRun; j < m_Queries.Count(); j++ )
+		{
+			if ( m_Queries[j].pNPC == query.pNPC )
+			{
+				bStillQueued = true;
+				break;
+			}
+		}
+		if ( !bStillQueued )
+		{
+			query.pNPC->SetNavigationDeferred( false );
+		}
+	}
+	m_Queries.RemoveMultipleFromHead( m_nQueriesRun );
+	m_nQueriesRun = 0;
+
+	for ( i = 0; i < m_Queries.Count(); i++ )
+	{
+		m_Queries[i].nFramesWaited++;
+	}
+	m_nCarriedOver += m_Queries.Count();
+
+	m_nFrames++;
+	m_flTotalRunTime += m_flLastRunTime;
+	m_flMaxRunTime = MAX( m_flMaxRunTime, m_flLastRunTime );
+}
+
+//-----------------------------------------------------------------------------
 
-static void ProcessNavigationQueries( CFunctor **pData, unsigned int nCount )
+void CPostFrameNavigationHook::ReleaseQueries( void )
 {
-	// Run all queued navigation on a separate thread
-	for ( int i = 0; i < nCount; i++ )
+	for ( int i = 0; i < m_Queries.Count(); i++ )
 	{
-		(*pData[i])();
+		m_Queries[i].pFunctor->Release();
+		m_Queries[i].pNPC->SetNavigationDeferred( false );
 	}
+	m_nDropped += m_Queries.Count();
+	m_Queries.RemoveAll();
 }
 
 //-----------------------------------------------------------------------------
@@ -358,12 +484,7 @@ static void ProcessNavigationQueries( CFunctor **pData, unsigned int nCount )
 void CPostFrameNavigationHook::FrameUpdatePreEntityThink( void )
 { 
 	// If the thread is executing, then wait for it to finish
-	if ( g_pQueuedNavigationQueryJob )
-	{
-		g_pQueuedNavigationQueryJob->WaitForFinishAndRelease();
-		g_pQueuedNavigationQueryJob = NULL;
-		m_Functors.Purge();
-	}
+	FinishQueries();
 	
 	if ( ai_post_frame_navigation.GetBool() == false )
 		return;
@@ -376,28 +497,122 @@ void CPostFrameNavigationHook::FrameUpdatePreEntityThink( void )
 //-----------------------------------------------------------------------------
 void CPostFrameNavigationHook::FrameUpdatePostEntityThink( void )
 {
-	if ( ai_post_frame_navigation.GetBool() == false )
-		return;
-
 	// The guts of the NPC will check against this to decide whether or not to queue its navigation calls
 	SetGrameFrameRunning( false );
 
+	if ( !m_Queries.Count() )
+		return;
+
+	m_nMaxQueued = MAX( m_nMaxQueued, m_Queries.Count() );
+	m_Queries.Sort( &CPostFrameNavigationHook::QueryLessFunc );
+
+	if ( ai_post_frame_navigation.GetBool() == false )
+	{
+		// Turned off with queries still waiting, don't leave the NPCs stuck
+		RunQueries( false );
+		FinishQueries();
+		return;
+	}
+
 	// Throw this off to a thread job
-	g_pQueuedNavigationQueryJob = ThreadExecute( &ProcessNavigationQueries, m_Functors.Base(), m_Functors.Count() );
+	m_pJob = ThreadExecute( this, &CPostFrameNavigationHook::RunQueries, true );
 }
 
 //-----------------------------------------------------------------------------
-// Purpose: Queue up our navigation call
+// Purpose: Queue up our navigation call.  A newer query from the same NPC
+//			replaces one that hasn't run yet.
 //-----------------------------------------------------------------------------
 void CPostFrameNavigationHook::EnqueueEntityNavigationQuery( CAI_BaseNPC *pNPC, CFunctor *pFunctor )
 {
 	if ( ai_post_frame_navigation.GetBool() == false )
 		return;
 
-	m_Functors.AddToTail( pFunctor );
+	int iPriority = GetQueryPriority( pNPC );
+	m_nSubmitted[iPriority]++;
+
+	for ( int i = 0; i < m_Queries.Count(); i++ )
+	{
+		NavigationQuery_t &query = m_Queries[i];
+		if ( query.pNPC == pNPC )
+		{
+			query.pFunctor->Release();
+			query.pFunctor = pFunctor;
+			query.iPriority = MIN( query.iPriority, iPriority );
+			m_nSuperseded++;
+			return;
+		}
+	}
+
+	NavigationQuery_t &query = m_Queries[ m_Queries.AddToTail() ];
+	query.pFunctor = pFunctor;
+	query.pNPC = pNPC;
+	query.iPriority = iPriority;
+	query.nFramesWaited = 0;
+	query.iSequence = m_iNextSequence++;
+
 	pNPC->SetNavigationDeferred( true );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: The functors point into the NPC, so nothing of its can be left
+//			queued or running once it's removed
+//-----------------------------------------------------------------------------
+void CPostFrameNavigationHook::OnNPCRemoved( CAI_BaseNPC *pNPC )
+{
+	FinishQueries();
+
+	for ( int i = m_Queries.Count() - 1; i >= 0; i-- )
+	{
+		if ( m_Queries[i].pNPC == pNPC )
+		{
+			m_Queries[i].pFunctor->Release();
+			m_Queries.Remove( i );
+			m_nDropped++;
+		}
+	}
+	pNPC->SetNavigationDeferred( false );
+}
+
+//-----------------------------------------------------------------------------
+
+void CPostFrameNavigationHook::ResetStats( void )
+{
+	memset( m_nSubmitted, 0, sizeof(m_nSubmitted) );
+	memset( m_nCompleted, 0, sizeof(m_nCompleted) );
+	m_nSuperseded = 0;
+	m_nCarriedOver = 0;
+	m_nDropped = 0;
+	m_nFrames = 0;
+	m_nMaxQueued = 0;
+	m_flTotalRunTime = 0;
+	m_flMaxRunTime = 0;
+}
+
+//-----------------------------------------------------------------------------
+
+void CPostFrameNavigationHook::PrintStats( void )
+{
+	static const char *s_pszPriorityNames[NUM_NAV_QUERY_PRIORITIES] = { "high", "normal", "low" };
+
+	Msg( "Deferred navigation queries (ai_post_frame_navigation %d, budget %.2f ms):\n", ai_post_frame_navigation.GetInt(), ai_post_frame_navigation_budget.GetFloat() );
+	for ( int i = 0; i < NUM_NAV_QUERY_PRIORITIES; i++ )
+	{
+		Msg( "  %-6s submitted %6d, completed %6d\n", s_pszPriorityNames[i], m_nSubmitted[i], m_nCompleted[i] );
+	}
+	Msg( "  superseded %d, carried over %d, dropped %d, queued now %d, most queued %d\n", m_nSuperseded, m_nCarriedOver, m_nDropped, m_Queries.Count(), m_nMaxQueued );
+	Msg( "  %d frames, %.3f ms average, %.3f ms worst\n", m_nFrames, ( m_nFrames ) ? m_flTotalRunTime * 1000.0f / m_nFrames : 0.0f, m_flMaxRunTime * 1000.0f );
+}
+
+CON_COMMAND( ai_post_frame_navigation_stats, "Print deferred navigation query stats. 'reset' to clear them." )
+{
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) )
+	{
+		PostFrameNavigationSystem()->ResetStats();
+		return;
+	}
+	PostFrameNavigationSystem()->PrintStats();
+}
+
 //
 //	Deferred Navigation calls go here
 //
@@ -13084,6 +13299,11 @@ CAI_BaseNPC::~CAI_BaseNPC(void)
 //-----------------------------------------------------------------------------
 void CAI_BaseNPC::UpdateOnRemove(void)
 {
+	if ( IsNavigationDeferred() )
+	{
+		PostFrameNavigationSystem()->OnNPCRemoved( this );
+	}
+
 	if ( !m_bDidDeathCleanup )
 	{
 		if ( m_NPCState == NPC_STATE_DEAD )
@@ -3439,12 +3439,24 @@ public:
 
 extern ConVar ai_post_frame_navigation;
 
+class CJob;
+
+enum NavigationQueryPriority_t
+{
+	NAV_QUERY_PRIORITY_HIGH = 0,		// Chasing an enemy
+	NAV_QUERY_PRIORITY_NORMAL,
+	NAV_QUERY_PRIORITY_LOW,				// Idle wandering
+
+	NUM_NAV_QUERY_PRIORITIES
+};
+
 class CPostFrameNavigationHook : public CBaseGameSystemPerFrame
 {
 public:
 	virtual const char *Name( void ) { return "CPostFrameNavigationHook"; }
 
 	virtual bool Init( void );
+	virtual void LevelShutdownPreEntity( void );
 	virtual void FrameUpdatePostEntityThink( void );
 	virtual void FrameUpdatePreEntityThink( void );
 
@@ -3452,10 +3464,45 @@ public:
 	void SetGrameFrameRunning( bool bState ) { m_bGameFrameRunning = bState; }
 	
 	void EnqueueEntityNavigationQuery( CAI_BaseNPC *pNPC, CFunctor *functor );
+	void OnNPCRemoved( CAI_BaseNPC *pNPC );
+
+	void PrintStats( void );
+	void ResetStats( void );
 
 private:
-	CUtlVector<CFunctor *>	m_Functors;
-	bool					m_bGameFrameRunning;
+	struct NavigationQuery_t
+	{
+		CFunctor *		pFunctor;
+		CAI_BaseNPC *	pNPC;
+		int				iPriority;
+		int				nFramesWaited;
+		int				iSequence;
+	};
+
+	static int		QueryLessFunc( const NavigationQuery_t *pLeft, const NavigationQuery_t *pRight );
+	static int		GetQueryPriority( CAI_BaseNPC *pNPC );
+
+	void			RunQueries( bool bBudgeted );
+	void			FinishQueries( void );
+	void			ReleaseQueries( void );
+
+	CUtlVector<NavigationQuery_t>	m_Queries;
+	CJob *			m_pJob;
+	int				m_nQueriesRun;				// Written by the job, read once it's finished
+	float			m_flLastRunTime;
+	int				m_iNextSequence;
+	bool			m_bGameFrameRunning;
+
+	// Stats
+	int				m_nSubmitted[NUM_NAV_QUERY_PRIORITIES];
+	int				m_nCompleted[NUM_NAV_QUERY_PRIORITIES];
+	int				m_nSuperseded;
+	int				m_nCarriedOver;
+	int				m_nDropped;
+	int				m_nFrames;
+	int				m_nMaxQueued;
+	float			m_flTotalRunTime;
+	float			m_flMaxRunTime;
 };
 
 extern CPostFrameNavigationHook *PostFrameNavigationSystem( void );
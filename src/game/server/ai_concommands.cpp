@@ -12,6 +12,7 @@
 #include "ai_node.h"
 #include "ai_link.h"
 #include "ai_networkmanager.h"
+#include "ai_pathfinder.h"
 #include "ndebugoverlay.h"
 #include "datacache/imdlcache.h"
 
@@ -1164,6 +1165,7 @@ CON_COMMAND( ai_clear_bad_links, "Clears bits set on nav links indicating link i
 			pNode->GetLinkByIndex( j )->m_LinkInfo &= ~bits_LINK_STALE_SUGGESTED;
 		}
 	}
+	CAI_Pathfinder::InvalidatePathCache();
 }
 
 CON_COMMAND( ai_test_los, "Test AI LOS from the player's POV" )
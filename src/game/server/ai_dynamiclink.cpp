@@ -15,6 +15,7 @@
 #include "ai_link.h"
 #include "ai_network.h"
 #include "ai_networkmanager.h"
+#include "ai_pathfinder.h"
 #ifdef MAPBASE
 #include "ai_hint.h"
 #include "ai_basenpc.h"
@@ -652,6 +653,7 @@ void CAI_DynamicLink::SetLinkState(void)
 			{
 				pLink->m_LinkInfo &= ~bits_LINK_OFF;
 			}
+			CAI_Pathfinder::InvalidatePathCache();
 		}
 		else
 		{
@@ -842,6 +844,7 @@ void CAI_DynamicLinkOneWay::SetLinkState(void)
 			// One-way always registers as off so it always calls UseAllowed()
 			pLink->m_pDynamicLink = this;
 			pLink->m_LinkInfo |= bits_LINK_OFF;
+			CAI_Pathfinder::InvalidatePathCache();
 		}
 		else
 		{
@@ -1115,6 +1118,7 @@ void CAI_RadialLinkController::ModifyNodeLinks( bool bMakeStale )
 							{
 								pLink->m_LinkInfo &= ~bits_LINK_STALE_SUGGESTED;
 							}
+							CAI_Pathfinder::InvalidatePathCache();
 						}
 					}
 				}
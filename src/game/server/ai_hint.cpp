@@ -24,6 +24,10 @@
 #define REPORTFAILURE(text) if ( hintCriteria.HasFlag( bits_HINT_NODE_REPORT_FAILURES ) ) \
 								NDebugOverlay::Text( GetAbsOrigin(), text, false, 60 )
 
+ConVar ai_hint_grid( "ai_hint_grid", "1", 0, "Only check the hints near a search's include zones, using a grid over each hint list" );
+
+const float AI_HINT_GRID_CELL_SIZE = 512;
+
 //==================================================
 // CHintCriteria
 //==================================================
@@ -252,6 +256,164 @@ bool CHintCriteria::InExcludedZone( const Vector &testPosition ) const
 	return InZone( m_zoneExclude, testPosition );
 }
 
+//==================================================
+// CAIHintVector
+//==================================================
+
+//-----------------------------------------------------------------------------
+// Purpose: Bucket the hints by cell with a counting sort, which keeps them in
+//			list order within each cell
+//-----------------------------------------------------------------------------
+void CAIHintVector::BuildGrid()
+{
+	m_bGridDirty = false;
+	m_nGridCellsX = m_nGridCellsY = 0;
+	m_GridCellStart.RemoveAll();
+	m_GridEntries.RemoveAll();
+	m_GridOrigins.RemoveAll();
+	m_GridUnindexed.RemoveAll();
+
+	CUtlVector<int> indexed;
+	for ( int i = 0; i < Count(); i++ )
+	{
+		if ( Element( i )->GetMoveParent() )
+		{
+			m_GridUnindexed.AddToTail( i );
+		}
+		else
+		{
+			indexed.AddToTail( i );
+		}
+	}
+
+	if ( !indexed.Count() )
+		return;
+
+	Vector2D mins = Element( indexed[0] )->GetAbsOrigin().AsVector2D();
+	Vector2D maxs = mins;
+	for ( int i = 1; i < indexed.Count(); i++ )
+	{
+		const Vector &origin = Element( indexed[i] )->GetAbsOrigin();
+		mins.x = MIN( mins.x, origin.x );
+		mins.y = MIN( mins.y, origin.y );
+		maxs.x = MAX( maxs.x, origin.x );
+		maxs.y = MAX( maxs.y, origin.y );
+	}
+
+	m_GridMins = mins;
+	m_nGridCellsX = (int)( ( maxs.x - mins.x ) / AI_HINT_GRID_CELL_SIZE ) + 1;
+	m_nGridCellsY = (int)( ( maxs.y - mins.y ) / AI_HINT_GRID_CELL_SIZE ) + 1;
+
+	int nCells = m_nGridCellsX * m_nGridCellsY;
+	m_GridCellStart.SetCount( nCells + 1 );
+	V_memset( m_GridCellStart.Base(), 0, m_GridCellStart.Count() * sizeof(int) );
+	m_GridEntries.SetCount( indexed.Count() );
+	m_GridOrigins.SetCount( indexed.Count() );
+
+	for ( int i = 0; i < indexed.Count(); i++ )
+	{
+		const Vector &origin = Element( indexed[i] )->GetAbsOrigin();
+		int x = (int)( ( origin.x - mins.x ) / AI_HINT_GRID_CELL_SIZE );
+		int y = (int)( ( origin.y - mins.y ) / AI_HINT_GRID_CELL_SIZE );
+		m_GridCellStart[ y * m_nGridCellsX + x + 1 ]++;
+	}
+
+	for ( int i = 1; i <= nCells; i++ )
+	{
+		m_GridCellStart[i] += m_GridCellStart[i - 1];
+	}
+
+	// m_GridCellStart[c] is used as the fill point for cell c - 1, so ends up as the start of cell c
+	for ( int i = 0; i < indexed.Count(); i++ )
+	{
+		const Vector &origin = Element( indexed[i] )->GetAbsOrigin();
+		int x = (int)( ( origin.x - mins.x ) / AI_HINT_GRID_CELL_SIZE );
+		int y = (int)( ( origin.y - mins.y ) / AI_HINT_GRID_CELL_SIZE );
+		int iEntry = m_GridCellStart[ y * m_nGridCellsX + x ]++;
+		m_GridEntries[iEntry] = indexed[i];
+		m_GridOrigins[iEntry] = origin;
+	}
+
+	for ( int i = nCells; i > 0; i-- )
+	{
+		m_GridCellStart[i] = m_GridCellStart[i - 1];
+	}
+	m_GridCellStart[0] = 0;
+}
+
+//-----------------------------------------------------------------------------
+
+static int SortHintIndices( const int *pLeft, const int *pRight )
+{
+	return *pLeft - *pRight;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Gathers the hints that pass the include zone test of hintCriteria,
+//			plus any that might have moved since the grid was built
+//-----------------------------------------------------------------------------
+bool CAIHintVector::GetHintsInIncludeZones( const CHintCriteria &hintCriteria, CUtlVector<int> *pResult )
+{
+	pResult->RemoveAll();
+
+	if ( !hintCriteria.HasIncludeZones() )
+		return false;
+
+	if ( m_bGridDirty )
+	{
+		BuildGrid();
+	}
+
+	for ( int zone = 0; zone < hintCriteria.NumIncludeZones(); zone++ )
+	{
+		if ( !m_nGridCellsX )
+			break;
+
+		Vector position;
+		float flRadiusSqr;
+		hintCriteria.GetIncludeZone( zone, &position, &flRadiusSqr );
+		float flRadius = sqrt( flRadiusSqr );
+
+		int x0 = MAX( (int)floor( ( position.x - flRadius - m_GridMins.x ) / AI_HINT_GRID_CELL_SIZE ), 0 );
+		int x1 = MIN( (int)floor( ( position.x + flRadius - m_GridMins.x ) / AI_HINT_GRID_CELL_SIZE ), m_nGridCellsX - 1 );
+		int y0 = MAX( (int)floor( ( position.y - flRadius - m_GridMins.y ) / AI_HINT_GRID_CELL_SIZE ), 0 );
+		int y1 = MIN( (int)floor( ( position.y + flRadius - m_GridMins.y ) / AI_HINT_GRID_CELL_SIZE ), m_nGridCellsY - 1 );
+
+		for ( int y = y0; y <= y1; y++ )
+		{
+			for ( int x = x0; x <= x1; x++ )
+			{
+				int iCell = y * m_nGridCellsX + x;
+				for ( int i = m_GridCellStart[iCell]; i < m_GridCellStart[iCell + 1]; i++ )
+				{
+					// Same test as CHintCriteria::InZone()
+					if ( ( m_GridOrigins[i] - position ).LengthSqr() < flRadiusSqr )
+					{
+						pResult->AddToTail( m_GridEntries[i] );
+					}
+				}
+			}
+		}
+	}
+
+	pResult->AddVectorToTail( m_GridUnindexed );
+
+	// Back into list order, dropping hints found in more than one zone
+	pResult->Sort( SortHintIndices );
+
+	int nUnique = 0;
+	for ( int i = 0; i < pResult->Count(); i++ )
+	{
+		if ( nUnique == 0 || pResult->Element( i ) != pResult->Element( nUnique - 1 ) )
+		{
+			pResult->Element( nUnique++ ) = pResult->Element( i );
+		}
+	}
+	pResult->SetCountNonDestructively( nUnique );
+
+	return true;
+}
+
 //-----------------------------------------------------------------------------
 // Init static variables
 //-----------------------------------------------------------------------------
@@ -321,11 +483,19 @@ int CAI_HintManager::FindAllHints( CAI_BaseNPC *pNPC, const Vector &position, co
 	bool hadNearest = hintCriteria.HasFlag( bits_HINT_NODE_NEAREST );
 	(const_cast<CHintCriteria &>(hintCriteria)).ClearFlag( bits_HINT_NODE_NEAREST );
 
+	// Only look near the include zones, if there are any
+	CUtlVector<int> candidates;
+	bool bUseGrid = ai_hint_grid.GetBool() && CAI_HintManager::gm_AllHints.GetHintsInIncludeZones( hintCriteria, &candidates );
+	if ( bUseGrid )
+	{
+		c = candidates.Count();
+	}
+
 	//  Now loop till we find a valid hint or return to the start
 	CAI_Hint *pTestHint;
 	for ( int i = 0; i < c; ++i )
 	{
-		pTestHint = CAI_HintManager::gm_AllHints[ i ];
+		pTestHint = CAI_HintManager::gm_AllHints[ bUseGrid ? candidates[i] : i ];
 		Assert( pTestHint );
 		if ( pTestHint->HintMatchesCriteria( pNPC, hintCriteria, position, NULL ) )
 			pResult->AddToTail( pTestHint );
@@ -383,40 +553,11 @@ CAI_Hint *CAI_HintManager::FindHint( CAI_BaseNPC *pNPC, const Vector &position,
 	CFastTimer timer;
 	timer.Start();
 #endif
-	bool singleType = hintCriteria.MatchesSingleHintType();
 	bool lookingForNearest = hintCriteria.HasFlag( bits_HINT_NODE_NEAREST );
-	bool bIgnoreHintType = true;
+	bool bIgnoreHintType;
 
 	CUtlVector< CAIHintVector * > lists;
-	if ( singleType )
-	{
-		int slot = CAI_HintManager::gm_TypedHints.Find( hintCriteria.GetFirstHintType() );
-		if ( slot != CAI_HintManager::gm_TypedHints.InvalidIndex() )
-		{
-			lists.AddToTail( &CAI_HintManager::gm_TypedHints[ slot ] );
-		}
-	}
-	else
-	{
-		int typeCount = hintCriteria.NumHintTypes();
-		if ( typeCount > 0 )
-		{
-			for ( int listType = 0; listType < typeCount; ++listType )
-			{
-				int slot = CAI_HintManager::gm_TypedHints.Find( hintCriteria.GetHintType( listType ) );
-				if ( slot != CAI_HintManager::gm_TypedHints.InvalidIndex() )
-				{
-					lists.AddToTail( &CAI_HintManager::gm_TypedHints[ slot ] );
-				}
-			}
-		}
-		else
-		{
-			// Still need to check hint type in this case
-			lists.AddToTail( &CAI_HintManager::gm_AllHints );
-			bIgnoreHintType = false;
-		}
-	}
+	GetHintLists( hintCriteria, &lists, &bIgnoreHintType );
 
 	CAI_Hint *pBestHint	= NULL;
 
@@ -459,6 +600,8 @@ CAI_Hint *CAI_HintManager::FindHint( CAI_BaseNPC *pNPC, const Vector &position,
 	// Longer search, reset best distance
 	flBestDistance = MAX_TRACE_LENGTH;
 
+	CUtlVector<int> candidates;
+
 	for ( int listNum = 0; listNum < listCount; ++listNum )
 	{
 		CAIHintVector *list = lists[ listNum ];
@@ -469,10 +612,18 @@ CAI_Hint *CAI_HintManager::FindHint( CAI_BaseNPC *pNPC, const Vector &position,
 		if ( !count )
 			continue;
 
+		// Only look near the include zones, if there are any. The candidates
+		// are in list order, so the same hint wins as in a full search.
+		bool bUseGrid = ai_hint_grid.GetBool() && list->GetHintsInIncludeZones( hintCriteria, &candidates );
+		if ( bUseGrid )
+		{
+			count = candidates.Count();
+		}
+
 		//  Now loop till we find a valid hint or return to the start
 		for ( i = 0 ; i < count; ++i )
 		{
-			pTestHint = list->Element( i );
+			pTestHint = list->Element( bUseGrid ? candidates[i] : i );
 			Assert( pTestHint );
 
 			++visited;
@@ -520,6 +671,121 @@ CAI_Hint *CAI_HintManager::FindHint( CAI_BaseNPC *pNPC, const Vector &position,
 	return pBestHint;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Finds up to nMaxHints hints that match the criteria, nearest to
+//			position first (weighted the same way as a nearest search).
+//			Lets behaviors that want to fall back to other hints get them all
+//			with one search instead of searching again for each one.
+// Output : Number of hints added to pResult
+//-----------------------------------------------------------------------------
+int CAI_HintManager::FindBestHints( CAI_BaseNPC *pNPC, const Vector &position, const CHintCriteria &hintCriteria, int nMaxHints, CUtlVector<CAI_Hint *> *pResult )
+{
+	pResult->RemoveAll();
+	if ( nMaxHints <= 0 )
+		return 0;
+
+	bool bIgnoreHintType;
+	CUtlVector< CAIHintVector * > lists;
+	GetHintLists( hintCriteria, &lists, &bIgnoreHintType );
+
+	// The distance is measured here, as the nearest test only keeps hints nearer than the last
+	bool hadNearest = hintCriteria.HasFlag( bits_HINT_NODE_NEAREST );
+	(const_cast<CHintCriteria &>(hintCriteria)).ClearFlag( bits_HINT_NODE_NEAREST );
+
+	CUtlVector<float> distances;
+	CUtlVector<int> candidates;
+
+	for ( int listNum = 0; listNum < lists.Count(); ++listNum )
+	{
+		CAIHintVector *list = lists[ listNum ];
+
+		bool bUseGrid = ai_hint_grid.GetBool() && list->GetHintsInIncludeZones( hintCriteria, &candidates );
+		int count = ( bUseGrid ) ? candidates.Count() : list->Count();
+
+		for ( int i = 0; i < count; ++i )
+		{
+			CAI_Hint *pTestHint = list->Element( bUseGrid ? candidates[i] : i );
+			Assert( pTestHint );
+
+			float distance = (pTestHint->GetAbsOrigin() - position).Length();
+#ifdef MAPBASE
+			if ( pTestHint->GetHintWeight() != 1.0f )
+			{
+				distance *= pTestHint->GetHintWeightInverse();
+			}
+#endif
+
+			// Skip the expensive tests when it wouldn't make the list
+			if ( pResult->Count() == nMaxHints && distance >= distances.Tail() )
+				continue;
+
+			if ( !pTestHint->HintMatchesCriteria( pNPC, hintCriteria, position, NULL, false, bIgnoreHintType ) )
+				continue;
+
+			// Insert in order, dropping the farthest if the list is full
+			if ( pResult->Count() == nMaxHints )
+			{
+				pResult->RemoveMultipleFromTail( 1 );
+				distances.RemoveMultipleFromTail( 1 );
+			}
+
+			int slot = distances.Count();
+			while ( slot > 0 && distances[slot - 1] > distance )
+			{
+				--slot;
+			}
+
+			pResult->InsertBefore( slot, pTestHint );
+			distances.InsertBefore( slot, distance );
+		}
+	}
+
+	if ( hadNearest )
+		(const_cast<CHintCriteria &>(hintCriteria)).SetFlag( bits_HINT_NODE_NEAREST );
+
+	return pResult->Count();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Gets the lists of hints a search with these criteria has to look
+//			through. If the criteria names no hint types, that's every hint,
+//			and the hint type must still be checked.
+//-----------------------------------------------------------------------------
+void CAI_HintManager::GetHintLists( const CHintCriteria &hintCriteria, CUtlVector< CAIHintVector * > *pLists, bool *pbIgnoreHintType )
+{
+	*pbIgnoreHintType = true;
+
+	if ( hintCriteria.MatchesSingleHintType() )
+	{
+		int slot = CAI_HintManager::gm_TypedHints.Find( hintCriteria.GetFirstHintType() );
+		if ( slot != CAI_HintManager::gm_TypedHints.InvalidIndex() )
+		{
+			pLists->AddToTail( &CAI_HintManager::gm_TypedHints[ slot ] );
+		}
+	}
+	else
+	{
+		int typeCount = hintCriteria.NumHintTypes();
+		if ( typeCount > 0 )
+		{
+			for ( int listType = 0; listType < typeCount; ++listType )
+			{
+				int slot = CAI_HintManager::gm_TypedHints.Find( hintCriteria.GetHintType( listType ) );
+				if ( slot != CAI_HintManager::gm_TypedHints.InvalidIndex() )
+				{
+					pLists->AddToTail( &CAI_HintManager::gm_TypedHints[ slot ] );
+				}
+			}
+		}
+		else
+		{
+			// Still need to check hint type in this case
+			pLists->AddToTail( &CAI_HintManager::gm_AllHints );
+			*pbIgnoreHintType = false;
+		}
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Searches for a hint node that this NPC cares about. If one is
 //			claims that hint node for this NPC so that no other NPCs
@@ -624,6 +890,7 @@ void CAI_HintManager::AddHint( CAI_Hint *pHint )
 	//  Add to linked list of hints
 	// ---------------------------------
 	CAI_HintManager::gm_AllHints.AddToTail( pHint );
+	CAI_HintManager::gm_AllHints.InvalidateGrid();
 	CAI_HintManager::AddHintByType( pHint );
 }
 
@@ -647,6 +914,7 @@ void CAI_HintManager::AddHintByType( CAI_Hint *pHint )
 		slot = CAI_HintManager::gm_TypedHints.Insert( type);
 	}
 	CAI_HintManager::gm_TypedHints[ slot ].AddToTail( pHint );
+	CAI_HintManager::gm_TypedHints[ slot ].InvalidateGrid();
 }
 
 void CAI_HintManager::RemoveHintByType( CAI_Hint *pHintToRemove )
@@ -655,6 +923,7 @@ void CAI_HintManager::RemoveHintByType( CAI_Hint *pHintToRemove )
 	if ( slot != CAI_HintManager::gm_TypedHints.InvalidIndex() )
 	{
 		CAI_HintManager::gm_TypedHints[ slot ].FindAndRemove( pHintToRemove );
+		CAI_HintManager::gm_TypedHints[ slot ].InvalidateGrid();
 	}
 }
 
@@ -665,6 +934,7 @@ void CAI_HintManager::RemoveHint( CAI_Hint *pHintToRemove )
 	//  Remove from linked list of hints
 	// --------------------------------------
 	gm_AllHints.FindAndRemove( pHintToRemove );
+	gm_AllHints.InvalidateGrid();
 	RemoveHintByType( pHintToRemove );
 
 	if ( CAI_HintManager::IsInFoundHintList( pHintToRemove ) )
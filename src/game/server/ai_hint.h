@@ -168,6 +168,9 @@ public:
 	bool		InIncludedZone( const Vector &testPosition ) const;
 	bool		InExcludedZone( const Vector &testPosition ) const;
 
+	int			NumIncludeZones() const			{ return m_zoneInclude.Count(); }
+	void		GetIncludeZone( int idx, Vector *pPosition, float *pRadiusSqr ) const	{ *pPosition = m_zoneInclude[idx].position; *pRadiusSqr = m_zoneInclude[idx].radiussqr; }
+
 	int			NumHintTypes() const;
 	int			GetHintType( int idx ) const;
 
@@ -211,11 +214,11 @@ DECLARE_POINTER_HANDLE(AIHintIter_t);
 class CAIHintVector : public CUtlVector< CAI_Hint * >
 {
 public:
-	CAIHintVector() : CUtlVector< CAI_Hint * >( 1, 0 )
+	CAIHintVector() : CUtlVector< CAI_Hint * >( 1, 0 ), m_bGridDirty( true )
 	{
 	}
 
-	CAIHintVector( const CAIHintVector& src )
+	CAIHintVector( const CAIHintVector& src ) : m_bGridDirty( true )
 	{
 		CopyArray( src.Base(), src.Count() );
 	}
@@ -223,8 +226,30 @@ public:
 	CAIHintVector &operator=( const CAIHintVector &src )
 	{
 		CopyArray( src.Base(), src.Count() );
+		m_bGridDirty = true;
 		return *this;
 	}
+
+	// Must be called whenever hints are added, removed or moved
+	void		InvalidateGrid()				{ m_bGridDirty = true; }
+
+	// Fills pResult with the indices, in list order, of the hints that may be
+	// inside the include zones of hintCriteria. Returns false if the criteria
+	// has no include zones, in which case every hint must be checked.
+	bool		GetHintsInIncludeZones( const CHintCriteria &hintCriteria, CUtlVector<int> *pResult );
+
+private:
+	void		BuildGrid();
+
+	// Uniform grid over the hint positions, built when first needed
+	bool				m_bGridDirty;
+	Vector2D			m_GridMins;
+	int					m_nGridCellsX;
+	int					m_nGridCellsY;
+	CUtlVector<int>		m_GridCellStart;	// entries of cell i are m_GridEntries[ m_GridCellStart[i], m_GridCellStart[i+1] )
+	CUtlVector<int>		m_GridEntries;		// hint indices, in list order within each cell
+	CUtlVector<Vector>	m_GridOrigins;		// parallel to m_GridEntries
+	CUtlVector<int>		m_GridUnindexed;	// parented hints, which can move without the grid knowing
 };
 
 class CAI_HintManager
@@ -251,6 +276,10 @@ public:
 	static int			FindAllHints( CAI_BaseNPC *pNPC, const Vector &position, const CHintCriteria &hintCriteria, CUtlVector<CAI_Hint *> *pResult );
 	static int			FindAllHints( const Vector &position, const CHintCriteria &hintCriteria, CUtlVector<CAI_Hint *> *pResult )	{ return FindAllHints( NULL, position, hintCriteria, pResult ); }
 	static int			FindAllHints( CAI_BaseNPC *pNPC, const CHintCriteria &hintCriteria, CUtlVector<CAI_Hint *> *pResult )		{ return FindAllHints( pNPC, pNPC->GetAbsOrigin(), hintCriteria, pResult ); }
+
+	// Purpose: Finds up to nMaxHints suitable hints, nearest to position first, in one search.
+	//			Doesn't lock them or note them as found.
+	static int			FindBestHints( CAI_BaseNPC *pNPC, const Vector &position, const CHintCriteria &hintCriteria, int nMaxHints, CUtlVector<CAI_Hint *> *pResult );
 	static int			GetFlags( const char *token );
 
 	static CAI_Hint		*GetFirstHint( AIHintIter_t *pIter );					
@@ -268,6 +297,8 @@ private:
 		HINT_HISTORY_MASK = (HINT_HISTORY-1)
 	};
 
+	static void			GetHintLists( const CHintCriteria &hintCriteria, CUtlVector< CAIHintVector * > *pLists, bool *pbIgnoreHintType );
+
 	static CAI_Hint		*AddFoundHint( CAI_Hint *hint );
 	static int			GetFoundHintCount();
 	static CAI_Hint		*GetFoundHint( int index );
@@ -453,6 +453,21 @@ bool CAI_Navigator::FindPath( const AI_NavGoal_t &goal, unsigned flags )
 ConVar ai_navigator_generate_spikes( "ai_navigator_generate_spikes", "0" );
 ConVar ai_navigator_generate_spikes_strength( "ai_navigator_generate_spikes_strength", "8" );
 
+//-----------------------------------------------------------------------------
+// Purpose: Runs a SetGoal queued by the post frame navigation system, unless
+//			the goal's target was removed while it waited
+//-----------------------------------------------------------------------------
+
+bool CAI_Navigator::SetDeferredGoal( const AI_NavGoal_t &goal, EHANDLE hTarget, unsigned flags )
+{
+	if ( hTarget.IsValid() && !hTarget )
+		return false;
+
+	AI_NavGoal_t targetGoal( goal );
+	targetGoal.pTarget = hTarget;
+	return SetGoal( targetGoal, flags );
+}
+
 //-----------------------------------------------------------------------------
 
 bool CAI_Navigator::SetGoal( const AI_NavGoal_t &goal, unsigned flags )
@@ -460,8 +475,10 @@ bool CAI_Navigator::SetGoal( const AI_NavGoal_t &goal, unsigned flags )
 	// Queue this up if we're in the middle of a frame
 	if ( PostFrameNavigationSystem()->IsGameFrameRunning() )
 	{
-		// Send off the query for queuing
-		PostFrameNavigationSystem()->EnqueueEntityNavigationQuery( GetOuter(), CreateFunctor( this, &CAI_Navigator::SetGoal, RefToVal( goal ), flags ) );
+		// Send off the query for queuing. It can wait past this frame, so the target goes by handle.
+		AI_NavGoal_t deferredGoal( goal );
+		deferredGoal.pTarget = NULL;
+		PostFrameNavigationSystem()->EnqueueEntityNavigationQuery( GetOuter(), CreateFunctor( this, &CAI_Navigator::SetDeferredGoal, RefToVal( deferredGoal ), EHANDLE( goal.pTarget ), flags ) );
 
 		// Complete immediately if we're waiting on that
 		// FIXME: This will probably cause a lot of subtle little nuisances...
@@ -3562,6 +3579,11 @@ bool CAI_Navigator::MarkCurWaypointFailedLink( void )
 		}
 	}
 
+	if ( didMark )
+	{
+		CAI_Pathfinder::InvalidatePathCache();
+	}
+
 	return didMark;
 }
 
@@ -551,6 +551,7 @@ protected:
 	virtual bool 		GetStoppingPath( CAI_WaypointList *pClippedWaypoints );
 
 private:
+	bool				SetDeferredGoal( const AI_NavGoal_t &goal, EHANDLE hTarget, unsigned flags );
 	bool				FindPath( const AI_NavGoal_t &goal, unsigned flags );
 	bool				FindPath( bool fSignalTaskStatus = true, bool bDontIgnoreBadLinks = false );
 	bool				MarkCurWaypointFailedLink( void );			// Call when route fails
@@ -184,6 +184,10 @@ CAI_Network::CAI_Network()
 	m_iNumNodes				= 0;		// Number of nodes in this network
 	m_pAInode				= NULL;		// Array of all nodes in this network
 
+	m_pLinkBlock			= NULL;
+	m_nLinkBlockSize		= 0;
+	m_nLinkBlockUsed		= 0;
+
 	m_iNearestCacheNext	= NEARNODE_CACHE_SIZE - 1;
 	// Force empty node caches to be rebuild
 	for (int node=0;node<NEARNODE_CACHE_SIZE;node++)
@@ -235,7 +239,10 @@ CAI_Network::~CAI_Network()
 							}
 						}
 					}
-					delete pLink;
+					if ( pLink < m_pLinkBlock || pLink >= m_pLinkBlock + m_nLinkBlockSize )
+					{
+						delete pLink;
+					}
 				}
 			}
 			delete pNode;
@@ -243,6 +250,8 @@ CAI_Network::~CAI_Network()
 	}
 	delete[] m_pAInode;
 	m_pAInode = NULL;
+	delete[] m_pLinkBlock;
+	m_pLinkBlock = NULL;
 }
 
 //-----------------------------------------------------------------------------
@@ -669,7 +678,7 @@ CAI_Link *CAI_Network::CreateLink( int srcID, int destID, CAI_DynamicLink *pDyna
 		return NULL;
 	}
 
-	CAI_Link *pLink = new CAI_Link;
+	CAI_Link *pLink = ( m_nLinkBlockUsed < m_nLinkBlockSize ) ? &m_pLinkBlock[m_nLinkBlockUsed++] : new CAI_Link;
 
 	pLink->m_iSrcID = srcID;
 	pLink->m_iDestID = destID;
@@ -681,6 +690,22 @@ CAI_Link *CAI_Network::CreateLink( int srcID, int destID, CAI_DynamicLink *pDyna
 	return pLink;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Used when loading a saved graph, so the links come from one
+//			allocation instead of one each
+//-----------------------------------------------------------------------------
+
+void CAI_Network::ReserveLinks( int nLinks )
+{
+	Assert( !m_pLinkBlock );
+	if ( m_pLinkBlock || nLinks <= 0 )
+		return;
+
+	m_pLinkBlock = new CAI_Link[nLinks];
+	m_nLinkBlockSize = nLinks;
+	m_nLinkBlockUsed = 0;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Returns true is two nodes are connected by the network graph
 //-----------------------------------------------------------------------------
@@ -92,6 +92,7 @@ public:
 
 	CAI_Node *		AddNode( const Vector &origin, float yaw );						// Returns a new node in the network
 	CAI_Link *		CreateLink( int srcID, int destID, CAI_DynamicLink *pDynamicLink = NULL );
+	void			ReserveLinks( int nLinks );									// Allocates the next nLinks links in one block
 
 	bool			IsConnected(int srcID, int destID);	// Use during run time
 	void			TestIsConnected(int startID, int endID);	// Use only for initialization!
@@ -170,6 +171,10 @@ private:
 	int					m_iNumNodes;				// Number of nodes in this network
 	CAI_Node**			m_pAInode;					// Array of all nodes in this network
 
+	CAI_Link *			m_pLinkBlock;				// Links allocated by ReserveLinks()
+	int					m_nLinkBlockSize;
+	int					m_nLinkBlockUsed;
+
 	enum
 	{
 		PARTITION_NODE	= ( 1 << 0 )
@@ -0,0 +1,305 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: On-disk layout of AI node graphs (.ain)
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "checksum_crc.h"
+#include "ai_networkfile.h"
+#include "ai_network.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+//-----------------------------------------------------------------------------
+// CAI_NetworkFileView
+//-----------------------------------------------------------------------------
+
+bool CAI_NetworkFileView::IsNetworkFile( const void *pData, int nSize )
+{
+	return ( nSize >= (int)sizeof(int) && *(const int *)pData == AINET_FILE_ID );
+}
+
+//-----------------------------------------------------------------------------
+
+static bool IsArrayInFile( int offset, int nElements, int nElementSize, int nFileSize )
+{
+	if ( offset < (int)sizeof(AI_NetworkFileHeader_t) || ( offset % AINET_FILE_ALIGN ) != 0 )
+		return false;
+	return ( (int64)offset + (int64)nElements * nElementSize <= nFileSize );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Checks the header, the array bounds and the checksum.  Nothing in
+//			the file is touched outside what the header describes.
+//-----------------------------------------------------------------------------
+
+bool CAI_NetworkFileView::Init( const void *pData, int nSize )
+{
+	m_pHeader = NULL;
+
+	if ( nSize < (int)sizeof(AI_NetworkFileHeader_t) || !IsNetworkFile( pData, nSize ) )
+		return false;
+
+	const AI_NetworkFileHeader_t *pHeader = (const AI_NetworkFileHeader_t *)pData;
+	if ( pHeader->fileVersion != AINET_FILE_VERSION || pHeader->numHulls != NUM_HULLS )
+		return false;
+
+	if ( pHeader->numNodes < 0 || pHeader->numLinks < 0 || pHeader->dataSize != nSize - (int)sizeof(AI_NetworkFileHeader_t) )
+		return false;
+
+	int numNodes = pHeader->numNodes;
+	int numLinks = pHeader->numLinks;
+	if ( !IsArrayInFile( pHeader->nodeOriginOffset,		numNodes, sizeof(Vector), nSize ) ||
+		 !IsArrayInFile( pHeader->nodeYawOffset,		numNodes, sizeof(float), nSize ) ||
+		 !IsArrayInFile( pHeader->nodeVOffsetOffset,	numNodes * NUM_HULLS, sizeof(float), nSize ) ||
+		 !IsArrayInFile( pHeader->nodeInfoOffset,		numNodes, sizeof(unsigned short), nSize ) ||
+		 !IsArrayInFile( pHeader->nodeZoneOffset,		numNodes, sizeof(short), nSize ) ||
+		 !IsArrayInFile( pHeader->nodeTypeOffset,		numNodes, sizeof(byte), nSize ) ||
+		 !IsArrayInFile( pHeader->nodeNumLinksOffset,	numNodes, sizeof(unsigned short), nSize ) ||
+		 !IsArrayInFile( pHeader->nodeWCIdOffset,		numNodes, sizeof(int), nSize ) ||
+		 !IsArrayInFile( pHeader->linkSrcOffset,		numLinks, sizeof(short), nSize ) ||
+		 !IsArrayInFile( pHeader->linkDestOffset,		numLinks, sizeof(short), nSize ) ||
+		 !IsArrayInFile( pHeader->linkMoveTypesOffset,	numLinks * NUM_HULLS, sizeof(byte), nSize ) )
+	{
+		return false;
+	}
+
+	if ( CRC32_ProcessSingleBuffer( pHeader + 1, pHeader->dataSize ) != pHeader->checksum )
+		return false;
+
+	m_pHeader = pHeader;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// CAI_NetworkFileWriter
+//-----------------------------------------------------------------------------
+
+void CAI_NetworkFileWriter::AddNode( const Vector &origin, float yaw, const float *pVOffsets, int type, unsigned short info, short zone, int wcId )
+{
+	m_NodeOrigins.AddToTail( origin );
+	m_NodeYaws.AddToTail( yaw );
+	for ( int hull = 0; hull < NUM_HULLS; hull++ )
+	{
+		m_NodeVOffsets[hull].AddToTail( pVOffsets[hull] );
+	}
+	m_NodeInfo.AddToTail( info );
+	m_NodeZones.AddToTail( zone );
+	m_NodeTypes.AddToTail( (byte)type );
+	m_NodeWCIds.AddToTail( wcId );
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_NetworkFileWriter::AddLink( int srcId, int destId, const byte *pMoveTypes )
+{
+	m_LinkSrcIds.AddToTail( srcId );
+	m_LinkDestIds.AddToTail( destId );
+	for ( int hull = 0; hull < NUM_HULLS; hull++ )
+	{
+		m_LinkMoveTypes[hull].AddToTail( pMoveTypes[hull] );
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+static int AllocFileArray( int &fileSize, int nElements, int nElementSize )
+{
+	int offset = fileSize;
+	fileSize = AlignValue( fileSize + nElements * nElementSize, AINET_FILE_ALIGN );
+	return offset;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Lays the graph out with links sorted by source node and writes it
+//-----------------------------------------------------------------------------
+
+void CAI_NetworkFileWriter::Write( CUtlBuffer &buf, int graphVersion, int mapVersion ) const
+{
+	int numNodes = m_NodeOrigins.Count();
+	int numLinks = m_LinkSrcIds.Count();
+	int i;
+
+	AI_NetworkFileHeader_t header;
+	memset( &header, 0, sizeof(header) );
+	header.id = AINET_FILE_ID;
+	header.fileVersion = AINET_FILE_VERSION;
+	header.graphVersion = graphVersion;
+	header.mapVersion = mapVersion;
+	header.numHulls = NUM_HULLS;
+	header.numNodes = numNodes;
+	header.numLinks = numLinks;
+
+	int fileSize = AlignValue( (int)sizeof(header), AINET_FILE_ALIGN );
+	header.nodeOriginOffset		= AllocFileArray( fileSize, numNodes, sizeof(Vector) );
+	header.nodeYawOffset		= AllocFileArray( fileSize, numNodes, sizeof(float) );
+	header.nodeVOffsetOffset	= AllocFileArray( fileSize, numNodes * NUM_HULLS, sizeof(float) );
+	header.nodeInfoOffset		= AllocFileArray( fileSize, numNodes, sizeof(unsigned short) );
+	header.nodeZoneOffset		= AllocFileArray( fileSize, numNodes, sizeof(short) );
+	header.nodeTypeOffset		= AllocFileArray( fileSize, numNodes, sizeof(byte) );
+	header.nodeNumLinksOffset	= AllocFileArray( fileSize, numNodes, sizeof(unsigned short) );
+	header.nodeWCIdOffset		= AllocFileArray( fileSize, numNodes, sizeof(int) );
+	header.linkSrcOffset		= AllocFileArray( fileSize, numLinks, sizeof(short) );
+	header.linkDestOffset		= AllocFileArray( fileSize, numLinks, sizeof(short) );
+	header.linkMoveTypesOffset	= AllocFileArray( fileSize, numLinks * NUM_HULLS, sizeof(byte) );
+	header.dataSize = fileSize - sizeof(header);
+
+	CUtlVector<byte> image;
+	image.SetCount( fileSize );
+	memset( image.Base(), 0, fileSize );
+	byte *pImage = image.Base();
+
+	if ( numNodes )
+	{
+		memcpy( pImage + header.nodeOriginOffset, m_NodeOrigins.Base(), numNodes * sizeof(Vector) );
+		memcpy( pImage + header.nodeYawOffset, m_NodeYaws.Base(), numNodes * sizeof(float) );
+		for ( int hull = 0; hull < NUM_HULLS; hull++ )
+		{
+			memcpy( pImage + header.nodeVOffsetOffset + hull * numNodes * sizeof(float), m_NodeVOffsets[hull].Base(), numNodes * sizeof(float) );
+		}
+		memcpy( pImage + header.nodeInfoOffset, m_NodeInfo.Base(), numNodes * sizeof(unsigned short) );
+		memcpy( pImage + header.nodeZoneOffset, m_NodeZones.Base(), numNodes * sizeof(short) );
+		memcpy( pImage + header.nodeTypeOffset, m_NodeTypes.Base(), numNodes * sizeof(byte) );
+		memcpy( pImage + header.nodeWCIdOffset, m_NodeWCIds.Base(), numNodes * sizeof(int) );
+	}
+
+	// Counting sort the links by source node, keeping the order within a node
+	CUtlVector<int> firstLink;
+	firstLink.SetCount( numNodes + 1 );
+	memset( firstLink.Base(), 0, firstLink.Count() * sizeof(int) );
+
+	unsigned short *pNumLinks = (unsigned short *)( pImage + header.nodeNumLinksOffset );
+	for ( i = 0; i < numLinks; i++ )
+	{
+		int srcId = m_LinkSrcIds[i];
+		int destId = m_LinkDestIds[i];
+		Assert( srcId >= 0 && srcId < numNodes && destId >= 0 && destId < numNodes );
+		firstLink[srcId + 1]++;
+		pNumLinks[srcId]++;
+		pNumLinks[destId]++;
+	}
+	for ( i = 0; i < numNodes; i++ )
+	{
+		firstLink[i + 1] += firstLink[i];
+	}
+
+	short *pLinkSrc = (short *)( pImage + header.linkSrcOffset );
+	short *pLinkDest = (short *)( pImage + header.linkDestOffset );
+	byte *pLinkMoveTypes = pImage + header.linkMoveTypesOffset;
+	for ( i = 0; i < numLinks; i++ )
+	{
+		int iSorted = firstLink[m_LinkSrcIds[i]]++;
+		pLinkSrc[iSorted] = m_LinkSrcIds[i];
+		pLinkDest[iSorted] = m_LinkDestIds[i];
+		for ( int hull = 0; hull < NUM_HULLS; hull++ )
+		{
+			pLinkMoveTypes[hull * numLinks + iSorted] = m_LinkMoveTypes[hull][i];
+		}
+	}
+
+	header.checksum = CRC32_ProcessSingleBuffer( pImage + sizeof(header), header.dataSize );
+	memcpy( pImage, &header, sizeof(header) );
+
+	buf.Put( pImage, fileSize );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Converts a graph saved by the old SaveNetworkGraph, which wrote
+//			each node and link field by field
+//-----------------------------------------------------------------------------
+
+bool AI_ConvertLegacyNetworkFile( CUtlBuffer &legacy, CUtlBuffer &out, int graphVersion )
+{
+	struct LegacyNode_t
+	{
+		Vector			origin;
+		float			yaw;
+		float			vOffsets[NUM_HULLS];
+		int				type;
+		unsigned short	info;
+		short			zone;
+	};
+
+	legacy.SeekGet( CUtlBuffer::SEEK_HEAD, 0 );
+
+	// Text graphs from before the binary format
+	if ( legacy.GetChar() == 'V' && legacy.GetChar() == 'e' && legacy.GetChar() == 'r' )
+		return false;
+
+	legacy.SeekGet( CUtlBuffer::SEEK_HEAD, 0 );
+
+	if ( legacy.GetInt() != graphVersion )
+		return false;
+
+	int mapVersion = legacy.GetInt();
+	int numNodes = legacy.GetInt();
+	if ( !legacy.IsValid() || numNodes > MAX_NODES || numNodes < 0 )
+		return false;
+
+	CUtlVector<LegacyNode_t> nodes;
+	nodes.SetCount( numNodes );
+
+	int node;
+	for ( node = 0; node < numNodes; node++ )
+	{
+		LegacyNode_t &legacyNode = nodes[node];
+		legacyNode.origin.x = legacy.GetFloat();
+		legacyNode.origin.y = legacy.GetFloat();
+		legacyNode.origin.z = legacy.GetFloat();
+		legacyNode.yaw = legacy.GetFloat();
+		legacy.Get( legacyNode.vOffsets, sizeof(legacyNode.vOffsets) );
+		legacyNode.type = legacy.GetChar();
+		if ( IsX360() )
+		{
+			legacy.SeekGet( CUtlBuffer::SEEK_CURRENT, 3 );
+		}
+		legacyNode.info = legacy.GetUnsignedShort();
+		legacyNode.zone = legacy.GetShort();
+	}
+
+	int totalNumLinks = legacy.GetInt();
+	if ( !legacy.IsValid() || totalNumLinks < 0 )
+		return false;
+
+	CUtlVector<short> linkIds;
+	CUtlVector<byte> linkMoveTypes;
+	linkIds.SetCount( totalNumLinks * 2 );
+	linkMoveTypes.SetCount( totalNumLinks * NUM_HULLS );
+	for ( int link = 0; link < totalNumLinks; link++ )
+	{
+		linkIds[link * 2] = legacy.GetShort();
+		linkIds[link * 2 + 1] = legacy.GetShort();
+		legacy.Get( &linkMoveTypes[link * NUM_HULLS], NUM_HULLS );
+
+		if ( !legacy.IsValid() )
+			return false;
+
+		for ( int end = 0; end < 2; end++ )
+		{
+			if ( linkIds[link * 2 + end] < 0 || linkIds[link * 2 + end] >= numNodes )
+				return false;
+		}
+	}
+
+	// The WC ids come last in the old layout
+	CAI_NetworkFileWriter writer;
+	for ( node = 0; node < numNodes; node++ )
+	{
+		const LegacyNode_t &legacyNode = nodes[node];
+		int wcId = legacy.GetInt();
+		writer.AddNode( legacyNode.origin, legacyNode.yaw, legacyNode.vOffsets, legacyNode.type, legacyNode.info, legacyNode.zone, wcId );
+	}
+
+	if ( !legacy.IsValid() )
+		return false;
+
+	for ( int link = 0; link < totalNumLinks; link++ )
+	{
+		writer.AddLink( linkIds[link * 2], linkIds[link * 2 + 1], &linkMoveTypes[link * NUM_HULLS] );
+	}
+
+	writer.Write( out, graphVersion, mapVersion );
+	return true;
+}
@@ -0,0 +1,128 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: On-disk layout of AI node graphs (.ain)
+//
+//=============================================================================//
+
+#ifndef AI_NETWORKFILE_H
+#define AI_NETWORKFILE_H
+
+#if defined( _WIN32 )
+#pragma once
+#endif
+
+#include "utlvector.h"
+#include "utlbuffer.h"
+#include "ai_hull.h"
+
+#define AINET_FILE_ID			MAKEID('A','I','N','G')
+#define AINET_FILE_VERSION		1
+#define AINET_FILE_ALIGN		16
+
+//-----------------------------------------------------------------------------
+// The whole file is a header followed by flat arrays, so it can be used in
+// place once it's in memory.  Offsets are in bytes from the start of the
+// header and every array starts on an AINET_FILE_ALIGN boundary.  Per hull
+// values are stored hull by hull, so all of one hull's values are adjacent.
+//-----------------------------------------------------------------------------
+
+struct AI_NetworkFileHeader_t
+{
+	int				id;						// AINET_FILE_ID
+	int				fileVersion;			// AINET_FILE_VERSION
+	int				graphVersion;			// AINET_VERSION_NUMBER of the code that built the graph
+	int				mapVersion;
+	unsigned int	checksum;				// CRC32 of everything after the header
+	int				dataSize;				// Bytes after the header
+	int				numHulls;
+	int				numNodes;
+	int				numLinks;
+
+	int				nodeOriginOffset;		// Vector[numNodes]
+	int				nodeYawOffset;			// float[numNodes]
+	int				nodeVOffsetOffset;		// float[numHulls][numNodes]
+	int				nodeInfoOffset;			// unsigned short[numNodes]
+	int				nodeZoneOffset;			// short[numNodes]
+	int				nodeTypeOffset;			// byte[numNodes]
+	int				nodeNumLinksOffset;		// unsigned short[numNodes], links touching each node
+	int				nodeWCIdOffset;			// int[numNodes]
+	int				linkSrcOffset;			// short[numLinks], sorted
+	int				linkDestOffset;			// short[numLinks]
+	int				linkMoveTypesOffset;	// byte[numHulls][numLinks]
+};
+
+//-----------------------------------------------------------------------------
+// CAI_NetworkFileView
+//
+// Purpose: Validates a graph image in memory and hands out its arrays.  Does
+//			not copy or own the data.
+//-----------------------------------------------------------------------------
+
+class CAI_NetworkFileView
+{
+public:
+	CAI_NetworkFileView() : m_pHeader( NULL ) {}
+
+	static bool		IsNetworkFile( const void *pData, int nSize );
+	bool			Init( const void *pData, int nSize );
+
+	const AI_NetworkFileHeader_t *Header() const	{ return m_pHeader; }
+	int				NumNodes() const				{ return m_pHeader->numNodes; }
+	int				NumLinks() const				{ return m_pHeader->numLinks; }
+
+	const Vector *			NodeOrigins() const				{ return Array<Vector>( m_pHeader->nodeOriginOffset ); }
+	const float *			NodeYaws() const				{ return Array<float>( m_pHeader->nodeYawOffset ); }
+	const float *			NodeVOffsets( int hull ) const	{ return Array<float>( m_pHeader->nodeVOffsetOffset ) + hull * m_pHeader->numNodes; }
+	const unsigned short *	NodeInfo() const				{ return Array<unsigned short>( m_pHeader->nodeInfoOffset ); }
+	const short *			NodeZones() const				{ return Array<short>( m_pHeader->nodeZoneOffset ); }
+	const byte *			NodeTypes() const				{ return Array<byte>( m_pHeader->nodeTypeOffset ); }
+	const unsigned short *	NodeNumLinks() const			{ return Array<unsigned short>( m_pHeader->nodeNumLinksOffset ); }
+	const int *				NodeWCIds() const				{ return Array<int>( m_pHeader->nodeWCIdOffset ); }
+	const short *			LinkSrcIds() const				{ return Array<short>( m_pHeader->linkSrcOffset ); }
+	const short *			LinkDestIds() const				{ return Array<short>( m_pHeader->linkDestOffset ); }
+	const byte *			LinkMoveTypes( int hull ) const	{ return Array<byte>( m_pHeader->linkMoveTypesOffset ) + hull * m_pHeader->numLinks; }
+
+private:
+	template <class T>
+	const T *		Array( int offset ) const		{ return (const T *)( (const byte *)m_pHeader + offset ); }
+
+	const AI_NetworkFileHeader_t *m_pHeader;
+};
+
+//-----------------------------------------------------------------------------
+// CAI_NetworkFileWriter
+//
+// Purpose: Collects a graph a node and link at a time and lays it out in the
+//			file format
+//-----------------------------------------------------------------------------
+
+class CAI_NetworkFileWriter
+{
+public:
+	void			AddNode( const Vector &origin, float yaw, const float *pVOffsets, int type, unsigned short info, short zone, int wcId );
+	void			AddLink( int srcId, int destId, const byte *pMoveTypes );
+
+	int				NumNodes() const	{ return m_NodeOrigins.Count(); }
+
+	void			Write( CUtlBuffer &buf, int graphVersion, int mapVersion ) const;
+
+private:
+	CUtlVector<Vector>			m_NodeOrigins;
+	CUtlVector<float>			m_NodeYaws;
+	CUtlVector<float>			m_NodeVOffsets[NUM_HULLS];
+	CUtlVector<unsigned short>	m_NodeInfo;
+	CUtlVector<short>			m_NodeZones;
+	CUtlVector<byte>			m_NodeTypes;
+	CUtlVector<int>				m_NodeWCIds;
+	CUtlVector<short>			m_LinkSrcIds;
+	CUtlVector<short>			m_LinkDestIds;
+	CUtlVector<byte>			m_LinkMoveTypes[NUM_HULLS];
+};
+
+//-----------------------------------------------------------------------------
+
+// Converts a graph saved in the old field by field layout.  Fails if the old
+// graph was built by a different AINET_VERSION_NUMBER.
+bool AI_ConvertLegacyNetworkFile( CUtlBuffer &legacy, CUtlBuffer &out, int graphVersion );
+
+#endif // AI_NETWORKFILE_H
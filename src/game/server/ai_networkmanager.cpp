@@ -14,9 +14,11 @@
 #include "editor_sendcommand.h"
 
 #include "ai_networkmanager.h"
+#include "ai_networkfile.h"
 #include "ai_network.h"
 #include "ai_node.h"
 #include "ai_navigator.h"
+#include "ai_pathfinder.h"
 #include "ai_link.h"
 #include "ai_dynamiclink.h"
 #include "ai_initutils.h"
@@ -25,6 +27,7 @@
 #include "ndebugoverlay.h"
 #include "ai_hint.h"
 #include "tier0/icommandline.h"
+#include "vstdlib/jobthread.h"
 #ifdef MAPBASE
 #include "gameinterface.h"
 #endif
@@ -81,6 +84,42 @@ extern CUtlVector<MODTITLECOMMENT> *Mapbase_GetChapterMaps();
 extern CUtlVector<MODCHAPTER> *Mapbase_GetChapterList();
 #endif
 
+// The visibility traces don't depend on each other, so they're done up front on the job
+// pool. The rest of the neighbor setup stays serial, so the graph comes out the same.
+ConVar ai_network_build_threads( "ai_network_build_threads", "-1", FCVAR_NONE, "Number of extra jobs used for node graph visibility traces. -1 uses the whole thread pool, 0 traces on the main thread." );
+
+// When the .ain is out of date, nodes that haven't moved keep their links from the old
+// graph and only the area around added, removed or edited nodes is rebuilt. Brush changes
+// away from any edited node are not picked up, so do a full build before shipping a map.
+ConVar ai_rebuildgraph_incremental( "ai_rebuildgraph_incremental", "0", FCVAR_NONE, "Reuse the out of date node graph for nodes that haven't changed when rebuilding." );
+
+//-----------------------------------------------------------------------------
+// Node graph read back from an out of date .ain
+//-----------------------------------------------------------------------------
+
+struct AI_PreviousGraphNode_t
+{
+	Vector			vecOrigin;
+	float			flYaw;
+	float			flVOffset[NUM_HULLS];
+	int				nType;
+	unsigned short	nInfo;
+	int				nWCNodeID;
+};
+
+struct AI_PreviousGraphLink_t
+{
+	int				iSrcID;
+	int				iDestID;
+	byte			iAcceptedMoveTypes[NUM_HULLS];
+};
+
+struct AI_PreviousGraph_t
+{
+	CUtlVector<AI_PreviousGraphNode_t>	nodes;
+	CUtlVector<AI_PreviousGraphLink_t>	links;
+};
+
 
 //-----------------------------------------------------------------------------
 // CAI_NetworkManager
@@ -116,6 +155,7 @@ CAI_NetworkManager::CAI_NetworkManager(void)
 {
 	m_pNetwork = new CAI_Network;
 	m_pEditOps = new CAI_NetworkEditTools(this);
+	m_pPreviousGraph = NULL;
 	m_bNeedGraphRebuild		= false;
 	m_fInitalized = false;
 	CAI_DynamicLink::gm_bInitialized = false;
@@ -134,6 +174,7 @@ CAI_NetworkManager::~CAI_NetworkManager(void)
 	// ---------------------------------------
 	delete m_pEditOps;
 	delete m_pNetwork;
+	delete m_pPreviousGraph;
 	if ( g_pAINetworkManager == this )
 	{
 		g_pAINetworkManager = NULL;
@@ -179,6 +220,7 @@ void CAI_NetworkManager::StartRebuild( void )
 	CAI_DynamicLink::gm_bInitialized = false;
 
 	g_AINetworkBuilder.Rebuild( m_pNetwork );
+	CAI_Pathfinder::InvalidatePathCache();
 
 	// ------------------------------------------------------------
 	// Purge any dynamic links for links that don't exist any more
@@ -265,54 +307,41 @@ void CAI_NetworkManager::SaveNetworkGraph( void )
 	Q_strncat( szNrpFilename, STRING( gpGlobals->mapname ), sizeof( szNrpFilename ), COPY_ALL_CHARACTERS );
 	Q_strncat( szNrpFilename, IsX360() ? ".360.ain" : ".ain", sizeof( szNrpFilename ), COPY_ALL_CHARACTERS  );
 
-	CUtlBuffer buf;
-
-	// ---------------------------
-	// Save the version number
-	// ---------------------------
-	buf.PutInt(AINET_VERSION_NUMBER);
-	buf.PutInt(gpGlobals->mapversion);
+	CAI_NetworkFileWriter writer;
 
 	// -------------------------------
 	// Dump all the nodes to the file
 	// -------------------------------
-	buf.PutInt( m_pNetwork->m_iNumNodes);
-
 	int node;
-	int totalNumLinks = 0;
+	CUtlMap<int, int> wcIDs;
+	SetDefLessFunc(wcIDs);
+	bool bCheckForProblems = false;
 	for ( node = 0; node < m_pNetwork->m_iNumNodes; node++)
 	{
 		CAI_Node *pNode = m_pNetwork->GetNode(node);
 		Assert( pNode->GetZone() != AI_NODE_ZONE_UNKNOWN );
 
-		buf.PutFloat( pNode->GetOrigin().x );
-		buf.PutFloat( pNode->GetOrigin().y );
-		buf.PutFloat( pNode->GetOrigin().z );
-		buf.PutFloat( pNode->GetYaw() );
-		buf.Put( pNode->m_flVOffset, sizeof( pNode->m_flVOffset ) );
-		buf.PutChar( pNode->GetType() );
-		if ( IsX360() )
-		{
-			buf.SeekPut( CUtlBuffer::SEEK_CURRENT, 3 );
-		}
-		buf.PutUnsignedShort( pNode->m_eNodeInfo );
-		buf.PutShort( pNode->GetZone() );
-
-		for (int link = 0; link < pNode->NumLinks(); link++)
+		int iPreviousNodeBinding = wcIDs.Find( GetEditOps()->m_pNodeIndexTable[node] );
+		if ( iPreviousNodeBinding != wcIDs.InvalidIndex() )
 		{
-			// Only dump if link source
-			if (node == pNode->GetLinkByIndex(link)->m_iSrcID)
+			if ( !bCheckForProblems )
 			{
-				totalNumLinks++;
+				DevWarning( "******* MAP CONTAINS DUPLICATE HAMMER NODE IDS! CHECK FOR PROBLEMS IN HAMMER TO CORRECT *******\n" );
+				bCheckForProblems = true;
 			}
+			DevWarning( "   AI node %d is associated with Hammer node %d, but %d is already bound to node %d\n", node, GetEditOps()->m_pNodeIndexTable[node], GetEditOps()->m_pNodeIndexTable[node], wcIDs[iPreviousNodeBinding] );
 		}
+		else
+		{
+			wcIDs.Insert( GetEditOps()->m_pNodeIndexTable[node], node );
+		}
+
+		writer.AddNode( pNode->GetOrigin(), pNode->GetYaw(), pNode->m_flVOffset, pNode->GetType(), pNode->m_eNodeInfo, pNode->GetZone(), GetEditOps()->m_pNodeIndexTable[node] );
 	}
 
 	// -------------------------------
 	// Dump all the links to the file
 	// -------------------------------
-	buf.PutInt( totalNumLinks );
-
 	for (node = 0; node < m_pNetwork->m_iNumNodes; node++)
 	{
 		CAI_Node *pNode = m_pNetwork->GetNode(node);
@@ -323,37 +352,13 @@ void CAI_NetworkManager::SaveNetworkGraph( void )
 			CAI_Link *pLink = pNode->GetLinkByIndex(link);
 			if (node == pLink->m_iSrcID)
 			{
-				buf.PutShort( pLink->m_iSrcID );
-				buf.PutShort( pLink->m_iDestID );
-				buf.Put( pLink->m_iAcceptedMoveTypes, sizeof( pLink->m_iAcceptedMoveTypes) );
+				writer.AddLink( pLink->m_iSrcID, pLink->m_iDestID, pLink->m_iAcceptedMoveTypes );
 			}
 		}
 	}
 
-	// -------------------------------
-	// Dump WC lookup table
-	// -------------------------------
-	CUtlMap<int, int> wcIDs;
-	SetDefLessFunc(wcIDs);
-	bool bCheckForProblems = false;
-	for (node = 0; node < m_pNetwork->m_iNumNodes; node++)
-	{
-		int iPreviousNodeBinding = wcIDs.Find( GetEditOps()->m_pNodeIndexTable[node] );
-		if ( iPreviousNodeBinding != wcIDs.InvalidIndex() )
-		{
-			if ( !bCheckForProblems )
-			{
-				DevWarning( "******* MAP CONTAINS DUPLICATE HAMMER NODE IDS! CHECK FOR PROBLEMS IN HAMMER TO CORRECT *******\n" );
-				bCheckForProblems = true;
-			}
-			DevWarning( "   AI node %d is associated with Hammer node %d, but %d is already bound to node %d\n", node, GetEditOps()->m_pNodeIndexTable[node], GetEditOps()->m_pNodeIndexTable[node], wcIDs[iPreviousNodeBinding] );
-		}
-		else
-		{
-			wcIDs.Insert( GetEditOps()->m_pNodeIndexTable[node], node );
-		}
-		buf.PutInt( GetEditOps()->m_pNodeIndexTable[node] );
-	}
+	CUtlBuffer buf;
+	writer.Write( buf, AINET_VERSION_NUMBER, gpGlobals->mapversion );
 
 	// -------------------------------
 	// Write the file out
@@ -545,32 +550,41 @@ void CAI_NetworkManager::LoadNetworkGraph( void )
 		return;
 	}
 
+	// ------------------------------------------------------
+	// Graphs saved in the old field by field layout are
+	// converted in memory, ai_convert_graph rewrites the file
+	// ------------------------------------------------------
+	if ( !CAI_NetworkFileView::IsNetworkFile( buf.Base(), buf.TellPut() ) )
+	{
+		CUtlBuffer converted;
+		if ( !AI_ConvertLegacyNetworkFile( buf, converted, AINET_VERSION_NUMBER ) )
+		{
+			DevMsg( "AI node graph %s is out of date\n", szNrpFilename );
+			return;
+		}
+		DevMsg( "Converted old format AI node graph %s\n", szNrpFilename );
+		buf.Swap( converted );
+	}
+
 	DevMsg( "Checking version\n" );
 
-	// ---------------------------
-	// Check the version number
-	// ---------------------------
-	if ( buf.GetChar() == 'V' && buf.GetChar() == 'e' && buf.GetChar() == 'r' )
+	CAI_NetworkFileView view;
+	if ( !view.Init( buf.Base(), buf.TellPut() ) )
 	{
-		DevMsg( "AI node graph %s is out of date\n", szNrpFilename );
+		DevMsg( "AI node graph %s is out of date or corrupt\n", szNrpFilename );
 		return;
 	}
-	
-	DevMsg( "Passed first ver check\n" );
-
 
-	buf.SeekGet( CUtlBuffer::SEEK_HEAD, 0 );
-
-	int version = buf.GetInt();
-	DevMsg( "Got version %d\n", version );
-
-	if ( version != AINET_VERSION_NUMBER)
+	// ---------------------------
+	// Check the version number
+	// ---------------------------
+	if ( view.Header()->graphVersion != AINET_VERSION_NUMBER )
 	{
 		DevMsg( "AI node graph %s is out of date\n", szNrpFilename );
 		return;
 	}
 
-	int mapversion = buf.GetInt();
+	int mapversion = view.Header()->mapVersion;
 	DevMsg( "Map version %d\n", mapversion );
 
 	if ( mapversion != gpGlobals->mapversion && !g_ai_norebuildgraph.GetBool() )
@@ -602,74 +616,74 @@ void CAI_NetworkManager::LoadNetworkGraph( void )
 	// ----------------------------------------
 	// Get the network size and allocate space
 	// ----------------------------------------
-	int numNodes = buf.GetInt();
+	int numNodes = view.NumNodes();
 
-	if ( numNodes > MAX_NODES || numNodes < 0 )
+	if ( numNodes > MAX_NODES )
 	{
 		Error( "AI node graph %s is corrupt\n", szNrpFilename );
-		DevMsg( "%s", (const char *)buf.Base() );
-		DevMsg( "\n" );
 		Assert( 0 );
 		return;
 	}
 	
 	DevMsg( "Finishing load\n" );
 
+	int numAllocNodes = numNodes;
 
 	// ------------------------------------------------------------------------
 	// If in wc_edit mode allocate extra space for nodes that might be created
 	// ------------------------------------------------------------------------
 	if ( engine->IsInEditMode() )
 	{
-		numNodes = MAX( numNodes, 1024 );
+		numAllocNodes = MAX( numNodes, 1024 );
 	}
 
-	m_pNetwork->m_pAInode = new CAI_Node*[MAX( numNodes, 1 )];
-	memset( m_pNetwork->m_pAInode, 0, sizeof( CAI_Node* ) * MAX( numNodes, 1 ) );
+	m_pNetwork->m_pAInode = new CAI_Node*[MAX( numAllocNodes, 1 )];
+	memset( m_pNetwork->m_pAInode, 0, sizeof( CAI_Node* ) * MAX( numAllocNodes, 1 ) );
 
 	// -------------------------------
-	// Load all the nodes to the file
+	// Load all the nodes from the file
 	// -------------------------------
+	const Vector *pOrigins = view.NodeOrigins();
+	const float *pYaws = view.NodeYaws();
+	const byte *pTypes = view.NodeTypes();
+	const unsigned short *pInfo = view.NodeInfo();
+	const short *pZones = view.NodeZones();
+	const unsigned short *pNumLinks = view.NodeNumLinks();
+
 	int node;
 	for ( node = 0; node < numNodes; node++)
 	{
-		Vector origin;
-		float yaw;
-		origin.x = buf.GetFloat();
-		origin.y = buf.GetFloat();
-		origin.z = buf.GetFloat();
-		yaw = buf.GetFloat();
-
-		CAI_Node *new_node = m_pNetwork->AddNode( origin, yaw );
+		CAI_Node *new_node = m_pNetwork->AddNode( pOrigins[node], pYaws[node] );
 
-		buf.Get( new_node->m_flVOffset, sizeof(new_node->m_flVOffset) );
-		new_node->m_eNodeType = (NodeType_e)buf.GetChar();
-		if ( IsX360() )
+		for ( int hull = 0; hull < NUM_HULLS; hull++ )
 		{
-			buf.SeekGet( CUtlBuffer::SEEK_CURRENT, 3 );
+			new_node->m_flVOffset[hull] = view.NodeVOffsets( hull )[node];
 		}
-
-		new_node->m_eNodeInfo = buf.GetUnsignedShort();
-		new_node->m_zone = buf.GetShort();
+		new_node->m_eNodeType = (NodeType_e)pTypes[node];
+		new_node->m_eNodeInfo = pInfo[node];
+		new_node->m_zone = pZones[node];
+		new_node->m_Links.EnsureCapacity( pNumLinks[node] );
 	}
 
 	// -------------------------------
-	// Load all the links to the fild
+	// Load all the links from the file
 	// -------------------------------
-	int totalNumLinks = buf.GetInt();
+	int totalNumLinks = view.NumLinks();
+	const short *pSrcIds = view.LinkSrcIds();
+	const short *pDestIds = view.LinkDestIds();
+
+	m_pNetwork->ReserveLinks( totalNumLinks );
 
 	for (int link = 0; link < totalNumLinks; link++)
 	{
-		int srcID, destID;
-
-		srcID = buf.GetShort();
-		destID = buf.GetShort();
-
-		CAI_Link *pLink = m_pNetwork->CreateLink( srcID, destID );;
-
-		byte ignored[NUM_HULLS];
-		byte *pDest = ( pLink ) ? &pLink->m_iAcceptedMoveTypes[0] : &ignored[0];
-		buf.Get( pDest, sizeof(ignored) );
+		CAI_Link *pLink = m_pNetwork->CreateLink( pSrcIds[link], pDestIds[link] );
+		if ( pLink )
+		{
+			for ( int hull = 0; hull < NUM_HULLS; hull++ )
+			{
+				pLink->m_iAcceptedMoveTypes[hull] = view.LinkMoveTypes( hull )[link];
+			}
+		}
 	}
 
 	// -------------------------------
@@ -679,9 +693,10 @@ void CAI_NetworkManager::LoadNetworkGraph( void )
 	GetEditOps()->m_pNodeIndexTable	= new int[MAX( m_pNetwork->m_iNumNodes, 1 )];
 	memset( GetEditOps()->m_pNodeIndexTable, 0, sizeof( int ) *MAX( m_pNetwork->m_iNumNodes, 1 ) );
 
+	const int *pWCIds = view.NodeWCIds();
 	for (node = 0; node < m_pNetwork->m_iNumNodes; node++)
 	{
-		GetEditOps()->m_pNodeIndexTable[node] = buf.GetInt();
+		GetEditOps()->m_pNodeIndexTable[node] = pWCIds[node];
 	}
 
 	
@@ -723,6 +738,7 @@ void CAI_NetworkManager::LoadNetworkGraph( void )
 
 	gm_fNetworksLoaded = true;
 	CAI_DynamicLink::gm_bInitialized = false;
+	CAI_Pathfinder::InvalidatePathCache();
 }
 
 /* Keep this around for debugging
@@ -907,6 +923,126 @@ void CAI_NetworkManager::DeleteAllAINetworks(void)
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose:  Reads the out of date .ain for this map so BuildNetworkGraph()
+//			 can keep the parts of it that haven't changed.  Only the graph
+//			 version has to match, the map version is ignored.
+//-----------------------------------------------------------------------------
+
+bool CAI_NetworkManager::LoadPreviousNetworkGraph( void )
+{
+	delete m_pPreviousGraph;
+	m_pPreviousGraph = NULL;
+
+	char szGraphFilename[MAX_PATH];
+	Q_snprintf( szGraphFilename, sizeof( szGraphFilename ), "maps/graphs/%s%s", STRING( gpGlobals->mapname ), IsX360() ? ".360.ain" : ".ain" );
+
+	CUtlBuffer buf;
+	if ( !filesystem->ReadFile( szGraphFilename, "game", buf ) )
+		return false;
+
+	if ( !CAI_NetworkFileView::IsNetworkFile( buf.Base(), buf.TellPut() ) )
+	{
+		CUtlBuffer converted;
+		if ( !AI_ConvertLegacyNetworkFile( buf, converted, AINET_VERSION_NUMBER ) )
+		{
+			DevMsg( "AI node graph %s is too old to rebuild incrementally\n", szGraphFilename );
+			return false;
+		}
+		buf.Swap( converted );
+	}
+
+	CAI_NetworkFileView view;
+	if ( !view.Init( buf.Base(), buf.TellPut() ) || view.Header()->graphVersion != AINET_VERSION_NUMBER || view.NumNodes() > MAX_NODES )
+	{
+		DevMsg( "AI node graph %s is too old to rebuild incrementally\n", szGraphFilename );
+		return false;
+	}
+
+	int numNodes = view.NumNodes();
+	AI_PreviousGraph_t *pPrevious = new AI_PreviousGraph_t;
+	pPrevious->nodes.SetCount( numNodes );
+
+	for ( int node = 0; node < numNodes; node++ )
+	{
+		AI_PreviousGraphNode_t &prevNode = pPrevious->nodes[node];
+		prevNode.vecOrigin = view.NodeOrigins()[node];
+		prevNode.flYaw = view.NodeYaws()[node];
+		for ( int hull = 0; hull < NUM_HULLS; hull++ )
+		{
+			prevNode.flVOffset[hull] = view.NodeVOffsets( hull )[node];
+		}
+		prevNode.nType = view.NodeTypes()[node];
+		prevNode.nInfo = view.NodeInfo()[node];
+		prevNode.nWCNodeID = view.NodeWCIds()[node];
+	}
+
+	pPrevious->links.SetCount( view.NumLinks() );
+	for ( int link = 0; link < view.NumLinks(); link++ )
+	{
+		AI_PreviousGraphLink_t &prevLink = pPrevious->links[link];
+		prevLink.iSrcID = view.LinkSrcIds()[link];
+		prevLink.iDestID = view.LinkDestIds()[link];
+		for ( int hull = 0; hull < NUM_HULLS; hull++ )
+		{
+			prevLink.iAcceptedMoveTypes[hull] = view.LinkMoveTypes( hull )[link];
+		}
+	}
+
+	DevMsg( "Read %d nodes from out of date AI node graph %s\n", numNodes, szGraphFilename );
+	m_pPreviousGraph = pPrevious;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:  Rewrites a graph saved in the old field by field layout, so it
+//			 can be loaded without converting it every time
+//-----------------------------------------------------------------------------
+
+CON_COMMAND( ai_convert_graph, "Converts an old format .ain to the current layout. Arguments: [map name], defaults to the current map" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	const char *pszMapName = ( args.ArgC() > 1 ) ? args[1] : STRING( gpGlobals->mapname );
+	if ( !pszMapName || !pszMapName[0] )
+	{
+		Msg( "Usage: ai_convert_graph <map name>\n" );
+		return;
+	}
+
+	char szGraphFilename[MAX_PATH];
+	Q_snprintf( szGraphFilename, sizeof( szGraphFilename ), "maps/graphs/%s%s", pszMapName, IsX360() ? ".360.ain" : ".ain" );
+
+	CUtlBuffer buf;
+	if ( !filesystem->ReadFile( szGraphFilename, "game", buf ) )
+	{
+		Msg( "Couldn't read %s\n", szGraphFilename );
+		return;
+	}
+
+	if ( CAI_NetworkFileView::IsNetworkFile( buf.Base(), buf.TellPut() ) )
+	{
+		Msg( "%s is already in the current format\n", szGraphFilename );
+		return;
+	}
+
+	CUtlBuffer converted;
+	if ( !AI_ConvertLegacyNetworkFile( buf, converted, AINET_VERSION_NUMBER ) )
+	{
+		Msg( "%s is out of date and has to be rebuilt\n", szGraphFilename );
+		return;
+	}
+
+	if ( !filesystem->WriteFile( szGraphFilename, "DEFAULT_WRITE_PATH", converted ) )
+	{
+		Msg( "Couldn't write %s\n", szGraphFilename );
+		return;
+	}
+
+	Msg( "Converted %s (%d bytes, was %d)\n", szGraphFilename, converted.TellPut(), buf.TellPut() );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose:  Only called if network has changed since last time level
 //			 was loaded
@@ -918,7 +1054,17 @@ void CAI_NetworkManager::BuildNetworkGraph( void )
 		return;
 
 	CAI_DynamicLink::gm_bInitialized = false;
-	g_AINetworkBuilder.Build( m_pNetwork );
+	if ( m_pPreviousGraph )
+	{
+		g_AINetworkBuilder.BuildIncremental( m_pNetwork, *m_pPreviousGraph );
+		delete m_pPreviousGraph;
+		m_pPreviousGraph = NULL;
+	}
+	else
+	{
+		g_AINetworkBuilder.Build( m_pNetwork );
+	}
+	CAI_Pathfinder::InvalidatePathCache();
 
 	// If I'm loading for the first time save.  Otherwise I'm 
 	// doing a wc edit and I don't want to save
@@ -955,6 +1101,10 @@ void CAI_NetworkManager::InitializeAINetworks()
 			CAI_BaseNPC::m_nDebugBits &= ~bits_debugDisableAI;
 		}
 	}
+	else if ( ai_rebuildgraph_incremental.GetBool() && !engine->IsInEditMode() && g_pGameRules->FAllowNPCs() )
+	{
+		pNetwork->LoadPreviousNetworkGraph();
+	}
 
 #ifdef MAPBASE_VSCRIPT
 	if (g_pScriptVM)
@@ -1245,10 +1395,25 @@ int CAI_NetworkEditTools::GetNodeIdFromWCId( int nWCId )
 		return -1;
 	}
 
+	// Hints and dynamic links look up every node they refer to as they are
+	// restored, so keep a reverse map rather than scanning the table each time
+	if ( m_pWCIdMapTable != m_pNodeIndexTable || m_nWCIdMapNodes != m_pNetwork->NumNodes() )
+	{
+		BuildWCIdMap();
+	}
+
+	int iMap = m_WCIdToNodeId.Find( nWCId );
+	if ( iMap != m_WCIdToNodeId.InvalidIndex() && m_pNodeIndexTable[ m_WCIdToNodeId[iMap] ] == nWCId )
+	{
+		return m_WCIdToNodeId[iMap];
+	}
+
+	// The table may have been edited since the map was built
 	for (int i=0;i<m_pNetwork->NumNodes();i++)
 	{
 		if (m_pNodeIndexTable[i] == nWCId)
 		{
+			m_WCIdToNodeId.InsertOrReplace( nWCId, i );
 			return i;
 		}
 	}
@@ -1257,6 +1422,21 @@ int CAI_NetworkEditTools::GetNodeIdFromWCId( int nWCId )
 
 //-----------------------------------------------------------------------------
 
+void CAI_NetworkEditTools::BuildWCIdMap()
+{
+	m_WCIdToNodeId.RemoveAll();
+	m_pWCIdMapTable = m_pNodeIndexTable;
+	m_nWCIdMapNodes = m_pNetwork->NumNodes();
+
+	// Walk backwards so the first node bound to an id wins, as in a forward search
+	for ( int i = m_nWCIdMapNodes - 1; i >= 0; i-- )
+	{
+		m_WCIdToNodeId.InsertOrReplace( m_pNodeIndexTable[i], i );
+	}
+}
+
+//-----------------------------------------------------------------------------
+
 int CAI_NetworkEditTools::GetWCIdFromNodeId( int nNodeId )
 {
 	if ( nNodeId == -1 || nNodeId >= m_pNetwork->NumNodes() )
@@ -2053,6 +2233,10 @@ CAI_NetworkEditTools::CAI_NetworkEditTools(CAI_NetworkManager *pNetworkManager)
 	m_pNetwork = pNetworkManager->GetNetwork(); // @tbd
 	m_pManager = pNetworkManager;
 
+	SetDefLessFunc( m_WCIdToNodeId );
+	m_pWCIdMapTable		= NULL;
+	m_nWCIdMapNodes		= 0;
+
 	
 }
 
@@ -2213,6 +2397,7 @@ void CAI_NetworkBuilder::Rebuild( CAI_Network *pNetwork )
 	{
 		m_NeighborsTable[i].Resize( nNodes );
 	}
+	InitVisibilityTraces( pNetwork, true );
 	for (i = 0; i < nNodes; i++)
 	{
 		// If near point of change recalculate
@@ -2263,6 +2448,8 @@ void CAI_NetworkBuilder::EndBuild()
 {
 	m_NeighborsTable.SetSize(0);
 	m_DidSetNeighborsTable.Resize(0);
+	m_VisibilityTable.SetSize(0);
+	m_TracedVisibilityTable.SetSize(0);
 	CAI_TestHull::ReturnTestHull();
 }
 
@@ -2321,6 +2508,10 @@ void CAI_NetworkBuilder::Build( CAI_Network *pNetwork )
 		m_NeighborsTable[i].Resize( nNodes );
 		m_NeighborsTable[i].ClearAll();
 	}
+	InitVisibilityTraces( pNetwork, false );
+	timer.End();
+	DevMsg( "...done tracing node visibility. %f seconds\n", timer.GetDuration().GetSeconds() );
+	timer.Start();
 	for (i = 0; i < nNodes; i++)
 	{	
 		InitNeighbors( pNetwork, ppNodes[i] );
@@ -2373,6 +2564,238 @@ void CAI_NetworkBuilder::Build( CAI_Network *pNetwork )
 		UTIL_Remove( pHelper );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose:  Builds the network reusing an out of date graph.  Nodes that are
+//			 unchanged since the old graph was saved keep their links, only
+//			 nodes within link range of an added, removed or edited node are
+//			 rebuilt.
+//-----------------------------------------------------------------------------
+
+static bool NodeMatchesPrevious( CAI_Node *pNode, const AI_PreviousGraphNode_t &prevNode )
+{
+	// Climb nodes spawn their dismount nodes while positioning, which have no WC id
+	if ( pNode->GetType() == NODE_CLIMB || pNode->GetType() != prevNode.nType )
+		return false;
+
+	if ( pNode->GetOrigin() != prevNode.vecOrigin || pNode->GetYaw() != prevNode.flYaw )
+		return false;
+
+	if ( ( pNode->m_eNodeInfo & 0xFFFF ) != prevNode.nInfo )
+		return false;
+
+	return ( memcmp( pNode->m_flVOffset, prevNode.flVOffset, sizeof(prevNode.flVOffset) ) == 0 );
+}
+
+void CAI_NetworkBuilder::BuildIncremental( CAI_Network *pNetwork, const AI_PreviousGraph_t &previous )
+{
+	int nNodes = pNetwork->NumNodes();
+	CAI_Node **ppNodes = pNetwork->AccessNodes();
+
+	if ( !nNodes )
+		return;
+
+	int *pNodeIndexTable = g_pAINetworkManager->GetEditOps()->m_pNodeIndexTable;
+	if ( !pNodeIndexTable )
+	{
+		Build( pNetwork );
+		return;
+	}
+
+	CAI_NetworkBuildHelper *pHelper = (CAI_NetworkBuildHelper *)CreateEntityByName( "ai_network_build_helper" );
+
+	VPROF( "AINet" );
+
+	BeginBuild();
+
+	CFastTimer masterTimer;
+	CFastTimer timer;
+	
+	DevMsg( "Incrementally building AI node graph...\n");
+	masterTimer.Start();
+
+	// ---------------------------
+	// Initialize node positions
+	// ---------------------------
+	DevMsg( "Initializing node positions...\n" );
+	timer.Start();
+	int i;
+	for ( i = 0; i < nNodes; i++)
+	{
+		InitNodePosition( pNetwork, ppNodes[i] );
+		if ( pHelper )
+			pHelper->PostInitNodePosition( pNetwork, ppNodes[i] );
+	}
+	nNodes = pNetwork->NumNodes(); // InitNodePosition can create nodes
+	timer.End();
+	DevMsg( "...done initializing node positions. %f seconds\n", timer.GetDuration().GetSeconds() );
+
+	// ---------------------------------------------------------------
+	// Match nodes up with the previous graph by WC id.  Anything that
+	// doesn't match marks the nodes around it as having to be rebuilt
+	// ---------------------------------------------------------------
+	DevMsg( "Matching nodes with previous graph...\n" );
+	timer.Start();
+
+	CUtlMap<int, int> previousByWCId;
+	SetDefLessFunc( previousByWCId );
+	for ( i = 0; i < previous.nodes.Count(); i++ )
+	{
+		int wcID = previous.nodes[i].nWCNodeID;
+		if ( wcID == NO_NODE )
+			continue;
+
+		int iMap = previousByWCId.Find( wcID );
+		if ( iMap == previousByWCId.InvalidIndex() )
+			previousByWCId.Insert( wcID, i );
+		else
+			previousByWCId[iMap] = NO_NODE; // ambiguous, treat as changed
+	}
+
+	CUtlVector<int> previousToNew;
+	previousToNew.SetCount( previous.nodes.Count() );
+	for ( i = 0; i < previousToNew.Count(); i++ )
+	{
+		previousToNew[i] = NO_NODE;
+	}
+
+	CUtlVector<Vector> changedPositions;
+	for ( i = 0; i < nNodes; i++ )
+	{
+		ppNodes[i]->ClearNeedsRebuild();
+
+		int iPrevious = NO_NODE;
+		int wcID = ( i < MAX_NODES ) ? pNodeIndexTable[i] : NO_NODE;
+		if ( wcID != NO_NODE )
+		{
+			int iMap = previousByWCId.Find( wcID );
+			if ( iMap != previousByWCId.InvalidIndex() )
+				iPrevious = previousByWCId[iMap];
+		}
+
+		if ( iPrevious != NO_NODE && previousToNew[iPrevious] == NO_NODE && NodeMatchesPrevious( ppNodes[i], previous.nodes[iPrevious] ) )
+		{
+			previousToNew[iPrevious] = i;
+		}
+		else
+		{
+			changedPositions.AddToTail( ppNodes[i]->GetOrigin() );
+		}
+	}
+
+	// Removed or moved nodes leave a hole the nodes around their old position have to fill
+	for ( i = 0; i < previousToNew.Count(); i++ )
+	{
+		if ( previousToNew[i] == NO_NODE )
+		{
+			changedPositions.AddToTail( previous.nodes[i].vecOrigin );
+		}
+	}
+
+	int nRebuild = 0;
+	for ( i = 0; i < nNodes; i++ )
+	{
+		float flMaxDistSqr = ( ppNodes[i]->GetType() == NODE_AIR ) ? MAX_AIR_NODE_LINK_DIST_SQ : MAX_NODE_LINK_DIST_SQ;
+		for ( int j = 0; j < changedPositions.Count(); j++ )
+		{
+			if ( ( ppNodes[i]->GetOrigin() - changedPositions[j] ).LengthSqr() < flMaxDistSqr )
+			{
+				ppNodes[i]->SetNeedsRebuild();
+				nRebuild++;
+				break;
+			}
+		}
+	}
+
+	// ---------------------------------------------
+	// Keep the links between nodes that aren't rebuilt
+	// ---------------------------------------------
+	for ( i = 0; i < nNodes; i++ )
+	{
+		ppNodes[i]->ClearLinks();
+	}
+
+	int nKeptLinks = 0;
+	for ( i = 0; i < previous.links.Count(); i++ )
+	{
+		const AI_PreviousGraphLink_t &prevLink = previous.links[i];
+		if ( !previous.nodes.IsValidIndex( prevLink.iSrcID ) || !previous.nodes.IsValidIndex( prevLink.iDestID ) )
+			continue;
+
+		int iSrc = previousToNew[prevLink.iSrcID];
+		int iDest = previousToNew[prevLink.iDestID];
+		if ( iSrc == NO_NODE || iDest == NO_NODE || ppNodes[iSrc]->NeedsRebuild() || ppNodes[iDest]->NeedsRebuild() )
+			continue;
+
+		CAI_Link *pLink = pNetwork->CreateLink( iSrc, iDest );
+		if ( pLink )
+		{
+			memcpy( pLink->m_iAcceptedMoveTypes, prevLink.iAcceptedMoveTypes, sizeof(pLink->m_iAcceptedMoveTypes) );
+			nKeptLinks++;
+		}
+	}
+	timer.End();
+	DevMsg( "...rebuilding %d of %d nodes, kept %d links. %f seconds\n", nRebuild, nNodes, nKeptLinks, timer.GetDuration().GetSeconds() );
+
+	// ---------------------------
+	// Initialize node neighbors
+	// ---------------------------
+	DevMsg( "Initializing node neighbors...\n" );
+	timer.Start();
+	m_DidSetNeighborsTable.Resize( nNodes );
+	m_DidSetNeighborsTable.ClearAll();
+	m_NeighborsTable.SetSize( nNodes );
+	for (i = 0; i < nNodes; i++)
+	{
+		m_NeighborsTable[i].Resize( nNodes );
+		m_NeighborsTable[i].ClearAll();
+	}
+	InitVisibilityTraces( pNetwork, true );
+	for (i = 0; i < nNodes; i++)
+	{
+		if (ppNodes[i]->NeedsRebuild())
+		{
+			InitNeighbors( pNetwork, ppNodes[i] );
+		}
+	}
+	ForceDynamicLinkNeighbors();
+	timer.End();
+	DevMsg( "...done initializing node neighbors. %f seconds\n", timer.GetDuration().GetSeconds() );
+
+	// ---------------------------
+	// Initialize accepted hulls
+	// ---------------------------
+	DevMsg( "Determining links...\n" );
+	timer.Start();
+	for (i = 0; i < nNodes; i++)
+	{	
+		if (ppNodes[i]->NeedsRebuild())
+		{
+			InitLinks( pNetwork, ppNodes[i] );
+		}
+	}
+	timer.End();
+	DevMsg( "...done determining links. %f seconds\n", timer.GetDuration().GetSeconds() );
+
+	// ------------------------------------------------------------
+	// Zones are a flood fill over the links, which is cheap enough
+	// to always redo for the whole graph
+	// ------------------------------------------------------------
+	for (i = 0; i < nNodes; i++)
+	{
+		ppNodes[i]->ClearNeedsRebuild();
+	}
+	InitZones( pNetwork );
+	masterTimer.End();
+	DevMsg( "...done building AI node graph, %f seconds\n", masterTimer.GetDuration().GetSeconds() );
+
+	g_pAINetworkManager->FixupHints();
+
+	EndBuild();
+
+	if ( pHelper )
+		UTIL_Remove( pHelper );
+}
+
 //------------------------------------------------------------------------------
 // Purpose : Forces testing of a connection between src and dest IDs for all dynamic links
 //			 	
@@ -2651,6 +3074,140 @@ void CAI_NetworkBuilder::InitNodePosition(CAI_Network *pNetwork, CAI_Node *pNode
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Line of sight test between two nodes used to pick candidate
+//			neighbors. Safe to call from the job threads.
+//-----------------------------------------------------------------------------
+bool CAI_NetworkBuilder::TestVisibility( const Vector &srcPos, const Vector &destPos )
+{
+	trace_t	tr;
+	tr.m_pEnt = NULL;
+
+	// Try several line of sight checks
+
+	// ------------------
+	//  Bottom to bottom
+	// ------------------
+	AI_TraceLine ( srcPos, destPos,MASK_NPCWORLDSTATIC,NULL,COLLISION_GROUP_NONE, &tr );
+	if (!tr.startsolid && tr.fraction == 1.0)
+		return true;
+
+	// ------------------
+	//  Top to top
+	// ------------------
+	AI_TraceLine ( srcPos + Vector( 0, 0, 70 ),destPos + Vector( 0, 0, 70 ),MASK_NPCWORLDSTATIC,NULL,COLLISION_GROUP_NONE, &tr );
+	if (!tr.startsolid && tr.fraction == 1.0)
+		return true;
+
+	// ------------------
+	//  Top to Bottom
+	// ------------------
+	AI_TraceLine ( srcPos + Vector( 0, 0, 70 ),destPos,MASK_NPCWORLDSTATIC,NULL,COLLISION_GROUP_NONE, &tr );
+	if (!tr.startsolid && tr.fraction == 1.0)
+		return true;
+
+	// ------------------
+	//  Bottom to Top
+	// ------------------
+	AI_TraceLine ( srcPos,destPos + Vector( 0, 0, 70 ),MASK_NPCWORLDSTATIC,NULL,COLLISION_GROUP_NONE, &tr );
+	if (!tr.startsolid && tr.fraction == 1.0)
+		return true;
+
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs the visibility traces InitVisibility() is going to need across
+//			the job pool. Each job only writes its own node's rows, and nothing
+//			in the network is modified until they're all done, so the results
+//			don't depend on the number of threads.
+//
+//			This traces a superset of the pairs InitVisibility() asks for: it
+//			can't know which nodes will be deleted as duplicates along the way.
+//			Pairs it skipped are traced on demand.
+//-----------------------------------------------------------------------------
+void CAI_NetworkBuilder::InitVisibilityTraces( CAI_Network *pNetwork, bool bRebuildOnly )
+{
+	int nNodes = pNetwork->NumNodes();
+
+	m_VisibilityTable.SetSize( nNodes );
+	m_TracedVisibilityTable.SetSize( nNodes );
+
+	CUtlVector<int> nodesToTrace;
+	for ( int i = 0; i < nNodes; i++ )
+	{
+		m_VisibilityTable[i].Resize( nNodes );
+		m_VisibilityTable[i].ClearAll();
+		m_TracedVisibilityTable[i].Resize( nNodes );
+		m_TracedVisibilityTable[i].ClearAll();
+
+		if ( !bRebuildOnly || pNetwork->GetNode( i )->NeedsRebuild() )
+		{
+			nodesToTrace.AddToTail( i );
+		}
+	}
+
+	m_pTracingNetwork = pNetwork;
+	m_bTracingRebuildOnly = bRebuildOnly;
+
+	int nMaxJobs = ai_network_build_threads.GetInt();
+	if ( nMaxJobs == 0 )
+	{
+		for ( int i = 0; i < nodesToTrace.Count(); i++ )
+		{
+			TraceNodeVisibility( nodesToTrace[i] );
+		}
+	}
+	else
+	{
+		typedef void (CAI_NetworkBuilder::*NoItemFunc_t)();
+		ParallelProcess( "CAI_NetworkBuilder::InitVisibilityTraces", nodesToTrace.Base(), nodesToTrace.Count(), this, &CAI_NetworkBuilder::TraceNodeVisibility, (NoItemFunc_t)NULL, (NoItemFunc_t)NULL, ( nMaxJobs < 0 ) ? INT_MAX : nMaxJobs );
+	}
+
+	m_pTracingNetwork = NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Job for InitVisibilityTraces(), traces from one node to each node
+//			InitVisibility() could test it against.
+//-----------------------------------------------------------------------------
+void CAI_NetworkBuilder::TraceNodeVisibility( int &iNode )
+{
+	CAI_Network *pNetwork = m_pTracingNetwork;
+	CAI_Node *pNode = pNetwork->GetNode( iNode );
+
+	if ( pNode->GetType() == NODE_DELETED )
+		return;
+
+	Vector srcPos = pNode->GetPosition(HULL_SMALL_CENTERED);
+
+	for ( int testnode = 0; testnode < pNetwork->NumNodes(); testnode++ )
+	{
+		CAI_Node *testNode = pNetwork->GetNode( testnode );
+
+		if ( testnode == iNode || testNode->GetType() == NODE_DELETED )
+			continue;
+
+		// Duplicates are never traced
+		if ( testNode->GetOrigin() == pNode->GetOrigin() && testNode->GetType() != NODE_CLIMB )
+			continue;
+
+		// Nodes handled earlier give us their result instead
+		if ( testnode < iNode && ( !m_bTracingRebuildOnly || testNode->NeedsRebuild() ) )
+			continue;
+
+		float flDistToCheckNode = ( testNode->GetOrigin() - pNode->GetOrigin() ).LengthSqr(); 
+		if ( flDistToCheckNode > ( ( testNode->GetType() == NODE_AIR ) ? MAX_AIR_NODE_LINK_DIST_SQ : MAX_NODE_LINK_DIST_SQ ) )
+			continue;
+
+		if ( TestVisibility( srcPos, testNode->GetPosition(HULL_SMALL_CENTERED) ) )
+		{
+			m_VisibilityTable[iNode].Set( testnode );
+		}
+		m_TracedVisibilityTable[iNode].Set( testnode );
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Set the visibility for this node.  (What nodes it can see with a
 //			line trace)
@@ -2723,61 +3280,15 @@ void CAI_NetworkBuilder::InitVisibility(CAI_Network *pNetwork, CAI_Node *pNode)
 				continue;
 		}
 
-		// The actual position of some nodes may be inside geometry as they have
-		// hull specific position offsets (e.g. climb nodes).  Get the hull specific 
-		// position using the smallest hull to make sure were not in geometry
-		Vector destPos = pNetwork->GetNode( testnode )->GetPosition(HULL_SMALL_CENTERED);
-
-		trace_t	tr;
-		tr.m_pEnt = NULL;
-
-		// Try several line of sight checks
-
-		bool isVisible = false;
-
-		// ------------------
-		//  Bottom to bottom
-		// ------------------
-		AI_TraceLine ( srcPos, destPos,MASK_NPCWORLDSTATIC,NULL,COLLISION_GROUP_NONE, &tr );
-		if (!tr.startsolid && tr.fraction == 1.0)
-		{
-			isVisible = true;
-		}
-
-		// ------------------
-		//  Top to top
-		// ------------------
-		if (!isVisible)
+		// Normally traced ahead of time by InitVisibilityTraces()
+		bool isVisible;
+		if ( m_TracedVisibilityTable.Count() > pNode->m_iID && m_TracedVisibilityTable[pNode->m_iID].IsBitSet( testnode ) )
 		{
-			AI_TraceLine ( srcPos + Vector( 0, 0, 70 ),destPos + Vector( 0, 0, 70 ),MASK_NPCWORLDSTATIC,NULL,COLLISION_GROUP_NONE, &tr );
-			if (!tr.startsolid && tr.fraction == 1.0)
-			{	
-				isVisible = true;
-			}
+			isVisible = m_VisibilityTable[pNode->m_iID].IsBitSet( testnode );
 		}
-
-		// ------------------
-		//  Top to Bottom
-		// ------------------
-		if (!isVisible)
-		{
-			AI_TraceLine ( srcPos + Vector( 0, 0, 70 ),destPos,MASK_NPCWORLDSTATIC,NULL,COLLISION_GROUP_NONE, &tr );
-			if (!tr.startsolid && tr.fraction == 1.0)
-			{	
-				isVisible = true;
-			}
-		}
-
-		// ------------------
-		//  Bottom to Top
-		// ------------------
-		if (!isVisible)
+		else
 		{
-			AI_TraceLine ( srcPos,destPos + Vector( 0, 0, 70 ),MASK_NPCWORLDSTATIC,NULL,COLLISION_GROUP_NONE, &tr );
-			if (!tr.startsolid && tr.fraction == 1.0)
-			{	
-				isVisible = true;
-			}
+			isVisible = TestVisibility( srcPos, testNode->GetPosition(HULL_SMALL_CENTERED) );
 		}
 
 		// ------------------
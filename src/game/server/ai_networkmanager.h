@@ -8,6 +8,7 @@
 #define AI_NETWORKMANAGER_H
 
 #include "utlvector.h"
+#include "utlmap.h"
 #include "bitstring.h"
 
 #if defined( _WIN32 )
@@ -19,6 +20,7 @@ class CAI_Network;
 class CAI_Node;
 class CAI_Link;
 class CAI_TestHull;
+struct AI_PreviousGraph_t;
 
 //-----------------------------------------------------------------------------
 // CAI_NetworkManager
@@ -67,6 +69,7 @@ private:
 	void			DelayedInit();
 	void			RebuildThink();
 	void			SaveNetworkGraph( void) ;	
+	bool			LoadPreviousNetworkGraph();
 	static bool		IsAIFileCurrent( const char *szMapName );		
 	
 	static bool				gm_fNetworksLoaded;							// Have AINetworks been loaded
@@ -74,6 +77,7 @@ private:
 	bool					m_bNeedGraphRebuild;					
 	CAI_NetworkEditTools *	m_pEditOps;
 	CAI_Network *			m_pNetwork;
+	AI_PreviousGraph_t *	m_pPreviousGraph;						// Out of date graph used for incremental builds
 
 
 	bool m_fInitalized;
@@ -97,12 +101,16 @@ class CAI_NetworkBuilder
 public:
 	void			Build( CAI_Network *pNetwork );
 	void			Rebuild( CAI_Network *pNetwork );
+	void			BuildIncremental( CAI_Network *pNetwork, const AI_PreviousGraph_t &previous );
 
 	void			InitNodePosition( CAI_Network *pNetwork, CAI_Node *pNode );
 
 	void			InitZones( CAI_Network *pNetwork );
 
 private:
+	void			InitVisibilityTraces( CAI_Network *pNetwork, bool bRebuildOnly );
+	void			TraceNodeVisibility( int &iNode );
+	static bool		TestVisibility( const Vector &srcPos, const Vector &destPos );
 	void			InitVisibility( CAI_Network *pNetwork, CAI_Node *pNode );
 	void			InitNeighbors( CAI_Network *pNetwork, CAI_Node *pNode );
 	void			InitClimbNodePosition( CAI_Network *pNetwork, CAI_Node *pNode );
@@ -120,6 +128,12 @@ private:
 	CUtlVector<CVarBitVec>	m_NeighborsTable;
 	CVarBitVec				m_DidSetNeighborsTable;
 	CAI_TestHull *			m_pTestHull;
+
+	// Precomputed line of sight results, see InitVisibilityTraces()
+	CUtlVector<CVarBitVec>	m_VisibilityTable;
+	CUtlVector<CVarBitVec>	m_TracedVisibilityTable;
+	CAI_Network *			m_pTracingNetwork;
+	bool					m_bTracingRebuildOnly;
 };
 
 extern CAI_NetworkBuilder g_AINetworkBuilder;
@@ -191,7 +205,12 @@ public:
 	CAI_NetworkManager *m_pManager;
 	CAI_Network *		m_pNetwork;
 
-
+	// Reverse of m_pNodeIndexTable for GetNodeIdFromWCId(). The table is
+	// written directly, so entries are checked against it before use.
+	void				BuildWCIdMap();
+	CUtlMap<int, int>	m_WCIdToNodeId;
+	int *				m_pWCIdMapTable;						// m_pNodeIndexTable when the map was built
+	int					m_nWCIdMapNodes;
 };
 
 //-----------------------------------------------------------------------------
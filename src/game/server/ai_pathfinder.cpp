@@ -249,6 +249,7 @@ bool CAI_Pathfinder::IsLinkStillStale(int moveType, CAI_Link *nodeLink)
 		GetNetwork()->GetNode(nodeLink->m_iDestID)->GetPosition(GetHullType()), moveType))
 	{
 		nodeLink->m_LinkInfo &= ~bits_LINK_STALE_SUGGESTED;
+		InvalidatePathCache();
 		return false;
 	}
 
@@ -272,6 +273,248 @@ int CAI_Pathfinder::NearestNodeToPoint( const Vector &vecOrigin )
 	return GetNetwork()->NearestNodeToPoint( GetOuter(), vecOrigin );
 }
 
+ConVar ai_path_cache( "ai_path_cache", "1", FCVAR_NONE, "Reuse node paths found for other NPCs of the same class, hull and capabilities" );
+ConVar ai_path_cache_lifetime( "ai_path_cache_lifetime", "1.0", FCVAR_NONE, "Seconds a cached node path can be reused" );
+
+//-----------------------------------------------------------------------------
+// Scratch space for FindBestPath, one per thread and reused between searches.
+// A node's entries only mean something while its stamp matches the current
+// search, so nothing is cleared between searches.  The open list is an
+// indexed binary heap on F, with ties going to the lower node id.
+//-----------------------------------------------------------------------------
+
+class CAI_PathfindContext
+{
+public:
+	CAI_PathfindContext() : m_iSearch( 0 ) {}
+
+	void BeginSearch( int nNodes )
+	{
+		if ( m_Stamp.Count() < nNodes )
+		{
+			int nOld = m_Stamp.Count();
+			m_Stamp.SetCount( nNodes );
+			for ( int i = nOld; i < nNodes; i++ )
+			{
+				m_Stamp[i] = 0;
+			}
+			m_PosX.SetCount( nNodes );
+			m_PosY.SetCount( nNodes );
+			m_PosZ.SetCount( nNodes );
+			m_G.SetCount( nNodes );
+			m_F.SetCount( nNodes );
+			m_Parent.SetCount( nNodes );
+			m_HeapIndex.SetCount( nNodes );
+		}
+
+		m_Heap.RemoveAll();
+
+		if ( ++m_iSearch == 0 )
+		{
+			// Wrapped, stamps from old searches could match again
+			memset( m_Stamp.Base(), 0, m_Stamp.Count() * sizeof(unsigned) );
+			m_iSearch = 1;
+		}
+	}
+
+	bool IsVisited( int node ) const	{ return ( m_Stamp[node] == m_iSearch ); }
+
+	void Visit( int node, const Vector &position )
+	{
+		m_Stamp[node] = m_iSearch;
+		m_PosX[node] = position.x;
+		m_PosY[node] = position.y;
+		m_PosZ[node] = position.z;
+		m_G[node] = FLT_MAX;
+		m_Parent[node] = NO_NODE;
+		m_HeapIndex[node] = -1;
+	}
+
+	Vector Position( int node ) const	{ return Vector( m_PosX[node], m_PosY[node], m_PosZ[node] ); }
+
+	bool HasOpen() const				{ return ( m_Heap.Count() != 0 ); }
+
+	void Open( int node )
+	{
+		if ( m_HeapIndex[node] == -1 )
+		{
+			m_HeapIndex[node] = m_Heap.AddToTail( node );
+		}
+		SiftUp( m_HeapIndex[node] );
+		SiftDown( m_HeapIndex[node] );
+	}
+
+	int PopOpen()
+	{
+		int node = m_Heap[0];
+		int last = m_Heap.Count() - 1;
+		Swap( 0, last );
+		m_Heap.RemoveMultipleFromTail( 1 );
+		m_HeapIndex[node] = -1;
+		if ( m_Heap.Count() )
+		{
+			SiftDown( 0 );
+		}
+		return node;
+	}
+
+	CUtlVector<float>	m_G;
+	CUtlVector<float>	m_F;
+	CUtlVector<int>		m_Parent;
+
+private:
+	bool Less( int nodeA, int nodeB ) const
+	{
+		return ( m_F[nodeA] < m_F[nodeB] || ( m_F[nodeA] == m_F[nodeB] && nodeA < nodeB ) );
+	}
+
+	void Swap( int i, int j )
+	{
+		int nodeI = m_Heap[i];
+		int nodeJ = m_Heap[j];
+		m_Heap[i] = nodeJ;
+		m_Heap[j] = nodeI;
+		m_HeapIndex[nodeJ] = i;
+		m_HeapIndex[nodeI] = j;
+	}
+
+	void SiftUp( int i )
+	{
+		while ( i > 0 )
+		{
+			int parent = ( i - 1 ) / 2;
+			if ( !Less( m_Heap[i], m_Heap[parent] ) )
+				break;
+			Swap( i, parent );
+			i = parent;
+		}
+	}
+
+	void SiftDown( int i )
+	{
+		int count = m_Heap.Count();
+		for ( ;; )
+		{
+			int child = 2 * i + 1;
+			if ( child >= count )
+				break;
+			if ( child + 1 < count && Less( m_Heap[child + 1], m_Heap[child] ) )
+				child++;
+			if ( !Less( m_Heap[child], m_Heap[i] ) )
+				break;
+			Swap( i, child );
+			i = child;
+		}
+	}
+
+	unsigned			m_iSearch;
+	CUtlVector<unsigned> m_Stamp;
+	CUtlVector<float>	m_PosX;
+	CUtlVector<float>	m_PosY;
+	CUtlVector<float>	m_PosZ;
+	CUtlVector<int>		m_HeapIndex;
+	CUtlVector<int>		m_Heap;
+};
+
+static CThreadLocalPtr<CAI_PathfindContext> s_pPathfindContext;
+
+static CAI_PathfindContext *GetPathfindContext()
+{
+	if ( !s_pPathfindContext )
+	{
+		s_pPathfindContext = new CAI_PathfindContext;
+	}
+	return s_pPathfindContext;
+}
+
+//-----------------------------------------------------------------------------
+// Node paths found by FindBestPath.  Squads tend to path between the same
+// nodes at the same time, so a path is reused for another NPC of the same
+// class, hull and capabilities after checking every node and link on it is
+// still usable by that NPC.  Anything that changes link state calls
+// InvalidatePathCache().
+//-----------------------------------------------------------------------------
+
+#define AI_PATH_CACHE_SIZE 256
+
+struct AI_CachedPath_t
+{
+	CAI_Network *	pNetwork;
+	int				startID;
+	int				endID;
+	int				hull;
+	int				capabilities;
+	string_t		iszClassname;
+	int				iSerial;
+	float			flExpireTime;
+	CUtlVector<short> nodes;			// start to end
+};
+
+static AI_CachedPath_t	g_AIPathCache[AI_PATH_CACHE_SIZE];
+static CThreadFastMutex	g_AIPathCacheMutex;
+static CInterlockedInt	g_iAIPathCacheSerial;
+
+static int AIPathCacheSlot( int startID, int endID, int hull, int capabilities )
+{
+	unsigned hash = ( (unsigned)startID * 2654435761u ) ^ ( (unsigned)endID * 40503u ) ^ ( (unsigned)hull << 24 ) ^ (unsigned)capabilities;
+	return ( hash >> 8 ) % AI_PATH_CACHE_SIZE;
+}
+
+void CAI_Pathfinder::InvalidatePathCache()
+{
+	++g_iAIPathCacheSerial;
+}
+
+//-----------------------------------------------------------------------------
+
+bool CAI_Pathfinder::GetCachedPath( int startID, int endID, CUtlVector<short> &nodes )
+{
+	if ( !ai_path_cache.GetBool() )
+		return false;
+
+	int slot = AIPathCacheSlot( startID, endID, GetHullType(), CapabilitiesGet() );
+
+	AUTO_LOCK( g_AIPathCacheMutex );
+	const AI_CachedPath_t &cached = g_AIPathCache[slot];
+	if ( cached.pNetwork != GetNetwork() || cached.startID != startID || cached.endID != endID ||
+		 cached.hull != GetHullType() || cached.capabilities != CapabilitiesGet() ||
+		 cached.iszClassname != GetOuter()->m_iClassname || cached.iSerial != g_iAIPathCacheSerial ||
+		 cached.flExpireTime < gpGlobals->curtime )
+	{
+		return false;
+	}
+
+	nodes.CopyArray( cached.nodes.Base(), cached.nodes.Count() );
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_Pathfinder::CachePath( int startID, int endID, const int *parentArray )
+{
+	if ( !ai_path_cache.GetBool() )
+		return;
+
+	int slot = AIPathCacheSlot( startID, endID, GetHullType(), CapabilitiesGet() );
+
+	AUTO_LOCK( g_AIPathCacheMutex );
+	AI_CachedPath_t &cached = g_AIPathCache[slot];
+	cached.pNetwork = GetNetwork();
+	cached.startID = startID;
+	cached.endID = endID;
+	cached.hull = GetHullType();
+	cached.capabilities = CapabilitiesGet();
+	cached.iszClassname = GetOuter()->m_iClassname;
+	cached.iSerial = g_iAIPathCacheSerial;
+	cached.flExpireTime = gpGlobals->curtime + ai_path_cache_lifetime.GetFloat();
+
+	cached.nodes.RemoveAll();
+	for ( int node = endID; node != NO_NODE; node = parentArray[node] )
+	{
+		cached.nodes.AddToHead( node );
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Build a path between two nodes
 //-----------------------------------------------------------------------------
@@ -289,36 +532,49 @@ AI_Waypoint_t *CAI_Pathfinder::FindBestPath(int startID, int endID)
 
 	int nNodes = GetNetwork()->NumNodes();
 	CAI_Node **pAInode = GetNetwork()->AccessNodes();
+	Hull_t hull = GetHullType();
 
-	CVarBitVec	openBS(nNodes);
-	CVarBitVec	closeBS(nNodes);
-
-	// ------------- INITIALIZE ------------------------
-	float* nodeG = (float *)stackalloc( nNodes * sizeof(float) );
-	float* nodeH = (float *)stackalloc( nNodes * sizeof(float) );
-	float* nodeF = (float *)stackalloc( nNodes * sizeof(float) );
-	int*   nodeP = (int *)stackalloc( nNodes * sizeof(int) );		// Node parent 
+	CAI_PathfindContext *pContext = GetPathfindContext();
+	pContext->BeginSearch( nNodes );
 
-	for (int node=0;node<nNodes;node++)
+	// ------------- CACHED PATH -----------------------
+	CUtlVector<short> cachedPath;
+	if ( GetCachedPath( startID, endID, cachedPath ) )
 	{
-		nodeG[node] = FLT_MAX;
-		nodeP[node] = -1;
-	}
+		bool bUsable = !GetOuter()->IsUnusableNode( startID, pAInode[startID]->GetHint() );
+		pContext->Visit( startID, vec3_origin );
+		for ( int i = 1; bUsable && i < cachedPath.Count(); i++ )
+		{
+			int prevID = cachedPath[i - 1];
+			int nodeID = cachedPath[i];
+			CAI_Link *pLink = pAInode[prevID]->HasLink( nodeID );
+
+			// Same tests the search makes of each link and node it passes through
+			bUsable = ( pLink && IsLinkUsable( pLink, prevID ) && !GetOuter()->IsUnusableNode( nodeID, pAInode[nodeID]->GetHint() ) );
+			pContext->Visit( nodeID, vec3_origin );
+			pContext->m_Parent[nodeID] = prevID;
+		}
 
-	nodeG[startID] = 0;
+		if ( bUsable )
+		{
+			return MakeRouteFromParents( pContext->m_Parent.Base(), endID );
+		}
+
+		pContext->BeginSearch( nNodes );
+	}
 
-	nodeH[startID] = 0.1*(pAInode[startID]->GetPosition(GetHullType())-pAInode[endID]->GetPosition(GetHullType())).Length(); // Don't want to over estimate
-	nodeF[startID] = nodeG[startID] + nodeH[startID];
+	// ------------- INITIALIZE ------------------------
+	Vector vecEnd = pAInode[endID]->GetPosition( hull );
+	pContext->Visit( startID, pAInode[startID]->GetPosition( hull ) );
 
-	openBS.Set(startID);
-	closeBS.Set( startID );
+	pContext->m_G[startID] = 0;
+	pContext->m_F[startID] = 0.1*(pContext->Position( startID ) - vecEnd).Length(); // Don't want to over estimate
+	pContext->Open( startID );
 
 	// --------------- FIND BEST PATH ------------------
-	while (!openBS.IsAllClear()) 
+	while ( pContext->HasOpen() ) 
 	{
-		int smallestID = CAI_Network::FindBSSmallest(&openBS,nodeF,nNodes);
-	
-		openBS.Clear(smallestID);
+		int smallestID = pContext->PopOpen();
 
 		CAI_Node *pSmallestNode = pAInode[smallestID];
 		
@@ -327,10 +583,13 @@ AI_Waypoint_t *CAI_Pathfinder::FindBestPath(int startID, int endID)
 
 		if (smallestID == endID) 
 		{
-			AI_Waypoint_t* route = MakeRouteFromParents(&nodeP[0], endID);
+			CachePath( startID, endID, pContext->m_Parent.Base() );
+			AI_Waypoint_t* route = MakeRouteFromParents( pContext->m_Parent.Base(), endID );
 			return route;
 		}
 
+		Vector r1 = pContext->Position( smallestID );
+
 		// Check this if the node is immediately in the path after the startNode 
 		// that it isn't blocked
 		for (int link=0; link < pSmallestNode->NumLinks();link++) 
@@ -341,27 +600,29 @@ AI_Waypoint_t *CAI_Pathfinder::FindBestPath(int startID, int endID)
 				continue;
 
 			// FIXME: the cost function should take into account Node costs (danger, flanking, etc).
-			int moveType = nodeLink->m_iAcceptedMoveTypes[GetHullType()] & CapabilitiesGet();
+			int moveType = nodeLink->m_iAcceptedMoveTypes[hull] & CapabilitiesGet();
 			int testID	 = nodeLink->DestNodeID(smallestID);
 
-			Vector r1 = pSmallestNode->GetPosition(GetHullType());
-			Vector r2 = pAInode[testID]->GetPosition(GetHullType());
+			// Unvisited nodes start out with a G of FLT_MAX
+			if ( !pContext->IsVisited( testID ) )
+			{
+				pContext->Visit( testID, pAInode[testID]->GetPosition( hull ) );
+			}
+
+			Vector r2 = pContext->Position( testID );
 			float dist   = GetOuter()->GetNavigator()->MovementCost( moveType, r1, r2 ); // MovementCost takes ref parameters!!
 
 			if ( dist == FLT_MAX )
 				continue;
 
-			float new_g  = nodeG[smallestID] + dist;
+			float new_g  = pContext->m_G[smallestID] + dist;
 
-			if ( !closeBS.IsBitSet(testID) || (new_g < nodeG[testID]) ) 
+			if ( new_g < pContext->m_G[testID] ) 
 			{
-				nodeP[testID] = smallestID;
-				nodeG[testID] = new_g;
-				nodeH[testID] = (pAInode[testID]->GetPosition(GetHullType())-pAInode[endID]->GetPosition(GetHullType())).Length();
-				nodeF[testID] = nodeG[testID] + nodeH[testID];
-
-				closeBS.Set( testID );
-				openBS.Set( testID );
+				pContext->m_Parent[testID] = smallestID;
+				pContext->m_G[testID] = new_g;
+				pContext->m_F[testID] = new_g + (r2 - vecEnd).Length();
+				pContext->Open( testID );
 			}
 		}
 	}
@@ -69,6 +69,8 @@ public:
 
 	bool			IsLinkUsable(CAI_Link *pLink, int startID);
 
+	static void		InvalidatePathCache();		// Call when link state changes
+
 	// --------------------------------
 	
 	AI_Waypoint_t *BuildRoute( const Vector &vStart, const Vector &vEnd, CBaseEntity *pTarget, float goalTolerance, Navigation_t curNavType = NAV_NONE, bool bLocalSucceedOnWithinTolerance = false );
@@ -117,6 +119,8 @@ private:
 	//---------------------------------
 	
 	AI_Waypoint_t*	MakeRouteFromParents(int *parentArray, int endID);
+	bool			GetCachedPath( int startID, int endID, CUtlVector<short> &nodes );
+	void			CachePath( int startID, int endID, const int *parentArray );
 	AI_Waypoint_t*	CreateNodeWaypoint( Hull_t hullType, int nodeID, int nodeFlags = 0 );
 	
 	AI_Waypoint_t*	BuildRouteThroughPoints( Vector *vecPoints, int nNumPoints, int nDirection, int nStartIndex, int nEndIndex, Navigation_t navType, CBaseEntity *pTarget );
@@ -35,9 +35,17 @@ const float AI_EFFICIENT_NPC_SEARCH_TIME = .35;
 const float AI_HIGH_PRIORITY_SEARCH_TIME = 0.15;
 const float AI_MISC_SEARCH_TIME  = 0.45;
 
+// Sensing grid cells are this wide. Queries are widened by the slack to cover
+// entities that have moved since the grid was built earlier in the frame.
+const float AI_SENSING_GRID_CELL_SIZE = 512;
+const float AI_SENSING_GRID_SLACK = 128;
+
+ConVar ai_sensing_grid( "ai_sensing_grid", "1", 0, "Find the NPCs and objects an NPC might see with a grid rebuilt each frame, rather than checking every one" );
+
 //-----------------------------------------------------------------------------
 
 CAI_SensedObjectsManager g_AI_SensedObjectsManager;
+CAI_SensingGrid g_AI_SensingGrid;
 
 //-----------------------------------------------------------------------------
 
@@ -460,13 +468,33 @@ int CAI_Senses::LookForNPCs( int iDistance )
 
 			CAI_BaseNPC **ppAIs = g_AI_Manager.AccessAIs();
 			
-			for ( i = 0; i < g_AI_Manager.NumAIs(); i++ )
+			if ( ai_sensing_grid.GetBool() )
 			{
-				if ( ppAIs[i] != GetOuter() && ( ppAIs[i]->ShouldNotDistanceCull() || origin.DistToSqr(ppAIs[i]->GetAbsOrigin()) < distSq ) )
+				CUtlVector<int> candidates;
+				g_AI_SensingGrid.QueryNPCs( origin, iDistance, &candidates );
+
+				for ( i = 0; i < candidates.Count(); i++ )
 				{
-					if ( Look( ppAIs[i] ) )
+					CAI_BaseNPC *pAI = ppAIs[candidates[i]];
+					if ( pAI != GetOuter() && ( pAI->ShouldNotDistanceCull() || origin.DistToSqr(pAI->GetAbsOrigin()) < distSq ) )
 					{
-						nSeen++;
+						if ( Look( pAI ) )
+						{
+							nSeen++;
+						}
+					}
+				}
+			}
+			else
+			{
+				for ( i = 0; i < g_AI_Manager.NumAIs(); i++ )
+				{
+					if ( ppAIs[i] != GetOuter() && ( ppAIs[i]->ShouldNotDistanceCull() || origin.DistToSqr(ppAIs[i]->GetAbsOrigin()) < distSq ) )
+					{
+						if ( Look( ppAIs[i] ) )
+						{
+							nSeen++;
+						}
 					}
 				}
 			}
@@ -516,18 +544,38 @@ int CAI_Senses::LookForObjects( int iDistance )
 
 		float distSq = ( iDistance * iDistance );
 		const Vector &origin = GetAbsOrigin();
-		int iter;
-		CBaseEntity *pEnt = g_AI_SensedObjectsManager.GetFirst( &iter );
-		while ( pEnt )
+		if ( ai_sensing_grid.GetBool() )
 		{
-			if ( pEnt->GetFlags() & BOX_QUERY_MASK )
+			CUtlVector<int> candidates;
+			g_AI_SensingGrid.QueryObjects( origin, iDistance, &candidates );
+
+			for ( int i = 0; i < candidates.Count(); i++ )
 			{
-				if ( origin.DistToSqr(pEnt->GetAbsOrigin()) < distSq && Look( pEnt) )
+				CBaseEntity *pEnt = g_AI_SensedObjectsManager.GetSensedObject( candidates[i] );
+				if ( pEnt && ( pEnt->GetFlags() & BOX_QUERY_MASK ) )
 				{
-					nSeen++;
+					if ( origin.DistToSqr(pEnt->GetAbsOrigin()) < distSq && Look( pEnt) )
+					{
+						nSeen++;
+					}
 				}
 			}
-			pEnt = g_AI_SensedObjectsManager.GetNext( &iter );
+		}
+		else
+		{
+			int iter;
+			CBaseEntity *pEnt = g_AI_SensedObjectsManager.GetFirst( &iter );
+			while ( pEnt )
+			{
+				if ( pEnt->GetFlags() & BOX_QUERY_MASK )
+				{
+					if ( origin.DistToSqr(pEnt->GetAbsOrigin()) < distSq && Look( pEnt) )
+					{
+						nSeen++;
+					}
+				}
+				pEnt = g_AI_SensedObjectsManager.GetNext( &iter );
+			}
 		}
 		
 		EndGather( nSeen, &m_SeenMisc );
@@ -683,6 +731,7 @@ void CAI_SensedObjectsManager::Term()
 {
 	gEntList.RemoveListenerEntity( this );
 	m_SensedObjects.RemoveAll();
+	g_AI_SensingGrid.Invalidate();
 }
 
 //-----------------------------------------------------------------------------
@@ -721,6 +770,7 @@ void CAI_SensedObjectsManager::OnEntitySpawned( CBaseEntity *pEntity )
 	if ( ( pEntity->GetFlags() & FL_OBJECT ) && !pEntity->IsPlayer() && !pEntity->IsNPC() )
 	{
 		m_SensedObjects.AddToTail( pEntity );
+		g_AI_SensingGrid.Invalidate();
 	}
 }
 
@@ -732,7 +782,10 @@ void CAI_SensedObjectsManager::OnEntityDeleted( CBaseEntity *pEntity )
 	{
 		int i = m_SensedObjects.Find( pEntity );
 		if ( i != m_SensedObjects.InvalidIndex() )
+		{
 			m_SensedObjects.FastRemove( i );
+			g_AI_SensingGrid.Invalidate();
+		}
 	}
 }
 
@@ -747,6 +800,193 @@ void CAI_SensedObjectsManager::AddEntity( CBaseEntity *pEntity )
 	// Add the object flag so it gets removed when it dies
 	pEntity->AddFlag( FL_OBJECT );
 	m_SensedObjects.AddToTail( pEntity );
+	g_AI_SensingGrid.Invalidate();
+}
+
+//=============================================================================
+//
+// CAI_SensingGrid
+//
+//=============================================================================
+
+CAI_SensingGrid::CAI_SensingGrid()
+ :	m_iBuildTick( -1 )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+static int SortSensingGridIndices( const int *pLeft, const int *pRight )
+{
+	return *pLeft - *pRight;
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_SensingGrid::QueryNPCs( const Vector &origin, float flRadius, CUtlVector<int> *pResult )
+{
+	Update();
+
+	pResult->RemoveAll();
+	m_NPCs.Query( origin, flRadius, pResult );
+	pResult->AddVectorToTail( m_NoCullNPCs );
+
+	// Look at them in the same order as the full list would
+	pResult->Sort( SortSensingGridIndices );
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_SensingGrid::QueryObjects( const Vector &origin, float flRadius, CUtlVector<int> *pResult )
+{
+	Update();
+
+	pResult->RemoveAll();
+	m_Objects.Query( origin, flRadius, pResult );
+	pResult->Sort( SortSensingGridIndices );
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_SensingGrid::Update()
+{
+	if ( m_iBuildTick == gpGlobals->tickcount )
+		return;
+
+	AI_PROFILE_SENSES(CAI_SensingGrid_Update);
+	m_iBuildTick = gpGlobals->tickcount;
+
+	CAI_BaseNPC **ppAIs = g_AI_Manager.AccessAIs();
+
+	m_BuildOrigins.RemoveAll();
+	m_BuildIndices.RemoveAll();
+	m_NoCullNPCs.RemoveAll();
+	for ( int i = 0; i < g_AI_Manager.NumAIs(); i++ )
+	{
+		if ( ppAIs[i]->ShouldNotDistanceCull() )
+		{
+			m_NoCullNPCs.AddToTail( i );
+		}
+		else
+		{
+			m_BuildOrigins.AddToTail( ppAIs[i]->GetAbsOrigin() );
+			m_BuildIndices.AddToTail( i );
+		}
+	}
+	m_NPCs.Build( m_BuildOrigins, m_BuildIndices );
+
+	m_BuildOrigins.RemoveAll();
+	m_BuildIndices.RemoveAll();
+	for ( int i = 0; i < g_AI_SensedObjectsManager.NumSensedObjects(); i++ )
+	{
+		CBaseEntity *pEnt = g_AI_SensedObjectsManager.GetSensedObject( i );
+		if ( pEnt )
+		{
+			m_BuildOrigins.AddToTail( pEnt->GetAbsOrigin() );
+			m_BuildIndices.AddToTail( i );
+		}
+	}
+	m_Objects.Build( m_BuildOrigins, m_BuildIndices );
+}
+
+//-----------------------------------------------------------------------------
+// Bucket the entries by cell with a counting sort, which keeps them in
+// ascending order within each cell.
+//-----------------------------------------------------------------------------
+
+void CAI_SensingGrid::CCells::Build( const CUtlVector<Vector> &origins, const CUtlVector<int> &indices )
+{
+	int nEntries = origins.Count();
+
+	m_nCellsX = m_nCellsY = 0;
+	m_CellStart.RemoveAll();
+	m_Entries.SetCount( nEntries );
+	m_Origins.SetCount( nEntries );
+
+	if ( !nEntries )
+		return;
+
+	Vector2D mins = origins[0].AsVector2D();
+	Vector2D maxs = mins;
+	for ( int i = 1; i < nEntries; i++ )
+	{
+		mins.x = MIN( mins.x, origins[i].x );
+		mins.y = MIN( mins.y, origins[i].y );
+		maxs.x = MAX( maxs.x, origins[i].x );
+		maxs.y = MAX( maxs.y, origins[i].y );
+	}
+
+	m_Mins = mins;
+	m_nCellsX = (int)( ( maxs.x - mins.x ) / AI_SENSING_GRID_CELL_SIZE ) + 1;
+	m_nCellsY = (int)( ( maxs.y - mins.y ) / AI_SENSING_GRID_CELL_SIZE ) + 1;
+
+	int nCells = m_nCellsX * m_nCellsY;
+	m_CellStart.SetCount( nCells + 1 );
+	V_memset( m_CellStart.Base(), 0, m_CellStart.Count() * sizeof(int) );
+
+	for ( int i = 0; i < nEntries; i++ )
+	{
+		int x = (int)( ( origins[i].x - mins.x ) / AI_SENSING_GRID_CELL_SIZE );
+		int y = (int)( ( origins[i].y - mins.y ) / AI_SENSING_GRID_CELL_SIZE );
+		m_CellStart[ y * m_nCellsX + x + 1 ]++;
+	}
+
+	for ( int i = 1; i <= nCells; i++ )
+	{
+		m_CellStart[i] += m_CellStart[i - 1];
+	}
+
+	// m_CellStart[c] is used as the fill point for cell c - 1, so ends up as the start of cell c
+	for ( int i = 0; i < nEntries; i++ )
+	{
+		int x = (int)( ( origins[i].x - mins.x ) / AI_SENSING_GRID_CELL_SIZE );
+		int y = (int)( ( origins[i].y - mins.y ) / AI_SENSING_GRID_CELL_SIZE );
+		int iEntry = m_CellStart[ y * m_nCellsX + x ]++;
+		m_Entries[iEntry] = indices[i];
+		m_Origins[iEntry] = origins[i].AsVector2D();
+	}
+
+	for ( int i = nCells; i > 0; i-- )
+	{
+		m_CellStart[i] = m_CellStart[i - 1];
+	}
+	m_CellStart[0] = 0;
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_SensingGrid::CCells::Query( const Vector &origin, float flRadius, CUtlVector<int> *pResult ) const
+{
+	if ( !m_nCellsX )
+		return;
+
+	float flReach = flRadius + AI_SENSING_GRID_SLACK;
+	float flReachSq = flReach * flReach;
+
+	int x0 = (int)floor( ( origin.x - flReach - m_Mins.x ) / AI_SENSING_GRID_CELL_SIZE );
+	int x1 = (int)floor( ( origin.x + flReach - m_Mins.x ) / AI_SENSING_GRID_CELL_SIZE );
+	int y0 = (int)floor( ( origin.y - flReach - m_Mins.y ) / AI_SENSING_GRID_CELL_SIZE );
+	int y1 = (int)floor( ( origin.y + flReach - m_Mins.y ) / AI_SENSING_GRID_CELL_SIZE );
+
+	x0 = MAX( x0, 0 );
+	y0 = MAX( y0, 0 );
+	x1 = MIN( x1, m_nCellsX - 1 );
+	y1 = MIN( y1, m_nCellsY - 1 );
+
+	for ( int y = y0; y <= y1; y++ )
+	{
+		for ( int x = x0; x <= x1; x++ )
+		{
+			int iCell = y * m_nCellsX + x;
+			for ( int i = m_CellStart[iCell]; i < m_CellStart[iCell + 1]; i++ )
+			{
+				if ( origin.AsVector2D().DistToSqr( m_Origins[i] ) <= flReachSq )
+				{
+					pResult->AddToTail( m_Entries[i] );
+				}
+			}
+		}
+	}
 }
 
 //=============================================================================
@@ -151,6 +151,9 @@ public:
 	CBaseEntity *	GetFirst( int *pIter );
 	CBaseEntity *	GetNext( int *pIter );
 
+	int				NumSensedObjects() const		{ return m_SensedObjects.Count(); }
+	CBaseEntity *	GetSensedObject( int i ) const	{ return m_SensedObjects[i]; }
+
 	virtual void 	AddEntity( CBaseEntity *pEntity );
 
 private:
@@ -163,6 +166,62 @@ private:
 extern CAI_SensedObjectsManager g_AI_SensedObjectsManager;
 
 //-----------------------------------------------------------------------------
+// class CAI_SensingGrid
+//
+// Purpose: Uniform grid over the NPCs and sensed objects, rebuilt at most once
+//			a frame, so a look only distance tests the entities near the looker
+//			instead of every one in the level.
+//-----------------------------------------------------------------------------
+
+class CAI_SensingGrid
+{
+public:
+	CAI_SensingGrid();
+
+	// Must be called whenever NPCs or sensed objects are added or removed,
+	// as the grid refers to them by index
+	void			Invalidate()	{ m_iBuildTick = -1; }
+
+	// Indices into g_AI_Manager.AccessAIs() of NPCs that may be within flRadius
+	// of origin, in ascending order. Includes every NPC that should not be
+	// distance culled. Callers still distance test the NPCs themselves.
+	void			QueryNPCs( const Vector &origin, float flRadius, CUtlVector<int> *pResult );
+
+	// Indices for g_AI_SensedObjectsManager.GetSensedObject() of objects that
+	// may be within flRadius of origin, in ascending order
+	void			QueryObjects( const Vector &origin, float flRadius, CUtlVector<int> *pResult );
+
+private:
+	class CCells
+	{
+	public:
+		void		Build( const CUtlVector<Vector> &origins, const CUtlVector<int> &indices );
+		void		Query( const Vector &origin, float flRadius, CUtlVector<int> *pResult ) const;
+
+	private:
+		Vector2D			m_Mins;
+		int					m_nCellsX;
+		int					m_nCellsY;
+		CUtlVector<int>		m_CellStart;	// entries of cell i are m_Entries[ m_CellStart[i], m_CellStart[i+1] )
+		CUtlVector<int>		m_Entries;		// indices, in ascending order within each cell
+		CUtlVector<Vector2D> m_Origins;		// parallel to m_Entries
+	};
+
+	void			Update();
+
+	CCells			m_NPCs;
+	CCells			m_Objects;
+	CUtlVector<int>	m_NoCullNPCs;			// NPCs that are considered at any distance, so aren't in the grid
+	int				m_iBuildTick;
+
+	// scratch space for building
+	CUtlVector<Vector> m_BuildOrigins;
+	CUtlVector<int>	m_BuildIndices;
+};
+
+extern CAI_SensingGrid g_AI_SensingGrid;
+
+//-----------------------------------------------------------------------------
 
 
 
@@ -1959,6 +1959,8 @@ void CBaseAnimating::BuildMatricesWithBoneMerge(
 }
 
 ConVar sv_pvsskipanimation( "sv_pvsskipanimation", "1", FCVAR_ARCHIVE, "Skips SetupBones when npc's are outside the PVS" );
+ConVar anim_pose_cache( "anim_pose_cache", "1", 0, "Share local poses between entities playing the same sequences at the same cycles and pose parameters" );
+ConVar anim_pose_cache_steps( "anim_pose_cache_steps", "256", 0, "Steps per cycle, pose parameter and layer weight range that count as the same pose for anim_pose_cache", true, 1, false, 0 );
 ConVar ai_setupbones_debug( "ai_setupbones_debug", "0", 0, "Shows that bones that are setup every think" );
 
 
@@ -2034,7 +2036,19 @@ void CBaseAnimating::SetupBones( matrix3x4_t *pBoneToWorld, int boneMask )
 		else
 		{
 			// Msg( "%.03f : %s:%s\n", gpGlobals->curtime, GetClassname(), GetEntityName().ToCStr() );
-			GetSkeleton( pStudioHdr, pos, q, boneMask );
+			CPoseCacheKey key( anim_pose_cache_steps.GetInt() );
+			bool bShared = anim_pose_cache.GetBool() && GetPoseCacheKey( pStudioHdr, boneMask, key );
+
+			// another entity animating the same way may have already worked out this pose
+			if ( !bShared || !Studio_GetSharedPose( key, pStudioHdr->numbones(), pos, q ) )
+			{
+				GetSkeleton( pStudioHdr, pos, q, boneMask );
+
+				if ( bShared )
+				{
+					Studio_AddSharedPose( key, pStudioHdr->numbones(), pos, q );
+				}
+			}
 		}
 	}
 	
@@ -3127,6 +3141,43 @@ void CBaseAnimating::GetSkeleton( CStudioHdr *pStudioHdr, Vector pos[], Quaterni
 	boneSetup.CalcBoneAdj( pos, q, GetEncodedControllerArray() );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: key the pose GetSkeleton() makes.  Server IK feeds the pose into
+//			the IK context, so entities using it don't share.
+//-----------------------------------------------------------------------------
+bool CBaseAnimating::GetPoseCacheKey( CStudioHdr *pStudioHdr, int boneMask, CPoseCacheKey &key )
+{
+	if ( m_pIk )
+		return false;
+
+	key.AddPointer( pStudioHdr->GetRenderHdr() );
+	key.AddInt( boneMask );
+
+	// real time and autoplay sequences play by the clock
+	key.AddFloat( gpGlobals->curtime );
+
+	key.AddInt( GetSequence() );
+	key.AddQuantized( GetCycle() );
+
+	const float *pPoseParameters = GetPoseParameterArray();
+	for ( int i = 0; i < pStudioHdr->GetNumPoseParameters(); i++ )
+	{
+		key.AddQuantized( pPoseParameters[i] );
+	}
+
+	// controllers are looked up by input field, not by index
+	if ( pStudioHdr->numbonecontrollers() )
+	{
+		const float *pControllers = GetEncodedControllerArray();
+		for ( int i = 0; i < NUM_BONECTRLS; i++ )
+		{
+			key.AddQuantized( pControllers[i] );
+		}
+	}
+
+	return key.IsValid();
+}
+
 int CBaseAnimating::DrawDebugTextOverlays(void) 
 {
 	int text_offset = BaseClass::DrawDebugTextOverlays();
@@ -3974,3 +4025,79 @@ CStudioHdr *CBaseAnimating::OnNewModel()
 
 	return hdr;
 }
+
+//-----------------------------------------------------------------------------
+// Purpose: time animation decode and blending per bone against four bones at
+//			a time, on a citizen and a combine soldier unless models are given
+//-----------------------------------------------------------------------------
+CON_COMMAND_F( anim_pose_benchmark, "Times animation decode and blending one bone at a time against four at a time, and reports ns per bone.\nUsage: anim_pose_benchmark [passes] [model...]", FCVAR_GAMEDLL | FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	static const char *s_pDefaultModels[] =
+	{
+		"models/humans/group01/male_07.mdl",
+		"models/combine_soldier.mdl",
+	};
+
+	int nPasses = ( args.ArgC() > 1 ) ? MAX( atoi( args[1] ), 1 ) : 100;
+	int nModels = ( args.ArgC() > 2 ) ? args.ArgC() - 2 : (int)ARRAYSIZE( s_pDefaultModels );
+
+	MDLCACHE_CRITICAL_SECTION();
+
+	for ( int i = 0; i < nModels; i++ )
+	{
+		const char *pModelName = ( args.ArgC() > 2 ) ? args[ i + 2 ] : s_pDefaultModels[i];
+
+		MDLHandle_t h = mdlcache->FindMDL( pModelName );
+		if ( h == MDLHANDLE_INVALID )
+		{
+			Warning( "anim_pose_benchmark: couldn't find %s\n", pModelName );
+			continue;
+		}
+
+		if ( mdlcache->IsErrorModel( h ) )
+		{
+			Warning( "anim_pose_benchmark: couldn't load %s\n", pModelName );
+		}
+		else
+		{
+			CStudioHdr studioHdr( mdlcache->GetStudioHdr( h ), mdlcache );
+			Studio_BenchmarkPoseKernels( &studioHdr, nPasses );
+		}
+
+		mdlcache->Release( h );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: shared poses point at model data, so don't keep them across levels
+//-----------------------------------------------------------------------------
+class CSharedPoseSystem : public CAutoGameSystem
+{
+public:
+	CSharedPoseSystem() : CAutoGameSystem( "CSharedPoseSystem" )
+	{
+	}
+
+	virtual void LevelShutdownPostEntity()
+	{
+		Studio_FlushSharedPoses();
+	}
+};
+
+static CSharedPoseSystem g_SharedPoseSystem;
+
+CON_COMMAND_F( anim_pose_cache_stats, "Reports the hit rate and memory of the shared pose cache.\nUsage: anim_pose_cache_stats [reset]", FCVAR_GAMEDLL )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	sharedposestats_t stats;
+	Studio_GetSharedPoseStats( stats, args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) );
+
+	int lookups = stats.hits + stats.misses;
+	Msg( "shared poses: %d hits, %d misses (%.1f%% hit rate)\n", stats.hits, stats.misses, lookups ? 100.0f * stats.hits / lookups : 0.0f );
+	Msg( "  %d poses in %u of %u KB\n", stats.poses, stats.usedBytes / 1024, stats.targetBytes / 1024 );
+}
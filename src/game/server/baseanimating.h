@@ -20,6 +20,7 @@
 struct animevent_t;
 struct matrix3x4_t;
 class CIKContext;
+class CPoseCacheKey;
 class KeyValues;
 FORWARD_DECLARE_HANDLE( memhandle_t );
 
@@ -136,6 +137,9 @@ public:
 	virtual bool CanBecomeRagdoll( void ); //Check if this entity will ragdoll when dead.
 
 	virtual	void GetSkeleton( CStudioHdr *pStudioHdr, Vector pos[], Quaternion q[], int boneMask );
+	// Everything GetSkeleton() depends on, so entities with the same key can share a pose.
+	// Classes with their own GetSkeleton() must add to this or return false.
+	virtual bool GetPoseCacheKey( CStudioHdr *pStudioHdr, int boneMask, CPoseCacheKey &key );
 
 	virtual void GetBoneTransform( int iBone, matrix3x4_t &pBoneToWorld );
 	virtual void SetupBones( matrix3x4_t *pBoneToWorld, int boneMask );
@@ -644,8 +644,22 @@ CBaseEntity *CBaseEntity::GetFollowedEntity()
 void CBaseEntity::SetClassname( const char *className )
 {
 	m_iClassname = AllocPooledString( className );
+	gEntList.ReportEntityNameChanged( this );
 }
 
+void CBaseEntity::SetName( string_t newName )
+{
+	m_iName = newName;
+	gEntList.ReportEntityNameChanged( this );
+}
+
+#ifdef MAPBASE_VSCRIPT
+void CBaseEntity::SetNameAsCStr( const char *newName )
+{
+	SetName( AllocPooledString(newName) );
+}
+#endif
+
 void CBaseEntity::SetModelIndex( int index )
 {
 	if ( IsDynamicModelIndex( index ) && !(GetBaseAnimating() && m_bDynamicModelAllowed) )
@@ -3941,6 +3955,9 @@ void CBaseEntity::OnRestore()
 
 	SimThink_EntityChanged( this );
 
+	// name and position were restored behind the search indices' back
+	gEntList.ReportEntityNameChanged( this );
+
 	// touchlinks get recomputed
 	if ( IsEFlagSet( EFL_CHECK_UNTOUCH ) )
 	{
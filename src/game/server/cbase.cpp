@@ -140,6 +140,14 @@ CEventAction::CEventAction( const char *ActionData )
 	if (szToken[0] != '\0')
 	{
 		m_iTarget = AllocPooledString(szToken);
+
+#ifdef MAPBASE
+		// Compile regex targets at map load instead of the first time the output fires
+		if (szToken[0] == '@' && szToken[1] == '/')
+		{
+			Matcher_PrecacheRegex( szToken + 2 );
+		}
+#endif
 	}
 
 	//
@@ -688,8 +696,8 @@ CEventQueue g_EventQueue;
 
 CEventQueue::CEventQueue()
 {
-	m_Events.m_flFireTime = -FLT_MAX;
-	m_Events.m_pNext = NULL;
+	m_pServicingEvent = NULL;
+	m_iNextSerial = 0;
 
 	Init();
 }
@@ -803,21 +811,34 @@ void CEventQueue::Init( void )
 void CEventQueue::Clear( void )
 {
 	// delete all the events in the queue
-	EventQueuePrioritizedEvent_t *pe = m_Events.m_pNext;
-	
-	while ( pe != NULL )
+	for ( int i = 0; i < m_Heap.Count(); i++ )
 	{
-		EventQueuePrioritizedEvent_t *next = pe->m_pNext;
-		delete pe;
-		pe = next;
+		EventQueuePrioritizedEvent_t *pe = m_Heap[i];
+		pe->m_iHeapIndex = -1;
+
+		// the event being fired is freed by ServiceEvents once it returns
+		if ( pe != m_pServicingEvent )
+		{
+			delete pe;
+		}
+	}
+
+	m_Heap.RemoveAll();
+	for ( int i = 0; i < NUM_EVENTQUEUE_INDICES; i++ )
+	{
+		m_Index[i].RemoveAll();
 	}
+#ifdef MAPBASE_VSCRIPT
+	m_LiveEvents.RemoveAll();
+#endif
 
-	m_Events.m_pNext = NULL;
+	m_iNextSerial = 0;
 }
 
 void CEventQueue::Dump( void )
 {
-	EventQueuePrioritizedEvent_t *pe = m_Events.m_pNext;
+	CUtlVector<EventQueuePrioritizedEvent_t *> events;
+	GetSortedEvents( events );
 
 	Msg("Dumping event queue. Current time is: %.2f\n",
 #ifdef TF_DLL
@@ -827,9 +848,9 @@ void CEventQueue::Dump( void )
 #endif
 		);
 
-	while ( pe != NULL )
+	for ( int i = 0; i < events.Count(); i++ )
 	{
-		EventQueuePrioritizedEvent_t *next = pe->m_pNext;
+		EventQueuePrioritizedEvent_t *pe = events[i];
 
 		Msg("   (%.2f) Target: '%s', Input: '%s', Parameter '%s'. Activator: '%s', Caller '%s'.  \n", 
 			pe->m_flFireTime, 
@@ -838,8 +859,6 @@ void CEventQueue::Dump( void )
 			pe->m_VariantValue.String(),
 			pe->m_pActivator ? pe->m_pActivator->GetDebugName() : "None", 
 			pe->m_pCaller ? pe->m_pCaller->GetDebugName() : "None"  );
-
-		pe = next;
 	}
 
 	Msg("Finished dump.\n");
@@ -921,43 +940,207 @@ void CEventQueue::AddEvent( CBaseEntity *target, const char *action, float fireD
 
 
 //-----------------------------------------------------------------------------
-// Purpose: private function, adds an event into the list
-// Input  : *newEvent - the (already built) event to add
+// Purpose: heap ordering; events with equal fire times keep their insertion order
 //-----------------------------------------------------------------------------
-void CEventQueue::AddEvent( EventQueuePrioritizedEvent_t *newEvent )
+bool CEventQueue::FiresBefore( const EventQueuePrioritizedEvent_t *a, const EventQueuePrioritizedEvent_t *b )
+{
+	if ( a->m_flFireTime != b->m_flFireTime )
+		return a->m_flFireTime < b->m_flFireTime;
+
+	return a->m_iSerial < b->m_iSerial;
+}
+
+static int __cdecl EventFireOrderSortFunc( EventQueuePrioritizedEvent_t * const *a, EventQueuePrioritizedEvent_t * const *b )
+{
+	if ( (*a)->m_flFireTime != (*b)->m_flFireTime )
+		return ( (*a)->m_flFireTime < (*b)->m_flFireTime ) ? -1 : 1;
+
+	if ( (*a)->m_iSerial != (*b)->m_iSerial )
+		return ( (*a)->m_iSerial < (*b)->m_iSerial ) ? -1 : 1;
+
+	return 0;
+}
+
+void CEventQueue::HeapSwap( int i, int j )
+{
+	EventQueuePrioritizedEvent_t *pTemp = m_Heap[i];
+	m_Heap[i] = m_Heap[j];
+	m_Heap[j] = pTemp;
+
+	m_Heap[i]->m_iHeapIndex = i;
+	m_Heap[j]->m_iHeapIndex = j;
+}
+
+void CEventQueue::HeapSiftUp( int i )
 {
-	// loop through the actions looking for a place to insert
-	EventQueuePrioritizedEvent_t *pe;
-	for ( pe = &m_Events; pe->m_pNext != NULL; pe = pe->m_pNext )
+	while ( i > 0 )
 	{
-		if ( pe->m_pNext->m_flFireTime > newEvent->m_flFireTime )
-		{
+		int parent = ( i - 1 ) >> 1;
+		if ( !FiresBefore( m_Heap[i], m_Heap[parent] ) )
+			break;
+
+		HeapSwap( i, parent );
+		i = parent;
+	}
+}
+
+void CEventQueue::HeapSiftDown( int i )
+{
+	int count = m_Heap.Count();
+	while ( 1 )
+	{
+		int child = ( i << 1 ) + 1;
+		if ( child >= count )
 			break;
+
+		if ( child + 1 < count && FiresBefore( m_Heap[child + 1], m_Heap[child] ) )
+		{
+			child++;
 		}
+
+		if ( !FiresBefore( m_Heap[child], m_Heap[i] ) )
+			break;
+
+		HeapSwap( i, child );
+		i = child;
 	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: per-entity chains so cancels don't have to scan the whole queue
+//-----------------------------------------------------------------------------
+void CEventQueue::LinkIndex( EventQueuePrioritizedEvent_t *pe, int iIndex, unsigned int iKey )
+{
+	pe->m_iIndexKey[iIndex] = iKey;
+	pe->m_pIndexPrev[iIndex] = NULL;
+	pe->m_pIndexNext[iIndex] = NULL;
 
-	Assert( pe );
+	if ( iKey == INVALID_EHANDLE_INDEX )
+		return;
 
-	// insert
-	newEvent->m_pNext = pe->m_pNext;
-	newEvent->m_pPrev = pe;
-	pe->m_pNext = newEvent;
-	if ( newEvent->m_pNext )
+	UtlHashHandle_t h = m_Index[iIndex].Find( iKey );
+	if ( h != m_Index[iIndex].InvalidHandle() )
+	{
+		EventQueuePrioritizedEvent_t *pHead = m_Index[iIndex][h];
+		pe->m_pIndexNext[iIndex] = pHead;
+		pHead->m_pIndexPrev[iIndex] = pe;
+		m_Index[iIndex][h] = pe;
+	}
+	else
+	{
+		m_Index[iIndex].Insert( iKey, pe );
+	}
+}
+
+void CEventQueue::UnlinkIndex( EventQueuePrioritizedEvent_t *pe, int iIndex )
+{
+	if ( pe->m_iIndexKey[iIndex] == INVALID_EHANDLE_INDEX )
+		return;
+
+	EventQueuePrioritizedEvent_t *pNext = pe->m_pIndexNext[iIndex];
+	EventQueuePrioritizedEvent_t *pPrev = pe->m_pIndexPrev[iIndex];
+
+	if ( pNext )
+	{
+		pNext->m_pIndexPrev[iIndex] = pPrev;
+	}
+
+	if ( pPrev )
+	{
+		pPrev->m_pIndexNext[iIndex] = pNext;
+	}
+	else if ( pNext )
 	{
-		newEvent->m_pNext->m_pPrev = newEvent;
+		// we were the head of this chain
+		UtlHashHandle_t h = m_Index[iIndex].Find( pe->m_iIndexKey[iIndex] );
+		Assert( h != m_Index[iIndex].InvalidHandle() );
+		m_Index[iIndex][h] = pNext;
 	}
+	else
+	{
+		m_Index[iIndex].Remove( pe->m_iIndexKey[iIndex] );
+	}
+
+	pe->m_iIndexKey[iIndex] = INVALID_EHANDLE_INDEX;
+	pe->m_pIndexNext[iIndex] = NULL;
+	pe->m_pIndexPrev[iIndex] = NULL;
+}
+
+EventQueuePrioritizedEvent_t *CEventQueue::FirstInIndex( int iIndex, CBaseEntity *pEntity ) const
+{
+	UtlHashHandle_t h = m_Index[iIndex].Find( (unsigned int)pEntity->GetRefEHandle().ToInt() );
+	if ( h == m_Index[iIndex].InvalidHandle() )
+		return NULL;
+
+	return m_Index[iIndex][h];
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: private function, adds an event into the queue
+// Input  : *newEvent - the (already built) event to add
+//-----------------------------------------------------------------------------
+void CEventQueue::AddEvent( EventQueuePrioritizedEvent_t *newEvent )
+{
+	newEvent->m_iSerial = m_iNextSerial++;
+	newEvent->m_iHeapIndex = m_Heap.AddToTail( newEvent );
+	HeapSiftUp( newEvent->m_iHeapIndex );
+
+	LinkIndex( newEvent, EVENTQUEUE_INDEX_TARGET, (unsigned int)newEvent->m_pEntTarget.ToInt() );
+	LinkIndex( newEvent, EVENTQUEUE_INDEX_CALLER, (unsigned int)newEvent->m_pCaller.ToInt() );
+
+#ifdef MAPBASE_VSCRIPT
+	m_LiveEvents.Insert( newEvent );
+#endif
 }
 
 void CEventQueue::RemoveEvent( EventQueuePrioritizedEvent_t *pe )
 {
-	Assert( pe->m_pPrev );
-	pe->m_pPrev->m_pNext = pe->m_pNext;
-	if ( pe->m_pNext )
+	int i = pe->m_iHeapIndex;
+	Assert( m_Heap.IsValidIndex( i ) && m_Heap[i] == pe );
+
+	int last = m_Heap.Count() - 1;
+	HeapSwap( i, last );
+	m_Heap.RemoveMultipleFromTail( 1 );
+
+	if ( i < last )
+	{
+		// the moved element may belong either above or below its new slot
+		HeapSiftUp( i );
+		HeapSiftDown( i );
+	}
+
+	pe->m_iHeapIndex = -1;
+
+	for ( int iIndex = 0; iIndex < NUM_EVENTQUEUE_INDICES; iIndex++ )
+	{
+		UnlinkIndex( pe, iIndex );
+	}
+
+#ifdef MAPBASE_VSCRIPT
+	m_LiveEvents.Remove( pe );
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: removes and frees an event. The event currently being serviced is
+//			only unlinked; ServiceEvents frees it once its input returns.
+//-----------------------------------------------------------------------------
+void CEventQueue::DeleteEvent( EventQueuePrioritizedEvent_t *pe )
+{
+	RemoveEvent( pe );
+
+	if ( pe != m_pServicingEvent )
 	{
-		pe->m_pNext->m_pPrev = pe->m_pPrev;
+		delete pe;
 	}
 }
 
+void CEventQueue::GetSortedEvents( CUtlVector<EventQueuePrioritizedEvent_t *> &events ) const
+{
+	events.CopyArray( m_Heap.Base(), m_Heap.Count() );
+	events.Sort( EventFireOrderSortFunc );
+}
+
 
 //-----------------------------------------------------------------------------
 // Purpose: fires off any events in the queue who's fire time is (or before) the present time
@@ -969,7 +1152,7 @@ void CEventQueue::ServiceEvents( void )
 		return;
 	}
 
-	EventQueuePrioritizedEvent_t *pe = m_Events.m_pNext;
+	EventQueuePrioritizedEvent_t *pe = m_Heap.Count() ? m_Heap[0] : NULL;
 
 #ifdef TF_DLL
 	while ( pe != NULL && pe->m_flFireTime <= engine->GetServerTime() )
@@ -979,6 +1162,9 @@ void CEventQueue::ServiceEvents( void )
 	{
 		MDLCACHE_CRITICAL_SECTION();
 
+		// inputs fired below may cancel this very event; DeleteEvent defers freeing it to us
+		m_pServicingEvent = pe;
+
 		bool targetFound = false;
 
 		// find the targets
@@ -1061,8 +1247,12 @@ void CEventQueue::ServiceEvents( void )
 			ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
 		}
 
-		// remove the event from the list (remembering that the queue may have been added to)
-		RemoveEvent( pe );
+		// remove the event from the queue (remembering that the queue may have been added to)
+		m_pServicingEvent = NULL;
+		if ( pe->m_iHeapIndex != -1 )
+		{
+			RemoveEvent( pe );
+		}
 		delete pe;
 
 		//
@@ -1076,8 +1266,8 @@ void CEventQueue::ServiceEvents( void )
 			}
 		}
 
-		// restart the list (to catch any new items have probably been added to the queue)
-		pe = m_Events.m_pNext;	
+		// restart from the head (to catch any new items have probably been added to the queue)
+		pe = m_Heap.Count() ? m_Heap[0] : NULL;
 	}
 }
 
@@ -1105,7 +1295,7 @@ void CEventQueue::CancelEvents( CBaseEntity *pCaller )
 	if (!pCaller)
 		return;
 
-	EventQueuePrioritizedEvent_t *pCur = m_Events.m_pNext;
+	EventQueuePrioritizedEvent_t *pCur = FirstInIndex( EVENTQUEUE_INDEX_CALLER, pCaller );
 
 	while (pCur != NULL)
 	{
@@ -1122,12 +1312,11 @@ void CEventQueue::CancelEvents( CBaseEntity *pCaller )
 		}
 
 		EventQueuePrioritizedEvent_t *pCurSave = pCur;
-		pCur = pCur->m_pNext;
+		pCur = pCur->m_pIndexNext[EVENTQUEUE_INDEX_CALLER];
 
 		if (bDelete)
 		{
-			RemoveEvent( pCurSave );
-			delete pCurSave;
+			DeleteEvent( pCurSave );
 		}
 	}
 }
@@ -1143,7 +1332,7 @@ void CEventQueue::CancelEventOn( CBaseEntity *pTarget, const char *sInputName )
 	if (!pTarget)
 		return;
 
-	EventQueuePrioritizedEvent_t *pCur = m_Events.m_pNext;
+	EventQueuePrioritizedEvent_t *pCur = FirstInIndex( EVENTQUEUE_INDEX_TARGET, pTarget );
 
 	while (pCur != NULL)
 	{
@@ -1158,12 +1347,11 @@ void CEventQueue::CancelEventOn( CBaseEntity *pTarget, const char *sInputName )
 		}
 
 		EventQueuePrioritizedEvent_t *pCurSave = pCur;
-		pCur = pCur->m_pNext;
+		pCur = pCur->m_pIndexNext[EVENTQUEUE_INDEX_TARGET];
 
 		if (bDelete)
 		{
-			RemoveEvent( pCurSave );
-			delete pCurSave;
+			DeleteEvent( pCurSave );
 		}
 	}
 }
@@ -1178,7 +1366,7 @@ bool CEventQueue::HasEventPending( CBaseEntity *pTarget, const char *sInputName
 	if (!pTarget)
 		return false;
 
-	EventQueuePrioritizedEvent_t *pCur = m_Events.m_pNext;
+	EventQueuePrioritizedEvent_t *pCur = FirstInIndex( EVENTQUEUE_INDEX_TARGET, pTarget );
 
 	while (pCur != NULL)
 	{
@@ -1191,7 +1379,7 @@ bool CEventQueue::HasEventPending( CBaseEntity *pTarget, const char *sInputName
 				return true;
 		}
 
-		pCur = pCur->m_pNext;
+		pCur = pCur->m_pIndexNext[EVENTQUEUE_INDEX_TARGET];
 	}
 
 	return false;
@@ -1218,28 +1406,27 @@ void CEventQueue::CancelEventsByInput( CBaseEntity *pTarget, const char *szInput
 		return;
 
 	string_t iszDebugName = MAKE_STRING( pTarget->GetDebugName() );
-	EventQueuePrioritizedEvent_t *pCur = m_Events.m_pNext;
 
-	while ( pCur )
+	// Events targeted by name aren't indexed, so this has to visit the whole queue.
+	// Collect first; removing from the heap reorders it.
+	CUtlVector<EventQueuePrioritizedEvent_t *> remove;
+
+	for ( int i = 0; i < m_Heap.Count(); i++ )
 	{
-		bool bRemove = false;
+		EventQueuePrioritizedEvent_t *pCur = m_Heap[i];
 
 		if ( pTarget == pCur->m_pEntTarget || pCur->m_iTarget == iszDebugName )
 		{
 			if ( !V_strncmp( STRING(pCur->m_iTargetInput), szInput, strlen(szInput) ) )
 			{
-				bRemove = true;
+				remove.AddToTail( pCur );
 			}
 		}
+	}
 
-		EventQueuePrioritizedEvent_t *pPrev = pCur;
-		pCur = pCur->m_pNext;
-
-		if ( bRemove )
-		{
-			RemoveEvent(pPrev);
-			delete pPrev;
-		}
+	for ( int i = 0; i < remove.Count(); i++ )
+	{
+		DeleteEvent( remove[i] );
 	}
 }
 
@@ -1247,32 +1434,21 @@ bool CEventQueue::RemoveEvent( int event )
 {
 	EventQueuePrioritizedEvent_t *pe = reinterpret_cast<EventQueuePrioritizedEvent_t*>(event); // INT_TO_POINTER
 
-	for ( EventQueuePrioritizedEvent_t *pCur = m_Events.m_pNext; pCur; pCur = pCur->m_pNext )
-	{
-		if ( pCur == pe )
-		{
-			RemoveEvent(pCur);
-			delete pCur;
-			return true;
-		}
-	}
+	if ( !m_LiveEvents.HasElement( pe ) )
+		return false;
 
-	return false;
+	DeleteEvent( pe );
+	return true;
 }
 
 float CEventQueue::GetTimeLeft( int event )
 {
 	EventQueuePrioritizedEvent_t *pe = reinterpret_cast<EventQueuePrioritizedEvent_t*>(event); // INT_TO_POINTER
 
-	for ( EventQueuePrioritizedEvent_t *pCur = m_Events.m_pNext; pCur; pCur = pCur->m_pNext )
-	{
-		if ( pCur == pe )
-		{
-			return (pCur->m_flFireTime - gpGlobals->curtime);
-		}
-	}
+	if ( !m_LiveEvents.HasElement( pe ) )
+		return 0.f;
 
-	return 0.f;
+	return (pe->m_flFireTime - gpGlobals->curtime);
 }
 #endif // MAPBASE_VSCRIPT
 
@@ -1297,29 +1473,29 @@ BEGIN_SIMPLE_DATADESC( EventQueuePrioritizedEvent_t )
 	DEFINE_FIELD( m_iOutputID, FIELD_INTEGER ),
 	DEFINE_CUSTOM_FIELD( m_VariantValue, variantFuncs ),
 
-//	DEFINE_FIELD( m_pNext, FIELD_??? ),
-//	DEFINE_FIELD( m_pPrev, FIELD_??? ),
+//	DEFINE_FIELD( m_iHeapIndex, FIELD_INTEGER ),	// rebuilt by AddEvent on restore
+//	DEFINE_FIELD( m_iSerial, FIELD_INTEGER ),
 END_DATADESC()
 
 
 int CEventQueue::Save( ISave &save )
 {
-	// count the number of items in the queue
-	EventQueuePrioritizedEvent_t *pe;
+	// events are written in fire order, same as the old sorted list did,
+	// so restoring re-inserts ties in their original order
+	CUtlVector<EventQueuePrioritizedEvent_t *> events;
+	GetSortedEvents( events );
 
-	m_iListCount = 0;
-	for ( pe = m_Events.m_pNext; pe != NULL; pe = pe->m_pNext )
-	{
-		m_iListCount++;
-	}
+	// count the number of items in the queue
+	m_iListCount = events.Count();
 
 	// save that value out to disk, so we know how many to restore
 	if ( !save.WriteFields( "EventQueue", this, NULL, m_DataMap.dataDesc, m_DataMap.dataNumFields ) )
 		return 0;
 	
 	// cycle through all the events, saving them all
-	for ( pe = m_Events.m_pNext; pe != NULL; pe = pe->m_pNext )
+	for ( int i = 0; i < events.Count(); i++ )
 	{
+		EventQueuePrioritizedEvent_t *pe = events[i];
 		if ( !save.WriteFields( "PEvent", pe, NULL, pe->m_DataMap.dataDesc, pe->m_DataMap.dataNumFields ) )
 			return 0;
 	}
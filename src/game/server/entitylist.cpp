@@ -11,6 +11,7 @@
 #include "igamesystem.h"
 #include "collisionutils.h"
 #include "UtlSortVector.h"
+#include "utlhashtable.h"
 #include "tier0/vprof.h"
 #include "mapentities.h"
 #include "client.h"
@@ -298,6 +299,538 @@ void SimThink_EntityChanged( CBaseEntity *pEntity )
 	g_SimThinkManager.EntityChanged( pEntity );
 }
 
+//-----------------------------------------------------------------------------
+// Spatial index for the *Nearest / *Within searches. Entities are hashed into
+// a uniform grid by origin and bucketed by targetname and classname, so a
+// radius search only visits entities with the right name in the cells it
+// overlaps instead of walking the whole entity list.
+//
+// Buckets compare names case-insensitively like NamesMatch() does. Wildcard,
+// regex and procedural queries still go through the linear searches.
+//-----------------------------------------------------------------------------
+ConVar ent_find_use_grid( "ent_find_use_grid", "1", FCVAR_NONE, "Use the spatial name index for radius and box entity searches." );
+
+#define ENTGRID_CELL_SHIFT		9		// 512 unit cells
+#define ENTGRID_CELL_SIZE		( 1 << ENTGRID_CELL_SHIFT )
+#define ENTGRID_CELL_BITS		10		// cells per axis, covers +/-262144 units
+#define ENTGRID_CELL_MASK		( ( 1 << ENTGRID_CELL_BITS ) - 1 )
+#define ENTGRID_MAX_CELLS		512		// searches covering more cells than this use the linear path
+#define ENTGRID_INVALID			0xFFFF
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns true if NamesMatch() would treat the name as a plain
+//			case-insensitive compare, so it can be looked up by name.
+//			Wildcards, regex and procedurals have to be matched one by one.
+//-----------------------------------------------------------------------------
+static bool IsPlainEntityName( const char *pszName )
+{
+	if ( !pszName || !pszName[0] || pszName[0] == '!' || pszName[0] == '@' )
+		return false;
+
+	return strpbrk( pszName, "*?" ) == NULL;
+}
+
+enum EntGridKey_t
+{
+	ENTGRID_KEY_NAME = 0,
+	ENTGRID_KEY_CLASSNAME,
+
+	NUM_ENTGRID_KEYS
+};
+
+struct EntGridBucketKey_t
+{
+	const char		*pszName;
+	unsigned int	nCell;
+};
+
+struct EntGridBucketHash_t
+{
+	unsigned int operator()( const EntGridBucketKey_t &key ) const
+	{
+		return CaselessStringHashFunctor()( key.pszName ) ^ Mix32HashFunctor()( key.nCell );
+	}
+};
+
+struct EntGridBucketEqual_t
+{
+	bool operator()( const EntGridBucketKey_t &a, const EntGridBucketKey_t &b ) const
+	{
+		return a.nCell == b.nCell && ( a.pszName == b.pszName || !Q_stricmp( a.pszName, b.pszName ) );
+	}
+};
+
+struct entgridnode_t
+{
+	const char		*pszKey[NUM_ENTGRID_KEYS];		// NULL if the entity has no name of this kind
+	unsigned short	nNext[NUM_ENTGRID_KEYS];
+	unsigned short	nPrev[NUM_ENTGRID_KEYS];
+	unsigned int	nSerial;		// Order of addition to the entity list, which is also iteration order
+	unsigned int	nCell;
+	unsigned short	nLargeIndex;	// Index in m_LargeEntities if the bounds reach past a cell
+	bool			bInUse;
+	bool			bDirty;
+};
+
+class CEntityNameGrid
+{
+public:
+	CEntityNameGrid()
+	{
+		Clear();
+	}
+
+	void Clear()
+	{
+		m_Buckets.Purge();
+		m_DirtyList.Purge();
+		m_LargeEntities.Purge();
+		m_nNextSerial = 0;
+		for ( int i = 0; i < ARRAYSIZE(m_Nodes); i++ )
+		{
+			ResetNode( m_Nodes[i] );
+		}
+	}
+
+	void LevelShutdownPostEntity()
+	{
+		Clear();
+	}
+
+	void AddEntity( int index )
+	{
+		entgridnode_t &node = m_Nodes[index];
+		Assert( !node.bInUse );
+		ResetNode( node );
+		node.bInUse = true;
+		node.nSerial = m_nNextSerial++;
+
+		// Names and position aren't set up yet, pick them up on the next search
+		MarkDirty( index );
+	}
+
+	void RemoveEntity( int index )
+	{
+		entgridnode_t &node = m_Nodes[index];
+		if ( !node.bInUse )
+			return;
+
+		Unlink( index );
+		SetLarge( index, false );
+		node.bInUse = false;
+	}
+
+	void MarkDirty( int index )
+	{
+		entgridnode_t &node = m_Nodes[index];
+		if ( node.bInUse && !node.bDirty )
+		{
+			node.bDirty = true;
+			m_DirtyList.AddToTail( (unsigned short)index );
+		}
+	}
+
+	unsigned int GetSerial( int index ) const
+	{
+		return m_Nodes[index].nSerial;
+	}
+
+	bool FindNearest( int iKey, const char *pszName, const Vector &vecSrc, float flRadius, CBaseEntity **ppResult, string_t iszExactClassname = NULL_STRING );
+	bool FindFirstInSphere( int iKey, const char *pszName, CBaseEntity *pStartEntity, const Vector &vecSrc, float flRadius, CBaseEntity **ppResult );
+	bool FindFirstInBox( int iKey, const char *pszName, CBaseEntity *pStartEntity, const Vector &vecMins, const Vector &vecMaxs, CBaseEntity **ppResult );
+
+private:
+	static void ResetNode( entgridnode_t &node )
+	{
+		for ( int i = 0; i < NUM_ENTGRID_KEYS; i++ )
+		{
+			node.pszKey[i] = NULL;
+			node.nNext[i] = node.nPrev[i] = ENTGRID_INVALID;
+		}
+		node.nSerial = 0;
+		node.nCell = 0;
+		node.nLargeIndex = ENTGRID_INVALID;
+		node.bInUse = false;
+		node.bDirty = false;
+	}
+
+	static CBaseEntity *GetEntity( int index )
+	{
+		return (CBaseEntity *)gEntList.GetEntInfoPtrByIndex( index )->m_pEntity;
+	}
+
+	static const char *GetKey( CBaseEntity *pEntity, int iKey )
+	{
+		const char *pszKey = ( iKey == ENTGRID_KEY_NAME ) ? STRING( pEntity->GetEntityName() ) : pEntity->GetClassname();
+		return ( pszKey && pszKey[0] ) ? pszKey : NULL;
+	}
+
+	static bool KeyMatches( CBaseEntity *pEntity, int iKey, const char *pszName )
+	{
+		const char *pszKey = GetKey( pEntity, iKey );
+		return pszKey && !Q_stricmp( pszKey, pszName );
+	}
+
+	static int CellCoord( float flCoord )
+	{
+		int nCoord = (int)floorf( flCoord ) >> ENTGRID_CELL_SHIFT;
+		return clamp( nCoord, -( 1 << ( ENTGRID_CELL_BITS - 1 ) ), ( 1 << ( ENTGRID_CELL_BITS - 1 ) ) - 1 );
+	}
+
+	static unsigned int PackCell( int x, int y, int z )
+	{
+		return ( ( x & ENTGRID_CELL_MASK ) << ( ENTGRID_CELL_BITS * 2 ) ) | ( ( y & ENTGRID_CELL_MASK ) << ENTGRID_CELL_BITS ) | ( z & ENTGRID_CELL_MASK );
+	}
+
+	static bool CanSearch( const char *pszName )
+	{
+		return ent_find_use_grid.GetBool() && IsPlainEntityName( pszName );
+	}
+
+	void Update();
+	void UpdateEntity( int index );
+	void Link( int index );
+	void Unlink( int index );
+	void SetLarge( int index, bool bLarge );
+	bool GatherCandidates( int iKey, const char *pszName, const Vector &vecMins, const Vector &vecMaxs );
+	bool GetStartSerial( CBaseEntity *pStartEntity, unsigned int *pSerial );
+
+	entgridnode_t		m_Nodes[NUM_ENT_ENTRIES];
+	CUtlHashtable< EntGridBucketKey_t, unsigned short, EntGridBucketHash_t, EntGridBucketEqual_t > m_Buckets;
+	CUtlVector<unsigned short>	m_DirtyList;
+	CUtlVector<unsigned short>	m_LargeEntities;
+	CUtlVector<unsigned short>	m_Candidates;
+	unsigned int		m_nNextSerial;
+};
+
+CEntityNameGrid g_EntityNameGrid;
+
+void CEntityNameGrid::Update()
+{
+	// UpdateEntity() doesn't touch the dirty list, so it's safe to walk it here
+	for ( int i = 0; i < m_DirtyList.Count(); i++ )
+	{
+		int index = m_DirtyList[i];
+		if ( m_Nodes[index].bDirty )
+		{
+			m_Nodes[index].bDirty = false;
+			UpdateEntity( index );
+		}
+	}
+	m_DirtyList.RemoveAll();
+}
+
+void CEntityNameGrid::UpdateEntity( int index )
+{
+	entgridnode_t &node = m_Nodes[index];
+	CBaseEntity *pEntity = GetEntity( index );
+	if ( !node.bInUse || !pEntity )
+		return;
+
+	const Vector &vecOrigin = pEntity->GetAbsOrigin();
+	unsigned int nCell = PackCell( CellCoord( vecOrigin.x ), CellCoord( vecOrigin.y ), CellCoord( vecOrigin.z ) );
+	const char *pszName = GetKey( pEntity, ENTGRID_KEY_NAME );
+	const char *pszClassname = GetKey( pEntity, ENTGRID_KEY_CLASSNAME );
+
+	if ( nCell != node.nCell || pszName != node.pszKey[ENTGRID_KEY_NAME] || pszClassname != node.pszKey[ENTGRID_KEY_CLASSNAME] )
+	{
+		Unlink( index );
+		node.nCell = nCell;
+		node.pszKey[ENTGRID_KEY_NAME] = pszName;
+		node.pszKey[ENTGRID_KEY_CLASSNAME] = pszClassname;
+		Link( index );
+	}
+
+	// Box searches only look one cell past their bounds, entities whose bounds
+	// can reach further than that (most brush entities) are checked separately
+	const Vector &vecMins = pEntity->CollisionProp()->OBBMins();
+	const Vector &vecMaxs = pEntity->CollisionProp()->OBBMaxs();
+	Vector vecReach( MAX( fabs( vecMins.x ), fabs( vecMaxs.x ) ), MAX( fabs( vecMins.y ), fabs( vecMaxs.y ) ), MAX( fabs( vecMins.z ), fabs( vecMaxs.z ) ) );
+	SetLarge( index, vecReach.LengthSqr() > ENTGRID_CELL_SIZE * ENTGRID_CELL_SIZE );
+}
+
+void CEntityNameGrid::Link( int index )
+{
+	entgridnode_t &node = m_Nodes[index];
+	for ( int iKey = 0; iKey < NUM_ENTGRID_KEYS; iKey++ )
+	{
+		if ( !node.pszKey[iKey] )
+			continue;
+
+		EntGridBucketKey_t key = { node.pszKey[iKey], ( node.nCell << 1 ) | iKey };
+		UtlHashHandle_t hBucket = m_Buckets.Find( key );
+		if ( hBucket == m_Buckets.InvalidHandle() )
+		{
+			m_Buckets.Insert( key, (unsigned short)index );
+			node.nNext[iKey] = ENTGRID_INVALID;
+		}
+		else
+		{
+			unsigned short nHead = m_Buckets[hBucket];
+			m_Nodes[nHead].nPrev[iKey] = (unsigned short)index;
+			node.nNext[iKey] = nHead;
+			m_Buckets[hBucket] = (unsigned short)index;
+		}
+		node.nPrev[iKey] = ENTGRID_INVALID;
+	}
+}
+
+void CEntityNameGrid::Unlink( int index )
+{
+	entgridnode_t &node = m_Nodes[index];
+	for ( int iKey = 0; iKey < NUM_ENTGRID_KEYS; iKey++ )
+	{
+		if ( !node.pszKey[iKey] )
+			continue;
+
+		if ( node.nNext[iKey] != ENTGRID_INVALID )
+		{
+			m_Nodes[node.nNext[iKey]].nPrev[iKey] = node.nPrev[iKey];
+		}
+
+		if ( node.nPrev[iKey] != ENTGRID_INVALID )
+		{
+			m_Nodes[node.nPrev[iKey]].nNext[iKey] = node.nNext[iKey];
+		}
+		else
+		{
+			// Head of the bucket
+			EntGridBucketKey_t key = { node.pszKey[iKey], ( node.nCell << 1 ) | iKey };
+			UtlHashHandle_t hBucket = m_Buckets.Find( key );
+			Assert( hBucket != m_Buckets.InvalidHandle() && m_Buckets[hBucket] == index );
+			if ( node.nNext[iKey] != ENTGRID_INVALID )
+			{
+				m_Buckets[hBucket] = node.nNext[iKey];
+			}
+			else
+			{
+				m_Buckets.Remove( key );
+			}
+		}
+
+		node.pszKey[iKey] = NULL;
+		node.nNext[iKey] = node.nPrev[iKey] = ENTGRID_INVALID;
+	}
+}
+
+void CEntityNameGrid::SetLarge( int index, bool bLarge )
+{
+	entgridnode_t &node = m_Nodes[index];
+	if ( bLarge == ( node.nLargeIndex != ENTGRID_INVALID ) )
+		return;
+
+	if ( bLarge )
+	{
+		node.nLargeIndex = m_LargeEntities.AddToTail( (unsigned short)index );
+	}
+	else
+	{
+		int nLargeIndex = node.nLargeIndex;
+		m_LargeEntities.FastRemove( nLargeIndex );
+		node.nLargeIndex = ENTGRID_INVALID;
+
+		// fast remove shifted someone, update that someone
+		if ( nLargeIndex < m_LargeEntities.Count() )
+		{
+			m_Nodes[m_LargeEntities[nLargeIndex]].nLargeIndex = nLargeIndex;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Fills m_Candidates with every entity whose origin is in a cell
+//			touching the given bounds and which has the given name.
+// Output : false if the bounds cover too many cells to be worth it.
+//-----------------------------------------------------------------------------
+bool CEntityNameGrid::GatherCandidates( int iKey, const char *pszName, const Vector &vecMins, const Vector &vecMaxs )
+{
+	int nMins[3], nMaxs[3];
+	int nCells = 1;
+	for ( int i = 0; i < 3; i++ )
+	{
+		nMins[i] = CellCoord( vecMins[i] );
+		nMaxs[i] = CellCoord( vecMaxs[i] );
+		nCells *= nMaxs[i] - nMins[i] + 1;
+		if ( nCells > ENTGRID_MAX_CELLS )
+			return false;
+	}
+
+	Update();
+
+	m_Candidates.RemoveAll();
+	for ( int x = nMins[0]; x <= nMaxs[0]; x++ )
+	{
+		for ( int y = nMins[1]; y <= nMaxs[1]; y++ )
+		{
+			for ( int z = nMins[2]; z <= nMaxs[2]; z++ )
+			{
+				EntGridBucketKey_t key = { pszName, ( PackCell( x, y, z ) << 1 ) | iKey };
+				UtlHashHandle_t hBucket = m_Buckets.Find( key );
+				if ( hBucket == m_Buckets.InvalidHandle() )
+					continue;
+
+				for ( unsigned short index = m_Buckets[hBucket]; index != ENTGRID_INVALID; index = m_Nodes[index].nNext[iKey] )
+				{
+					m_Candidates.AddToTail( index );
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+bool CEntityNameGrid::GetStartSerial( CBaseEntity *pStartEntity, unsigned int *pSerial )
+{
+	if ( !pStartEntity )
+	{
+		*pSerial = 0;
+		return true;
+	}
+
+	const CBaseHandle &eh = pStartEntity->GetRefEHandle();
+	if ( !eh.IsValid() || !m_Nodes[eh.GetEntryIndex()].bInUse || GetEntity( eh.GetEntryIndex() ) != pStartEntity )
+		return false;
+
+	*pSerial = m_Nodes[eh.GetEntryIndex()].nSerial + 1;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Same result as walking the list and keeping the closest entity
+//			strictly inside the radius, ties going to the earliest in the list.
+//			iszExactClassname additionally requires that exact pooled classname.
+// Output : false if the search has to be done the slow way.
+//-----------------------------------------------------------------------------
+bool CEntityNameGrid::FindNearest( int iKey, const char *pszName, const Vector &vecSrc, float flRadius, CBaseEntity **ppResult, string_t iszExactClassname )
+{
+	float flMaxDist2 = flRadius * flRadius;
+	if ( flMaxDist2 == 0 || !CanSearch( pszName ) )
+		return false;
+
+	Vector vecExtents( fabs( flRadius ), fabs( flRadius ), fabs( flRadius ) );
+	if ( !GatherCandidates( iKey, pszName, vecSrc - vecExtents, vecSrc + vecExtents ) )
+		return false;
+
+	CBaseEntity *pBest = NULL;
+	unsigned int nBestSerial = 0;
+	for ( int i = 0; i < m_Candidates.Count(); i++ )
+	{
+		CBaseEntity *pEntity = GetEntity( m_Candidates[i] );
+		if ( !pEntity->edict() || !KeyMatches( pEntity, iKey, pszName ) )
+			continue;
+
+		// FindEntityByClassnameFast() compares pooled strings, which is case sensitive
+		if ( iszExactClassname != NULL_STRING && pEntity->m_iClassname != iszExactClassname )
+			continue;
+
+		float flDist2 = (pEntity->GetAbsOrigin() - vecSrc).LengthSqr();
+		unsigned int nSerial = m_Nodes[m_Candidates[i]].nSerial;
+		if ( flDist2 < flMaxDist2 || ( pBest && flDist2 == flMaxDist2 && nSerial < nBestSerial ) )
+		{
+			pBest = pEntity;
+			nBestSerial = nSerial;
+			flMaxDist2 = flDist2;
+		}
+	}
+
+	*ppResult = pBest;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds the entity that comes first in the list after pStartEntity
+//			and is strictly inside the radius.
+// Output : false if the search has to be done the slow way.
+//-----------------------------------------------------------------------------
+bool CEntityNameGrid::FindFirstInSphere( int iKey, const char *pszName, CBaseEntity *pStartEntity, const Vector &vecSrc, float flRadius, CBaseEntity **ppResult )
+{
+	unsigned int nStartSerial;
+	float flMaxDist2 = flRadius * flRadius;
+	if ( flMaxDist2 == 0 || !CanSearch( pszName ) || !GetStartSerial( pStartEntity, &nStartSerial ) )
+		return false;
+
+	Vector vecExtents( fabs( flRadius ), fabs( flRadius ), fabs( flRadius ) );
+	if ( !GatherCandidates( iKey, pszName, vecSrc - vecExtents, vecSrc + vecExtents ) )
+		return false;
+
+	CBaseEntity *pBest = NULL;
+	unsigned int nBestSerial = 0;
+	for ( int i = 0; i < m_Candidates.Count(); i++ )
+	{
+		unsigned int nSerial = m_Nodes[m_Candidates[i]].nSerial;
+		if ( nSerial < nStartSerial || ( pBest && nSerial > nBestSerial ) )
+			continue;
+
+		CBaseEntity *pEntity = GetEntity( m_Candidates[i] );
+		if ( !pEntity->edict() || !KeyMatches( pEntity, iKey, pszName ) )
+			continue;
+
+		if ( (pEntity->GetAbsOrigin() - vecSrc).LengthSqr() < flMaxDist2 )
+		{
+			pBest = pEntity;
+			nBestSerial = nSerial;
+		}
+	}
+
+	*ppResult = pBest;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds the entity that comes first in the list after pStartEntity
+//			and whose bounds intersect the box.
+// Output : false if the search has to be done the slow way.
+//-----------------------------------------------------------------------------
+bool CEntityNameGrid::FindFirstInBox( int iKey, const char *pszName, CBaseEntity *pStartEntity, const Vector &vecMins, const Vector &vecMaxs, CBaseEntity **ppResult )
+{
+	unsigned int nStartSerial;
+	if ( !CanSearch( pszName ) || !GetStartSerial( pStartEntity, &nStartSerial ) )
+		return false;
+
+	// Small entities can't reach further than a cell from their origin
+	Vector vecExtents( ENTGRID_CELL_SIZE, ENTGRID_CELL_SIZE, ENTGRID_CELL_SIZE );
+	if ( !GatherCandidates( iKey, pszName, vecMins - vecExtents, vecMaxs + vecExtents ) )
+		return false;
+
+	// The large ones have to be checked wherever they are
+	for ( int i = 0; i < m_LargeEntities.Count(); i++ )
+	{
+		const entgridnode_t &node = m_Nodes[m_LargeEntities[i]];
+		if ( node.pszKey[iKey] && !Q_stricmp( node.pszKey[iKey], pszName ) )
+		{
+			m_Candidates.AddToTail( m_LargeEntities[i] );
+		}
+	}
+
+	CBaseEntity *pBest = NULL;
+	unsigned int nBestSerial = 0;
+	for ( int i = 0; i < m_Candidates.Count(); i++ )
+	{
+		unsigned int nSerial = m_Nodes[m_Candidates[i]].nSerial;
+		if ( nSerial < nStartSerial || ( pBest && nSerial > nBestSerial ) )
+			continue;
+
+		CBaseEntity *pEntity = GetEntity( m_Candidates[i] );
+		if ( !pEntity->edict() && !pEntity->IsEFlagSet( EFL_SERVER_ONLY ) )
+			continue;
+
+		if ( !KeyMatches( pEntity, iKey, pszName ) )
+			continue;
+
+		Vector entMins, entMaxs;
+		pEntity->CollisionProp()->WorldSpaceAABB( &entMins, &entMaxs );
+		if ( IsBoxIntersectingBox( vecMins, vecMaxs, entMins, entMaxs ) )
+		{
+			pBest = pEntity;
+			nBestSerial = nSerial;
+		}
+	}
+
+	*ppResult = pBest;
+	return true;
+}
+
 static CBaseEntityClassList *s_pClassLists = NULL;
 CBaseEntityClassList::CBaseEntityClassList()
 {
@@ -372,6 +905,231 @@ void CGlobalEntityList::AddListenerEntity( IEntityListener *pListener )
 	m_entityListeners.AddToTail( pListener );
 }
 
+//-----------------------------------------------------------------------------
+// Per-name entity lists for the name and classname searches. Each list holds
+// every entity whose targetname (or classname) matches case-insensitively,
+// kept in entity list order, so walking it gives the same sequence as walking
+// the whole entity list and testing each entity.
+//
+// Lists are updated immediately when a name changes (see
+// ReportEntityNameChanged) and when an entity leaves the entity list.
+//-----------------------------------------------------------------------------
+ConVar ent_find_use_name_lists( "ent_find_use_name_lists", "1", FCVAR_NONE, "Use per-name entity lists for name and classname searches." );
+
+struct entnamelist_t
+{
+	unsigned short	nHead;
+	unsigned short	nTail;
+};
+
+struct entnamelistnode_t
+{
+	string_t		iszKey[NUM_ENTGRID_KEYS];
+	unsigned short	nNext[NUM_ENTGRID_KEYS];
+	unsigned short	nPrev[NUM_ENTGRID_KEYS];
+};
+
+class CEntityNameLists
+{
+public:
+	CEntityNameLists()
+	{
+		Clear();
+	}
+
+	void Clear()
+	{
+		for ( int iKey = 0; iKey < NUM_ENTGRID_KEYS; iKey++ )
+		{
+			m_Lists[iKey].Purge();
+		}
+
+		for ( int i = 0; i < ARRAYSIZE(m_Nodes); i++ )
+		{
+			ResetNode( m_Nodes[i] );
+		}
+	}
+
+	void LevelShutdownPostEntity()
+	{
+		Clear();
+	}
+
+	void AddEntity( int index )
+	{
+		ResetNode( m_Nodes[index] );
+	}
+
+	void RemoveEntity( int index )
+	{
+		for ( int iKey = 0; iKey < NUM_ENTGRID_KEYS; iKey++ )
+		{
+			Unlink( index, iKey );
+		}
+	}
+
+	void EntityNameChanged( CBaseEntity *pEntity )
+	{
+		int index = pEntity->GetRefEHandle().GetEntryIndex();
+		for ( int iKey = 0; iKey < NUM_ENTGRID_KEYS; iKey++ )
+		{
+			string_t iszKey = ( iKey == ENTGRID_KEY_NAME ) ? pEntity->GetEntityName() : pEntity->m_iClassname;
+			if ( iszKey == m_Nodes[index].iszKey[iKey] )
+				continue;
+
+			Unlink( index, iKey );
+			if ( iszKey != NULL_STRING && STRING(iszKey)[0] )
+			{
+				Link( index, iKey, iszKey );
+			}
+		}
+	}
+
+	static bool CanSearch( const char *pszName )
+	{
+		return ent_find_use_name_lists.GetBool() && IsPlainEntityName( pszName );
+	}
+
+	CBaseEntity *FirstAfter( int iKey, const char *pszName, CBaseEntity *pStartEntity );
+
+	CBaseEntity *Next( int iKey, CBaseEntity *pEntity )
+	{
+		unsigned short nNext = m_Nodes[pEntity->GetRefEHandle().GetEntryIndex()].nNext[iKey];
+		return ( nNext != ENTGRID_INVALID ) ? GetEntity( nNext ) : NULL;
+	}
+
+	int ListCount( int iKey ) const
+	{
+		return m_Lists[iKey].Count();
+	}
+
+private:
+	static void ResetNode( entnamelistnode_t &node )
+	{
+		for ( int iKey = 0; iKey < NUM_ENTGRID_KEYS; iKey++ )
+		{
+			node.iszKey[iKey] = NULL_STRING;
+			node.nNext[iKey] = node.nPrev[iKey] = ENTGRID_INVALID;
+		}
+	}
+
+	static CBaseEntity *GetEntity( int index )
+	{
+		return (CBaseEntity *)gEntList.GetEntInfoPtrByIndex( index )->m_pEntity;
+	}
+
+	void Link( int index, int iKey, string_t iszKey );
+	void Unlink( int index, int iKey );
+
+	entnamelistnode_t	m_Nodes[NUM_ENT_ENTRIES];
+	CUtlHashtable< const char *, entnamelist_t, CaselessStringHashFunctor, CaselessStringEqualFunctor > m_Lists[NUM_ENTGRID_KEYS];
+};
+
+CEntityNameLists g_EntityNameLists;
+
+void CEntityNameLists::Link( int index, int iKey, string_t iszKey )
+{
+	entnamelistnode_t &node = m_Nodes[index];
+	Assert( node.iszKey[iKey] == NULL_STRING );
+	node.iszKey[iKey] = iszKey;
+
+	UtlHashHandle_t hList = m_Lists[iKey].Find( STRING(iszKey) );
+	if ( hList == m_Lists[iKey].InvalidHandle() )
+	{
+		entnamelist_t list = { (unsigned short)index, (unsigned short)index };
+		m_Lists[iKey].Insert( STRING(iszKey), list );
+		node.nNext[iKey] = node.nPrev[iKey] = ENTGRID_INVALID;
+		return;
+	}
+
+	// Names are nearly always set right after the entity is created, so
+	// searching back from the tail for our place in list order is cheap
+	entnamelist_t &list = m_Lists[iKey][hList];
+	unsigned int nSerial = g_EntityNameGrid.GetSerial( index );
+	unsigned short nPrev = list.nTail;
+	while ( nPrev != ENTGRID_INVALID && g_EntityNameGrid.GetSerial( nPrev ) > nSerial )
+	{
+		nPrev = m_Nodes[nPrev].nPrev[iKey];
+	}
+
+	unsigned short nNext = ( nPrev != ENTGRID_INVALID ) ? m_Nodes[nPrev].nNext[iKey] : list.nHead;
+	node.nPrev[iKey] = nPrev;
+	node.nNext[iKey] = nNext;
+
+	if ( nPrev != ENTGRID_INVALID )
+		m_Nodes[nPrev].nNext[iKey] = (unsigned short)index;
+	else
+		list.nHead = (unsigned short)index;
+
+	if ( nNext != ENTGRID_INVALID )
+		m_Nodes[nNext].nPrev[iKey] = (unsigned short)index;
+	else
+		list.nTail = (unsigned short)index;
+}
+
+void CEntityNameLists::Unlink( int index, int iKey )
+{
+	entnamelistnode_t &node = m_Nodes[index];
+	if ( node.iszKey[iKey] == NULL_STRING )
+		return;
+
+	UtlHashHandle_t hList = m_Lists[iKey].Find( STRING(node.iszKey[iKey]) );
+	Assert( hList != m_Lists[iKey].InvalidHandle() );
+	entnamelist_t &list = m_Lists[iKey][hList];
+
+	if ( node.nPrev[iKey] != ENTGRID_INVALID )
+		m_Nodes[node.nPrev[iKey]].nNext[iKey] = node.nNext[iKey];
+	else
+		list.nHead = node.nNext[iKey];
+
+	if ( node.nNext[iKey] != ENTGRID_INVALID )
+		m_Nodes[node.nNext[iKey]].nPrev[iKey] = node.nPrev[iKey];
+	else
+		list.nTail = node.nPrev[iKey];
+
+	if ( list.nHead == ENTGRID_INVALID )
+	{
+		m_Lists[iKey].Remove( STRING(node.iszKey[iKey]) );
+	}
+
+	node.iszKey[iKey] = NULL_STRING;
+	node.nNext[iKey] = node.nPrev[iKey] = ENTGRID_INVALID;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the first entity after pStartEntity in list order whose
+//			name matches pszName, or NULL if there aren't any.
+//-----------------------------------------------------------------------------
+CBaseEntity *CEntityNameLists::FirstAfter( int iKey, const char *pszName, CBaseEntity *pStartEntity )
+{
+	unsigned int nStartSerial = 0;
+	if ( pStartEntity )
+	{
+		int nStartIndex = pStartEntity->GetRefEHandle().GetEntryIndex();
+		const entnamelistnode_t &startNode = m_Nodes[nStartIndex];
+
+		// Continuing a search, which is the common case
+		if ( startNode.iszKey[iKey] != NULL_STRING && !Q_stricmp( STRING(startNode.iszKey[iKey]), pszName ) )
+		{
+			return ( startNode.nNext[iKey] != ENTGRID_INVALID ) ? GetEntity( startNode.nNext[iKey] ) : NULL;
+		}
+
+		nStartSerial = g_EntityNameGrid.GetSerial( nStartIndex ) + 1;
+	}
+
+	UtlHashHandle_t hList = m_Lists[iKey].Find( pszName );
+	if ( hList == m_Lists[iKey].InvalidHandle() )
+		return NULL;
+
+	for ( unsigned short index = m_Lists[iKey][hList].nHead; index != ENTGRID_INVALID; index = m_Nodes[index].nNext[iKey] )
+	{
+		if ( g_EntityNameGrid.GetSerial( index ) >= nStartSerial )
+			return GetEntity( index );
+	}
+
+	return NULL;
+}
+
 void CGlobalEntityList::RemoveListenerEntity( IEntityListener *pListener )
 {
 	m_entityListeners.FindAndRemove( pListener );
@@ -481,6 +1239,32 @@ void CGlobalEntityList::ReportEntityFlagsChanged( CBaseEntity *pEntity, unsigned
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Called when an entity's targetname or classname is changed so the
+//			search indices can pick up the new name.
+//-----------------------------------------------------------------------------
+void CGlobalEntityList::ReportEntityNameChanged( CBaseEntity *pEntity )
+{
+	const CBaseHandle &eh = pEntity->GetRefEHandle();
+	if ( eh.IsValid() )
+	{
+		g_EntityNameGrid.MarkDirty( eh.GetEntryIndex() );
+		g_EntityNameLists.EntityNameChanged( pEntity );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Called when an entity's origin or collision bounds change.
+//-----------------------------------------------------------------------------
+void CGlobalEntityList::ReportEntityMoved( CBaseEntity *pEntity )
+{
+	const CBaseHandle &eh = pEntity->GetRefEHandle();
+	if ( eh.IsValid() )
+	{
+		g_EntityNameGrid.MarkDirty( eh.GetEntryIndex() );
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Used to confirm a pointer is a pointer to an entity, useful for
 //			asserts.
@@ -511,6 +1295,21 @@ CBaseEntity *CGlobalEntityList::FindEntityByClassname( CBaseEntity *pStartEntity
 CBaseEntity *CGlobalEntityList::FindEntityByClassname( CBaseEntity *pStartEntity, const char *szName )
 #endif
 {
+	if ( g_EntityNameLists.CanSearch( szName ) )
+	{
+		for ( CBaseEntity *pEntity = g_EntityNameLists.FirstAfter( ENTGRID_KEY_CLASSNAME, szName, pStartEntity ); pEntity; pEntity = g_EntityNameLists.Next( ENTGRID_KEY_CLASSNAME, pEntity ) )
+		{
+#ifdef MAPBASE
+			if ( pFilter && !pFilter->ShouldFindEntity(pEntity) )
+				continue;
+#endif
+			return pEntity;
+		}
+
+		return NULL;
+	}
+
+	// Wildcards and such have to be tested against every entity
 	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
 
 	for ( ;pInfo; pInfo = pInfo->m_pNext )
@@ -542,19 +1341,17 @@ CBaseEntity *CGlobalEntityList::FindEntityByClassname( CBaseEntity *pStartEntity
 // From Alien Swarm SDK
 CBaseEntity *CGlobalEntityList::FindEntityByClassnameFast( CBaseEntity *pStartEntity, string_t iszClassname )
 {
-	/*
-	if ( pStartEntity )
+	if ( g_EntityNameLists.CanSearch( STRING(iszClassname) ) )
 	{
-		return pStartEntity->m_pNextByClass;
-	}
+		// The lists are case-insensitive, this wants the exact string
+		for ( CBaseEntity *pEntity = g_EntityNameLists.FirstAfter( ENTGRID_KEY_CLASSNAME, STRING(iszClassname), pStartEntity ); pEntity; pEntity = g_EntityNameLists.Next( ENTGRID_KEY_CLASSNAME, pEntity ) )
+		{
+			if ( pEntity->m_iClassname == iszClassname )
+				return pEntity;
+		}
 
-	EntsByStringList_t key = { iszClassname };
-	UtlHashHandle_t hEntry = g_EntsByClassname.Find( key );
-	if ( hEntry != g_EntsByClassname.InvalidHandle() )
-	{
-		return g_EntsByClassname[hEntry].pHead;
+		return NULL;
 	}
-	*/
 
 	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
 
@@ -808,7 +1605,21 @@ CBaseEntity *CGlobalEntityList::FindEntityByName( CBaseEntity *pStartEntity, con
 
 		return NULL;
 	}
+
+	if ( g_EntityNameLists.CanSearch( szName ) )
+	{
+		for ( CBaseEntity *ent = g_EntityNameLists.FirstAfter( ENTGRID_KEY_NAME, szName, pStartEntity ); ent; ent = g_EntityNameLists.Next( ENTGRID_KEY_NAME, ent ) )
+		{
+			if ( pFilter && !pFilter->ShouldFindEntity(ent) )
+				continue;
+
+			return ent;
+		}
+
+		return NULL;
+	}
 	
+	// Wildcards and regex have to be tested against every entity
 	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
 
 	for ( ;pInfo; pInfo = pInfo->m_pNext )
@@ -841,6 +1652,18 @@ CBaseEntity *CGlobalEntityList::FindEntityByNameFast( CBaseEntity *pStartEntity,
 	if ( iszName == NULL_STRING || STRING(iszName)[0] == 0 )
 		return NULL;
 
+	if ( g_EntityNameLists.CanSearch( STRING(iszName) ) )
+	{
+		// The lists are case-insensitive, this wants the exact string
+		for ( CBaseEntity *ent = g_EntityNameLists.FirstAfter( ENTGRID_KEY_NAME, STRING(iszName), pStartEntity ); ent; ent = g_EntityNameLists.Next( ENTGRID_KEY_NAME, ent ) )
+		{
+			if ( ent->m_iName.Get() == iszName )
+				return ent;
+		}
+
+		return NULL;
+	}
+
 	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
 
 	for ( ;pInfo; pInfo = pInfo->m_pNext )
@@ -971,6 +1794,8 @@ CBaseEntity *CGlobalEntityList::FindEntityInSphere( CBaseEntity *pStartEntity, c
 CBaseEntity *CGlobalEntityList::FindEntityByNameNearest( const char *szName, const Vector &vecSrc, float flRadius, CBaseEntity *pSearchingEntity, CBaseEntity *pActivator, CBaseEntity *pCaller )
 {
 	CBaseEntity *pEntity = NULL;
+	if ( g_EntityNameGrid.FindNearest( ENTGRID_KEY_NAME, szName, vecSrc, flRadius, &pEntity ) )
+		return pEntity;
 
 	//
 	// Check for matching class names within the search radius.
@@ -1024,6 +1849,9 @@ CBaseEntity *CGlobalEntityList::FindEntityByNameWithin( CBaseEntity *pStartEntit
 		return gEntList.FindEntityByName( pEntity, szName, pSearchingEntity, pActivator, pCaller );
 	}
 
+	if ( g_EntityNameGrid.FindFirstInSphere( ENTGRID_KEY_NAME, szName, pStartEntity, vecSrc, flRadius, &pEntity ) )
+		return pEntity;
+
 	while ((pEntity = gEntList.FindEntityByName( pEntity, szName, pSearchingEntity, pActivator, pCaller )) != NULL)
 	{
 		if ( !pEntity->edict() )
@@ -1052,6 +1880,8 @@ CBaseEntity *CGlobalEntityList::FindEntityByNameWithin( CBaseEntity *pStartEntit
 CBaseEntity *CGlobalEntityList::FindEntityByClassnameNearest( const char *szName, const Vector &vecSrc, float flRadius )
 {
 	CBaseEntity *pEntity = NULL;
+	if ( g_EntityNameGrid.FindNearest( ENTGRID_KEY_CLASSNAME, szName, vecSrc, flRadius, &pEntity ) )
+		return pEntity;
 
 	//
 	// Check for matching class names within the search radius.
@@ -1085,6 +1915,8 @@ CBaseEntity *CGlobalEntityList::FindEntityByClassnameNearest( const char *szName
 CBaseEntity *CGlobalEntityList::FindEntityByClassnameNearestFast( string_t iszName, const Vector &vecSrc, float flRadius )
 {
 	CBaseEntity *pEntity = NULL;
+	if ( g_EntityNameGrid.FindNearest( ENTGRID_KEY_CLASSNAME, STRING( iszName ), vecSrc, flRadius, &pEntity, iszName ) )
+		return pEntity;
 
 	//
 	// Check for matching class names within the search radius.
@@ -1176,6 +2008,9 @@ CBaseEntity *CGlobalEntityList::FindEntityByClassnameWithin( CBaseEntity *pStart
 		return gEntList.FindEntityByClassname( pEntity, szName );
 	}
 
+	if ( g_EntityNameGrid.FindFirstInSphere( ENTGRID_KEY_CLASSNAME, szName, pStartEntity, vecSrc, flRadius, &pEntity ) )
+		return pEntity;
+
 	while ((pEntity = gEntList.FindEntityByClassname( pEntity, szName )) != NULL)
 	{
 		if ( !pEntity->edict() )
@@ -1207,6 +2042,8 @@ CBaseEntity *CGlobalEntityList::FindEntityByClassnameWithin( CBaseEntity *pStart
 	// Check for matching class names within the search radius.
 	//
 	CBaseEntity *pEntity = pStartEntity;
+	if ( g_EntityNameGrid.FindFirstInBox( ENTGRID_KEY_CLASSNAME, szName, pStartEntity, vecMins, vecMaxs, &pEntity ) )
+		return pEntity;
 
 	while ((pEntity = gEntList.FindEntityByClassname( pEntity, szName )) != NULL)
 	{
@@ -1424,6 +2261,9 @@ void CGlobalEntityList::OnAddEntity( IHandleEntity *pEnt, CBaseHandle handle )
 	if ( i > m_iHighestEnt )
 		m_iHighestEnt = i;
 
+	g_EntityNameGrid.AddEntity( i );
+	g_EntityNameLists.AddEntity( i );
+
 	// If it's a CBaseEntity, notify the listeners.
 	CBaseEntity *pBaseEnt = static_cast<IServerUnknown*>(pEnt)->GetBaseEntity();
 	if ( pBaseEnt->edict() )
@@ -1431,6 +2271,9 @@ void CGlobalEntityList::OnAddEntity( IHandleEntity *pEnt, CBaseHandle handle )
 	
 	// NOTE: Must be a CBaseEntity on server
 	Assert( pBaseEnt );
+
+	// Pick up anything named before it got a handle
+	g_EntityNameLists.EntityNameChanged( pBaseEnt );
 	//DevMsg(2,"Created %s\n", pBaseEnt->GetClassname() );
 	for ( i = m_entityListeners.Count()-1; i >= 0; i-- )
 	{
@@ -1462,6 +2305,9 @@ void CGlobalEntityList::OnRemoveEntity( IHandleEntity *pEnt, CBaseHandle handle
 		m_iNumEdicts--;
 
 	m_iNumEnts--;
+
+	g_EntityNameGrid.RemoveEntity( handle.GetEntryIndex() );
+	g_EntityNameLists.RemoveEntity( handle.GetEntryIndex() );
 }
 
 void CGlobalEntityList::NotifyCreateEntity( CBaseEntity *pEnt )
@@ -1747,6 +2593,8 @@ public:
 		g_TouchManager.LevelShutdownPostEntity();
 		g_AimManager.LevelShutdownPostEntity();
 		g_SimThinkManager.LevelShutdownPostEntity();
+		g_EntityNameGrid.LevelShutdownPostEntity();
+		g_EntityNameLists.LevelShutdownPostEntity();
 		CBaseEntityClassList *pClassList = s_pClassLists;
 		while ( pClassList )
 		{
@@ -1964,3 +2812,96 @@ CON_COMMAND(report_simthinklist, "Lists all simulating/thinking entities")
 	list.ReportEntityList();
 }
 
+
+//-----------------------------------------------------------------------------
+// Purpose: Times name and classname lookups with and without the per-name
+//			entity lists, using a batch of temporary entities.
+//-----------------------------------------------------------------------------
+static int EntFindBenchmark_Run( const CUtlVector<string_t> &names, int nIterations )
+{
+	int nFound = 0;
+	for ( int i = 0; i < nIterations; i++ )
+	{
+		const char *pszName = STRING( names[i % names.Count()] );
+		for ( CBaseEntity *pEntity = gEntList.FindEntityByName( NULL, pszName ); pEntity; pEntity = gEntList.FindEntityByName( pEntity, pszName ) )
+		{
+			nFound++;
+		}
+
+		for ( CBaseEntity *pEntity = gEntList.FindEntityByNameFast( NULL, names[i % names.Count()] ); pEntity; pEntity = gEntList.FindEntityByNameFast( pEntity, names[i % names.Count()] ) )
+		{
+			nFound++;
+		}
+
+		// Classname enumeration visits every test entity, so do fewer of them
+		if ( ( i % 16 ) == 0 )
+		{
+			for ( CBaseEntity *pEntity = gEntList.FindEntityByClassname( NULL, "logic_relay" ); pEntity; pEntity = gEntList.FindEntityByClassname( pEntity, "logic_relay" ) )
+			{
+				nFound++;
+			}
+		}
+	}
+
+	return nFound;
+}
+
+CON_COMMAND_F( ent_find_benchmark, "Spawns temporary entities and times name/classname lookups with and without the name lists.\nUsage: ent_find_benchmark [entities] [unique names] [iterations]", FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nEntities = args.ArgC() > 1 ? atoi( args[1] ) : 1000;
+	int nNames = args.ArgC() > 2 ? atoi( args[2] ) : 100;
+	int nIterations = args.ArgC() > 3 ? atoi( args[3] ) : 10000;
+
+	// Leave some room for whatever the map wants to spawn
+	nEntities = clamp( nEntities, 1, NUM_ENT_ENTRIES - gEntList.NumberOfEntities() - 256 );
+	nNames = clamp( nNames, 1, nEntities );
+	nIterations = MAX( nIterations, 1 );
+
+	CUtlVector<string_t> names;
+	for ( int i = 0; i < nNames; i++ )
+	{
+		names.AddToTail( AllocPooledString( CFmtStr( "ent_find_benchmark_%d", i ) ) );
+	}
+
+	CUtlVector<CBaseEntity *> entities;
+	for ( int i = 0; i < nEntities; i++ )
+	{
+		CBaseEntity *pEntity = CreateEntityByName( "logic_relay" );
+		if ( !pEntity )
+			break;
+
+		pEntity->SetName( names[i % nNames] );
+		DispatchSpawn( pEntity );
+		entities.AddToTail( pEntity );
+	}
+
+	bool bOldValue = ent_find_use_name_lists.GetBool();
+
+	ent_find_use_name_lists.SetValue( 0 );
+	double flStart = Plat_FloatTime();
+	int nFoundLinear = EntFindBenchmark_Run( names, nIterations );
+	double flLinear = Plat_FloatTime() - flStart;
+
+	ent_find_use_name_lists.SetValue( 1 );
+	flStart = Plat_FloatTime();
+	int nFoundLists = EntFindBenchmark_Run( names, nIterations );
+	double flLists = Plat_FloatTime() - flStart;
+
+	ent_find_use_name_lists.SetValue( bOldValue );
+
+	Msg( "ent_find_benchmark: %d entities (%d total), %d names, %d iterations\n", entities.Count(), gEntList.NumberOfEntities(), nNames, nIterations );
+	Msg( "  linear search: %8.3f ms (%d found)\n", flLinear * 1000.0, nFoundLinear );
+	Msg( "  name lists:    %8.3f ms (%d found)\n", flLists * 1000.0, nFoundLists );
+	if ( nFoundLinear != nFoundLists )
+	{
+		Warning( "ent_find_benchmark: results differ!\n" );
+	}
+
+	for ( int i = 0; i < entities.Count(); i++ )
+	{
+		UTIL_Remove( entities[i] );
+	}
+}
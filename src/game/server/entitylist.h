@@ -137,6 +137,8 @@ public:
 	void RemoveListenerEntity( IEntityListener *pListener );
 
 	void ReportEntityFlagsChanged( CBaseEntity *pEntity, unsigned int flagsOld, unsigned int flagsNow );
+	void ReportEntityNameChanged( CBaseEntity *pEntity );
+	void ReportEntityMoved( CBaseEntity *pEntity );
 
 	// entity is about to be removed, notify the listeners
 	void NotifyCreateEntity( CBaseEntity *pEnt );
@@ -15,6 +15,17 @@
 #endif
 
 #include "mempool.h"
+#include "utlhashtable.h"
+
+// Secondary indices maintained alongside the fire-time heap so that cancels and
+// lookups by entity only have to visit that entity's own events.
+enum EventQueueIndex_t
+{
+	EVENTQUEUE_INDEX_TARGET = 0,	// keyed by m_pEntTarget
+	EVENTQUEUE_INDEX_CALLER,		// keyed by m_pCaller
+
+	NUM_EVENTQUEUE_INDICES
+};
 
 struct EventQueuePrioritizedEvent_t
 {
@@ -28,8 +39,13 @@ struct EventQueuePrioritizedEvent_t
 
 	variant_t m_VariantValue;	// variable-type parameter
 
-	EventQueuePrioritizedEvent_t *m_pNext;
-	EventQueuePrioritizedEvent_t *m_pPrev;
+	int m_iHeapIndex;			// position in CEventQueue::m_Heap, -1 when not queued
+	unsigned int m_iSerial;		// insertion order, breaks ties between events with the same fire time
+
+	// intrusive per-entity chains, see EventQueueIndex_t
+	unsigned int m_iIndexKey[NUM_EVENTQUEUE_INDICES];
+	EventQueuePrioritizedEvent_t *m_pIndexNext[NUM_EVENTQUEUE_INDICES];
+	EventQueuePrioritizedEvent_t *m_pIndexPrev[NUM_EVENTQUEUE_INDICES];
 
 	DECLARE_SIMPLE_DATADESC();
 
@@ -81,9 +97,29 @@ private:
 
 	void AddEvent( EventQueuePrioritizedEvent_t *event );
 	void RemoveEvent( EventQueuePrioritizedEvent_t *pe );
+	void DeleteEvent( EventQueuePrioritizedEvent_t *pe );
+
+	// binary min-heap on (m_flFireTime, m_iSerial)
+	static bool FiresBefore( const EventQueuePrioritizedEvent_t *a, const EventQueuePrioritizedEvent_t *b );
+	void HeapSwap( int i, int j );
+	void HeapSiftUp( int i );
+	void HeapSiftDown( int i );
+
+	void LinkIndex( EventQueuePrioritizedEvent_t *pe, int iIndex, unsigned int iKey );
+	void UnlinkIndex( EventQueuePrioritizedEvent_t *pe, int iIndex );
+	EventQueuePrioritizedEvent_t *FirstInIndex( int iIndex, CBaseEntity *pEntity ) const;
+
+	// copies the queued events into fire order, for save and dump
+	void GetSortedEvents( CUtlVector<EventQueuePrioritizedEvent_t *> &events ) const;
 
 	DECLARE_SIMPLE_DATADESC();
-	EventQueuePrioritizedEvent_t m_Events;
+	CUtlVector<EventQueuePrioritizedEvent_t *> m_Heap;
+	CUtlHashtable<unsigned int, EventQueuePrioritizedEvent_t *> m_Index[NUM_EVENTQUEUE_INDICES];
+#ifdef MAPBASE_VSCRIPT
+	CUtlHashtable<const void *> m_LiveEvents;	// validates script event IDs before they are dereferenced
+#endif
+	EventQueuePrioritizedEvent_t *m_pServicingEvent;	// event currently being fired by ServiceEvents
+	unsigned int m_iNextSerial;
 	int m_iListCount;
 };
 
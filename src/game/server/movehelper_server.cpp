@@ -67,10 +67,14 @@ public:
 
 	void			SetHost( CBasePlayer *host );
 
+	virtual void	SetReplaying( bool bReplaying )	{ m_bReplaying = bReplaying; }
+	virtual bool	IsReplaying( void ) const		{ return m_bReplaying; }
+
 	virtual bool IsWorldEntity( const CBaseHandle &handle );
 
 private:
 	CBasePlayer*	m_pHostPlayer;
+	bool			m_bReplaying;
 
 	// results, tallied on client and server, but only used by server to run SV_Impact.
 	// we store off our velocity in the trace_t structure so that we can determine results
@@ -115,6 +119,7 @@ static inline edict_t* GetEdict( EntityHandle_t handle )
 CMoveHelperServer::CMoveHelperServer( void ) : m_TouchList( 0, 128 )
 {
 	m_pHostPlayer = 0;
+	m_bReplaying = false;
 	SetSingleton( this );
 }
 
@@ -183,6 +188,9 @@ bool CMoveHelperServer::AddToTouched( const trace_t &tr, const Vector& impactvel
 	if ( !tr.m_pEnt )
 		return false;
 
+	if ( m_bReplaying )
+		return false;
+
 	if ( tr.m_pEnt == m_pHostPlayer )
 	{
 		Assert( !"CMoveHelperServer::AddToTouched:  Tried to add self to touchlist!!!" );
@@ -269,6 +277,9 @@ void CMoveHelperServer::ProcessImpacts( void )
 //-----------------------------------------------------------------------------
 void CMoveHelperServer::StartSound( const Vector& origin, const char *soundname )
 {
+	if ( m_bReplaying )
+		return;
+
 	//MDB - Changing this to send to PAS, as the overloaded function below has done.
 	//Also removed the UsePredictionRules, client does not yet play the equivalent sound
 
@@ -284,6 +295,8 @@ void CMoveHelperServer::StartSound( const Vector& origin, const char *soundname
 void CMoveHelperServer::StartSound( const Vector& origin, int channel, char const* sample, 
 						float volume, soundlevel_t soundlevel, int fFlags, int pitch )
 {
+	if ( m_bReplaying )
+		return;
 
 	CRecipientFilter filter;
 	filter.AddRecipientsByPAS( origin );
@@ -359,6 +372,9 @@ void CMoveHelperServer::Con_NPrintf( int idx, char const* pFormat, ...)
 //-----------------------------------------------------------------------------
 bool CMoveHelperServer::PlayerFallingDamage( void )
 {
+	if ( m_bReplaying )
+		return ( m_pHostPlayer->m_iHealth > 0 );
+
 	float flFallDamage = g_pGameRules->FlPlayerFallDamage( m_pHostPlayer );	
 	if ( flFallDamage > 0 )
 	{
@@ -407,6 +423,9 @@ bool CMoveHelperServer::PlayerFallingDamage( void )
 //-----------------------------------------------------------------------------
 void CMoveHelperServer::PlayerSetAnimation( PLAYER_ANIM eAnim )
 {
+	if ( m_bReplaying )
+		return;
+
 	m_pHostPlayer->SetAnimation( eAnim );
 }
 
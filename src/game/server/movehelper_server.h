@@ -31,6 +31,11 @@ abstract_class IMoveHelperServer : public IMoveHelper
 {
 public:
 	virtual void SetHost( CBasePlayer *host ) = 0;
+
+	// While replaying commands that already ran, movement plays no sounds or
+	// animations, deals no falling damage and touches nothing
+	virtual void SetReplaying( bool bReplaying ) = 0;
+	virtual bool IsReplaying( void ) const = 0;
 };
 
 //-----------------------------------------------------------------------------
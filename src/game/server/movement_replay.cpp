@@ -0,0 +1,412 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Records the movement commands of one player, and replays them
+//			through g_pGameMovement to time ProcessMovement on its own and
+//			check it still moves the player the same way.
+//
+//			Each command is replayed from the player state it was recorded
+//			with, so one command that comes out differently doesn't throw
+//			off the ones after it.  Replays run against the collision of
+//			whatever map is loaded, which should be the one recorded on.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "player.h"
+#include "igamemovement.h"
+#include "movehelper_server.h"
+#include "filesystem.h"
+#include "utlbuffer.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+extern IGameMovement *g_pGameMovement;
+extern CMoveData *g_pMoveData;
+
+#define MOVEMENT_RECORDING_ID		MAKEID('M','V','R','C')
+#define MOVEMENT_RECORDING_VERSION	1
+
+//-----------------------------------------------------------------------------
+// Player state that ProcessMovement reads besides the move data
+//-----------------------------------------------------------------------------
+struct MovementPlayerState_t
+{
+	void Save( CBasePlayer *player );
+	void Restore( CBasePlayer *player ) const;
+	static void MuteFootsteps( CBasePlayer *player )	{ player->m_flStepSoundTime = 1.0e6f; }
+
+	float		curtime;
+	float		frametime;
+	int			flags;
+	int			groundEntity;		// entity index, -1 for none
+	int			moveType;
+	int			moveCollide;
+	int			waterLevel;
+	int			waterType;
+	bool		ducked;
+	bool		ducking;
+	bool		inDuckJump;
+	float		duckTime;
+	float		duckJumpTime;
+	float		jumpTime;
+	float		fallVelocity;
+	float		surfaceFriction;
+	float		waterJumpTime;
+	Vector		waterJumpVel;
+	float		stepSoundTime;
+	Vector		viewOffset;
+	Vector		baseVelocity;
+	QAngle		viewAngle;
+};
+
+void MovementPlayerState_t::Save( CBasePlayer *player )
+{
+	curtime = gpGlobals->curtime;
+	frametime = gpGlobals->frametime;
+	flags = player->GetFlags();
+	groundEntity = player->GetGroundEntity() ? player->GetGroundEntity()->entindex() : -1;
+	moveType = player->GetMoveType();
+	moveCollide = player->GetMoveCollide();
+	waterLevel = player->GetWaterLevel();
+	waterType = player->GetWaterType();
+	ducked = player->m_Local.m_bDucked;
+	ducking = player->m_Local.m_bDucking;
+	inDuckJump = player->m_Local.m_bInDuckJump;
+	duckTime = player->m_Local.m_flDucktime;
+	duckJumpTime = player->m_Local.m_flDuckJumpTime;
+	jumpTime = player->m_Local.m_flJumpTime;
+	fallVelocity = player->m_Local.m_flFallVelocity;
+	surfaceFriction = player->m_surfaceFriction;
+	waterJumpTime = player->m_flWaterJumpTime;
+	waterJumpVel = player->m_vecWaterJumpVel;
+	stepSoundTime = player->m_flStepSoundTime;
+	viewOffset = player->GetViewOffset();
+	baseVelocity = player->GetBaseVelocity();
+	viewAngle = player->pl.v_angle;
+}
+
+void MovementPlayerState_t::Restore( CBasePlayer *player ) const
+{
+	gpGlobals->curtime = curtime;
+	gpGlobals->frametime = frametime;
+	player->ClearFlags();
+	player->AddFlag( flags );
+	player->SetGroundEntity( ( groundEntity >= 0 ) ? CBaseEntity::Instance( groundEntity ) : NULL );
+	if ( player->GetMoveType() != moveType || player->GetMoveCollide() != moveCollide )
+	{
+		player->SetMoveType( (MoveType_t)moveType, (MoveCollide_t)moveCollide );
+	}
+	player->SetWaterLevel( waterLevel );
+	player->SetWaterType( waterType );
+	player->m_Local.m_bDucked = ducked;
+	player->m_Local.m_bDucking = ducking;
+	player->m_Local.m_bInDuckJump = inDuckJump;
+	player->m_Local.m_flDucktime = duckTime;
+	player->m_Local.m_flDuckJumpTime = duckJumpTime;
+	player->m_Local.m_flJumpTime = jumpTime;
+	player->m_Local.m_flFallVelocity = fallVelocity;
+	player->m_surfaceFriction = surfaceFriction;
+	player->m_flWaterJumpTime = waterJumpTime;
+	player->m_vecWaterJumpVel = waterJumpVel;
+	player->m_flStepSoundTime = stepSoundTime;
+	player->SetViewOffset( viewOffset );
+	player->SetBaseVelocity( baseVelocity );
+	player->pl.v_angle = viewAngle;
+}
+
+//-----------------------------------------------------------------------------
+// One command: what went into ProcessMovement, and where it left the player
+//-----------------------------------------------------------------------------
+struct MovementRecord_t
+{
+	int						commandNumber;
+	MovementPlayerState_t	state;
+	CMoveData				move;
+	Vector					resultOrigin;
+	Vector					resultVelocity;
+};
+
+struct MovementRecordingHeader_t
+{
+	unsigned int	id;
+	int				version;
+	int				recordSize;			// sizeof( MovementRecord_t ) when written
+	int				recordCount;
+	char			mapName[ MAX_MAP_NAME ];
+};
+
+//-----------------------------------------------------------------------------
+class CMovementRecorder
+{
+public:
+	CMovementRecorder( void ) : m_hPlayer( NULL ), m_bHavePending( false ) {}
+
+	bool IsRecording( void ) const			{ return m_hPlayer.Get() != NULL; }
+	void Start( CBasePlayer *player, const char *filename );
+	void Stop( void );
+
+	void PreMove( CBasePlayer *player, CUserCmd *ucmd, CMoveData *move );
+	void PostMove( CBasePlayer *player, CMoveData *move );
+
+private:
+	CHandle< CBasePlayer >			m_hPlayer;
+	char							m_filename[ MAX_PATH ];
+	CUtlVector< MovementRecord_t >	m_records;
+	MovementRecord_t				m_pending;
+	bool							m_bHavePending;
+};
+
+static CMovementRecorder g_MovementRecorder;
+
+void CMovementRecorder::Start( CBasePlayer *player, const char *filename )
+{
+	m_hPlayer = player;
+	Q_strncpy( m_filename, filename, sizeof( m_filename ) );
+	m_records.RemoveAll();
+	m_bHavePending = false;
+}
+
+void CMovementRecorder::Stop( void )
+{
+	if ( !IsRecording() )
+		return;
+
+	m_hPlayer = NULL;
+
+	MovementRecordingHeader_t header;
+	Q_memset( &header, 0, sizeof( header ) );
+	header.id = MOVEMENT_RECORDING_ID;
+	header.version = MOVEMENT_RECORDING_VERSION;
+	header.recordSize = sizeof( MovementRecord_t );
+	header.recordCount = m_records.Count();
+	Q_strncpy( header.mapName, STRING( gpGlobals->mapname ), sizeof( header.mapName ) );
+
+	CUtlBuffer fileBuffer;
+	fileBuffer.Put( &header, sizeof( header ) );
+	fileBuffer.Put( m_records.Base(), m_records.Count() * sizeof( MovementRecord_t ) );
+
+	if ( filesystem->WriteFile( m_filename, "MOD", fileBuffer ) )
+	{
+		Msg( "Wrote %d movement commands to '%s'\n", m_records.Count(), m_filename );
+	}
+	else
+	{
+		Warning( "Unable to write movement recording '%s'\n", m_filename );
+	}
+
+	m_records.Purge();
+}
+
+void CMovementRecorder::PreMove( CBasePlayer *player, CUserCmd *ucmd, CMoveData *move )
+{
+	if ( player != m_hPlayer.Get() )
+		return;
+
+	m_pending.commandNumber = ucmd->command_number;
+	m_pending.state.Save( player );
+	m_pending.move = *move;
+	m_bHavePending = true;
+}
+
+void CMovementRecorder::PostMove( CBasePlayer *player, CMoveData *move )
+{
+	if ( !m_bHavePending || player != m_hPlayer.Get() )
+		return;
+
+	m_pending.resultOrigin = move->GetAbsOrigin();
+	m_pending.resultVelocity = move->m_vecVelocity;
+	m_records.AddToTail( m_pending );
+	m_bHavePending = false;
+}
+
+//-----------------------------------------------------------------------------
+// Called by CPlayerMove::RunCommand around ProcessMovement
+//-----------------------------------------------------------------------------
+void MovementRecorder_PrePlayerMove( CBasePlayer *player, CUserCmd *ucmd, CMoveData *move )
+{
+	if ( g_MovementRecorder.IsRecording() )
+	{
+		g_MovementRecorder.PreMove( player, ucmd, move );
+	}
+}
+
+void MovementRecorder_PostPlayerMove( CBasePlayer *player, CMoveData *move )
+{
+	if ( g_MovementRecorder.IsRecording() )
+	{
+		g_MovementRecorder.PostMove( player, move );
+	}
+}
+
+//-----------------------------------------------------------------------------
+CON_COMMAND_F( movement_record, "Records the movement commands of the player running it until movement_record_stop.\nUsage: movement_record <filename>", FCVAR_GAMEDLL | FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	CBasePlayer *player = UTIL_GetCommandClient();
+	if ( !player )
+		return;
+
+	if ( args.ArgC() < 2 )
+	{
+		Msg( "Usage: movement_record <filename>\n" );
+		return;
+	}
+
+	g_MovementRecorder.Stop();
+	g_MovementRecorder.Start( player, args[1] );
+	Msg( "Recording movement of %s to '%s'\n", player->GetPlayerName(), args[1] );
+}
+
+CON_COMMAND_F( movement_record_stop, "Stops movement_record and writes the recording.", FCVAR_GAMEDLL | FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( !g_MovementRecorder.IsRecording() )
+	{
+		Msg( "Not recording movement\n" );
+		return;
+	}
+
+	g_MovementRecorder.Stop();
+}
+
+//-----------------------------------------------------------------------------
+CON_COMMAND_F( movement_replay, "Replays a movement recording through ProcessMovement on the player running it, and reports the time per command and any commands that move the player differently than when recorded.\nUsage: movement_replay <filename> [passes] [tolerance]", FCVAR_GAMEDLL | FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	CBasePlayer *player = UTIL_GetCommandClient();
+	if ( !player )
+		return;
+
+	if ( args.ArgC() < 2 )
+	{
+		Msg( "Usage: movement_replay <filename> [passes] [tolerance]\n" );
+		return;
+	}
+
+	if ( g_MovementRecorder.IsRecording() )
+	{
+		Msg( "movement_replay: stop recording first\n" );
+		return;
+	}
+
+	int passes = ( args.ArgC() > 2 ) ? MAX( atoi( args[2] ), 1 ) : 1;
+	float tolerance = ( args.ArgC() > 3 ) ? atof( args[3] ) : 0.0f;
+
+	CUtlBuffer fileBuffer;
+	if ( !filesystem->ReadFile( args[1], "MOD", fileBuffer ) )
+	{
+		Warning( "movement_replay: unable to read '%s'\n", args[1] );
+		return;
+	}
+
+	MovementRecordingHeader_t header;
+	fileBuffer.Get( &header, sizeof( header ) );
+	if ( !fileBuffer.IsValid() || header.id != MOVEMENT_RECORDING_ID || header.version != MOVEMENT_RECORDING_VERSION || header.recordSize != sizeof( MovementRecord_t ) || header.recordCount < 0 )
+	{
+		Warning( "movement_replay: '%s' is not a movement recording from this build\n", args[1] );
+		return;
+	}
+
+	if ( fileBuffer.GetBytesRemaining() < header.recordCount * (int)sizeof( MovementRecord_t ) )
+	{
+		Warning( "movement_replay: '%s' is truncated\n", args[1] );
+		return;
+	}
+
+	if ( header.recordCount == 0 )
+	{
+		Msg( "movement_replay: '%s' is empty\n", args[1] );
+		return;
+	}
+
+	if ( Q_stricmp( header.mapName, STRING( gpGlobals->mapname ) ) )
+	{
+		Warning( "movement_replay: '%s' was recorded on %s, not %s\n", args[1], header.mapName, STRING( gpGlobals->mapname ) );
+	}
+
+	CUtlVector< MovementRecord_t > records;
+	records.SetCount( header.recordCount );
+	fileBuffer.Get( records.Base(), header.recordCount * sizeof( MovementRecord_t ) );
+
+	// put the player back the way they were afterwards
+	MovementPlayerState_t savedState;
+	savedState.Save( player );
+	Vector savedOrigin = player->GetAbsOrigin();
+	Vector savedVelocity = player->GetAbsVelocity();
+	QAngle savedAngles = player->GetLocalAngles();
+	CMoveData savedMove = *g_pMoveData;
+
+	int diverged = 0;
+	int firstDiverged = -1;
+	float maxOriginError = 0.0f;
+	float maxVelocityError = 0.0f;
+	double totalTime = 0.0;
+
+	// the move helper answers for the player being moved, without the sounds,
+	// damage and touches of running the commands for real
+	MoveHelperServer()->SetHost( player );
+	MoveHelperServer()->SetReplaying( true );
+	g_pGameMovement->StartTrackPredictionErrors( player );
+
+	for( int pass=0; pass<passes; ++pass )
+	{
+		for( int i=0; i<records.Count(); ++i )
+		{
+			const MovementRecord_t &record = records[i];
+
+			record.state.Restore( player );
+			MovementPlayerState_t::MuteFootsteps( player );
+
+			*g_pMoveData = record.move;
+			g_pMoveData->m_nPlayerHandle = player->GetRefEHandle();
+
+			double start = Plat_FloatTime();
+			g_pGameMovement->ProcessMovement( player, g_pMoveData );
+			totalTime += Plat_FloatTime() - start;
+
+			if ( pass > 0 )
+				continue;
+
+			float originError = ( g_pMoveData->GetAbsOrigin() - record.resultOrigin ).Length();
+			float velocityError = ( g_pMoveData->m_vecVelocity - record.resultVelocity ).Length();
+			maxOriginError = MAX( maxOriginError, originError );
+			maxVelocityError = MAX( maxVelocityError, velocityError );
+
+			if ( originError > tolerance || velocityError > tolerance )
+			{
+				if ( firstDiverged < 0 )
+				{
+					firstDiverged = i;
+					Warning( "movement_replay: command %d ended at ( %.3f %.3f %.3f ) moving ( %.3f %.3f %.3f ), recorded ( %.3f %.3f %.3f ) moving ( %.3f %.3f %.3f )\n",
+						record.commandNumber,
+						g_pMoveData->GetAbsOrigin().x, g_pMoveData->GetAbsOrigin().y, g_pMoveData->GetAbsOrigin().z,
+						g_pMoveData->m_vecVelocity.x, g_pMoveData->m_vecVelocity.y, g_pMoveData->m_vecVelocity.z,
+						record.resultOrigin.x, record.resultOrigin.y, record.resultOrigin.z,
+						record.resultVelocity.x, record.resultVelocity.y, record.resultVelocity.z );
+				}
+				++diverged;
+			}
+		}
+	}
+
+	g_pGameMovement->FinishTrackPredictionErrors( player );
+	MoveHelperServer()->SetReplaying( false );
+	MoveHelperServer()->SetHost( NULL );
+
+	savedState.Restore( player );
+	player->SetAbsOrigin( savedOrigin );
+	player->SetAbsVelocity( savedVelocity );
+	player->SetLocalAngles( savedAngles );
+	*g_pMoveData = savedMove;
+
+	int commands = records.Count() * passes;
+	Msg( "movement_replay: %d commands x %d passes, %.0f ns per command\n", records.Count(), passes, totalTime * 1.0e9 / commands );
+	Msg( "  %d commands diverged, largest difference %.4f in origin, %.4f in velocity\n", diverged, maxOriginError, maxVelocityError );
+}
@@ -43,10 +43,6 @@ extern void HintMessageToAllPlayers( const char *message );
 unsigned int CNavArea::m_nextID = 1;
 NavAreaVector TheNavAreas;
 
-unsigned int CNavArea::m_masterMarker = 1;
-CNavArea *CNavArea::m_openList = NULL;
-CNavArea *CNavArea::m_openListTail = NULL;
-
 bool CNavArea::m_isReset = false;
 uint32 CNavArea::s_nCurrVisTestCounter = 0;
 
@@ -164,10 +160,10 @@ void CNavArea::CompressIDs( void )
 	FOR_EACH_VEC( TheNavAreas, id )
 	{
 		CNavArea *area = TheNavAreas[id];
-		area->m_id = m_nextID++;
 
 		// remove and re-add the area from the nav mesh to update the hashed ID
 		TheNavMesh->RemoveNavArea( area );
+		area->m_id = m_nextID++;
 		TheNavMesh->AddNavArea( area );
 	}
 }
@@ -179,20 +175,17 @@ void CNavArea::CompressIDs( void )
  */
 CNavArea::CNavArea( void )
 {
-	m_marker = 0;
+	m_searchIndex = CNavAreaSearchContext::AllocateAreaIndex();
 	m_nearNavSearchMarker = 0;
 	m_damagingTickCount = 0;
-	m_openMarker = 0;
+	m_cluster = -1;
+	m_clusterAreaIndex = -1;
 
-	m_parent = NULL;
-	m_parentHow = GO_NORTH;
 	m_attributeFlags = 0;
 	m_place = TheNavMesh->GetNavPlace();
 	m_isUnderwater = false;
 	m_avoidanceObstacleHeight = 0.0f;
 
-	m_totalCost = 0.0f;
-
 	ResetNodes();
 
 	int i;
@@ -530,6 +523,8 @@ CNavArea::~CNavArea()
 	// spot encounters aren't owned by anything else, so free them up here
 	m_spotEncounters.PurgeAndDeleteElements();
 
+	CNavAreaSearchContext::FreeAreaIndex( m_searchIndex );
+
 	// if we are resetting the system, don't bother cleaning up - all areas are being destroyed
 	if (m_isReset)
 		return;
@@ -3353,79 +3348,178 @@ void CNavArea::DrawConnectedAreas( void ) const
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+// Every live search context, so an area index can be cleared in all of them when it is handed out again
+static CUtlVector< CNavAreaSearchContext * > s_searchContexts;
+static CThreadFastMutex s_searchContextMutex;
+
+static CNavAreaSearchContext s_defaultSearchContext;
+static CThreadLocalPtr< CNavAreaSearchContext > s_currentSearchContext;
+
+static int s_areaIndexCount = 0;
+static CUtlVector< int > s_freeAreaIndices;
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavAreaSearchContext::CNavAreaSearchContext( void )
+{
+	m_masterMarker = 1;
+	m_openList = NULL;
+	m_openListTail = NULL;
+
+	AUTO_LOCK( s_searchContextMutex );
+	s_searchContexts.AddToTail( this );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavAreaSearchContext::~CNavAreaSearchContext()
+{
+	AUTO_LOCK( s_searchContextMutex );
+	s_searchContexts.FindAndFastRemove( this );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavAreaSearchContext *CNavAreaSearchContext::GetCurrent( void )
+{
+	CNavAreaSearchContext *context = s_currentSearchContext;
+	return ( context ) ? context : &s_defaultSearchContext;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavAreaSearchContext::SetCurrent( CNavAreaSearchContext *context )
+{
+	s_currentSearchContext = ( context == &s_defaultSearchContext ) ? NULL : context;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Hand out an index for a new area, reusing those of destroyed areas.
+ * Areas are only created while no searches are running, so this only locks against contexts coming and going.
+ */
+int CNavAreaSearchContext::AllocateAreaIndex( void )
+{
+	if ( s_freeAreaIndices.Count() == 0 )
+	{
+		return s_areaIndexCount++;
+	}
+
+	int index = s_freeAreaIndices.Tail();
+	s_freeAreaIndices.RemoveMultipleFromTail( 1 );
+
+	// a new area starts unmarked and off the open list in every context
+	AUTO_LOCK( s_searchContextMutex );
+	FOR_EACH_VEC( s_searchContexts, it )
+	{
+		s_searchContexts[ it ]->ResetState( index );
+	}
+
+	return index;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavAreaSearchContext::FreeAreaIndex( int index )
+{
+	s_freeAreaIndices.AddToTail( index );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavAreaSearchContext::GrowState( void )
+{
+	int oldCount = m_state.Count();
+	m_state.SetCount( s_areaIndexCount );
+	V_memset( m_state.Base() + oldCount, 0, ( s_areaIndexCount - oldCount ) * sizeof( AreaState ) );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavAreaSearchContext::ResetState( int index )
+{
+	if ( index < m_state.Count() )
+	{
+		V_memset( &m_state[ index ], 0, sizeof( AreaState ) );
+	}
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Add to open list in decreasing value order
  */
-void CNavArea::AddToOpenList( void )
+void CNavAreaSearchContext::AddToOpenList( CNavArea *area )
 {
-	Assert( (m_openList && m_openList->m_prevOpen == NULL) || m_openList == NULL );
+	AreaState &state = GetState( area );
 
-	if ( IsOpen() )
+	if ( state.openMarker == m_masterMarker )
 	{
 		// already on list
 		return;
 	}
 
 	// mark as being on open list for quick check
-	m_openMarker = m_masterMarker;
+	state.openMarker = m_masterMarker;
 
 	// if list is empty, add and return
 	if ( m_openList == NULL )
 	{
-		m_openList = this;
-		m_openListTail = this;
-		this->m_prevOpen = NULL;
-		this->m_nextOpen = NULL;
+		m_openList = area;
+		m_openListTail = area;
+		state.prevOpen = NULL;
+		state.nextOpen = NULL;
 		return;
 	}
 
-	// insert self in ascending cost order
+	// insert in ascending cost order
 	// Since costs are positive, IEEE754 let's us compare as integers (see http://www.cygnus-software.com/papers/comparingfloats/comparingfloats.htm)
-	CNavArea *area, *last = NULL;
-	int thisCostBits = *reinterpret_cast<const int *>(&m_totalCost);
+	CNavArea *other, *last = NULL;
+	int thisCostBits = *reinterpret_cast<const int *>(&state.totalCost);
 
-	Assert ( m_totalCost >= 0.0f );
-	for( area = m_openList; area; area = area->m_nextOpen )
+	Assert ( state.totalCost >= 0.0f );
+	for( other = m_openList; other; other = GetState( other ).nextOpen )
 	{
-		Assert ( area->GetTotalCost() >= 0.0f );
-		int thoseCostBits = *reinterpret_cast<const int *>(&area->m_totalCost);
+		const AreaState &otherState = GetState( other );
+		Assert ( otherState.totalCost >= 0.0f );
+		int thoseCostBits = *reinterpret_cast<const int *>(&otherState.totalCost);
 		if ( thisCostBits < thoseCostBits )
 		{
 			break;
 		}
-		last = area;
+		last = other;
 	}
 
-	if ( area )
+	if ( other )
 	{
 		// insert before this area
-		this->m_prevOpen = area->m_prevOpen;
+		AreaState &otherState = GetState( other );
+		state.prevOpen = otherState.prevOpen;
 
-		if ( this->m_prevOpen )
+		if ( state.prevOpen )
 		{
-			this->m_prevOpen->m_nextOpen = this;
+			GetState( state.prevOpen ).nextOpen = area;
 		}
 		else
 		{
-			m_openList = this;
+			m_openList = area;
 		}
 
-		this->m_nextOpen = area;
-		area->m_prevOpen = this;
+		state.nextOpen = other;
+		otherState.prevOpen = area;
 	}
 	else
 	{
 		// append to end of list
-		last->m_nextOpen = this;
-		this->m_prevOpen = last;
+		GetState( last ).nextOpen = area;
+		state.prevOpen = last;
 	
-		this->m_nextOpen = NULL;
+		state.nextOpen = NULL;
 
-		m_openListTail = this;
+		m_openListTail = area;
 	}
-
-	Assert( (m_openList && m_openList->m_prevOpen == NULL) || m_openList == NULL );
 }
 
 
@@ -3433,127 +3527,311 @@ void CNavArea::AddToOpenList( void )
 /**
  * Add to tail of the open list
  */
-void CNavArea::AddToOpenListTail( void )
+void CNavAreaSearchContext::AddToOpenListTail( CNavArea *area )
 {
-	Assert( (m_openList && m_openList->m_prevOpen == NULL) || m_openList == NULL );
+	AreaState &state = GetState( area );
 
-	if ( IsOpen() )
+	if ( state.openMarker == m_masterMarker )
 	{
 		// already on list
 		return;
 	}
 
 	// mark as being on open list for quick check
-	m_openMarker = m_masterMarker;
+	state.openMarker = m_masterMarker;
 
 	// if list is empty, add and return
 	if ( m_openList == NULL )
 	{
-		m_openList = this;
-		m_openListTail = this;
-		this->m_prevOpen = NULL;
-		this->m_nextOpen = NULL;
-
-		Assert( (m_openList && m_openList->m_prevOpen == NULL) || m_openList == NULL );
+		m_openList = area;
+		m_openListTail = area;
+		state.prevOpen = NULL;
+		state.nextOpen = NULL;
 		return;
 	}
 
 	// append to end of list
-	m_openListTail->m_nextOpen = this;
-
-	this->m_prevOpen = m_openListTail;
-	this->m_nextOpen = NULL;
+	GetState( m_openListTail ).nextOpen = area;
 
-	m_openListTail = this;
+	state.prevOpen = m_openListTail;
+	state.nextOpen = NULL;
 
-	Assert( (m_openList && m_openList->m_prevOpen == NULL) || m_openList == NULL );
+	m_openListTail = area;
 }
 
+
 //--------------------------------------------------------------------------------------------------------------
 /**
- * A smaller value has been found, update this area on the open list
+ * A smaller value has been found, update the area on the open list
  * @todo "bubbling" does unnecessary work, since the order of all other nodes will be unchanged - only this node is altered
  */
-void CNavArea::UpdateOnOpenList( void )
+void CNavAreaSearchContext::UpdateOnOpenList( CNavArea *area )
 {
+	AreaState &state = GetState( area );
+
 	// since value can only decrease, bubble this area up from current spot
-	while( m_prevOpen && this->GetTotalCost() < m_prevOpen->GetTotalCost() )
+	while( state.prevOpen && state.totalCost < GetState( state.prevOpen ).totalCost )
 	{
 		// swap position with predecessor
-		CNavArea *other = m_prevOpen;
-		CNavArea *before = other->m_prevOpen;
-		CNavArea *after  = this->m_nextOpen;
+		CNavArea *other = state.prevOpen;
+		AreaState &otherState = GetState( other );
+		CNavArea *before = otherState.prevOpen;
+		CNavArea *after  = state.nextOpen;
 
-		this->m_nextOpen = other;
-		this->m_prevOpen = before;
+		state.nextOpen = other;
+		state.prevOpen = before;
 
-		other->m_prevOpen = this;
-		other->m_nextOpen = after;
+		otherState.prevOpen = area;
+		otherState.nextOpen = after;
 
 		if ( before )
 		{
-			before->m_nextOpen = this;
+			GetState( before ).nextOpen = area;
 		}
 		else
 		{
-			m_openList = this;
+			m_openList = area;
 		}
 
 		if ( after )
 		{
-			after->m_prevOpen = other;
+			GetState( after ).prevOpen = other;
 		}
 		else
 		{
-			m_openListTail = this;
+			m_openListTail = area;
 		}
 	}
 }
 
+
 //--------------------------------------------------------------------------------------------------------------
-void CNavArea::RemoveFromOpenList( void )
+void CNavAreaSearchContext::RemoveFromOpenList( CNavArea *area )
 {
-	if ( m_openMarker == 0 )
+	AreaState &state = GetState( area );
+
+	if ( state.openMarker == 0 )
 	{
 		// not on the list
 		return;
 	}
 
-	if ( m_prevOpen )
+	if ( state.prevOpen )
 	{
-		m_prevOpen->m_nextOpen = m_nextOpen;
+		GetState( state.prevOpen ).nextOpen = state.nextOpen;
 	}
 	else
 	{
-		m_openList = m_nextOpen;
+		m_openList = state.nextOpen;
 	}
 	
-	if ( m_nextOpen )
+	if ( state.nextOpen )
 	{
-		m_nextOpen->m_prevOpen = m_prevOpen;
+		GetState( state.nextOpen ).prevOpen = state.prevOpen;
 	}
 	else
 	{
-		m_openListTail = m_prevOpen;
+		m_openListTail = state.prevOpen;
 	}
 	
 	// zero is an invalid marker
-	m_openMarker = 0;
+	state.openMarker = 0;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Remove and return the first element of the open list
+ */
+CNavArea *CNavAreaSearchContext::PopOpenList( void )
+{
+	if ( m_openList == NULL )
+		return NULL;
+
+	CNavArea *area = m_openList;
+
+	// disconnect from list
+	RemoveFromOpenList( area );
+
+	AreaState &state = GetState( area );
+	state.prevOpen = NULL;
+	state.nextOpen = NULL;
+
+	return area;
 }
 
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Clears the open and closed lists for a new search
  */
-void CNavArea::ClearSearchLists( void )
+void CNavAreaSearchContext::ClearSearchLists( void )
 {
 	// effectively clears all open list pointers and closed flags
-	CNavArea::MakeNewMarker();
+	MakeNewMarker();
 
 	m_openList = NULL;
 	m_openListTail = NULL;
 }
 
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * A path search run by nav_test_parallel_paths, and the path it found
+ */
+struct NavPathTestSearch
+{
+	CNavArea *startArea;
+	CNavArea *goalArea;
+	bool isFound;
+	CUtlVector< CNavArea * > path;					// from the goal, or the area closest to it, back to the start
+
+	void Run( void )
+	{
+		ShortestPathCost cost;
+		CNavArea *closestArea = NULL;
+		isFound = NavAreaBuildPath( startArea, goalArea, NULL, cost, &closestArea );
+
+		path.RemoveAll();
+		for( CNavArea *area = ( isFound ) ? goalArea : closestArea; area; area = area->GetParent() )
+		{
+			path.AddToTail( area );
+		}
+	}
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * The search contexts of one nav_test_parallel_paths run, each lent to one search at a time.
+ * There are only ever as many as searches running at once, and they are all destroyed with the pool.
+ */
+class NavPathTestContextPool
+{
+public:
+	~NavPathTestContextPool()
+	{
+		m_contexts.PurgeAndDeleteElements();
+	}
+
+	CNavAreaSearchContext *Lend( void )
+	{
+		AUTO_LOCK( m_mutex );
+		if ( m_free.Count() )
+		{
+			CNavAreaSearchContext *context = m_free.Tail();
+			m_free.RemoveMultipleFromTail( 1 );
+			return context;
+		}
+
+		CNavAreaSearchContext *context = new CNavAreaSearchContext;
+		m_contexts.AddToTail( context );
+		return context;
+	}
+
+	void Return( CNavAreaSearchContext *context )
+	{
+		AUTO_LOCK( m_mutex );
+		m_free.AddToTail( context );
+	}
+
+private:
+	CThreadFastMutex m_mutex;
+	CUtlVector< CNavAreaSearchContext * > m_contexts;
+	CUtlVector< CNavAreaSearchContext * > m_free;
+};
+
+static NavPathTestContextPool *s_testContextPool = NULL;
+
+static void RunParallelPathTestSearch( NavPathTestSearch &search )
+{
+	CNavAreaSearchContext *context = s_testContextPool->Lend();
+	{
+		CNavAreaSearchScope scope( context );
+		search.Run();
+	}
+	s_testContextPool->Return( context );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CON_COMMAND_F( nav_test_parallel_paths, "Runs path searches between random areas at the same time on worker threads, and checks each finds the same path as when run on its own.\nUsage: nav_test_parallel_paths [searches]", FCVAR_GAMEDLL | FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( TheNavAreas.Count() == 0 )
+	{
+		Msg( "nav_test_parallel_paths: no Navigation Mesh is loaded\n" );
+		return;
+	}
+
+	int count = ( args.ArgC() > 1 ) ? MAX( atoi( args[1] ), 1 ) : 1000;
+
+	// the same pairs of areas every run
+	CUniformRandomStream random;
+	random.SetSeed( 1 );
+
+	CUtlVector< NavPathTestSearch > serial, parallel;
+	serial.SetCount( count );
+	parallel.SetCount( count );
+	for( int i=0; i<count; ++i )
+	{
+		serial[i].startArea = parallel[i].startArea = TheNavAreas[ random.RandomInt( 0, TheNavAreas.Count()-1 ) ];
+		serial[i].goalArea = parallel[i].goalArea = TheNavAreas[ random.RandomInt( 0, TheNavAreas.Count()-1 ) ];
+	}
+
+	double start = Plat_FloatTime();
+	for( int i=0; i<count; ++i )
+	{
+		serial[i].Run();
+	}
+	double serialTime = Plat_FloatTime() - start;
+
+	NavPathTestContextPool contextPool;
+	s_testContextPool = &contextPool;
+
+	start = Plat_FloatTime();
+	ParallelProcess( "nav_test_parallel_paths", parallel.Base(), parallel.Count(), &RunParallelPathTestSearch );
+	double parallelTime = Plat_FloatTime() - start;
+
+	s_testContextPool = NULL;
+
+	int found = 0;
+	int diffs = 0;
+	for( int i=0; i<count; ++i )
+	{
+		if ( serial[i].isFound )
+			++found;
+
+		bool isSame = ( serial[i].isFound == parallel[i].isFound && serial[i].path.Count() == parallel[i].path.Count() );
+		for( int j=0; isSame && j<serial[i].path.Count(); ++j )
+		{
+			isSame = ( serial[i].path[j] == parallel[i].path[j] );
+		}
+
+		if ( !isSame )
+		{
+			++diffs;
+			DevMsg( "nav_test_parallel_paths: path from area #%d to area #%d differs\n", serial[i].startArea->GetID(), serial[i].goalArea->GetID() );
+		}
+	}
+
+	Msg( "nav_test_parallel_paths: %d searches, %d areas, %d paths found\n", count, TheNavAreas.Count(), found );
+	Msg( "  serial:   %8.3f ms\n", serialTime * 1000.0 );
+	Msg( "  parallel: %8.3f ms\n", parallelTime * 1000.0 );
+
+	if ( diffs )
+	{
+		Warning( "nav_test_parallel_paths: %d parallel searches differ from serial ones!\n", diffs );
+	}
+	else
+	{
+		Msg( "  all parallel searches match\n" );
+	}
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 void CNavArea::SetCorner( NavCornerType corner, const Vector& newPosition )
 {
@@ -22,6 +22,8 @@ enum { MAX_NAV_TEAMS = 2 };
 class CFuncElevator;
 class CFuncNavPrerequisite;
 class CFuncNavCost;
+class CNavMeshFileView;
+class CNavMeshFileWriter;
 
 class CNavVectorNoEditAllocator
 {
@@ -131,6 +133,7 @@ public:
 
 	void Save( CUtlBuffer &fileBuffer, unsigned int version ) const;
 	void Load( CUtlBuffer &fileBuffer, unsigned int version );
+	void Load( const CNavMeshFileView &file, int index );
 	NavErrorType PostLoad( void );
 
 	const Vector &GetPosition( void ) const		{ return m_pos; }	// get the position of the hiding spot
@@ -221,30 +224,18 @@ protected:
 
 	/* 54 */	bool m_isBlocked[ MAX_NAV_TEAMS ];							// if true, some part of the world is preventing movement through this nav area
 
-	/* 56 */	unsigned int m_marker;										// used to flag the area as visited
-	/* 60 */	float m_totalCost;											// the distance so far plus an estimate of the distance left
-	/* 64 */	float m_costSoFar;											// distance travelled so far
+	/* 56 */	int m_searchIndex;											// this area's entry in every CNavAreaSearchContext, which holds its A* state
 
-	/* 68 */	CNavArea *m_nextOpen, *m_prevOpen;							// only valid if m_openMarker == m_masterMarker
-	/* 76 */	unsigned int m_openMarker;									// if this equals the current marker value, we are on the open list
-
-	/* 80 */	int	m_attributeFlags;										// set of attribute bit flags (see NavAttributeType)
+	/* 60 */	int	m_attributeFlags;										// set of attribute bit flags (see NavAttributeType)
 
 	//- connections to adjacent areas -------------------------------------------------------------------
-	/* 84 */	NavConnectVector m_connect[ NUM_DIRECTIONS ];				// a list of adjacent areas for each direction
-	/* 100*/	NavLadderConnectVector m_ladder[ CNavLadder::NUM_LADDER_DIRECTIONS ];	// list of ladders leading up and down from this area
-	/* 108*/	NavConnectVector m_elevatorAreas;							// a list of areas reachable via elevator from this area
-
-	/* 112*/	unsigned int m_nearNavSearchMarker;							// used in GetNearestNavArea()
-
-	/* 116*/	CNavArea *m_parent;											// the area just prior to this on in the search path
-	/* 120*/	NavTraverseType m_parentHow;								// how we get from parent to us
-
-	/* 124*/	float m_pathLengthSoFar;									// length of path so far, needed for limiting pathfind max path length
+	/* 64 */	NavConnectVector m_connect[ NUM_DIRECTIONS ];				// a list of adjacent areas for each direction
+	/* 80 */	NavLadderConnectVector m_ladder[ CNavLadder::NUM_LADDER_DIRECTIONS ];	// list of ladders leading up and down from this area
+	/* 88 */	NavConnectVector m_elevatorAreas;							// a list of areas reachable via elevator from this area
 
-	/* *************** 360 cache line *************** */
+	/* 92 */	unsigned int m_nearNavSearchMarker;							// used in GetNearestNavArea()
 
-	/* 128*/	CFuncElevator *m_elevator;									// if non-NULL, this area is in an elevator's path. The elevator can transport us vertically to another area.
+	/* 96 */	CFuncElevator *m_elevator;									// if non-NULL, this area is in an elevator's path. The elevator can transport us vertically to another area.
 
 	// --- End critical data --- 
 };
@@ -273,6 +264,8 @@ public:
 
 	virtual void Save( CUtlBuffer &fileBuffer, unsigned int version ) const;	// (EXTEND)
 	virtual NavErrorType Load( CUtlBuffer &fileBuffer, unsigned int version, unsigned int subVersion );		// (EXTEND)
+	void Save( CNavMeshFileWriter &file ) const;						// store in the flat layout. Meshes with custom data use the streamed layout instead.
+	void Load( const CNavMeshFileView &file, int index );
 	virtual NavErrorType PostLoad( void );								// (EXTEND) invoked after all areas have been loaded - for pointer binding, etc
 
 	virtual void SaveToSelectedSet( KeyValues *areaKey ) const;		// (EXTEND) saves attributes for the area to a KeyValues
@@ -423,13 +416,14 @@ public:
 	float GetLightIntensity( void ) const;						// returns a 0..1 light intensity averaged over the whole area
 
 	//- A* pathfinding algorithm ------------------------------------------------------------------------
-	static void MakeNewMarker( void )	{ ++m_masterMarker; if (m_masterMarker == 0) m_masterMarker = 1; }
-	void Mark( void )					{ m_marker = m_masterMarker; }
-	BOOL IsMarked( void ) const			{ return (m_marker == m_masterMarker) ? true : false; }
+	// these use the calling thread's search context (see CNavAreaSearchContext)
+	static void MakeNewMarker( void );
+	void Mark( void );
+	BOOL IsMarked( void ) const;
 	
-	void SetParent( CNavArea *parent, NavTraverseType how = NUM_TRAVERSE_TYPES )	{ m_parent = parent; m_parentHow = how; }
-	CNavArea *GetParent( void ) const	{ return m_parent; }
-	NavTraverseType GetParentHow( void ) const	{ return m_parentHow; }
+	void SetParent( CNavArea *parent, NavTraverseType how = NUM_TRAVERSE_TYPES );
+	CNavArea *GetParent( void ) const;
+	NavTraverseType GetParentHow( void ) const;
 
 	bool IsOpen( void ) const;									// true if on "open list"
 	void AddToOpenList( void );									// add to open list in decreasing value order
@@ -445,14 +439,14 @@ public:
 
 	static void ClearSearchLists( void );						// clears the open and closed lists for a new search
 
-	void SetTotalCost( float value )	{ Assert( value >= 0.0 && !IS_NAN(value) ); m_totalCost = value; }
-	float GetTotalCost( void ) const	{ return m_totalCost; }
+	void SetTotalCost( float value );
+	float GetTotalCost( void ) const;
 
-	void SetCostSoFar( float value )	{ Assert( value >= 0.0 && !IS_NAN(value) ); m_costSoFar = value; }
-	float GetCostSoFar( void ) const	{ return m_costSoFar; }
+	void SetCostSoFar( float value );
+	float GetCostSoFar( void ) const;
 
-	void SetPathLengthSoFar( float value )	{ Assert( value >= 0.0 && !IS_NAN(value) ); m_pathLengthSoFar = value; }
-	float GetPathLengthSoFar( void ) const	{ return m_pathLengthSoFar; }
+	void SetPathLengthSoFar( float value );
+	float GetPathLengthSoFar( void ) const;
 
 	//- editing -----------------------------------------------------------------------------------------
 	virtual void Draw( void ) const;							// draw area for debugging & editing
@@ -642,6 +636,8 @@ public:
 private:
 	friend class CNavMesh;
 	friend class CNavLadder;
+	friend class CNavAreaHierarchy;
+	friend class CNavAreaSearchContext;
 	friend class CCSNavArea;									// allow CS load code to complete replace our default load behavior
 
 	static bool m_isReset;										// if true, don't bother cleaning up in destructor since everything is going away
@@ -702,10 +698,8 @@ private:
 	float m_lightIntensity[ NUM_CORNERS ];						// 0..1 light intensity at corners
 
 	//- A* pathfinding algorithm ------------------------------------------------------------------------
-	static unsigned int m_masterMarker;
-
-	static CNavArea *m_openList;
-	static CNavArea *m_openListTail;
+	int m_cluster;												// cluster this area is in for hierarchical path searches, or -1
+	int m_clusterAreaIndex;										// index of this area in its cluster
 
 	//- connections to adjacent areas -------------------------------------------------------------------
 	NavConnectVector m_incomingConnect[ NUM_DIRECTIONS ];		// a list of adjacent areas for each direction that connect TO us, but we have no connection back to them
@@ -762,6 +756,105 @@ typedef CUtlVector< CNavArea * > NavAreaVector;
 extern NavAreaVector TheNavAreas;
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * The state of an area search: the marker, the open list, and each area's parent and costs.
+ * Every thread searches with its current context, which is a shared default one unless another has been bound
+ * with CNavAreaSearchContext::SetCurrent() or CNavAreaSearchScope.  Searches on threads with their own
+ * contexts don't touch each other's state, so they can run at the same time as long as nothing changes the mesh.
+ * The CNavArea A* accessors go through the calling thread's context; code that makes many calls can fetch
+ * the context once and use it directly.
+ */
+class CNavAreaSearchContext
+{
+public:
+	CNavAreaSearchContext( void );
+	~CNavAreaSearchContext();
+
+	static CNavAreaSearchContext *GetCurrent( void );			// the calling thread's context
+	static void SetCurrent( CNavAreaSearchContext *context );	// bind a context to the calling thread, NULL for the default one
+
+	void MakeNewMarker( void )								{ ++m_masterMarker; if (m_masterMarker == 0) m_masterMarker = 1; }
+	void ClearSearchLists( void );							// clears the open and closed lists for a new search
+
+	void Mark( const CNavArea *area )						{ GetState( area ).marker = m_masterMarker; }
+	bool IsMarked( const CNavArea *area )					{ return GetState( area ).marker == m_masterMarker; }
+
+	void SetParent( const CNavArea *area, CNavArea *parent, NavTraverseType how = NUM_TRAVERSE_TYPES )	{ AreaState &state = GetState( area ); state.parent = parent; state.parentHow = how; }
+	CNavArea *GetParent( const CNavArea *area )				{ return GetState( area ).parent; }
+	NavTraverseType GetParentHow( const CNavArea *area )	{ return GetState( area ).parentHow; }
+
+	void SetTotalCost( const CNavArea *area, float value )	{ Assert( value >= 0.0 && !IS_NAN(value) ); GetState( area ).totalCost = value; }
+	float GetTotalCost( const CNavArea *area )				{ return GetState( area ).totalCost; }
+
+	void SetCostSoFar( const CNavArea *area, float value )	{ Assert( value >= 0.0 && !IS_NAN(value) ); GetState( area ).costSoFar = value; }
+	float GetCostSoFar( const CNavArea *area )				{ return GetState( area ).costSoFar; }
+
+	void SetPathLengthSoFar( const CNavArea *area, float value )	{ Assert( value >= 0.0 && !IS_NAN(value) ); GetState( area ).pathLengthSoFar = value; }
+	float GetPathLengthSoFar( const CNavArea *area )		{ return GetState( area ).pathLengthSoFar; }
+
+	bool IsOpen( const CNavArea *area )						{ return GetState( area ).openMarker == m_masterMarker; }
+	void AddToOpenList( CNavArea *area );					// add to open list in decreasing value order
+	void AddToOpenListTail( CNavArea *area );				// add to tail of the open list
+	void UpdateOnOpenList( CNavArea *area );				// a smaller value has been found, update the area on the open list
+	void RemoveFromOpenList( CNavArea *area );
+	bool IsOpenListEmpty( void ) const						{ return (m_openList) ? false : true; }
+	CNavArea *PopOpenList( void );							// remove and return the first element of the open list
+
+	// "closed" is visited (marked) and not on the open list
+	bool IsClosed( const CNavArea *area )					{ return IsMarked( area ) && !IsOpen( area ); }
+	void AddToClosedList( const CNavArea *area )			{ Mark( area ); }
+
+	// every area has an index into the state of every context, handed out as areas are created
+	static int AllocateAreaIndex( void );
+	static void FreeAreaIndex( int index );
+
+private:
+	struct AreaState
+	{
+		unsigned int marker;								// used to flag the area as visited
+		unsigned int openMarker;							// if this equals the master marker, the area is on the open list
+		CNavArea *nextOpen, *prevOpen;						// only valid if the area is on the open list
+		float totalCost;									// the distance so far plus an estimate of the distance left
+		float costSoFar;									// distance travelled so far
+		float pathLengthSoFar;								// length of path so far, needed for limiting pathfind max path length
+		CNavArea *parent;									// the area just prior to this one in the search path
+		NavTraverseType parentHow;							// how we get from parent to us
+	};
+
+	AreaState &GetState( const CNavArea *area );
+	void GrowState( void );									// make room for every area index handed out so far
+	void ResetState( int index );							// forget whatever a destroyed area left at this index
+
+	unsigned int m_masterMarker;
+	CNavArea *m_openList;
+	CNavArea *m_openListTail;
+	CUtlVector< AreaState > m_state;						// indexed by CNavArea::m_searchIndex
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Binds a search context to the calling thread for the lifetime of the scope
+ */
+class CNavAreaSearchScope
+{
+public:
+	CNavAreaSearchScope( CNavAreaSearchContext *context ) : m_prevContext( CNavAreaSearchContext::GetCurrent() )
+	{
+		CNavAreaSearchContext::SetCurrent( context );
+	}
+
+	~CNavAreaSearchScope()
+	{
+		CNavAreaSearchContext::SetCurrent( m_prevContext );
+	}
+
+private:
+	CNavAreaSearchContext *m_prevContext;
+};
+
+
 //--------------------------------------------------------------------------------------------------------------
 //--------------------------------------------------------------------------------------------------------------
 //
@@ -824,50 +917,142 @@ inline CNavArea *CNavArea::GetAdjacentArea( NavDirType dir, int i ) const
 	return NULL;
 }
 
+//--------------------------------------------------------------------------------------------------------------
+inline CNavAreaSearchContext::AreaState &CNavAreaSearchContext::GetState( const CNavArea *area )
+{
+	int index = area->m_searchIndex;
+	if ( index >= m_state.Count() )
+	{
+		GrowState();
+	}
+
+	return m_state[ index ];
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline void CNavArea::MakeNewMarker( void )
+{
+	CNavAreaSearchContext::GetCurrent()->MakeNewMarker();
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline void CNavArea::Mark( void )
+{
+	CNavAreaSearchContext::GetCurrent()->Mark( this );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline BOOL CNavArea::IsMarked( void ) const
+{
+	return CNavAreaSearchContext::GetCurrent()->IsMarked( this );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline void CNavArea::SetParent( CNavArea *parent, NavTraverseType how )
+{
+	CNavAreaSearchContext::GetCurrent()->SetParent( this, parent, how );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline CNavArea *CNavArea::GetParent( void ) const
+{
+	return CNavAreaSearchContext::GetCurrent()->GetParent( this );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline NavTraverseType CNavArea::GetParentHow( void ) const
+{
+	return CNavAreaSearchContext::GetCurrent()->GetParentHow( this );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline void CNavArea::SetTotalCost( float value )
+{
+	CNavAreaSearchContext::GetCurrent()->SetTotalCost( this, value );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline float CNavArea::GetTotalCost( void ) const
+{
+	return CNavAreaSearchContext::GetCurrent()->GetTotalCost( this );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline void CNavArea::SetCostSoFar( float value )
+{
+	CNavAreaSearchContext::GetCurrent()->SetCostSoFar( this, value );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline float CNavArea::GetCostSoFar( void ) const
+{
+	return CNavAreaSearchContext::GetCurrent()->GetCostSoFar( this );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline void CNavArea::SetPathLengthSoFar( float value )
+{
+	CNavAreaSearchContext::GetCurrent()->SetPathLengthSoFar( this, value );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline float CNavArea::GetPathLengthSoFar( void ) const
+{
+	return CNavAreaSearchContext::GetCurrent()->GetPathLengthSoFar( this );
+}
+
 //--------------------------------------------------------------------------------------------------------------
 inline bool CNavArea::IsOpen( void ) const
 {
-	return (m_openMarker == m_masterMarker) ? true : false;
+	return CNavAreaSearchContext::GetCurrent()->IsOpen( this );
 }
 
 //--------------------------------------------------------------------------------------------------------------
-inline bool CNavArea::IsOpenListEmpty( void )
+inline void CNavArea::AddToOpenList( void )
 {
-	Assert( (m_openList && m_openList->m_prevOpen == NULL) || m_openList == NULL );
-	return (m_openList) ? false : true;
+	CNavAreaSearchContext::GetCurrent()->AddToOpenList( this );
 }
 
 //--------------------------------------------------------------------------------------------------------------
-inline CNavArea *CNavArea::PopOpenList( void )
+inline void CNavArea::AddToOpenListTail( void )
 {
-	Assert( (m_openList && m_openList->m_prevOpen == NULL) || m_openList == NULL );
+	CNavAreaSearchContext::GetCurrent()->AddToOpenListTail( this );
+}
 
-	if ( m_openList )
-	{
-		CNavArea *area = m_openList;
-	
-		// disconnect from list
-		area->RemoveFromOpenList();
-		area->m_prevOpen = NULL;
-		area->m_nextOpen = NULL;
+//--------------------------------------------------------------------------------------------------------------
+inline void CNavArea::UpdateOnOpenList( void )
+{
+	CNavAreaSearchContext::GetCurrent()->UpdateOnOpenList( this );
+}
 
-		Assert( (m_openList && m_openList->m_prevOpen == NULL) || m_openList == NULL );
+//--------------------------------------------------------------------------------------------------------------
+inline void CNavArea::RemoveFromOpenList( void )
+{
+	CNavAreaSearchContext::GetCurrent()->RemoveFromOpenList( this );
+}
 
-		return area;
-	}
+//--------------------------------------------------------------------------------------------------------------
+inline bool CNavArea::IsOpenListEmpty( void )
+{
+	return CNavAreaSearchContext::GetCurrent()->IsOpenListEmpty();
+}
 
-	Assert( (m_openList && m_openList->m_prevOpen == NULL) || m_openList == NULL );
+//--------------------------------------------------------------------------------------------------------------
+inline CNavArea *CNavArea::PopOpenList( void )
+{
+	return CNavAreaSearchContext::GetCurrent()->PopOpenList();
+}
 
-	return NULL;
+//--------------------------------------------------------------------------------------------------------------
+inline void CNavArea::ClearSearchLists( void )
+{
+	CNavAreaSearchContext::GetCurrent()->ClearSearchLists();
 }
 
 //--------------------------------------------------------------------------------------------------------------
 inline bool CNavArea::IsClosed( void ) const
 {
-	if (IsMarked() && !IsOpen())
-		return true;
-
-	return false;
+	return CNavAreaSearchContext::GetCurrent()->IsClosed( this );
 }
 
 //--------------------------------------------------------------------------------------------------------------
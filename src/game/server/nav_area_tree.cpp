@@ -0,0 +1,274 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose:
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+// nav_area_tree.cpp
+// Bounding volume hierarchy over Navigation Mesh areas, for nearest area queries
+
+#include "cbase.h"
+#include "nav_area.h"
+#include "nav_area_tree.h"
+
+// NOTE: This has to be the last file included!
+#include "tier0/memdbgon.h"
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return the squared distance from 'pos' to the box, zero if it is inside
+ */
+inline float DistanceToBoxSq( const Vector &pos, const Vector &lo, const Vector &hi )
+{
+	float dx = MAX( MAX( lo.x - pos.x, pos.x - hi.x ), 0.0f );
+	float dy = MAX( MAX( lo.y - pos.y, pos.y - hi.y ), 0.0f );
+	float dz = MAX( MAX( lo.z - pos.z, pos.z - hi.z ), 0.0f );
+
+	return dx*dx + dy*dy + dz*dz;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Build the tree over the given areas, replacing whatever was there
+ */
+void CNavAreaTree::Build( const CUtlVector< CNavArea * > &areas )
+{
+	Reset();
+
+	int count = areas.Count();
+	if ( count == 0 )
+		return;
+
+	m_areas.CopyArray( areas.Base(), count );
+	m_extents.SetCount( count );
+	m_centers.SetCount( count );
+
+	for( int i=0; i<count; ++i )
+	{
+		m_areas[i]->GetExtent( &m_extents[i] );
+		m_centers[i] = 0.5f * ( m_extents[i].lo + m_extents[i].hi );
+	}
+
+	m_nodes.EnsureCapacity( 2 * count / MAX_LEAF_AREAS + 1 );
+	m_nodes.AddToTail();
+	BuildNode( 0, 0, count );
+
+	m_centers.Purge();
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavAreaTree::Reset( void )
+{
+	m_nodes.RemoveAll();
+	m_areas.RemoveAll();
+	m_extents.RemoveAll();
+	m_centers.RemoveAll();
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Fill in the given node for areas [first, first+count), splitting it if there are too many for a leaf
+ */
+void CNavAreaTree::BuildNode( int node, int first, int count )
+{
+	Vector lo = m_extents[ first ].lo;
+	Vector hi = m_extents[ first ].hi;
+	Vector centerLo = m_centers[ first ];
+	Vector centerHi = m_centers[ first ];
+
+	for( int i=first+1; i<first+count; ++i )
+	{
+		VectorMin( lo, m_extents[i].lo, lo );
+		VectorMax( hi, m_extents[i].hi, hi );
+		VectorMin( centerLo, m_centers[i], centerLo );
+		VectorMax( centerHi, m_centers[i], centerHi );
+	}
+
+	m_nodes[ node ].lo = lo;
+	m_nodes[ node ].hi = hi;
+
+	if ( count <= MAX_LEAF_AREAS )
+	{
+		m_nodes[ node ].index = first;
+		m_nodes[ node ].count = count;
+		return;
+	}
+
+	// split at the median along whichever horizontal axis the centers are most spread out on
+	int axis = ( centerHi.x - centerLo.x >= centerHi.y - centerLo.y ) ? 0 : 1;
+	int half = count / 2;
+	SelectMedian( first, count, first + half, axis );
+
+	// both children are added together so they are adjacent
+	int child = m_nodes.AddMultipleToTail( 2 );
+	m_nodes[ node ].index = child;
+	m_nodes[ node ].count = 0;
+
+	BuildNode( child, first, half );
+	BuildNode( child + 1, first + half, count - half );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Partially sort areas [first, first+count) so every area before 'nth' has a center no greater on 'axis',
+ * and every area after it has a center no less.
+ */
+void CNavAreaTree::SelectMedian( int first, int count, int nth, int axis )
+{
+	int lo = first;
+	int hi = first + count - 1;
+
+	while( lo < hi )
+	{
+		float pivot = m_centers[ ( lo + hi ) / 2 ][ axis ];
+		int i = lo;
+		int j = hi;
+
+		while( i <= j )
+		{
+			while( m_centers[i][ axis ] < pivot )
+				++i;
+
+			while( m_centers[j][ axis ] > pivot )
+				--j;
+
+			if ( i <= j )
+			{
+				SwapAreas( i, j );
+				++i;
+				--j;
+			}
+		}
+
+		if ( nth <= j )
+		{
+			hi = j;
+		}
+		else if ( nth >= i )
+		{
+			lo = i;
+		}
+		else
+		{
+			break;
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavAreaTree::SwapAreas( int i, int j )
+{
+	V_swap( m_areas[i], m_areas[j] );
+	V_swap( m_extents[i], m_extents[j] );
+	V_swap( m_centers[i], m_centers[j] );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Find up to 'maxCount' areas closest to 'pos', nearest first.
+ * Subtrees are visited nearest first and skipped once their bounds are farther than the worst area kept.
+ */
+int CNavAreaTree::CollectNearest( const Vector &pos, const Vector &source, float maxDistSq, int team, int maxCount, CNavArea **areas, Vector *areaPos, float *distSq ) const
+{
+	if ( m_nodes.Count() == 0 || maxCount <= 0 )
+		return 0;
+
+	struct StackEntry
+	{
+		int node;
+		float distSq;
+	};
+
+	StackEntry stack[ MAX_DEPTH ];
+	int stackCount = 0;
+
+	stack[ stackCount ].node = 0;
+	stack[ stackCount ].distSq = DistanceToBoxSq( pos, m_nodes[0].lo, m_nodes[0].hi );
+	++stackCount;
+
+	int found = 0;
+	float boundSq = maxDistSq;
+
+	while( stackCount )
+	{
+		--stackCount;
+		if ( stack[ stackCount ].distSq >= boundSq )
+			continue;
+
+		const Node &node = m_nodes[ stack[ stackCount ].node ];
+
+		if ( node.count )
+		{
+			for( int i=node.index; i<node.index + node.count; ++i )
+			{
+				if ( DistanceToBoxSq( pos, m_extents[i].lo, m_extents[i].hi ) >= boundSq )
+					continue;
+
+				CNavArea *area = m_areas[i];
+
+				// don't consider blocked areas
+				if ( area->IsBlocked( team ) )
+					continue;
+
+				Vector close;
+				area->GetClosestPointOnArea( source, &close );
+
+				float closeDistSq = ( close - pos ).LengthSqr();
+				if ( closeDistSq >= boundSq )
+					continue;
+
+				// insert in order, dropping the farthest area if the list is full
+				int slot = ( found < maxCount ) ? found++ : maxCount - 1;
+				while( slot > 0 && distSq[ slot-1 ] > closeDistSq )
+				{
+					areas[ slot ] = areas[ slot-1 ];
+					areaPos[ slot ] = areaPos[ slot-1 ];
+					distSq[ slot ] = distSq[ slot-1 ];
+					--slot;
+				}
+
+				areas[ slot ] = area;
+				areaPos[ slot ] = close;
+				distSq[ slot ] = closeDistSq;
+
+				if ( found == maxCount )
+				{
+					boundSq = distSq[ maxCount-1 ];
+				}
+			}
+			continue;
+		}
+
+		// push the farther child first, so the nearer one is searched first
+		int nearChild = node.index;
+		int farChild = node.index + 1;
+		float nearDistSq = DistanceToBoxSq( pos, m_nodes[ nearChild ].lo, m_nodes[ nearChild ].hi );
+		float farDistSq = DistanceToBoxSq( pos, m_nodes[ farChild ].lo, m_nodes[ farChild ].hi );
+
+		if ( farDistSq < nearDistSq )
+		{
+			V_swap( nearChild, farChild );
+			V_swap( nearDistSq, farDistSq );
+		}
+
+		Assert( stackCount + 2 <= MAX_DEPTH );
+
+		stack[ stackCount ].node = farChild;
+		stack[ stackCount ].distSq = farDistSq;
+		++stackCount;
+
+		stack[ stackCount ].node = nearChild;
+		stack[ stackCount ].distSq = nearDistSq;
+		++stackCount;
+	}
+
+	return found;
+}
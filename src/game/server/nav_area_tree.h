@@ -0,0 +1,67 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose:
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+// nav_area_tree.h
+// Bounding volume hierarchy over Navigation Mesh areas, for nearest area queries
+
+#ifndef _NAV_AREA_TREE_H_
+#define _NAV_AREA_TREE_H_
+
+#include "nav.h"
+#include "utlvector.h"
+
+class CNavArea;
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * A static tree of nav area extents, split in XY at the median area center.
+ * Each node keeps the full 3D bounds of its areas so distance bounds account for height as well.
+ * The tree holds raw area pointers, so it must be rebuilt whenever areas are added, removed, or reshaped.
+ */
+class CNavAreaTree
+{
+public:
+	CNavAreaTree( void ) { }
+
+	void Build( const CUtlVector< CNavArea * > &areas );
+	void Reset( void );
+
+	bool IsEmpty( void ) const							{ return m_nodes.Count() == 0; }
+	int GetNodeCount( void ) const						{ return m_nodes.Count(); }
+
+	/**
+	 * Find up to 'maxCount' areas closest to 'pos', nearest first, skipping areas blocked for 'team'.
+	 * Distance is from 'pos' to the point on the area closest to 'source', as CNavMesh::GetNearestNavArea measures it.
+	 * Only areas closer than sqrt( maxDistSq ) are returned.  The closest point on each area and its squared
+	 * distance go in 'areaPos' and 'distSq', which must have room for 'maxCount' entries as 'areas' does.
+	 * Returns the number of areas found.
+	 */
+	int CollectNearest( const Vector &pos, const Vector &source, float maxDistSq, int team, int maxCount, CNavArea **areas, Vector *areaPos, float *distSq ) const;
+
+private:
+	enum { MAX_LEAF_AREAS = 4, MAX_DEPTH = 64 };
+
+	struct Node
+	{
+		Vector lo, hi;									// bounds of every area under this node
+		int index;										// first area for a leaf, first of the two adjacent children otherwise
+		int count;										// number of areas in a leaf, 0 otherwise
+	};
+
+	void BuildNode( int node, int first, int count );
+	void SelectMedian( int first, int count, int nth, int axis );	// partially sort so the area at 'nth' has the median center on 'axis'
+	void SwapAreas( int i, int j );
+
+	CUtlVector< Node > m_nodes;
+	CUtlVector< CNavArea * > m_areas;					// in leaf order
+	CUtlVector< Extent > m_extents;						// parallel to m_areas
+	CUtlVector< Vector > m_centers;						// parallel to m_areas, only used while building
+};
+
+
+#endif // _NAV_AREA_TREE_H_
@@ -11,6 +11,7 @@
 
 #include "cbase.h"
 #include "nav_mesh.h"
+#include "nav_meshfile.h"
 #include "gamerules.h"
 #include "datacache/imdlcache.h"
 
@@ -36,7 +37,8 @@
 /// IMPORTANT: If this version changes, the swap function in makegamedata 
 /// must be updated to match. If not, this will break the Xbox 360.
 // TODO: Was changed from 15, update when latest 360 code is integrated (MSB 5/5/09)
-const int NavCurrentVersion = 16;
+const int NavCurrentVersion = 17;
+const int NavLastStreamedVersion = 16;		// last version to store areas field by field, still used by meshes with custom data
 
 //--------------------------------------------------------------------------------------------------------------
 //
@@ -671,6 +673,283 @@ NavErrorType CNavArea::Load( CUtlBuffer &fileBuffer, unsigned int version, unsig
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Save a navigation area in the flat layout
+ */
+void CNavArea::Save( CNavMeshFileWriter &file ) const
+{
+	file.m_areaID.AddToTail( m_id );
+	file.m_areaAttributes.AddToTail( m_attributeFlags );
+	file.m_areaNWCorner.AddToTail( m_nwCorner );
+	file.m_areaSECorner.AddToTail( m_seCorner );
+	file.m_areaNEZ.AddToTail( m_neZ );
+	file.m_areaSWZ.AddToTail( m_swZ );
+	file.m_areaPlace.AddToTail( placeDirectory.GetIndex( GetPlace() ) );
+
+	int i;
+	for( i=0; i<MAX_NAV_TEAMS; ++i )
+	{
+		file.m_areaEarliestOccupyTime[i].AddToTail( m_earliestOccupyTime[i] );
+	}
+
+	for ( i=0; i<NUM_CORNERS; ++i )
+	{
+		file.m_areaLightIntensity[i].AddToTail( m_lightIntensity[i] );
+	}
+
+	file.m_areaInheritVisibility.AddToTail( file.GetAreaIndex( m_inheritVisibilityFrom.area ) );
+
+	// connections to adjacent areas, in the enum order NORTH, EAST, SOUTH, WEST
+	for( int d=0; d<NUM_DIRECTIONS; d++ )
+	{
+		file.m_areaFirstConnect.AddToTail( file.m_connectArea.Count() );
+
+		FOR_EACH_VEC( m_connect[d], it )
+		{
+			int index = file.GetAreaIndex( m_connect[d][ it ].area );
+			if ( index >= 0 )
+			{
+				file.m_connectArea.AddToTail( index );
+			}
+		}
+	}
+
+	// hiding spots, in the order the writer numbered them
+	file.m_areaFirstHidingSpot.AddToTail( file.m_hidingSpotID.Count() );
+	FOR_EACH_VEC( m_hidingSpots, hit )
+	{
+		const HidingSpot *spot = m_hidingSpots[ hit ];
+
+		file.m_hidingSpotID.AddToTail( spot->GetID() );
+		file.m_hidingSpotPos.AddToTail( spot->GetPosition() );
+		file.m_hidingSpotFlags.AddToTail( (unsigned char)spot->GetFlags() );
+	}
+
+	// encounter paths
+	file.m_areaFirstEncounter.AddToTail( file.m_encounterFromArea.Count() );
+	FOR_EACH_VEC( m_spotEncounters, it )
+	{
+		const SpotEncounter *e = m_spotEncounters[ it ];
+
+		file.m_encounterFromArea.AddToTail( file.GetAreaIndex( e->from.area ) );
+		file.m_encounterFromDir.AddToTail( (unsigned char)e->fromDir );
+		file.m_encounterToArea.AddToTail( file.GetAreaIndex( e->to.area ) );
+		file.m_encounterToDir.AddToTail( (unsigned char)e->toDir );
+
+		file.m_encounterFirstSpot.AddToTail( file.m_encounterSpot.Count() );
+		FOR_EACH_VEC( e->spots, sit )
+		{
+			const SpotOrder *order = &e->spots[ sit ];
+
+			// order->spot may be NULL if we've loaded a nav mesh that has been edited but not re-analyzed
+			file.m_encounterSpot.AddToTail( file.GetHidingSpotIndex( order->spot ) );
+			file.m_encounterSpotT.AddToTail( (unsigned char)(255 * order->t) );
+		}
+	}
+
+	// ladders leading up and down from this area
+	for ( i=0; i<CNavLadder::NUM_LADDER_DIRECTIONS; ++i )
+	{
+		file.m_areaFirstLadder.AddToTail( file.m_ladderConnect.Count() );
+
+		FOR_EACH_VEC( m_ladder[i], it )
+		{
+			int index = file.GetLadderIndex( m_ladder[i][it].ladder );
+			if ( index >= 0 )
+			{
+				file.m_ladderConnect.AddToTail( index );
+			}
+		}
+	}
+
+	// visible area set
+	file.m_areaFirstVisible.AddToTail( file.m_visibleArea.Count() );
+	for ( int vit=0; vit<m_potentiallyVisibleAreas.Count(); ++vit )
+	{
+		file.m_visibleArea.AddToTail( file.GetAreaIndex( m_potentiallyVisibleAreas[ vit ].area ) );
+		file.m_visibleAttributes.AddToTail( m_potentiallyVisibleAreas[ vit ].attributes );
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Load a navigation area from the flat layout.
+ * References to other areas, hiding spots and ladders are turned back into IDs, which PostLoad() binds
+ * the same way as for the streamed layout.
+ */
+void CNavArea::Load( const CNavMeshFileView &file, int index )
+{
+	const int areaCount = file.GetAreaCount();
+
+	m_id = file.GetAreaID( index );
+
+	// update nextID to avoid collisions
+	if (m_id >= m_nextID)
+		m_nextID = m_id+1;
+
+	m_attributeFlags = file.Get< int >( &NavFlatHeader::areaAttributes )[ index ];
+
+	// load extent of area
+	m_nwCorner = file.Get< Vector >( &NavFlatHeader::areaNWCorner )[ index ];
+	m_seCorner = file.Get< Vector >( &NavFlatHeader::areaSECorner )[ index ];
+
+	m_center.x = (m_nwCorner.x + m_seCorner.x)/2.0f;
+	m_center.y = (m_nwCorner.y + m_seCorner.y)/2.0f;
+	m_center.z = (m_nwCorner.z + m_seCorner.z)/2.0f;
+
+	if ( ( m_seCorner.x - m_nwCorner.x ) > 0.0f && ( m_seCorner.y - m_nwCorner.y ) > 0.0f )
+	{
+		m_invDxCorners = 1.0f / ( m_seCorner.x - m_nwCorner.x );
+		m_invDyCorners = 1.0f / ( m_seCorner.y - m_nwCorner.y );
+	}
+	else
+	{
+		m_invDxCorners = m_invDyCorners = 0;
+
+		DevWarning( "Degenerate Navigation Area #%d at setpos %g %g %g\n", 
+			m_id, m_center.x, m_center.y, m_center.z );
+	}
+
+	// load heights of implicit corners
+	m_neZ = file.Get< float >( &NavFlatHeader::areaNEZ )[ index ];
+	m_swZ = file.Get< float >( &NavFlatHeader::areaSWZ )[ index ];
+
+	CheckWaterLevel();
+
+	int first, last, i;
+
+	// load connections to adjacent areas
+	const int *connectArea = file.Get< int >( &NavFlatHeader::connectArea );
+	for( int d=0; d<NUM_DIRECTIONS; d++ )
+	{
+		file.GetRange( &NavFlatHeader::areaFirstConnect, index * NUM_DIRECTIONS + d, &first, &last );
+
+		m_connect[d].EnsureCapacity( last - first );
+		for( i=first; i<last; ++i )
+		{
+			NavConnect connect;
+			connect.id = file.GetAreaID( connectArea[i] );
+
+			// don't allow self-referential connections
+			if ( connect.id != m_id )
+			{
+				m_connect[d].AddToTail( connect );
+			}
+		}
+	}
+
+	// load hiding spots
+	file.GetRange( &NavFlatHeader::areaFirstHidingSpot, index, &first, &last );
+	for( i=first; i<last; ++i )
+	{
+		// create new hiding spot and put on master list
+		HidingSpot *spot = TheNavMesh->CreateHidingSpot();
+
+		spot->Load( file, i );
+
+		m_hidingSpots.AddToTail( spot );
+	}
+
+	// load encounter paths
+	const int *encounterFromArea = file.Get< int >( &NavFlatHeader::encounterFromArea );
+	const unsigned char *encounterFromDir = file.Get< unsigned char >( &NavFlatHeader::encounterFromDir );
+	const int *encounterToArea = file.Get< int >( &NavFlatHeader::encounterToArea );
+	const unsigned char *encounterToDir = file.Get< unsigned char >( &NavFlatHeader::encounterToDir );
+	const int *encounterSpot = file.Get< int >( &NavFlatHeader::encounterSpot );
+	const unsigned char *encounterSpotT = file.Get< unsigned char >( &NavFlatHeader::encounterSpotT );
+
+	file.GetRange( &NavFlatHeader::areaFirstEncounter, index, &first, &last );
+	for( int e=first; e<last; ++e )
+	{
+		SpotEncounter *encounter = new SpotEncounter;
+
+		encounter->from.id = file.GetAreaID( encounterFromArea[e] );
+		encounter->fromDir = static_cast<NavDirType>( encounterFromDir[e] );
+		encounter->to.id = file.GetAreaID( encounterToArea[e] );
+		encounter->toDir = static_cast<NavDirType>( encounterToDir[e] );
+
+		int firstSpot, lastSpot;
+		file.GetRange( &NavFlatHeader::encounterFirstSpot, e, &firstSpot, &lastSpot );
+
+		encounter->spots.EnsureCapacity( lastSpot - firstSpot );
+		for( int s=firstSpot; s<lastSpot; ++s )
+		{
+			SpotOrder order;
+			order.id = file.GetHidingSpotID( encounterSpot[s] );
+			order.t = (float)encounterSpotT[s]/255.0f;
+
+			encounter->spots.AddToTail( order );
+		}
+
+		m_spotEncounters.AddToTail( encounter );
+	}
+
+	// convert place directory entry to actual Place
+	SetPlace( placeDirectory.IndexToPlace( file.Get< unsigned short >( &NavFlatHeader::areaPlace )[ index ] ) );
+
+	// load ladder data
+	const int *ladderConnect = file.Get< int >( &NavFlatHeader::ladderConnect );
+	for ( int dir=0; dir<CNavLadder::NUM_LADDER_DIRECTIONS; ++dir )
+	{
+		file.GetRange( &NavFlatHeader::areaFirstLadder, index * CNavLadder::NUM_LADDER_DIRECTIONS + dir, &first, &last );
+		for( i=first; i<last; ++i )
+		{
+			NavLadderConnect connect;
+			connect.id = file.GetLadderID( ladderConnect[i] );
+
+			bool alreadyConnected = false;
+			FOR_EACH_VEC( m_ladder[dir], j )
+			{
+				if ( m_ladder[dir][j].id == connect.id )
+				{
+					alreadyConnected = true;
+					break;
+				}
+			}
+
+			if ( !alreadyConnected )
+			{
+				m_ladder[dir].AddToTail( connect );
+			}
+		}
+	}
+
+	// load earliest occupy times
+	const float *earliestOccupyTime = file.Get< float >( &NavFlatHeader::areaEarliestOccupyTime );
+	for( i=0; i<MAX_NAV_TEAMS; ++i )
+	{
+		m_earliestOccupyTime[i] = earliestOccupyTime[ i * areaCount + index ];
+	}
+
+	// load light intensity
+	const float *lightIntensity = file.Get< float >( &NavFlatHeader::areaLightIntensity );
+	for ( i=0; i<NUM_CORNERS; ++i )
+	{
+		m_lightIntensity[i] = lightIntensity[ i * areaCount + index ];
+	}
+
+	// load visibility information
+	const int *visibleArea = file.Get< int >( &NavFlatHeader::visibleArea );
+	const unsigned char *visibleAttributes = file.Get< unsigned char >( &NavFlatHeader::visibleAttributes );
+
+	file.GetRange( &NavFlatHeader::areaFirstVisible, index, &first, &last );
+	m_potentiallyVisibleAreas.EnsureCapacity( last - first );
+	for( i=first; i<last; ++i )
+	{
+		AreaBindInfo info;
+		info.id = file.GetAreaID( visibleArea[i] );
+		info.attributes = visibleAttributes[i];
+
+		m_potentiallyVisibleAreas.AddToTail( info );
+	}
+
+	// read area from which we inherit visibility
+	m_inheritVisibilityFrom.id = file.GetAreaID( file.Get< int >( &NavFlatHeader::areaInheritVisibility )[ index ] );
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Convert loaded IDs to pointers
@@ -1065,6 +1344,38 @@ static void WarnIfMeshNeedsAnalysis( int version )
 #endif
 }
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Interleave the bits of an area's center, quantized to 64 unit cells, so sorting by the result keeps
+ * areas that are near each other close together
+ */
+static unsigned int NavAreaLocationKey( const CNavArea *area )
+{
+	const Vector &center = area->GetCenter();
+	unsigned int x = (unsigned int)clamp( (int)( center.x / 64.0f ) + 32768, 0, 65535 );
+	unsigned int y = (unsigned int)clamp( (int)( center.y / 64.0f ) + 32768, 0, 65535 );
+
+	unsigned int key = 0;
+	for( int bit=0; bit<16; ++bit )
+	{
+		key |= ( ( x >> bit ) & 1 ) << ( 2*bit );
+		key |= ( ( y >> bit ) & 1 ) << ( 2*bit + 1 );
+	}
+
+	return key;
+}
+
+static int CompareNavAreaLocations( CNavArea * const *area1, CNavArea * const *area2 )
+{
+	unsigned int key1 = NavAreaLocationKey( *area1 );
+	unsigned int key2 = NavAreaLocationKey( *area2 );
+	if ( key1 != key2 )
+		return ( key1 < key2 ) ? -1 : 1;
+
+	return ( (*area1)->GetID() < (*area2)->GetID() ) ? -1 : 1;
+}
+
+
 /**
  * Store Navigation Mesh to a file
  */
@@ -1114,7 +1425,12 @@ bool CNavMesh::Save( void ) const
 	// 14 - Added a bool for if the nav needs analysis
 	// 15 - removed approach areas
 	// 16 - Added visibility data to the base mesh
-	fileBuffer.PutUnsignedInt( NavCurrentVersion );
+	// 17 - Areas, ladders and hiding spots stored as flat arrays after the place directory
+	//
+	// Derived classes store their custom data inside each area, which only the streamed layout of
+	// version 16 has room for.
+	unsigned int version = ( GetSubVersionNumber() == 0 ) ? NavCurrentVersion : NavLastStreamedVersion;
+	fileBuffer.PutUnsignedInt( version );
 
 	// The sub-version number is maintained and owned by classes derived from CNavMesh and CNavArea
 	// and allows them to track their custom data just as we do at this top level
@@ -1147,36 +1463,63 @@ bool CNavMesh::Save( void ) const
 
 	SaveCustomDataPreArea( fileBuffer );
 
-	//
-	// Store navigation areas
-	//
+	if ( version >= 17 )
 	{
-		// store number of areas
-		unsigned int count = TheNavAreas.Count();
-		fileBuffer.PutUnsignedInt( count );
+		//
+		// Store areas, ladders and hiding spots as one flat block. Areas go in the order of
+		// their location, so neighbors are near each other in the file and in memory after loading.
+		//
+		NavAreaVector areas;
+		areas.AddVectorToTail( TheNavAreas );
+		areas.Sort( CompareNavAreaLocations );
 
-		// store each area
-		FOR_EACH_VEC( TheNavAreas, it )
+		CNavMeshFileWriter file( areas, m_ladders );
+
+		FOR_EACH_VEC( areas, it )
 		{
-			CNavArea *area = TheNavAreas[ it ];
+			areas[ it ]->Save( file );
+		}
 
-			area->Save( fileBuffer, NavCurrentVersion );
+		for ( int i=0; i<m_ladders.Count(); ++i )
+		{
+			m_ladders[i]->Save( file );
 		}
-	}
 
-	//
-	// Store ladders
-	//
+		file.Write( fileBuffer );
+	}
+	else
 	{
-		// store number of ladders
-		unsigned int count = m_ladders.Count();
-		fileBuffer.PutUnsignedInt( count );
+		//
+		// Store navigation areas
+		//
+		{
+			// store number of areas
+			unsigned int count = TheNavAreas.Count();
+			fileBuffer.PutUnsignedInt( count );
 
-		// store each ladder
-		for ( int i=0; i<m_ladders.Count(); ++i )
+			// store each area
+			FOR_EACH_VEC( TheNavAreas, it )
+			{
+				CNavArea *area = TheNavAreas[ it ];
+
+				area->Save( fileBuffer, version );
+			}
+		}
+
+		//
+		// Store ladders
+		//
 		{
-			CNavLadder *ladder = m_ladders[i];
-			ladder->Save( fileBuffer, NavCurrentVersion );
+			// store number of ladders
+			unsigned int count = m_ladders.Count();
+			fileBuffer.PutUnsignedInt( count );
+
+			// store each ladder
+			for ( int i=0; i<m_ladders.Count(); ++i )
+			{
+				CNavLadder *ladder = m_ladders[i];
+				ladder->Save( fileBuffer, version );
+			}
 		}
 	}
 	
@@ -1495,8 +1838,25 @@ NavErrorType CNavMesh::Load( void )
 	LoadCustomDataPreArea( fileBuffer, subVersion );
 
 	// get number of areas
-	unsigned int count = fileBuffer.GetUnsignedInt();
+	CNavMeshFileView flatFile;
+	unsigned int count;
 	unsigned int i;
+	if ( version >= 17 )
+	{
+		// the flat block starts on an aligned boundary after the place directory, and is used in place
+		fileBuffer.SeekGet( CUtlBuffer::SEEK_HEAD, AlignValue( fileBuffer.TellGet(), NAV_FLAT_ALIGN ) );
+		if ( !fileBuffer.IsValid() || !flatFile.Init( fileBuffer.PeekGet(), fileBuffer.GetBytesRemaining() ) )
+		{
+			Msg( "Corrupt navigation file '%s'.\n", filename );
+			return NAV_CORRUPT_DATA;
+		}
+
+		count = flatFile.GetAreaCount();
+	}
+	else
+	{
+		count = fileBuffer.GetUnsignedInt();
+	}
 
 	if ( count == 0 )
 	{
@@ -1515,7 +1875,14 @@ NavErrorType CNavMesh::Load( void )
 	for( i=0; i<count; ++i )
 	{
 		CNavArea *area = TheNavMesh->CreateArea();
-		area->Load( fileBuffer, version, subVersion );
+		if ( version >= 17 )
+		{
+			area->Load( flatFile, i );
+		}
+		else
+		{
+			area->Load( fileBuffer, version, subVersion );
+		}
 		TheNavAreas.AddToTail( area );
 
 		area->GetExtent( &areaExtent );
@@ -1542,7 +1909,22 @@ NavErrorType CNavMesh::Load( void )
 	//
 	// Set up all the ladders
 	//
-	if (version >= 6)
+	if ( version >= 17 )
+	{
+		count = flatFile.GetLadderCount();
+		m_ladders.EnsureCapacity( count );
+
+		for( i=0; i<count; ++i )
+		{
+			CNavLadder *ladder = new CNavLadder;
+			ladder->Load( flatFile, i );
+			m_ladders.AddToTail( ladder );
+		}
+
+		// step over the block to any derived class data
+		fileBuffer.SeekGet( CUtlBuffer::SEEK_CURRENT, flatFile.GetSize() );
+	}
+	else if (version >= 6)
 	{
 		count = fileBuffer.GetUnsignedInt();
 		m_ladders.EnsureCapacity( count );
@@ -1691,6 +2073,9 @@ NavErrorType CNavMesh::PostLoad( unsigned int version )
 
 	// the Navigation Mesh has been successfully loaded
 	m_isLoaded = true;
+
+	// build the clusters for hierarchical path searches now, rather than during the first search
+	GetAreaHierarchy();
 	
 	return NAV_OK;
 }
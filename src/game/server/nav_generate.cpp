@@ -17,6 +17,7 @@
 #include "viewport_panel_names.h"
 //#include "terror/TerrorShared.h"
 #include "fmtstr.h"
+#include "vstdlib/jobthread.h"
 
 #ifdef TERROR
 #include "func_simpleladder.h"
@@ -42,6 +43,8 @@ ConVar nav_generate_fixup_jump_areas( "nav_generate_fixup_jump_areas", "1", FCVA
 ConVar nav_generate_incremental_range( "nav_generate_incremental_range", "2000", FCVAR_CHEAT );
 ConVar nav_generate_incremental_tolerance( "nav_generate_incremental_tolerance", "0", FCVAR_CHEAT, "Z tolerance for adding new nav areas." );
 ConVar nav_area_max_size( "nav_area_max_size", "50", FCVAR_CHEAT, "Max area size created in nav generation" );
+ConVar nav_generate_parallel( "nav_generate_parallel", "1", FCVAR_CHEAT, "Sample walkable space a breadth-first wave at a time, tracing on all cores. 0 uses the original depth-first walk." );
+ConVar nav_generate_checkpoint_interval( "nav_generate_checkpoint_interval", "0", FCVAR_CHEAT, "Seconds between saving sampling progress during nav_generate, so nav_generate_resume can pick it up. 0 disables." );
 
 // Common bounding box for traces
 Vector NavTraceMins( -0.45, -0.45, 0 );
@@ -3427,6 +3430,8 @@ void CNavMesh::BeginGeneration( bool incremental )
 
 	m_generationState = SAMPLE_WALKABLE_SPACE;
 	m_sampleTick = 0;
+	m_sampleFrontier.RemoveAll();
+	m_nextGenerationCheckpointTime = Plat_FloatTime() + nav_generate_checkpoint_interval.GetFloat();
 	m_generationMode = (incremental) ? GENERATE_INCREMENTAL : GENERATE_FULL;
 	lastMsgTime = 0.0f;
 
@@ -3631,14 +3636,26 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 			AnalysisProgress( "Sampling walkable space...", 100, m_sampleTick / 10, false );
 			m_sampleTick = ( m_sampleTick + 1 ) % 1000;
 
-			while ( SampleStep() )
+			bool parallel = nav_generate_parallel.GetBool();
+			while ( parallel ? SampleWavefront() : SampleStep() )
 			{
 				if ( Plat_FloatTime() - startTime > maxTime )
 				{
+					if ( nav_generate_checkpoint_interval.GetFloat() > 0.0f && Plat_FloatTime() >= m_nextGenerationCheckpointTime )
+					{
+						SaveGenerationCheckpoint();
+						m_nextGenerationCheckpointTime = Plat_FloatTime() + nav_generate_checkpoint_interval.GetFloat();
+					}
 					return true;
 				}
 			}
 
+			// a finished sampling pass has nothing left to resume
+			if ( m_generationMode == GENERATE_FULL && filesystem->FileExists( GetGenerationCheckpointFilename(), "MOD" ) )
+			{
+				filesystem->RemoveFile( GetGenerationCheckpointFilename(), "MOD" );
+			}
+
 			// sampling is complete, now build nav areas
 			m_generationState = CREATE_AREAS_FROM_SAMPLES;
 
@@ -4071,7 +4088,7 @@ const char *CNavMesh::GetPlayerSpawnName( void ) const
  * Node Z positions are ground level.
  */
 CNavNode *CNavMesh::AddNode( const Vector &destPos, const Vector &normal, NavDirType dir, CNavNode *source, bool isOnDisplacement, 
-							float obstacleHeight, float obstacleStartDist, float obstacleEndDist )
+							float obstacleHeight, float obstacleStartDist, float obstacleEndDist, bool checkSurroundings )
 {
 	// check if a node exists at this location
 	CNavNode *node = CNavNode::GetNode( destPos );
@@ -4108,17 +4125,9 @@ CNavNode *CNavMesh::AddNode( const Vector &destPos, const Vector &normal, NavDir
 		m_currentNode = node;
 	}
 
-	node->CheckCrouch();
-
-	// determine if there's a cliff nearby and set an attribute on this node
-	for ( int i = 0; i < NUM_DIRECTIONS; i++ )
+	if ( checkSurroundings )
 	{
-		NavDirType dir = (NavDirType) i;
-		if ( CheckCliff( node->GetPosition(), dir ) )
-		{
-			node->SetAttributes( node->GetAttributes() | NAV_MESH_CLIFF );
-			break;
-		}
+		CheckNodeSurroundings( node );
 	}
 
 	return node;
@@ -4348,35 +4357,11 @@ bool CNavMesh::SampleStep( void )
 	{
 		if (m_currentNode == NULL)
 		{
-			// sampling is complete from current seed, try next one
-			m_currentNode = GetNextWalkableSeedNode();
-
+			m_currentNode = GetNextSampleStartNode();
 			if (m_currentNode == NULL)
 			{
-				if ( m_generationMode == GENERATE_INCREMENTAL || m_generationMode == GENERATE_SIMPLIFY )
-				{
-					return false;
-				}
-
-				// search is exhausted - continue search from ends of ladders
-				for ( int i=0; i<m_ladders.Count(); ++i )
-				{
-					CNavLadder *ladder = m_ladders[i];
-
-					// check ladder bottom
-					if ((m_currentNode = LadderEndSearch( &ladder->m_bottom, ladder->GetDir() )) != 0)
-						break;
-
-					// check ladder top
-					if ((m_currentNode = LadderEndSearch( &ladder->m_top, ladder->GetDir() )) != 0)
-						break;
-				}
-
-				if (m_currentNode == NULL)
-				{
-					// all seeds exhausted, sampling complete
-					return false;
-				}
+				// all seeds exhausted, sampling complete
+				return false;
 			}
 		}
 
@@ -4388,232 +4373,429 @@ bool CNavMesh::SampleStep( void )
 			if (!m_currentNode->HasVisited( (NavDirType)dir ))
 			{
 				// have not searched in this direction yet
+				m_generationDir = (NavDirType)dir;
 
-				// start at current node position
-				Vector pos = *m_currentNode->GetPosition();
-
-				// snap to grid
-				int cx = SnapToGrid( pos.x );
-				int cy = SnapToGrid( pos.y );
+				// mark direction as visited
+				m_currentNode->MarkAsVisited( m_generationDir );
 
-				// attempt to move to adjacent node
-				switch( dir )
+				SampleStepInfo step;
+				step.from = m_currentNode;
+				step.dir = m_generationDir;
+				if ( ComputeSampleStep( &step ) )
 				{
-					case NORTH:		cy -= GenerationStepSize; break;
-					case SOUTH:		cy += GenerationStepSize; break;
-					case EAST:		cx += GenerationStepSize; break;
-					case WEST:		cx -= GenerationStepSize; break;
+					// we can move here
+					// create a new navigation node, and update current node pointer
+					AddNode( step.to, step.toNormal, step.dir, step.from, step.isOnDisplacement, step.obstacleHeight, step.obstacleStartDist, step.obstacleEndDist );
 				}
 
-				pos.x = cx;
-				pos.y = cy;
+				return true;
+			}
+		}
 
-				m_generationDir = (NavDirType)dir;
+		// all directions have been searched from this node - pop back to its parent and continue
+		m_currentNode = m_currentNode->GetParent();
+	}
+}
 
-				// mark direction as visited
-				m_currentNode->MarkAsVisited( m_generationDir );
 
-				// sanity check to not generate across the world for incremental generation
-				const float incrementalRange = nav_generate_incremental_range.GetFloat();
-				if ( m_generationMode == GENERATE_INCREMENTAL && incrementalRange > 0 )
-				{
-					bool inRange = false;
-					for ( int i=0; i<m_walkableSeeds.Count(); ++i )
-					{
-						const Vector &seedPos = m_walkableSeeds[i].pos;
-						if ( (seedPos - pos).IsLengthLessThan( incrementalRange ) )
-						{
-							inRange = true;
-							break;
-						}
-					}
+//--------------------------------------------------------------------------------------------------------------
+static int CompareNavNodeIDs( CNavNode * const *node1, CNavNode * const *node2 )
+{
+	return (int)(*node1)->GetID() - (int)(*node2)->GetID();
+}
 
-					if ( !inRange )
-					{
-						return true;
-					}
-				}
 
-				if ( m_generationMode == GENERATE_SIMPLIFY )
-				{
-					if ( !m_simplifyGenerationExtent.Contains( pos ) )
-					{
-						return true;
-					}
-				}
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Sample the map one breadth-first "wave" at a time.  The steps out of every node on the front of the
+ * wave are traced in parallel, then applied one by one in a fixed order, so the result doesn't depend
+ * on how many threads did the tracing.
+ *
+ * Returns true if sampling needs to continue, or false if done.
+ */
+bool CNavMesh::SampleWavefront( void )
+{
+	if ( m_sampleFrontier.Count() == 0 )
+	{
+		CNavNode *node = GetNextSampleStartNode();
+		if ( node == NULL )
+		{
+			// all seeds exhausted, sampling complete
+			return false;
+		}
 
-				// test if we can move to new position
-				trace_t result;
-				Vector from( *m_currentNode->GetPosition() );
-				CTraceFilterWalkableEntities filter( NULL, COLLISION_GROUP_NONE, WALK_THRU_EVERYTHING );
-				Vector to, toNormal;
-				float obstacleHeight = 0, obstacleStartDist = 0, obstacleEndDist = GenerationStepSize;
-				if ( TraceAdjacentNode( 0, from, pos, &result ) )
-				{
-					to = result.endpos;
-					toNormal = result.plane.normal;
-				}
-				else
-				{
-					// test going up ClimbUpHeight
-					bool success = false;
-					for ( float height = StepHeight; height <= ClimbUpHeight; height += 1.0f )
-					{						
-						trace_t tr;
-						Vector start( from );
-						Vector end( pos );
-						start.z += height;
-						end.z += height;
-						UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
-						if ( !tr.startsolid && tr.fraction == 1.0f )
-						{
-							if ( !StayOnFloor( &tr ) )
-							{
-								break;
-							}
+		m_sampleFrontier.AddToTail( node );
+	}
 
-							to = tr.endpos;
-							toNormal = tr.plane.normal;
+	// pick up anything a depth-first SampleStep() left on its stack
+	for ( ; m_currentNode; m_currentNode = m_currentNode->GetParent() )
+	{
+		m_sampleFrontier.AddToTail( m_currentNode );
+	}
 
-							start = end = from;
-							end.z += height;
-							UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
-							if ( tr.fraction < 1.0f )
-							{
-								break;
-							}
+	// don't let one wave run far past the time slice on open maps
+	const int maxWaveSize = 2048;
+	int waveSize = MIN( m_sampleFrontier.Count(), maxWaveSize );
 
-							// keep track of far up we had to go to find a path to the next node
-							obstacleHeight = height;
-							success = true;
-							break;
-						}
-						else
-						{
-							// Could not trace from node to node at this height, something is in the way.
-							// Trace in the other direction to see if we hit something
-							Vector vecToObstacleStart = tr.endpos - start;
-							Assert( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) );
-							if ( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) )
-							{
-								UTIL_TraceHull( end, start, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
-								if ( !tr.startsolid && tr.fraction < 1.0 )
-								{
-									// We hit something going the other direction.  There is some obstacle between the two nodes.
-									Vector vecToObstacleEnd = tr.endpos - start;
-									Assert( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize ) );
-									if ( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize )  )
-									{
-										// Remember the distances to start and end of the obstacle (with respect to the "from" node).
-										// Keep track of the last distances to obstacle as we keep increasing the height we do a trace for.
-										// If we do eventually clear the obstacle, these values will be the start and end distance to the
-										// very tip of the obstacle.
-										obstacleStartDist = vecToObstacleStart.Length();
-										obstacleEndDist = vecToObstacleEnd.Length();
-										if ( obstacleEndDist == 0 )
-										{
-											obstacleEndDist = GenerationStepSize;
-										}
-									}								
-								}
-							}
-						}
-					}
+	CUtlVector< SampleStepInfo > steps;
+	steps.EnsureCapacity( waveSize * NUM_DIRECTIONS );
+	for( int i=0; i<waveSize; ++i )
+	{
+		CNavNode *node = m_sampleFrontier[i];
+		for( int dir = NORTH; dir < NUM_DIRECTIONS; dir++ )
+		{
+			if ( !node->HasVisited( (NavDirType)dir ) )
+			{
+				SampleStepInfo &step = steps[ steps.AddToTail() ];
+				step.from = node;
+				step.dir = (NavDirType)dir;
+			}
+		}
+	}
 
-					if ( !success )
-					{
-						return true;
-					}
-				}
+	ParallelProcess( "CNavMesh::SampleWavefront", steps.Base(), steps.Count(), &CNavMesh::ComputeSampleStepJob );
 
-				// Don't generate nodes if we spill off the end of the world onto skybox
-				if ( result.surface.flags & ( SURF_SKY|SURF_SKY2D ) )
-				{
-					return true;
-				}
+	CUtlVector< CNavNode * > touchedNodes;
+	touchedNodes.EnsureCapacity( steps.Count() );
+	for( int i=0; i<steps.Count(); ++i )
+	{
+		const SampleStepInfo &step = steps[i];
 
-				// If we're incrementally generating, don't overlap existing nav areas.
-				Vector testPos( to );
-				bool overlapSE = IsNodeOverlapped( testPos, Vector(  1,  1, HalfHumanHeight ) );
-				bool overlapSW = IsNodeOverlapped( testPos, Vector( -1,  1, HalfHumanHeight ) );
-				bool overlapNE = IsNodeOverlapped( testPos, Vector(  1, -1, HalfHumanHeight ) );
-				bool overlapNW = IsNodeOverlapped( testPos, Vector( -1, -1, HalfHumanHeight ) );
-				if ( overlapSE && overlapSW && overlapNE && overlapNW && m_generationMode != GENERATE_SIMPLIFY )
-				{
-					return true;
-				}
+		// an earlier step in this wave may have linked back through this direction already
+		if ( step.from->HasVisited( step.dir ) )
+			continue;
 
-				int nTolerance = nav_generate_incremental_tolerance.GetInt();
-				if ( nTolerance > 0 && m_generationMode == GENERATE_INCREMENTAL )
-				{
-					bool bValid = false;
-					int zPos = to.z;
-					for ( int i=0; i<m_walkableSeeds.Count(); ++i )
-					{
-						const Vector &seedPos = m_walkableSeeds[i].pos;
-						int zMin = seedPos.z - nTolerance;
-						int zMax = seedPos.z + nTolerance;
+		step.from->MarkAsVisited( step.dir );
 
-						if ( zPos >= zMin && zPos <= zMax )
-						{
-							bValid = true;
-							break;
-						}
-					}
+		if ( !step.canMove )
+			continue;
 
-					if ( !bValid )
-						return true;
+		unsigned int nodeCount = CNavNode::GetListLength();
+		CNavNode *node = AddNode( step.to, step.toNormal, step.dir, step.from, step.isOnDisplacement, step.obstacleHeight, step.obstacleStartDist, step.obstacleEndDist, false );
+		if ( CNavNode::GetListLength() != nodeCount )
+		{
+			m_sampleFrontier.AddToTail( node );
+		}
+
+		touchedNodes.AddToTail( node );
+	}
+
+	m_sampleFrontier.RemoveMultipleFromHead( waveSize );
+
+	// AddNode() moves the current node, which only SampleStep() uses
+	m_currentNode = NULL;
+
+	// the crouch and cliff tests were skipped above, run them once per node
+	touchedNodes.Sort( CompareNavNodeIDs );
+	int uniqueCount = 0;
+	for( int i=0; i<touchedNodes.Count(); ++i )
+	{
+		if ( uniqueCount == 0 || touchedNodes[ uniqueCount-1 ] != touchedNodes[i] )
+		{
+			touchedNodes[ uniqueCount++ ] = touchedNodes[i];
+		}
+	}
+
+	ParallelProcess( "CNavMesh::SampleWavefront", touchedNodes.Base(), uniqueCount, &CNavMesh::CheckNodeSurroundings );
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return a node to continue sampling from: a node left over from a resumed checkpoint, the next
+ * walkable seed, or the end of a ladder.  Returns NULL when sampling is complete.
+ */
+CNavNode *CNavMesh::GetNextSampleStartNode( void )
+{
+	if ( m_sampleFrontier.Count() )
+	{
+		CNavNode *node = m_sampleFrontier.Tail();
+		m_sampleFrontier.RemoveMultipleFromTail( 1 );
+		return node;
+	}
+
+	// sampling is complete from current seed, try next one
+	CNavNode *node = GetNextWalkableSeedNode();
+	if ( node )
+		return node;
+
+	if ( m_generationMode == GENERATE_INCREMENTAL || m_generationMode == GENERATE_SIMPLIFY )
+	{
+		return NULL;
+	}
+
+	// search is exhausted - continue search from ends of ladders
+	for ( int i=0; i<m_ladders.Count(); ++i )
+	{
+		CNavLadder *ladder = m_ladders[i];
+
+		// check ladder bottom
+		if ((node = LadderEndSearch( &ladder->m_bottom, ladder->GetDir() )) != 0)
+			return node;
+
+		// check ladder top
+		if ((node = LadderEndSearch( &ladder->m_top, ladder->GetDir() )) != 0)
+			return node;
+	}
+
+	// all seeds exhausted, sampling complete
+	return NULL;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Trace a step from step->from in step->dir and fill in where it lands.
+ * Returns false if the step can't be taken.
+ */
+bool CNavMesh::ComputeSampleStep( SampleStepInfo *step ) const
+{
+	step->canMove = false;
+
+	// start at current node position
+	Vector pos = *step->from->GetPosition();
+
+	// snap to grid
+	int cx = SnapToGrid( pos.x );
+	int cy = SnapToGrid( pos.y );
+
+	// attempt to move to adjacent node
+	switch( step->dir )
+	{
+		case NORTH:		cy -= GenerationStepSize; break;
+		case SOUTH:		cy += GenerationStepSize; break;
+		case EAST:		cx += GenerationStepSize; break;
+		case WEST:		cx -= GenerationStepSize; break;
+	}
+
+	pos.x = cx;
+	pos.y = cy;
+
+	// sanity check to not generate across the world for incremental generation
+	const float incrementalRange = nav_generate_incremental_range.GetFloat();
+	if ( m_generationMode == GENERATE_INCREMENTAL && incrementalRange > 0 )
+	{
+		bool inRange = false;
+		for ( int i=0; i<m_walkableSeeds.Count(); ++i )
+		{
+			const Vector &seedPos = m_walkableSeeds[i].pos;
+			if ( (seedPos - pos).IsLengthLessThan( incrementalRange ) )
+			{
+				inRange = true;
+				break;
+			}
+		}
+
+		if ( !inRange )
+		{
+			return false;
+		}
+	}
+
+	if ( m_generationMode == GENERATE_SIMPLIFY )
+	{
+		if ( !m_simplifyGenerationExtent.Contains( pos ) )
+		{
+			return false;
+		}
+	}
+
+	// test if we can move to new position
+	trace_t result;
+	Vector from( *step->from->GetPosition() );
+	CTraceFilterWalkableEntities filter( NULL, COLLISION_GROUP_NONE, WALK_THRU_EVERYTHING );
+	Vector to, toNormal;
+	float obstacleHeight = 0, obstacleStartDist = 0, obstacleEndDist = GenerationStepSize;
+	if ( TraceAdjacentNode( 0, from, pos, &result ) )
+	{
+		to = result.endpos;
+		toNormal = result.plane.normal;
+	}
+	else
+	{
+		// test going up ClimbUpHeight
+		bool success = false;
+		for ( float height = StepHeight; height <= ClimbUpHeight; height += 1.0f )
+		{						
+			trace_t tr;
+			Vector start( from );
+			Vector end( pos );
+			start.z += height;
+			end.z += height;
+			UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
+			if ( !tr.startsolid && tr.fraction == 1.0f )
+			{
+				if ( !StayOnFloor( &tr ) )
+				{
+					break;
 				}
 
+				to = tr.endpos;
+				toNormal = tr.plane.normal;
 
-				bool isOnDisplacement = result.IsDispSurface();
+				start = end = from;
+				end.z += height;
+				UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
+				if ( tr.fraction < 1.0f )
+				{
+					break;
+				}
 
-				if ( nav_displacement_test.GetInt() > 0 )
+				// keep track of far up we had to go to find a path to the next node
+				obstacleHeight = height;
+				success = true;
+				break;
+			}
+			else
+			{
+				// Could not trace from node to node at this height, something is in the way.
+				// Trace in the other direction to see if we hit something
+				Vector vecToObstacleStart = tr.endpos - start;
+				Assert( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) );
+				if ( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) )
 				{
-					// Test for nodes under displacement surfaces.
-					// This happens during development, and is a pain because the space underneath a displacement
-					// is not 'solid'.
-					Vector start = to + Vector( 0, 0, 0 );
-					Vector end = start + Vector( 0, 0, nav_displacement_test.GetInt() );
-					UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
-
-					if ( result.fraction > 0 )
+					UTIL_TraceHull( end, start, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
+					if ( !tr.startsolid && tr.fraction < 1.0 )
 					{
-						end = start;
-						start = result.endpos;
-						UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
-						if ( result.fraction < 1 )
+						// We hit something going the other direction.  There is some obstacle between the two nodes.
+						Vector vecToObstacleEnd = tr.endpos - start;
+						Assert( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize ) );
+						if ( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize )  )
 						{
-							// if we made it down to within StepHeight, maybe we're on a static prop
-							if ( result.endpos.z > to.z + StepHeight )
+							// Remember the distances to start and end of the obstacle (with respect to the "from" node).
+							// Keep track of the last distances to obstacle as we keep increasing the height we do a trace for.
+							// If we do eventually clear the obstacle, these values will be the start and end distance to the
+							// very tip of the obstacle.
+							obstacleStartDist = vecToObstacleStart.Length();
+							obstacleEndDist = vecToObstacleEnd.Length();
+							if ( obstacleEndDist == 0 )
 							{
-								return true;
+								obstacleEndDist = GenerationStepSize;
 							}
-						}
+						}								
 					}
 				}
+			}
+		}
 
-				float deltaZ = to.z - m_currentNode->GetPosition()->z;
-				// If there's an obstacle in the way and it's traversable, or the obstacle is not higher than the destination node itself minus a small epsilon
-				// (meaning the obstacle was just the height change to get to the destination node, no extra obstacle between the two), clear obstacle height
-				// and distances
-				if ( ( obstacleHeight < MaxTraversableHeight ) || ( deltaZ > ( obstacleHeight - 2.0f ) ) )
-				{
-					obstacleHeight = 0;
-					obstacleStartDist = 0;
-					obstacleEndDist = GenerationStepSize;
-				}
+		if ( !success )
+		{
+			return false;
+		}
+	}
 
-				// we can move here
-				// create a new navigation node, and update current node pointer
-				AddNode( to, toNormal, m_generationDir, m_currentNode, isOnDisplacement, obstacleHeight, obstacleStartDist, obstacleEndDist );
+	// Don't generate nodes if we spill off the end of the world onto skybox
+	if ( result.surface.flags & ( SURF_SKY|SURF_SKY2D ) )
+	{
+		return false;
+	}
 
-				return true;
+	// If we're incrementally generating, don't overlap existing nav areas.
+	Vector testPos( to );
+	bool overlapSE = IsNodeOverlapped( testPos, Vector(  1,  1, HalfHumanHeight ) );
+	bool overlapSW = IsNodeOverlapped( testPos, Vector( -1,  1, HalfHumanHeight ) );
+	bool overlapNE = IsNodeOverlapped( testPos, Vector(  1, -1, HalfHumanHeight ) );
+	bool overlapNW = IsNodeOverlapped( testPos, Vector( -1, -1, HalfHumanHeight ) );
+	if ( overlapSE && overlapSW && overlapNE && overlapNW && m_generationMode != GENERATE_SIMPLIFY )
+	{
+		return false;
+	}
+
+	int nTolerance = nav_generate_incremental_tolerance.GetInt();
+	if ( nTolerance > 0 && m_generationMode == GENERATE_INCREMENTAL )
+	{
+		bool bValid = false;
+		int zPos = to.z;
+		for ( int i=0; i<m_walkableSeeds.Count(); ++i )
+		{
+			const Vector &seedPos = m_walkableSeeds[i].pos;
+			int zMin = seedPos.z - nTolerance;
+			int zMax = seedPos.z + nTolerance;
+
+			if ( zPos >= zMin && zPos <= zMax )
+			{
+				bValid = true;
+				break;
 			}
 		}
 
-		// all directions have been searched from this node - pop back to its parent and continue
-		m_currentNode = m_currentNode->GetParent();
+		if ( !bValid )
+			return false;
+	}
+
+
+	bool isOnDisplacement = result.IsDispSurface();
+
+	if ( nav_displacement_test.GetInt() > 0 )
+	{
+		// Test for nodes under displacement surfaces.
+		// This happens during development, and is a pain because the space underneath a displacement
+		// is not 'solid'.
+		Vector start = to + Vector( 0, 0, 0 );
+		Vector end = start + Vector( 0, 0, nav_displacement_test.GetInt() );
+		UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
+
+		if ( result.fraction > 0 )
+		{
+			end = start;
+			start = result.endpos;
+			UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
+			if ( result.fraction < 1 )
+			{
+				// if we made it down to within StepHeight, maybe we're on a static prop
+				if ( result.endpos.z > to.z + StepHeight )
+				{
+					return false;
+				}
+			}
+		}
+	}
+
+	float deltaZ = to.z - step->from->GetPosition()->z;
+	// If there's an obstacle in the way and it's traversable, or the obstacle is not higher than the destination node itself minus a small epsilon
+	// (meaning the obstacle was just the height change to get to the destination node, no extra obstacle between the two), clear obstacle height
+	// and distances
+	if ( ( obstacleHeight < MaxTraversableHeight ) || ( deltaZ > ( obstacleHeight - 2.0f ) ) )
+	{
+		obstacleHeight = 0;
+		obstacleStartDist = 0;
+		obstacleEndDist = GenerationStepSize;
+	}
+
+	step->canMove = true;
+	step->to = to;
+	step->toNormal = toNormal;
+	step->isOnDisplacement = isOnDisplacement;
+	step->obstacleHeight = obstacleHeight;
+	step->obstacleStartDist = obstacleStartDist;
+	step->obstacleEndDist = obstacleEndDist;
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavMesh::ComputeSampleStepJob( SampleStepInfo &step )
+{
+	TheNavMesh->ComputeSampleStep( &step );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavMesh::CheckNodeSurroundings( CNavNode *&node )
+{
+	node->CheckCrouch();
+
+	// determine if there's a cliff nearby and set an attribute on this node
+	for ( int i = 0; i < NUM_DIRECTIONS; i++ )
+	{
+		NavDirType dir = (NavDirType) i;
+		if ( CheckCliff( node->GetPosition(), dir ) )
+		{
+			node->SetAttributes( node->GetAttributes() | NAV_MESH_CLIFF );
+			break;
+		}
 	}
 }
 
@@ -4655,6 +4837,274 @@ CNavNode *CNavMesh::GetNextWalkableSeedNode( void )
 }
 
 
+#define NAV_CHECKPOINT_MAGIC		MAKEID('N','V','C','P')
+#define NAV_CHECKPOINT_VERSION		1
+
+//--------------------------------------------------------------------------------------------------------------
+static void PutCheckpointVector( CUtlBuffer &buf, const Vector &v )
+{
+	buf.PutFloat( v.x );
+	buf.PutFloat( v.y );
+	buf.PutFloat( v.z );
+}
+
+static Vector GetCheckpointVector( CUtlBuffer &buf )
+{
+	Vector v;
+	v.x = buf.GetFloat();
+	v.y = buf.GetFloat();
+	v.z = buf.GetFloat();
+	return v;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+const char *CNavMesh::GetGenerationCheckpointFilename( void ) const
+{
+	// persistant return value
+	static char filename[256];
+	Q_snprintf( filename, sizeof( filename ), "maps/%s.nav_checkpoint", STRING( gpGlobals->mapname ) );
+
+	return filename;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Write every sampled node and where the search was up to, so a full generation that gets interrupted
+ * can pick up from here with nav_generate_resume.  Nodes refer to each other by their index in the file.
+ */
+void CNavMesh::SaveGenerationCheckpoint( void )
+{
+	// incremental and simplify passes depend on the mesh they started from, which isn't saved here
+	if ( m_generationMode != GENERATE_FULL || m_generationState != SAMPLE_WALKABLE_SPACE )
+		return;
+
+	// oldest first, so a resume recreates them in the same order
+	CUtlVector< CNavNode * > nodes;
+	nodes.EnsureCapacity( CNavNode::GetListLength() );
+	for ( CNavNode *node = CNavNode::GetFirst(); node; node = node->GetNext() )
+	{
+		nodes.AddToTail( node );
+	}
+	nodes.Sort( CompareNavNodeIDs );
+
+	CUtlMap< unsigned int, int > nodeIndex( DefLessFunc( unsigned int ) );
+	FOR_EACH_VEC( nodes, it )
+	{
+		nodeIndex.Insert( nodes[it]->GetID(), it );
+	}
+
+	#define NODE_INDEX( node )	( (node) ? nodeIndex[ nodeIndex.Find( (node)->GetID() ) ] : -1 )
+
+	CUtlBuffer fileBuffer;
+	fileBuffer.PutInt( NAV_CHECKPOINT_MAGIC );
+	fileBuffer.PutInt( NAV_CHECKPOINT_VERSION );
+	fileBuffer.PutInt( gpGlobals->mapversion );
+
+	fileBuffer.PutInt( m_seedIdx );
+	fileBuffer.PutInt( m_walkableSeeds.Count() );
+	FOR_EACH_VEC( m_walkableSeeds, it )
+	{
+		PutCheckpointVector( fileBuffer, m_walkableSeeds[it].pos );
+		PutCheckpointVector( fileBuffer, m_walkableSeeds[it].normal );
+	}
+
+	fileBuffer.PutInt( nodes.Count() );
+	FOR_EACH_VEC( nodes, it )
+	{
+		const CNavNode *node = nodes[it];
+
+		PutCheckpointVector( fileBuffer, node->m_pos );
+		PutCheckpointVector( fileBuffer, node->m_normal );
+		fileBuffer.PutInt( NODE_INDEX( node->m_parent ) );
+		fileBuffer.PutInt( node->m_attributeFlags );
+		fileBuffer.PutUnsignedChar( node->m_visited );
+		fileBuffer.PutUnsignedChar( node->m_isOnDisplacement );
+
+		for ( int i=0; i<NUM_DIRECTIONS; ++i )
+		{
+			fileBuffer.PutInt( NODE_INDEX( node->m_to[i] ) );
+			fileBuffer.PutFloat( node->m_obstacleHeight[i] );
+			fileBuffer.PutFloat( node->m_obstacleStartDist[i] );
+			fileBuffer.PutFloat( node->m_obstacleEndDist[i] );
+		}
+
+		for ( int i=0; i<NUM_CORNERS; ++i )
+		{
+			fileBuffer.PutUnsignedChar( node->m_isBlocked[i] );
+			fileBuffer.PutUnsignedChar( node->m_crouch[i] );
+			fileBuffer.PutFloat( node->m_groundHeightAboveNode[i] );
+		}
+	}
+
+	// the nodes still to be searched from: the wave front, then the depth-first stack with its deepest node last
+	CUtlVector< CNavNode * > stack;
+	for ( CNavNode *node = m_currentNode; node; node = node->GetParent() )
+	{
+		stack.AddToHead( node );
+	}
+
+	fileBuffer.PutInt( m_sampleFrontier.Count() + stack.Count() );
+	FOR_EACH_VEC( m_sampleFrontier, it )
+	{
+		fileBuffer.PutInt( NODE_INDEX( m_sampleFrontier[it] ) );
+	}
+	FOR_EACH_VEC( stack, it )
+	{
+		fileBuffer.PutInt( NODE_INDEX( stack[it] ) );
+	}
+
+	#undef NODE_INDEX
+
+	if ( !filesystem->WriteFile( GetGenerationCheckpointFilename(), "MOD", fileBuffer ) )
+	{
+		Warning( "Unable to save nav generation checkpoint '%s'\n", GetGenerationCheckpointFilename() );
+		return;
+	}
+
+	DevMsg( "Saved nav generation checkpoint (%d nodes)\n", nodes.Count() );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Restore the nodes and search state written by SaveGenerationCheckpoint() into a freshly begun generation.
+ * Returns false if the checkpoint is for a different build of the map or is damaged.
+ */
+bool CNavMesh::LoadGenerationCheckpoint( CUtlBuffer &fileBuffer )
+{
+	if ( fileBuffer.GetInt() != NAV_CHECKPOINT_MAGIC || fileBuffer.GetInt() != NAV_CHECKPOINT_VERSION )
+		return false;
+
+	if ( fileBuffer.GetInt() != gpGlobals->mapversion )
+		return false;
+
+	int seedIdx = fileBuffer.GetInt();
+	int seedCount = fileBuffer.GetInt();
+	if ( !fileBuffer.IsValid() || seedCount < 0 || seedIdx < 0 || seedIdx > seedCount )
+		return false;
+
+	CUtlVector< WalkableSeedSpot > seeds;
+	for ( int i=0; i<seedCount; ++i )
+	{
+		WalkableSeedSpot &seed = seeds[ seeds.AddToTail() ];
+		seed.pos = GetCheckpointVector( fileBuffer );
+		seed.normal = GetCheckpointVector( fileBuffer );
+	}
+
+	int nodeCount = fileBuffer.GetInt();
+	if ( !fileBuffer.IsValid() || nodeCount < 0 )
+		return false;
+
+	CUtlVector< CNavNode * > nodes;
+	CUtlVector< int > links;
+	nodes.EnsureCapacity( nodeCount );
+	links.EnsureCapacity( nodeCount * NUM_DIRECTIONS );
+	for ( int it=0; it<nodeCount; ++it )
+	{
+		Vector pos = GetCheckpointVector( fileBuffer );
+		Vector normal = GetCheckpointVector( fileBuffer );
+		int parent = fileBuffer.GetInt();
+		int attributeFlags = fileBuffer.GetInt();
+		unsigned char visited = fileBuffer.GetUnsignedChar();
+		bool isOnDisplacement = fileBuffer.GetUnsignedChar() != 0;
+
+		// a node's parent is always older than it
+		if ( !fileBuffer.IsValid() || parent >= it )
+			return false;
+
+		CNavNode *node = new CNavNode( pos, normal, ( parent >= 0 ) ? nodes[parent] : NULL, isOnDisplacement );
+		node->m_attributeFlags = attributeFlags;
+		node->m_visited = visited;
+
+		for ( int i=0; i<NUM_DIRECTIONS; ++i )
+		{
+			links.AddToTail( fileBuffer.GetInt() );
+			node->m_obstacleHeight[i] = fileBuffer.GetFloat();
+			node->m_obstacleStartDist[i] = fileBuffer.GetFloat();
+			node->m_obstacleEndDist[i] = fileBuffer.GetFloat();
+		}
+
+		for ( int i=0; i<NUM_CORNERS; ++i )
+		{
+			node->m_isBlocked[i] = fileBuffer.GetUnsignedChar() != 0;
+			node->m_crouch[i] = fileBuffer.GetUnsignedChar() != 0;
+			node->m_groundHeightAboveNode[i] = fileBuffer.GetFloat();
+		}
+
+		nodes.AddToTail( node );
+	}
+
+	// links can point either way, so they're resolved once every node exists
+	FOR_EACH_VEC( links, it )
+	{
+		int to = links[it];
+		if ( to >= nodeCount )
+			return false;
+
+		nodes[ it / NUM_DIRECTIONS ]->m_to[ it % NUM_DIRECTIONS ] = ( to >= 0 ) ? nodes[to] : NULL;
+	}
+
+	int frontierCount = fileBuffer.GetInt();
+	if ( !fileBuffer.IsValid() || frontierCount < 0 )
+		return false;
+
+	m_currentNode = NULL;
+	m_sampleFrontier.RemoveAll();
+	for ( int it=0; it<frontierCount; ++it )
+	{
+		int index = fileBuffer.GetInt();
+		if ( !fileBuffer.IsValid() || index < 0 || index >= nodeCount )
+			return false;
+
+		m_sampleFrontier.AddToTail( nodes[index] );
+	}
+
+	m_walkableSeeds.RemoveAll();
+	m_walkableSeeds.AddVectorToTail( seeds );
+	m_seedIdx = seedIdx;
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Begin a full generation, continuing the sampling from the checkpoint left by an interrupted
+ * one if there is a usable checkpoint for this map.
+ */
+void CNavMesh::ResumeGeneration( void )
+{
+	CUtlBuffer fileBuffer;
+	bool haveCheckpoint = filesystem->ReadFile( GetGenerationCheckpointFilename(), "MOD", fileBuffer );
+
+	BeginGeneration();
+
+	if ( !IsGenerating() )
+		return;
+
+	if ( !haveCheckpoint )
+	{
+		Msg( "No nav generation checkpoint for this map, starting from the beginning.\n" );
+		return;
+	}
+
+	if ( !LoadGenerationCheckpoint( fileBuffer ) )
+	{
+		Msg( "Nav generation checkpoint is out of date or damaged, starting from the beginning.\n" );
+
+		// throw away anything the partial load created
+		CNavNode::CleanupGeneration();
+		m_sampleFrontier.RemoveAll();
+		m_currentNode = NULL;
+		return;
+	}
+
+	Msg( "Resuming from a checkpoint of %d sampled nodes.\n", CNavNode::GetListLength() );
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Check LOS, ignoring any entities that we can walk through
@@ -0,0 +1,523 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose:
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+// nav_hierarchy.cpp
+// Cluster graph over the Navigation Mesh, for hierarchical path searches
+
+#include "cbase.h"
+#include "nav_mesh.h"
+#include "nav_hierarchy.h"
+#include "utlmap.h"
+#include "tier0/vprof.h"
+
+// NOTE: This has to be the last file included!
+#include "tier0/memdbgon.h"
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * A way out of an area that NavAreaBuildPath() would follow, and how far it goes
+ */
+struct NavAreaExit
+{
+	CNavArea *area;
+	float length;
+};
+
+typedef CUtlVectorFixedGrowable< NavAreaExit, 32 > NavAreaExitVector;
+
+
+//--------------------------------------------------------------------------------------------------------------
+static void AddNavAreaExit( const CNavArea *area, CNavArea *to, float length, NavAreaExitVector *exits )
+{
+	if ( to == NULL || to == area )
+		return;
+
+	NavAreaExit &exit = exits->Element( exits->AddToTail() );
+	exit.area = to;
+	exit.length = ( length > 0.0f ) ? length : ( to->GetCenter() - area->GetCenter() ).Length();
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Collect the areas reachable from 'area' by walking, ladder or elevator, the same ones NavAreaBuildPath() searches
+ */
+static void CollectNavAreaExits( const CNavArea *area, NavAreaExitVector *exits )
+{
+	exits->RemoveAll();
+
+	for( int dir=0; dir<NUM_DIRECTIONS; ++dir )
+	{
+		const NavConnectVector *floorList = area->GetAdjacentAreas( (NavDirType)dir );
+		FOR_EACH_VEC( (*floorList), it )
+		{
+			AddNavAreaExit( area, floorList->Element( it ).area, floorList->Element( it ).length, exits );
+		}
+	}
+
+	// do not use the BEHIND connection going up, as its very hard to get to from a ladder
+	const NavLadderConnectVector *ladderList = area->GetLadders( CNavLadder::LADDER_UP );
+	FOR_EACH_VEC( (*ladderList), it )
+	{
+		const CNavLadder *ladder = ladderList->Element( it ).ladder;
+		AddNavAreaExit( area, ladder->m_topForwardArea, ladder->m_length, exits );
+		AddNavAreaExit( area, ladder->m_topLeftArea, ladder->m_length, exits );
+		AddNavAreaExit( area, ladder->m_topRightArea, ladder->m_length, exits );
+	}
+
+	ladderList = area->GetLadders( CNavLadder::LADDER_DOWN );
+	FOR_EACH_VEC( (*ladderList), it )
+	{
+		const CNavLadder *ladder = ladderList->Element( it ).ladder;
+		AddNavAreaExit( area, ladder->m_bottomArea, ladder->m_length, exits );
+	}
+
+	if ( area->GetElevator() )
+	{
+		const NavConnectVector &elevatorAreas = area->GetElevatorAreas();
+		FOR_EACH_VEC( elevatorAreas, it )
+		{
+			AddNavAreaExit( area, elevatorAreas[ it ].area, -1.0f, exits );
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return true if no search can pass through this area, whatever team or options it uses
+ */
+static bool IsAlwaysBlocked( const CNavArea *area )
+{
+	if ( area->HasAttributes( NAV_MESH_NAV_BLOCKER ) )
+		return false;
+
+	for( int i=0; i<MAX_NAV_TEAMS; ++i )
+	{
+		if ( !area->IsBlocked( i ) )
+			return false;
+	}
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavAreaHierarchy::CNavAreaHierarchy( void ) : m_open( 0, 0, IsFartherOpenEntry ), m_clusterOpen( 0, 0, IsFartherOpenEntry )
+{
+	m_clusterSize = 0.0f;
+	m_corridorMarker = 0;
+	m_currentSearchMarker = 0;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavAreaHierarchy::Reset( void )
+{
+	m_clusters.Purge();
+	m_entrances.Purge();
+	m_links.Purge();
+	m_costSoFar.Purge();
+	m_parent.Purge();
+	m_searchMarker.Purge();
+	m_startDistance.Purge();
+	m_open.Purge();
+	m_clusterOpen.Purge();
+
+	m_clusterSize = 0.0f;
+	m_corridorMarker = 0;
+	m_currentSearchMarker = 0;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Divide TheNavAreas into square clusters of the given size, find the entrances between them,
+ * and compute the distances from each entrance to every area in its cluster.
+ */
+void CNavAreaHierarchy::Build( float clusterSize )
+{
+	Reset();
+
+	m_clusterSize = clusterSize;
+
+	if ( TheNavAreas.Count() == 0 || clusterSize <= 0.0f )
+		return;
+
+	// assign areas to clusters by the square their center is in
+	CUtlMap< unsigned int, int > clusterByCell( DefLessFunc( unsigned int ) );
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		CNavArea *area = TheNavAreas[ it ];
+
+		unsigned int x = (unsigned int)floor( area->GetCenter().x / clusterSize ) & 0xFFFF;
+		unsigned int y = (unsigned int)floor( area->GetCenter().y / clusterSize ) & 0xFFFF;
+		unsigned int cell = ( x << 16 ) | y;
+
+		int index = clusterByCell.Find( cell );
+		if ( index == clusterByCell.InvalidIndex() )
+		{
+			index = clusterByCell.Insert( cell, clusterByCell.Count() );
+		}
+
+		area->m_cluster = clusterByCell[ index ];
+	}
+
+	m_clusters.SetCount( clusterByCell.Count() );
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		CNavArea *area = TheNavAreas[ it ];
+		Cluster &cluster = m_clusters[ area->m_cluster ];
+
+		area->m_clusterAreaIndex = cluster.areas.AddToTail( area );
+		cluster.areaEntrance.AddToTail( -1 );
+	}
+
+	FOR_EACH_VEC( m_clusters, it )
+	{
+		m_clusters[ it ].isDirty = true;
+		m_clusters[ it ].corridorMarker = 0;
+	}
+
+	// entrances are areas with a way into or out of another cluster
+	NavAreaExitVector exits;
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		CNavArea *area = TheNavAreas[ it ];
+
+		CollectNavAreaExits( area, &exits );
+		for( int i=0; i<exits.Count(); ++i )
+		{
+			if ( exits[i].area->m_cluster != area->m_cluster )
+			{
+				AddEntrance( area );
+				AddEntrance( exits[i].area );
+			}
+		}
+	}
+
+	// link each entrance to the entrances it leads to in other clusters
+	FOR_EACH_VEC( m_entrances, it )
+	{
+		Entrance &entrance = m_entrances[ it ];
+		entrance.firstLink = m_links.Count();
+
+		CollectNavAreaExits( entrance.area, &exits );
+		for( int i=0; i<exits.Count(); ++i )
+		{
+			const CNavArea *to = exits[i].area;
+			if ( to->m_cluster == entrance.cluster )
+				continue;
+
+			Link &link = m_links[ m_links.AddToTail() ];
+			link.entrance = m_clusters[ to->m_cluster ].areaEntrance[ to->m_clusterAreaIndex ];
+			link.length = exits[i].length;
+		}
+
+		entrance.linkCount = m_links.Count() - entrance.firstLink;
+	}
+
+	FOR_EACH_VEC( m_clusters, it )
+	{
+		ComputeClusterDistances( it );
+	}
+
+	// one extra search node for the goal
+	int nodeCount = m_entrances.Count() + 1;
+	m_costSoFar.SetCount( nodeCount );
+	m_parent.SetCount( nodeCount );
+	m_searchMarker.SetCount( nodeCount );
+	for( int i=0; i<nodeCount; ++i )
+	{
+		m_searchMarker[i] = 0;
+	}
+
+	DevMsg( "Nav area hierarchy: %d areas in %d clusters, %d entrances, %d links\n", TheNavAreas.Count(), m_clusters.Count(), m_entrances.Count(), m_links.Count() );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+int CNavAreaHierarchy::AddEntrance( CNavArea *area )
+{
+	Cluster &cluster = m_clusters[ area->m_cluster ];
+
+	int index = cluster.areaEntrance[ area->m_clusterAreaIndex ];
+	if ( index >= 0 )
+		return index;
+
+	index = m_entrances.AddToTail();
+	cluster.areaEntrance[ area->m_clusterAreaIndex ] = index;
+
+	Entrance &entrance = m_entrances[ index ];
+	entrance.area = area;
+	entrance.cluster = area->m_cluster;
+	entrance.clusterEntrance = cluster.entrances.AddToTail( index );
+	entrance.firstLink = 0;
+	entrance.linkCount = 0;
+
+	return index;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * The area has become blocked or unblocked, so distances across its cluster may have changed
+ */
+void CNavAreaHierarchy::OnAreaBlockedChanged( const CNavArea *area )
+{
+	if ( area->m_cluster >= 0 && area->m_cluster < m_clusters.Count() && m_clusters[ area->m_cluster ].areas.IsValidIndex( area->m_clusterAreaIndex ) &&
+		 m_clusters[ area->m_cluster ].areas[ area->m_clusterAreaIndex ] == area )
+	{
+		m_clusters[ area->m_cluster ].isDirty = true;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Compute the travel distance from every entrance of the cluster to every area in it
+ */
+void CNavAreaHierarchy::ComputeClusterDistances( int clusterIndex )
+{
+	Cluster &cluster = m_clusters[ clusterIndex ];
+
+	int areaCount = cluster.areas.Count();
+	cluster.distance.SetCount( cluster.entrances.Count() * areaCount );
+
+	FOR_EACH_VEC( cluster.entrances, it )
+	{
+		ComputeDistancesInCluster( m_entrances[ cluster.entrances[ it ] ].area, false, TEAM_ANY, false, cluster.distance.Base() + it * areaCount );
+	}
+
+	cluster.isDirty = false;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Dijkstra search from 'startArea' that doesn't leave its cluster.
+ * If 'isExact', areas blocked for the given team are avoided, otherwise only areas blocked for everyone are.
+ */
+void CNavAreaHierarchy::ComputeDistancesInCluster( const CNavArea *startArea, bool isExact, int teamID, bool ignoreNavBlockers, float *distance )
+{
+	int clusterIndex = startArea->m_cluster;
+	const Cluster &cluster = m_clusters[ clusterIndex ];
+
+	for( int i=0; i<cluster.areas.Count(); ++i )
+	{
+		distance[i] = FLT_MAX;
+	}
+
+	m_clusterOpen.RemoveAll();
+
+	OpenEntry start;
+	start.node = startArea->m_clusterAreaIndex;
+	start.costSoFar = start.totalCost = 0.0f;
+	distance[ start.node ] = 0.0f;
+	m_clusterOpen.Insert( start );
+
+	NavAreaExitVector exits;
+
+	while( m_clusterOpen.Count() )
+	{
+		OpenEntry entry = m_clusterOpen.ElementAtHead();
+		m_clusterOpen.RemoveAtHead();
+
+		// skip if a shorter way here was already found
+		if ( entry.costSoFar > distance[ entry.node ] )
+			continue;
+
+		CollectNavAreaExits( cluster.areas[ entry.node ], &exits );
+		for( int i=0; i<exits.Count(); ++i )
+		{
+			const CNavArea *to = exits[i].area;
+			if ( to->m_cluster != clusterIndex )
+				continue;
+
+			if ( isExact ? to->IsBlocked( teamID, ignoreNavBlockers ) : IsAlwaysBlocked( to ) )
+				continue;
+
+			float costSoFar = entry.costSoFar + exits[i].length;
+			if ( costSoFar >= distance[ to->m_clusterAreaIndex ] )
+				continue;
+
+			distance[ to->m_clusterAreaIndex ] = costSoFar;
+
+			OpenEntry next;
+			next.node = to->m_clusterAreaIndex;
+			next.costSoFar = next.totalCost = costSoFar;
+			m_clusterOpen.Insert( next );
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavAreaHierarchy::AddToOpenList( int node, float costSoFar, int parent, const Vector &goalPos )
+{
+	if ( m_searchMarker[ node ] == m_currentSearchMarker && m_costSoFar[ node ] <= costSoFar )
+		return;
+
+	m_searchMarker[ node ] = m_currentSearchMarker;
+	m_costSoFar[ node ] = costSoFar;
+	m_parent[ node ] = parent;
+
+	OpenEntry entry;
+	entry.node = node;
+	entry.costSoFar = costSoFar;
+	entry.totalCost = costSoFar;
+
+	if ( node < m_entrances.Count() )
+	{
+		entry.totalCost += ( m_entrances[ node ].area->GetCenter() - goalPos ).Length();
+	}
+
+	m_open.Insert( entry );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * A* search over the entrances from 'startArea' to 'goalArea'.
+ * Leaving the start cluster uses exact distances for the searching team, crossing every other cluster uses
+ * its precomputed entrance distances, and moving between clusters checks each entrance for the team.
+ */
+CNavAreaHierarchy::CorridorResult CNavAreaHierarchy::FindCorridor( CNavArea *startArea, CNavArea *goalArea, int teamID, bool ignoreNavBlockers )
+{
+	VPROF_BUDGET( "CNavAreaHierarchy::FindCorridor", "NextBotSpiky" );
+
+	if ( startArea->m_cluster < 0 || goalArea->m_cluster < 0 || startArea->m_cluster == goalArea->m_cluster )
+		return CORRIDOR_UNNEEDED;
+
+	++m_currentSearchMarker;
+	if ( m_currentSearchMarker == 0 )
+	{
+		m_currentSearchMarker = 1;
+		for( int i=0; i<m_searchMarker.Count(); ++i )
+		{
+			m_searchMarker[i] = 0;
+		}
+	}
+
+	int goalNode = m_entrances.Count();
+	int goalCluster = goalArea->m_cluster;
+	const Vector &goalPos = goalArea->GetCenter();
+
+	m_open.RemoveAll();
+
+	// start from each entrance of the start cluster the start area can reach
+	const Cluster &startCluster = m_clusters[ startArea->m_cluster ];
+	m_startDistance.SetCount( startCluster.areas.Count() );
+	ComputeDistancesInCluster( startArea, true, teamID, ignoreNavBlockers, m_startDistance.Base() );
+
+	FOR_EACH_VEC( startCluster.entrances, it )
+	{
+		const Entrance &entrance = m_entrances[ startCluster.entrances[ it ] ];
+
+		float distance = m_startDistance[ entrance.area->m_clusterAreaIndex ];
+		if ( distance == FLT_MAX )
+			continue;
+
+		if ( entrance.area != startArea && entrance.area->IsBlocked( teamID, ignoreNavBlockers ) )
+			continue;
+
+		AddToOpenList( startCluster.entrances[ it ], distance, -1, goalPos );
+	}
+
+	bool isFound = false;
+
+	while( m_open.Count() )
+	{
+		OpenEntry entry = m_open.ElementAtHead();
+		m_open.RemoveAtHead();
+
+		// skip if a shorter way here was already found
+		if ( entry.costSoFar > m_costSoFar[ entry.node ] )
+			continue;
+
+		if ( entry.node == goalNode )
+		{
+			isFound = true;
+			break;
+		}
+
+		const Entrance &from = m_entrances[ entry.node ];
+
+		if ( m_clusters[ from.cluster ].isDirty )
+		{
+			ComputeClusterDistances( from.cluster );
+		}
+
+		const Cluster &cluster = m_clusters[ from.cluster ];
+		const float *fromDistance = cluster.distance.Base() + from.clusterEntrance * cluster.areas.Count();
+
+		// across this cluster to its other entrances
+		FOR_EACH_VEC( cluster.entrances, it )
+		{
+			int to = cluster.entrances[ it ];
+			if ( to == entry.node )
+				continue;
+
+			float distance = fromDistance[ m_entrances[ to ].area->m_clusterAreaIndex ];
+			if ( distance == FLT_MAX )
+				continue;
+
+			if ( m_entrances[ to ].area->IsBlocked( teamID, ignoreNavBlockers ) )
+				continue;
+
+			AddToOpenList( to, entry.costSoFar + distance, entry.node, goalPos );
+		}
+
+		// across the goal cluster to the goal
+		if ( from.cluster == goalCluster )
+		{
+			float distance = fromDistance[ goalArea->m_clusterAreaIndex ];
+			if ( distance != FLT_MAX )
+			{
+				AddToOpenList( goalNode, entry.costSoFar + distance, entry.node, goalPos );
+			}
+		}
+
+		// into neighboring clusters
+		for( int i=from.firstLink; i<from.firstLink + from.linkCount; ++i )
+		{
+			const Link &link = m_links[i];
+			if ( m_entrances[ link.entrance ].area->IsBlocked( teamID, ignoreNavBlockers ) )
+				continue;
+
+			AddToOpenList( link.entrance, entry.costSoFar + link.length, entry.node, goalPos );
+		}
+	}
+
+	if ( !isFound )
+		return CORRIDOR_UNREACHABLE;
+
+	// mark the clusters the route passes through
+	++m_corridorMarker;
+	if ( m_corridorMarker == 0 )
+	{
+		m_corridorMarker = 1;
+		FOR_EACH_VEC( m_clusters, it )
+		{
+			m_clusters[ it ].corridorMarker = 0;
+		}
+	}
+
+	m_clusters[ startArea->m_cluster ].corridorMarker = m_corridorMarker;
+	m_clusters[ goalCluster ].corridorMarker = m_corridorMarker;
+
+	for( int node = m_parent[ goalNode ]; node >= 0; node = m_parent[ node ] )
+	{
+		m_clusters[ m_entrances[ node ].cluster ].corridorMarker = m_corridorMarker;
+	}
+
+	return CORRIDOR_FOUND;
+}
@@ -0,0 +1,121 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose:
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+// nav_hierarchy.h
+// Cluster graph over the Navigation Mesh, for hierarchical path searches
+
+#ifndef _NAV_HIERARCHY_H_
+#define _NAV_HIERARCHY_H_
+
+#include "nav_area.h"
+#include "utlvector.h"
+#include "utlpriorityqueue.h"
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * The mesh divided into square clusters of areas, with the travel distances between the areas on cluster
+ * borders ("entrances") worked out ahead of time.
+ * A search over entrances finds the clusters a path must pass through, and the real search is then limited
+ * to those clusters (see the hierarchical NavAreaBuildPath() in nav_pathfind.h).
+ *
+ * Distances inside a cluster only leave out areas that no team can get through, so they never say a path
+ * is impossible when one exists.  Clusters whose areas change blocked state are worked out again the next
+ * time a search reaches them.
+ */
+class CNavAreaHierarchy
+{
+public:
+	CNavAreaHierarchy( void );
+
+	void Build( float clusterSize );							// divide TheNavAreas into clusters and compute each cluster's entrance distances
+	void Reset( void );
+
+	bool IsEmpty( void ) const							{ return m_clusters.Count() == 0; }
+	float GetClusterSize( void ) const					{ return m_clusterSize; }
+	int GetClusterCount( void ) const					{ return m_clusters.Count(); }
+	int GetEntranceCount( void ) const					{ return m_entrances.Count(); }
+
+	void OnAreaBlockedChanged( const CNavArea *area );		// the area's cluster must be recomputed before it is used again
+
+	enum CorridorResult
+	{
+		CORRIDOR_FOUND,			// the clusters a path passes through are marked
+		CORRIDOR_UNNEEDED,		// start and goal share a cluster, search the mesh directly
+		CORRIDOR_UNREACHABLE,	// there is no path from start to goal
+	};
+
+	/**
+	 * Search the entrances for the shortest route from 'startArea' to 'goalArea', and mark the clusters
+	 * along it so IsInCorridor() is true for their areas until the next search.
+	 */
+	CorridorResult FindCorridor( CNavArea *startArea, CNavArea *goalArea, int teamID, bool ignoreNavBlockers );
+
+	bool IsInCorridor( const CNavArea *area ) const
+	{
+		return area->m_cluster >= 0 && m_clusters[ area->m_cluster ].corridorMarker == m_corridorMarker;
+	}
+
+private:
+	struct Entrance
+	{
+		CNavArea *area;
+		int cluster;
+		int clusterEntrance;									// index in the cluster's entrance list
+		int firstLink;											// links to other clusters are m_links[ firstLink, firstLink+linkCount )
+		int linkCount;
+	};
+
+	struct Link
+	{
+		int entrance;
+		float length;
+	};
+
+	struct Cluster
+	{
+		CUtlVector< CNavArea * > areas;
+		CUtlVector< int > entrances;							// into m_entrances
+		CUtlVector< int > areaEntrance;							// per area, its index in m_entrances or -1
+		CUtlVector< float > distance;							// entrances x areas, travel distance from each entrance to each area, FLT_MAX if unreachable
+		bool isDirty;											// areas have changed blocked state since 'distance' was computed
+		unsigned int corridorMarker;
+	};
+
+	struct OpenEntry
+	{
+		int node;
+		float costSoFar;
+		float totalCost;
+	};
+
+	static bool IsFartherOpenEntry( const OpenEntry &lhs, const OpenEntry &rhs )	{ return lhs.totalCost > rhs.totalCost; }
+
+	int AddEntrance( CNavArea *area );							// make the area an entrance of its cluster if it isn't already, and return its index
+	void ComputeClusterDistances( int cluster );
+	void ComputeDistancesInCluster( const CNavArea *startArea, bool isExact, int teamID, bool ignoreNavBlockers, float *distance );	// distance from 'startArea' to every area in its cluster
+	void AddToOpenList( int node, float costSoFar, int parent, const Vector &goalPos );
+
+	float m_clusterSize;
+	CUtlVector< Cluster > m_clusters;
+	CUtlVector< Entrance > m_entrances;
+	CUtlVector< Link > m_links;
+
+	unsigned int m_corridorMarker;
+
+	// search state, kept between searches
+	CUtlPriorityQueue< OpenEntry > m_open;
+	CUtlPriorityQueue< OpenEntry > m_clusterOpen;				// for searches inside a cluster, which may happen in the middle of an entrance search
+	CUtlVector< float > m_costSoFar;							// per entrance, plus one for the goal
+	CUtlVector< int > m_parent;
+	CUtlVector< unsigned int > m_searchMarker;
+	unsigned int m_currentSearchMarker;
+	CUtlVector< float > m_startDistance;						// from the start area to each area in its cluster
+};
+
+
+#endif // _NAV_HIERARCHY_H_
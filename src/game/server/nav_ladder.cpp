@@ -14,6 +14,7 @@
 #include "nav_node.h"
 #include "nav_pathfind.h"
 #include "nav_colors.h"
+#include "nav_meshfile.h"
 #ifdef TERROR
 #include "TerrorShared.h"
 #endif
@@ -579,6 +580,69 @@ void CNavLadder::Load( CUtlBuffer &fileBuffer, unsigned int version )
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Save a navigation ladder in the flat layout
+ */
+void CNavLadder::Save( CNavMeshFileWriter &file ) const
+{
+	file.m_ladderID.AddToTail( m_id );
+	file.m_ladderWidth.AddToTail( m_width );
+	file.m_ladderLength.AddToTail( m_length );
+	file.m_ladderTop.AddToTail( m_top );
+	file.m_ladderBottom.AddToTail( m_bottom );
+	file.m_ladderDir.AddToTail( m_dir );
+
+	// in the order LADDER_TOP_FORWARD .. LADDER_BOTTOM
+	file.m_ladderArea.AddToTail( file.GetAreaIndex( m_topForwardArea ) );
+	file.m_ladderArea.AddToTail( file.GetAreaIndex( m_topLeftArea ) );
+	file.m_ladderArea.AddToTail( file.GetAreaIndex( m_topRightArea ) );
+	file.m_ladderArea.AddToTail( file.GetAreaIndex( m_topBehindArea ) );
+	file.m_ladderArea.AddToTail( file.GetAreaIndex( m_bottomArea ) );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Load a navigation ladder from the flat layout.  The areas must already be loaded.
+ */
+void CNavLadder::Load( const CNavMeshFileView &file, int index )
+{
+	m_id = file.GetLadderID( index );
+
+	// update nextID to avoid collisions
+	if (m_id >= m_nextID)
+		m_nextID = m_id+1;
+
+	m_width = file.Get< float >( &NavFlatHeader::ladderWidth )[ index ];
+	m_length = file.Get< float >( &NavFlatHeader::ladderLength )[ index ];
+	m_top = file.Get< Vector >( &NavFlatHeader::ladderTop )[ index ];
+	m_bottom = file.Get< Vector >( &NavFlatHeader::ladderBottom )[ index ];
+
+	m_dir = (NavDirType)file.Get< int >( &NavFlatHeader::ladderDir )[ index ];
+	SetDir( m_dir ); // regenerate the surface normal
+
+	const int *area = file.Get< int >( &NavFlatHeader::ladderArea ) + index * NAV_LADDER_AREAS;
+	m_topForwardArea = TheNavMesh->GetNavAreaByID( file.GetAreaID( area[ LADDER_TOP_FORWARD ] ) );
+	m_topLeftArea = TheNavMesh->GetNavAreaByID( file.GetAreaID( area[ LADDER_TOP_LEFT ] ) );
+	m_topRightArea = TheNavMesh->GetNavAreaByID( file.GetAreaID( area[ LADDER_TOP_RIGHT ] ) );
+	m_topBehindArea = TheNavMesh->GetNavAreaByID( file.GetAreaID( area[ LADDER_TOP_BEHIND ] ) );
+	m_bottomArea = TheNavMesh->GetNavAreaByID( file.GetAreaID( area[ LADDER_BOTTOM ] ) );
+	if ( !m_bottomArea )
+	{
+		DevMsg( "ERROR: Unconnected ladder #%d bottom at ( %g, %g, %g )\n", m_id, m_bottom.x, m_bottom.y, m_bottom.z );
+		DevWarning( "nav_unmark; nav_mark ladder %d; nav_warp_to_mark\n", m_id );
+	}
+	else if (!m_topForwardArea && !m_topLeftArea && !m_topRightArea)	// can't include behind area, since it is not used when going up a ladder
+	{
+		DevMsg( "ERROR: Unconnected ladder #%d top at ( %g, %g, %g )\n", m_id, m_top.x, m_top.y, m_top.z );
+		DevWarning( "nav_unmark; nav_mark ladder %d; nav_warp_to_mark\n", m_id );
+	}
+
+	FindLadderEntity();
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Functor returns true if ladder is free, or false if someone is on the ladder
@@ -14,6 +14,8 @@
 #include "nav.h"
 
 class CNavArea;
+class CNavMeshFileView;
+class CNavMeshFileWriter;
 
 //--------------------------------------------------------------------------------------------------------------
 /**
@@ -41,6 +43,8 @@ public:
 
 	void Save( CUtlBuffer &fileBuffer, unsigned int version ) const;
 	void Load( CUtlBuffer &fileBuffer, unsigned int version );
+	void Save( CNavMeshFileWriter &file ) const;
+	void Load( const CNavMeshFileView &file, int index );
 
 	unsigned int GetID( void ) const	{ return m_id; }		///< return this ladder's unique ID
 	static void CompressIDs( void );							///<re-orders ladder ID's so they are continuous
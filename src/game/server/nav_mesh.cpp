@@ -15,7 +15,9 @@
 #include "nav_node.h"
 #include "fmtstr.h"
 #include "utlbuffer.h"
+#include "nav_meshfile.h"
 #include "tier0/vprof.h"
+#include "vstdlib/jobthread.h"
 #ifdef TERROR
 #include "func_simpleladder.h"
 #endif
@@ -46,6 +48,9 @@ ConVar nav_show_func_nav_avoid( "nav_show_func_nav_avoid", "0", FCVAR_GAMEDLL |
 ConVar nav_show_func_nav_prefer( "nav_show_func_nav_prefer", "0", FCVAR_GAMEDLL | FCVAR_CHEAT, "Show areas of designer-placed bot preference due to func_nav_prefer entities" );
 ConVar nav_show_func_nav_prerequisite( "nav_show_func_nav_prerequisite", "0", FCVAR_GAMEDLL | FCVAR_CHEAT, "Show areas of designer-placed bot preference due to func_nav_prerequisite entities" );
 ConVar nav_max_vis_delta_list_length( "nav_max_vis_delta_list_length", "64", FCVAR_CHEAT );
+ConVar nav_area_hierarchy( "nav_area_hierarchy", "1", FCVAR_CHEAT, "Let hierarchical NavAreaBuildPath() searches plan a route over clusters of areas first. 0 makes them search the whole mesh." );
+ConVar nav_area_cluster_size( "nav_area_cluster_size", "1024", FCVAR_CHEAT, "Width of the square clusters of areas used by hierarchical path searches." );
+ConVar nav_nearest_area_tree( "nav_nearest_area_tree", "1", FCVAR_CHEAT, "Find nearest nav areas with a tree of area extents instead of searching the grid in rings." );
 
 extern ConVar nav_show_potentially_visible;
 
@@ -54,6 +59,8 @@ int g_DebugPathfindCounter = 0;
 
 bool FindGroundForNode( Vector *pos, Vector *normal );
 
+static const int NEAREST_AREA_CANDIDATES = 8;				// areas to collect at once when nearest area searches check line of sight
+
 
 //--------------------------------------------------------------------------------------------------------------
 CNavMesh::CNavMesh( void )
@@ -65,6 +72,8 @@ CNavMesh::CNavMesh( void )
 	m_hostThreadModeRestoreValue = 0;
 	m_placeCount = 0;
 	m_placeName = NULL;
+	m_isAreaTreeDirty = true;
+	m_isAreaHierarchyDirty = true;
 
 	LoadPlaceDatabase();
 
@@ -101,6 +110,7 @@ void CNavMesh::Reset( void )
 
 	m_generationMode = GENERATE_NONE;
 	m_currentNode = NULL;
+	m_nextGenerationCheckpointTime = 0.0f;
 	ClearWalkableSeeds();
 
 	m_isAnalyzed = false;
@@ -199,6 +209,7 @@ void CNavMesh::DestroyNavigationMesh( bool incremental )
 
 	// destroy navigation nodes created during map generation
 	CNavNode::CleanupGeneration();
+	m_sampleFrontier.RemoveAll();
 
 	if ( !incremental )
 	{
@@ -208,11 +219,18 @@ void CNavMesh::DestroyNavigationMesh( bool incremental )
 		m_gridSizeY = 0;
 	}
 
+	m_areaTree.Reset();
+	m_isAreaTreeDirty = true;
+
+	m_areaHierarchy.Reset();
+	m_isAreaHierarchyDirty = true;
+
 	// clear the hash table
 	for( int i=0; i<HASH_TABLE_SIZE; ++i )
 	{
 		m_hashTable[i] = NULL;
 	}
+	m_areaByID.RemoveAll();
 
 	if ( !incremental )
 	{
@@ -503,11 +521,31 @@ void CNavMesh::AddNavArea( CNavArea *area )
 		area->m_prevHash = NULL;
 	}
 
+	// add to ID table
+	unsigned int id = area->GetID();
+	if ( id < MAX_INDEXED_AREA_ID )
+	{
+		if ( id >= (unsigned int)m_areaByID.Count() )
+		{
+			int oldCount = m_areaByID.Count();
+			m_areaByID.AddMultipleToTail( id + 1 - oldCount );
+			for( int i=oldCount; i<m_areaByID.Count(); ++i )
+			{
+				m_areaByID[i] = NULL;
+			}
+		}
+
+		m_areaByID[ id ] = area;
+	}
+
 	if ( area->GetAttributes() & NAV_MESH_TRANSIENT )
 	{
 		m_transientAreas.AddToTail( area );
 	}
 
+	m_isAreaTreeDirty = true;
+	m_isAreaHierarchyDirty = true;
+
 	++m_areaCount;
 }
 
@@ -554,6 +592,13 @@ void CNavMesh::RemoveNavArea( CNavArea *area )
 		area->m_nextHash->m_prevHash = area->m_prevHash;
 	}
 
+	// remove from ID table, unless another area has taken the ID over
+	unsigned int id = area->GetID();
+	if ( id < (unsigned int)m_areaByID.Count() && m_areaByID[ id ] == area )
+	{
+		m_areaByID[ id ] = NULL;
+	}
+
 	if ( area->GetAttributes() & NAV_MESH_TRANSIENT )
 	{
 		BuildTransientAreaList();
@@ -562,6 +607,9 @@ void CNavMesh::RemoveNavArea( CNavArea *area )
 	m_avoidanceObstacleAreas.FindAndRemove( area );
 	m_blockedAreas.FindAndRemove( area );
 
+	m_isAreaTreeDirty = true;
+	m_isAreaHierarchyDirty = true;
+
 	--m_areaCount;
 }
 
@@ -814,6 +862,53 @@ CNavArea *CNavMesh::GetNavArea( CBaseEntity *pEntity, int nFlags, float flBeneat
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return a point at 'pos' that isn't embedded in the world, to trace line of sight to nearby areas from
+ */
+static Vector GetNearestNavAreaTraceStart( const Vector &pos )
+{
+	trace_t result;
+
+	UTIL_TraceLine( pos, pos + Vector( 0, 0, StepHeight ), MASK_NPCSOLID_BRUSHONLY, NULL, COLLISION_GROUP_NONE, &result );
+	if ( result.startsolid )
+	{
+		// it was embedded - move it out
+		return result.endpos + Vector( 0, 0, 1.0f );
+	}
+
+	return pos;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return true if the point 'areaPos' on a nav area is in sight of 'safePos'
+ */
+static bool IsNearestNavAreaVisible( const Vector &safePos, const Vector &areaPos )
+{
+	trace_t result;
+
+	// Don't bother tracing from the nav area up to safePos.z if it's within StepHeight of the area, since areas can be embedded in the ground a bit
+	float heightDelta = fabs(areaPos.z - safePos.z);
+	if ( heightDelta > StepHeight )
+	{
+		// trace to the height of the original point
+		UTIL_TraceLine( areaPos + Vector( 0, 0, StepHeight ), Vector( areaPos.x, areaPos.y, safePos.z ), MASK_NPCSOLID_BRUSHONLY, NULL, COLLISION_GROUP_NONE, &result );
+		
+		if ( result.fraction != 1.0f )
+		{
+			return false;
+		}
+	}
+
+	// trace to the original point's height above the area
+	UTIL_TraceLine( safePos, Vector( areaPos.x, areaPos.y, safePos.z + StepHeight ), MASK_NPCSOLID_BRUSHONLY, NULL, COLLISION_GROUP_NONE, &result );
+
+	return ( result.fraction == 1.0f );
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Given a position in the world, return the nav area that is closest
@@ -828,13 +923,10 @@ CNavArea *CNavMesh::GetNearestNavArea( const Vector &pos, bool anyZ, float maxDi
 	if ( !m_grid.Count() )
 		return NULL;	
 
-	CNavArea *close = NULL;
-	float closeDistSq = maxDist * maxDist;
-
 	// quick check
 	if ( !checkLOS && !checkGround )
 	{
-		close = GetNavArea( pos );
+		CNavArea *close = GetNavArea( pos );
 		if ( close )
 		{
 			return close;
@@ -843,21 +935,81 @@ CNavArea *CNavMesh::GetNearestNavArea( const Vector &pos, bool anyZ, float maxDi
 
 	// ensure source position is well behaved
 	Vector source;
-	source.x = pos.x;
-	source.y = pos.y;
-	if ( GetGroundHeight( pos, &source.z ) == false )
+	if ( !GetNearestNavAreaSource( pos, checkGround, &source ) )
+		return NULL;
+
+	if ( UpdateAreaTree() )
 	{
-		if ( !checkGround )
-		{
-			source.z = pos.z;
-		}
-		else
+		return GetNearestNavAreaInTree( pos, source, maxDist, checkLOS, team );
+	}
+
+	return GetNearestNavAreaInGrid( pos, source, maxDist, checkLOS, team );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return the point above the ground under 'pos' that nearest area searches measure areas from.
+ * Returns false if there is no ground and 'checkGround' is set.
+ */
+bool CNavMesh::GetNearestNavAreaSource( const Vector &pos, bool checkGround, Vector *source ) const
+{
+	source->x = pos.x;
+	source->y = pos.y;
+	if ( GetGroundHeight( pos, &source->z ) == false )
+	{
+		if ( checkGround )
 		{
-			return NULL;
+			return false;
 		}
+
+		source->z = pos.z;
 	}
 
-	source.z += HalfHumanHeight;
+	source->z += HalfHumanHeight;
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Rebuild the area tree if areas have changed since it was built.
+ * Returns false if nearest area searches should use the grid instead.
+ */
+bool CNavMesh::UpdateAreaTree( void ) const
+{
+	// areas are reshaped in place while editing and generating, so the tree can't be trusted until they are done
+	if ( !nav_nearest_area_tree.GetBool() || m_isEditing || IsGenerating() )
+	{
+		m_isAreaTreeDirty = true;
+		return false;
+	}
+
+	if ( m_isAreaTreeDirty )
+	{
+		VPROF_BUDGET( "CNavMesh::UpdateAreaTree", "NextBot" );
+
+		m_areaTree.Build( TheNavAreas );
+		m_isAreaTreeDirty = false;
+	}
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Find the nearest area by searching grid cells in increasing rings around 'pos'
+ */
+CNavArea *CNavMesh::GetNearestNavAreaInGrid( const Vector &pos, const Vector &source, float maxDist, bool checkLOS, int team ) const
+{
+	CNavArea *close = NULL;
+	float closeDistSq = maxDist * maxDist;
+
+	// make sure 'pos' is not embedded in the world, once we have a candidate to check LOS to
+	Vector safePos;
+	bool hasSafePos = false;
 
 	// find closest nav area
 
@@ -939,39 +1091,13 @@ CNavArea *CNavMesh::GetNearestNavArea( const Vector &pos, bool anyZ, float maxDi
 					// It is still good to do this in some isolated cases, however
 					if ( checkLOS )
 					{
-						trace_t result;
-
-						// make sure 'pos' is not embedded in the world
-						Vector safePos;
-
-						UTIL_TraceLine( pos, pos + Vector( 0, 0, StepHeight ), MASK_NPCSOLID_BRUSHONLY, NULL, COLLISION_GROUP_NONE, &result );
-						if ( result.startsolid )
-						{
-							// it was embedded - move it out
-							safePos = result.endpos + Vector( 0, 0, 1.0f );
-						}
-						else
+						if ( !hasSafePos )
 						{
-							safePos = pos;
+							safePos = GetNearestNavAreaTraceStart( pos );
+							hasSafePos = true;
 						}
 
-						// Don't bother tracing from the nav area up to safePos.z if it's within StepHeight of the area, since areas can be embedded in the ground a bit
-						float heightDelta = fabs(areaPos.z - safePos.z);
-						if ( heightDelta > StepHeight )
-						{
-							// trace to the height of the original point
-							UTIL_TraceLine( areaPos + Vector( 0, 0, StepHeight ), Vector( areaPos.x, areaPos.y, safePos.z ), MASK_NPCSOLID_BRUSHONLY, NULL, COLLISION_GROUP_NONE, &result );
-							
-							if ( result.fraction != 1.0f )
-							{
-								continue;
-							}
-						}
-
-						// trace to the original point's height above the area
-						UTIL_TraceLine( safePos, Vector( areaPos.x, areaPos.y, safePos.z + StepHeight ), MASK_NPCSOLID_BRUSHONLY, NULL, COLLISION_GROUP_NONE, &result );
-
-						if ( result.fraction != 1.0f )
+						if ( !IsNearestNavAreaVisible( safePos, areaPos ) )
 						{
 							continue;
 						}
@@ -991,6 +1117,262 @@ CNavArea *CNavMesh::GetNearestNavArea( const Vector &pos, bool anyZ, float maxDi
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Find the nearest area by searching the area tree.
+ * Unlike the grid search, this always finds the closest area in range.
+ */
+CNavArea *CNavMesh::GetNearestNavAreaInTree( const Vector &pos, const Vector &source, float maxDist, bool checkLOS, int team ) const
+{
+	CNavArea *close;
+	Vector closePos;
+	float closeDistSq;
+
+	if ( !checkLOS )
+	{
+		return m_areaTree.CollectNearest( pos, source, maxDist * maxDist, team, 1, &close, &closePos, &closeDistSq ) ? close : NULL;
+	}
+
+	// candidates come back nearest first, so the first one in sight is the answer.
+	// Widen the search until one is, or there are no more areas in range.
+	Vector safePos = GetNearestNavAreaTraceStart( pos );
+
+	CUtlVectorFixedGrowable< CNavArea *, NEAREST_AREA_CANDIDATES > candidates;
+	CUtlVectorFixedGrowable< Vector, NEAREST_AREA_CANDIDATES > candidatePos;
+	CUtlVectorFixedGrowable< float, NEAREST_AREA_CANDIDATES > candidateDistSq;
+	CUtlVectorFixedGrowable< CNavArea *, NEAREST_AREA_CANDIDATES > hidden;
+
+	for( int maxCount = NEAREST_AREA_CANDIDATES; ; maxCount *= 4 )
+	{
+		candidates.SetCount( maxCount );
+		candidatePos.SetCount( maxCount );
+		candidateDistSq.SetCount( maxCount );
+
+		int found = m_areaTree.CollectNearest( pos, source, maxDist * maxDist, team, maxCount, candidates.Base(), candidatePos.Base(), candidateDistSq.Base() );
+
+		for( int i=0; i<found; ++i )
+		{
+			// already traced on a narrower search
+			if ( hidden.HasElement( candidates[i] ) )
+				continue;
+
+			if ( IsNearestNavAreaVisible( safePos, candidatePos[i] ) )
+			{
+				return candidates[i];
+			}
+
+			hidden.AddToTail( candidates[i] );
+		}
+
+		if ( found < maxCount )
+		{
+			return NULL;
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * A nearest area search in GetNearestNavAreas() that is waiting on line of sight traces
+ */
+struct NearestNavAreaQuery
+{
+	int index;												// into the caller's arrays
+	Vector pos;
+	Vector source;
+	Vector safePos;
+
+	CNavArea *candidate[ NEAREST_AREA_CANDIDATES ];			// nearest first
+	Vector candidatePos[ NEAREST_AREA_CANDIDATES ];
+	float candidateDistSq[ NEAREST_AREA_CANDIDATES ];
+	int candidateCount;
+	int nextCandidate;										// the candidate being traced to
+	bool isVisible;											// result of tracing to the next candidate
+};
+
+static void ComputeNearestNavAreaTraceStart( NearestNavAreaQuery &query )
+{
+	query.safePos = GetNearestNavAreaTraceStart( query.pos );
+}
+
+static void TestNearestNavAreaCandidate( NearestNavAreaQuery &query )
+{
+	query.isVisible = IsNearestNavAreaVisible( query.safePos, query.candidatePos[ query.nextCandidate ] );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Find the nearest area to each of 'count' positions, as GetNearestNavArea() does.
+ * With 'checkLOS', every position's nearest few areas are found up front and the line of sight traces
+ * for all positions are run together on all cores, a candidate per position per pass.
+ */
+void CNavMesh::GetNearestNavAreas( int count, const Vector *pos, CNavArea **nearest, float maxDist, bool checkLOS, bool checkGround, int team ) const
+{
+	VPROF_BUDGET( "CNavMesh::GetNearestNavAreas", "NextBot" );
+
+	if ( !checkLOS || !m_grid.Count() || !UpdateAreaTree() )
+	{
+		for( int i=0; i<count; ++i )
+		{
+			nearest[i] = GetNearestNavArea( pos[i], false, maxDist, checkLOS, checkGround, team );
+		}
+		return;
+	}
+
+	CUtlVector< NearestNavAreaQuery > pending;
+	pending.EnsureCapacity( count );
+
+	for( int i=0; i<count; ++i )
+	{
+		nearest[i] = NULL;
+
+		// ground traces can touch entities, so they stay on this thread
+		Vector source;
+		if ( !GetNearestNavAreaSource( pos[i], checkGround, &source ) )
+			continue;
+
+		NearestNavAreaQuery &query = pending[ pending.AddToTail() ];
+		query.index = i;
+		query.pos = pos[i];
+		query.source = source;
+		query.candidateCount = m_areaTree.CollectNearest( pos[i], source, maxDist * maxDist, team, NEAREST_AREA_CANDIDATES, query.candidate, query.candidatePos, query.candidateDistSq );
+		query.nextCandidate = 0;
+
+		if ( query.candidateCount == 0 )
+		{
+			pending.RemoveMultipleFromTail( 1 );
+		}
+	}
+
+	if ( pending.Count() == 0 )
+		return;
+
+	ParallelProcess( "CNavMesh::GetNearestNavAreas", pending.Base(), pending.Count(), &ComputeNearestNavAreaTraceStart );
+
+	while( pending.Count() )
+	{
+		ParallelProcess( "CNavMesh::GetNearestNavAreas", pending.Base(), pending.Count(), &TestNearestNavAreaCandidate );
+
+		for( int i=pending.Count()-1; i>=0; --i )
+		{
+			NearestNavAreaQuery &query = pending[i];
+
+			if ( query.isVisible )
+			{
+				nearest[ query.index ] = query.candidate[ query.nextCandidate ];
+			}
+			else if ( ++query.nextCandidate < query.candidateCount )
+			{
+				// try the next closest on the next pass
+				continue;
+			}
+			else if ( query.candidateCount == NEAREST_AREA_CANDIDATES )
+			{
+				// none of these were in sight, but there may be more areas in range
+				nearest[ query.index ] = GetNearestNavAreaInTree( query.pos, query.source, maxDist, true, team );
+			}
+
+			pending.FastRemove( i );
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Time nearest area searches from random points around the mesh with the grid, the area tree, and batches
+ */
+CON_COMMAND_F( nav_bench_nearest_area, "Times nearest nav area searches from random points around the mesh, using the grid, the area tree, and GetNearestNavAreas().\nUsage: nav_bench_nearest_area [queries] [check LOS]", FCVAR_GAMEDLL | FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( TheNavAreas.Count() == 0 )
+	{
+		Msg( "nav_bench_nearest_area: no Navigation Mesh is loaded\n" );
+		return;
+	}
+
+	int count = ( args.ArgC() > 1 ) ? MAX( atoi( args[1] ), 1 ) : 10000;
+	bool checkLOS = ( args.ArgC() > 2 ) ? ( atoi( args[2] ) != 0 ) : false;
+
+	// points over and around random areas, the same ones every run
+	CUniformRandomStream random;
+	random.SetSeed( 1 );
+
+	CUtlVector< Vector > points;
+	points.SetCount( count );
+	for( int i=0; i<count; ++i )
+	{
+		Extent extent;
+		TheNavAreas[ random.RandomInt( 0, TheNavAreas.Count()-1 ) ]->GetExtent( &extent );
+
+		points[i].x = random.RandomFloat( extent.lo.x - 500.0f, extent.hi.x + 500.0f );
+		points[i].y = random.RandomFloat( extent.lo.y - 500.0f, extent.hi.y + 500.0f );
+		points[i].z = random.RandomFloat( extent.lo.z, extent.hi.z + 200.0f );
+	}
+
+	CUtlVector< CNavArea * > gridAreas, treeAreas, batchAreas;
+	gridAreas.SetCount( count );
+	treeAreas.SetCount( count );
+	batchAreas.SetCount( count );
+
+	bool oldValue = nav_nearest_area_tree.GetBool();
+
+	nav_nearest_area_tree.SetValue( 0 );
+	double start = Plat_FloatTime();
+	for( int i=0; i<count; ++i )
+	{
+		gridAreas[i] = TheNavMesh->GetNearestNavArea( points[i], false, 10000.0f, checkLOS );
+	}
+	double gridTime = Plat_FloatTime() - start;
+
+	// the first search builds the tree
+	nav_nearest_area_tree.SetValue( 1 );
+	start = Plat_FloatTime();
+	TheNavMesh->GetNearestNavArea( points[0], false, 10000.0f, checkLOS );
+	double buildTime = Plat_FloatTime() - start;
+
+	start = Plat_FloatTime();
+	for( int i=0; i<count; ++i )
+	{
+		treeAreas[i] = TheNavMesh->GetNearestNavArea( points[i], false, 10000.0f, checkLOS );
+	}
+	double treeTime = Plat_FloatTime() - start;
+
+	start = Plat_FloatTime();
+	TheNavMesh->GetNearestNavAreas( count, points.Base(), batchAreas.Base(), 10000.0f, checkLOS );
+	double batchTime = Plat_FloatTime() - start;
+
+	nav_nearest_area_tree.SetValue( oldValue );
+
+	int gridDiffs = 0;
+	int batchDiffs = 0;
+	for( int i=0; i<count; ++i )
+	{
+		if ( gridAreas[i] != treeAreas[i] )
+			++gridDiffs;
+
+		if ( batchAreas[i] != treeAreas[i] )
+			++batchDiffs;
+	}
+
+	Msg( "nav_bench_nearest_area: %d queries, %d areas%s\n", count, TheNavAreas.Count(), checkLOS ? ", checking LOS" : "" );
+	Msg( "  grid:  %8.3f ms\n", gridTime * 1000.0 );
+	Msg( "  tree:  %8.3f ms (+%.3f ms first search and build)\n", treeTime * 1000.0, buildTime * 1000.0 );
+	Msg( "  batch: %8.3f ms\n", batchTime * 1000.0 );
+
+	// the grid search stops one ring past its first hit, so it can miss a slightly closer area the tree finds
+	Msg( "  %d results differ between grid and tree\n", gridDiffs );
+	if ( batchDiffs )
+	{
+		Warning( "nav_bench_nearest_area: %d batched results differ from single searches!\n", batchDiffs );
+	}
+}
+
+
 //----------------------------------------------------------------------------
 // Given a position in the world, return the nav area that is closest
 // and at the same height, or beneath it.
@@ -1024,6 +1406,11 @@ CNavArea *CNavMesh::GetNavAreaByID( unsigned int id ) const
 	if (id == 0)
 		return NULL;
 
+	if ( id < MAX_INDEXED_AREA_ID )
+	{
+		return ( id < (unsigned int)m_areaByID.Count() ) ? m_areaByID[ id ] : NULL;
+	}
+
 	int key = ComputeHashKey( id );
 
 	for( CNavArea *area = m_hashTable[key]; area; area = area->m_nextHash )
@@ -1037,6 +1424,31 @@ CNavArea *CNavMesh::GetNavAreaByID( unsigned int id ) const
 	return NULL;
 }
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return the cluster graph for hierarchical path searches, building it first if areas have changed.
+ * Returns NULL if searches should cover the whole mesh instead.
+ */
+CNavAreaHierarchy *CNavMesh::GetAreaHierarchy( void ) const
+{
+	// areas are reshaped and reconnected in place while editing and generating, so the clusters can't be trusted until they are done
+	if ( !nav_area_hierarchy.GetBool() || m_isEditing || IsGenerating() )
+	{
+		m_isAreaHierarchyDirty = true;
+		return NULL;
+	}
+
+	if ( m_isAreaHierarchyDirty || m_areaHierarchy.GetClusterSize() != nav_area_cluster_size.GetFloat() )
+	{
+		VPROF_BUDGET( "CNavMesh::GetAreaHierarchy", "NextBot" );
+
+		m_areaHierarchy.Build( nav_area_cluster_size.GetFloat() );
+		m_isAreaHierarchyDirty = false;
+	}
+
+	return m_areaHierarchy.IsEmpty() ? NULL : &m_areaHierarchy;
+}
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Given an ID, return the associated ladder
@@ -2594,6 +3006,17 @@ void CommandNavGenerate( void )
 static ConCommand nav_generate( "nav_generate", CommandNavGenerate, "Generate a Navigation Mesh for the current map and save it to disk.", FCVAR_GAMEDLL | FCVAR_CHEAT );
 
 
+//--------------------------------------------------------------------------------------------------------------
+void CommandNavGenerateResume( void )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	TheNavMesh->ResumeGeneration();
+}
+static ConCommand nav_generate_resume( "nav_generate_resume", CommandNavGenerateResume, "Continue an interrupted nav_generate from the checkpoint saved by nav_generate_checkpoint_interval.", FCVAR_GAMEDLL | FCVAR_CHEAT );
+
+
 //--------------------------------------------------------------------------------------------------------------
 void CommandNavGenerateIncremental( void )
 {
@@ -3071,6 +3494,19 @@ void HidingSpot::Load( CUtlBuffer &fileBuffer, unsigned int version )
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+void HidingSpot::Load( const CNavMeshFileView &file, int index )
+{
+	m_id = file.GetHidingSpotID( index );
+	m_pos = file.Get< Vector >( &NavFlatHeader::hidingSpotPos )[ index ];
+	m_flags = file.Get< unsigned char >( &NavFlatHeader::hidingSpotFlags )[ index ];
+
+	// update next ID to avoid ID collisions by later spots
+	if (m_id >= m_nextID)
+		m_nextID = m_id+1;
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Hiding Spot post-load processing
@@ -3095,6 +3531,10 @@ NavErrorType HidingSpot::PostLoad( void )
  */
 HidingSpot *GetHidingSpotByID( unsigned int id )
 {
+	// IDs are handed out in creation order, so unless spots have been destroyed they match their index
+	if ( id < (unsigned int)TheHidingSpots.Count() && TheHidingSpots[ id ]->GetID() == id )
+		return TheHidingSpots[ id ];
+
 	FOR_EACH_VEC( TheHidingSpots, it )
 	{
 		HidingSpot *spot = TheHidingSpots[ it ];
@@ -3115,6 +3555,8 @@ void CNavMesh::OnAreaBlocked( CNavArea *area )
 	{
 		m_blockedAreas.AddToTail( area );
 	}
+
+	m_areaHierarchy.OnAreaBlockedChanged( area );
 }
 
 
@@ -3123,6 +3565,8 @@ void CNavMesh::OnAreaBlocked( CNavArea *area )
 void CNavMesh::OnAreaUnblocked( CNavArea *area )
 {
 	m_blockedAreas.FindAndRemove( area );
+
+	m_areaHierarchy.OnAreaBlockedChanged( area );
 }
 
 
@@ -26,6 +26,8 @@
 #include "nav.h"
 #include "nav_area.h"
 #include "nav_colors.h"
+#include "nav_area_tree.h"
+#include "nav_hierarchy.h"
 
 
 class CNavArea;
@@ -320,8 +322,10 @@ public:
 	CNavArea *GetNavArea( const Vector &pos, float beneathLimt = 120.0f ) const;	// given a position, return the nav area that IsOverlapping and is *immediately* beneath it
 	CNavArea *GetNavArea( CBaseEntity *pEntity, int nGetNavAreaFlags, float flBeneathLimit = 120.0f ) const;
 	CNavArea *GetNavAreaByID( unsigned int id ) const;
+	CNavAreaHierarchy *GetAreaHierarchy( void ) const;			// return the cluster graph for hierarchical NavAreaBuildPath() searches, or NULL if they should search the whole mesh
 	CNavArea *GetNearestNavArea( const Vector &pos, bool anyZ = false, float maxDist = 10000.0f, bool checkLOS = false, bool checkGround = true, int team = TEAM_ANY ) const;
 	CNavArea *GetNearestNavArea( CBaseEntity *pEntity, int nGetNavAreaFlags = GETNAVAREA_CHECK_GROUND, float maxDist = 10000.0f ) const;
+	void GetNearestNavAreas( int count, const Vector *pos, CNavArea **nearest, float maxDist = 10000.0f, bool checkLOS = false, bool checkGround = true, int team = TEAM_ANY ) const;	// GetNearestNavArea for many positions at once, with the line of sight traces batched
 
 	Place GetPlace( const Vector &pos ) const;							// return Place at given coordinate
 	const char *PlaceToName( Place place ) const;						// given a place, return its name
@@ -348,6 +352,7 @@ public:
 	//
 	#define INCREMENTAL_GENERATION true
 	void BeginGeneration( bool incremental = false );					// initiate the generation process
+	void ResumeGeneration( void );										// continue a full generation from its last checkpoint, or start a new one
 	void BeginAnalysis( bool quitWhenFinished = false );						// re-analyze an existing Mesh.  Determine Hiding Spots, Encounter Spots, etc.
 
 	bool IsGenerating( void ) const		{ return m_generationMode != GENERATE_NONE; }	// return true while a Navigation Mesh is being generated
@@ -1080,6 +1085,19 @@ private:
 	CNavArea *m_hashTable[ HASH_TABLE_SIZE ];					// hash table to optimize lookup by ID
 	int ComputeHashKey( unsigned int id ) const;				// returns a hash key for the given nav area ID
 
+	enum { MAX_INDEXED_AREA_ID = 1 << 20 };
+	CUtlVector< CNavArea * > m_areaByID;						// areas indexed by ID, for all IDs below MAX_INDEXED_AREA_ID. The hash table is only searched for larger IDs.
+
+	mutable CNavAreaTree m_areaTree;							// areas by extent, for nearest area searches
+	mutable bool m_isAreaTreeDirty;								// true if areas have changed since m_areaTree was built
+	bool UpdateAreaTree( void ) const;							// rebuild the area tree if needed. Returns false if nearest area searches should use the grid instead.
+	bool GetNearestNavAreaSource( const Vector &pos, bool checkGround, Vector *source ) const;	// return the point nearest area searches measure areas from
+	CNavArea *GetNearestNavAreaInGrid( const Vector &pos, const Vector &source, float maxDist, bool checkLOS, int team ) const;
+	CNavArea *GetNearestNavAreaInTree( const Vector &pos, const Vector &source, float maxDist, bool checkLOS, int team ) const;
+
+	mutable CNavAreaHierarchy m_areaHierarchy;					// clusters of areas for hierarchical path searches
+	mutable bool m_isAreaHierarchyDirty;						// true if areas have been added or removed since m_areaHierarchy was built
+
 	int WorldToGridX( float wx ) const;							// given X component, return grid index
 	int WorldToGridY( float wy ) const;							// given Y component, return grid index
 	void AllocateGrid( float minX, float maxX, float minY, float maxY );	// clear and reset the grid to the given extents
@@ -1156,13 +1174,37 @@ private:
 
 	CNavNode *m_currentNode;									// the current node we are sampling from
 	NavDirType m_generationDir;
-	CNavNode *AddNode( const Vector &destPos, const Vector &destNormal, NavDirType dir, CNavNode *source, bool isOnDisplacement, float obstacleHeight, float flObstacleStartDist, float flObstacleEndDist );		// add a nav node and connect it, update current node
+	CNavNode *AddNode( const Vector &destPos, const Vector &destNormal, NavDirType dir, CNavNode *source, bool isOnDisplacement, float obstacleHeight, float flObstacleStartDist, float flObstacleEndDist, bool checkSurroundings = true );		// add a nav node and connect it, update current node
 
 	NavLadderVector m_ladders;									// list of ladder navigation representations
 	void BuildLadders( void );
 	void DestroyLadders( void );
 
 	bool SampleStep( void );									// sample the walkable areas of the map
+	bool SampleWavefront( void );								// sample a whole breadth-first wave of nodes at once, tracing in parallel
+	CNavNode *GetNextSampleStartNode( void );					// return a node to continue sampling from, or NULL if sampling is complete
+
+	struct SampleStepInfo
+	{
+		CNavNode *from;
+		NavDirType dir;
+		bool canMove;											// results below are only valid if this is true
+		Vector to;
+		Vector toNormal;
+		bool isOnDisplacement;
+		float obstacleHeight;
+		float obstacleStartDist;
+		float obstacleEndDist;
+	};
+	bool ComputeSampleStep( SampleStepInfo *step ) const;		// trace a step from a node. Only reads the mesh, so it can run on any thread
+	static void ComputeSampleStepJob( SampleStepInfo &step );
+	static void CheckNodeSurroundings( CNavNode *&node );		// crouch and cliff tests for a node, which only write to the node itself
+	CUtlVector< CNavNode * > m_sampleFrontier;					// nodes that still have directions to be sampled
+
+	const char *GetGenerationCheckpointFilename( void ) const;
+	void SaveGenerationCheckpoint( void );						// write the sampled nodes to disk, so an interrupted generation can be resumed
+	bool LoadGenerationCheckpoint( CUtlBuffer &fileBuffer );
+	float m_nextGenerationCheckpointTime;
 	void CreateNavAreasFromNodes( void );						// cover all of the sampled nodes with nav areas
 
 	bool TestArea( CNavNode *node, int width, int height );		// check if an area of size (width, height) can fit, starting from node as upper left corner
@@ -0,0 +1,330 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose:
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+// nav_meshfile.cpp
+// Flat layout of the Navigation Mesh in version 17+ .nav files
+
+#include "cbase.h"
+#include "checksum_crc.h"
+#include "nav_meshfile.h"
+
+// NOTE: This has to be the last file included!
+#include "tier0/memdbgon.h"
+
+
+//--------------------------------------------------------------------------------------------------------------
+static bool IsArrayInBlock( const NavFlatArray &array, int count, int elementSize, int blockSize )
+{
+	if ( count < 0 || array.count != count || array.offset < (int)sizeof( NavFlatHeader ) || ( array.offset % NAV_FLAT_ALIGN ) != 0 )
+		return false;
+
+	return ( (int64)array.offset + (int64)count * elementSize <= blockSize );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+static bool AreIndicesValid( const int *indices, int count, int lo, int hi )
+{
+	for( int i=0; i<count; ++i )
+	{
+		if ( indices[i] < lo || indices[i] >= hi )
+			return false;
+	}
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Lists are stored back to back, so their starts must run from 0 to the total without going backwards
+ */
+static bool AreListStartsValid( const int *first, int lists, int total )
+{
+	if ( first[0] != 0 || first[ lists ] != total )
+		return false;
+
+	for( int i=0; i<lists; ++i )
+	{
+		if ( first[i] > first[i+1] )
+			return false;
+	}
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Check that every array lies inside the block, every index refers to something that exists, and the
+ * checksum matches.  Once this passes, loading can trust the block without further checks.
+ */
+bool CNavMeshFileView::Init( const void *data, int size )
+{
+	m_header = NULL;
+
+	if ( size < (int)sizeof( NavFlatHeader ) )
+		return false;
+
+	const NavFlatHeader *header = (const NavFlatHeader *)data;
+	if ( header->id != NAV_FLAT_ID || header->dataSize < 0 || header->dataSize > size - (int)sizeof( NavFlatHeader ) )
+		return false;
+
+	int blockSize = sizeof( NavFlatHeader ) + header->dataSize;
+	int areas = header->areaID.count;
+	int spots = header->hidingSpotID.count;
+	int encounters = header->encounterFromArea.count;
+	int ladders = header->ladderID.count;
+	if ( areas < 0 || spots < 0 || encounters < 0 || ladders < 0 )
+		return false;
+
+	if ( !IsArrayInBlock( header->areaID,					areas, sizeof( unsigned int ), blockSize ) ||
+		 !IsArrayInBlock( header->areaAttributes,			areas, sizeof( int ), blockSize ) ||
+		 !IsArrayInBlock( header->areaNWCorner,				areas, sizeof( Vector ), blockSize ) ||
+		 !IsArrayInBlock( header->areaSECorner,				areas, sizeof( Vector ), blockSize ) ||
+		 !IsArrayInBlock( header->areaNEZ,					areas, sizeof( float ), blockSize ) ||
+		 !IsArrayInBlock( header->areaSWZ,					areas, sizeof( float ), blockSize ) ||
+		 !IsArrayInBlock( header->areaPlace,				areas, sizeof( unsigned short ), blockSize ) ||
+		 !IsArrayInBlock( header->areaEarliestOccupyTime,	areas * MAX_NAV_TEAMS, sizeof( float ), blockSize ) ||
+		 !IsArrayInBlock( header->areaLightIntensity,		areas * NUM_CORNERS, sizeof( float ), blockSize ) ||
+		 !IsArrayInBlock( header->areaInheritVisibility,	areas, sizeof( int ), blockSize ) ||
+		 !IsArrayInBlock( header->areaFirstConnect,			areas * NUM_DIRECTIONS + 1, sizeof( int ), blockSize ) ||
+		 !IsArrayInBlock( header->connectArea,				header->connectArea.count, sizeof( int ), blockSize ) ||
+		 !IsArrayInBlock( header->areaFirstHidingSpot,		areas + 1, sizeof( int ), blockSize ) ||
+		 !IsArrayInBlock( header->hidingSpotID,				spots, sizeof( unsigned int ), blockSize ) ||
+		 !IsArrayInBlock( header->hidingSpotPos,			spots, sizeof( Vector ), blockSize ) ||
+		 !IsArrayInBlock( header->hidingSpotFlags,			spots, sizeof( unsigned char ), blockSize ) ||
+		 !IsArrayInBlock( header->areaFirstEncounter,		areas + 1, sizeof( int ), blockSize ) ||
+		 !IsArrayInBlock( header->encounterFromArea,		encounters, sizeof( int ), blockSize ) ||
+		 !IsArrayInBlock( header->encounterFromDir,			encounters, sizeof( unsigned char ), blockSize ) ||
+		 !IsArrayInBlock( header->encounterToArea,			encounters, sizeof( int ), blockSize ) ||
+		 !IsArrayInBlock( header->encounterToDir,			encounters, sizeof( unsigned char ), blockSize ) ||
+		 !IsArrayInBlock( header->encounterFirstSpot,		encounters + 1, sizeof( int ), blockSize ) ||
+		 !IsArrayInBlock( header->encounterSpot,			header->encounterSpot.count, sizeof( int ), blockSize ) ||
+		 !IsArrayInBlock( header->encounterSpotT,			header->encounterSpot.count, sizeof( unsigned char ), blockSize ) ||
+		 !IsArrayInBlock( header->areaFirstLadder,			areas * CNavLadder::NUM_LADDER_DIRECTIONS + 1, sizeof( int ), blockSize ) ||
+		 !IsArrayInBlock( header->ladderConnect,			header->ladderConnect.count, sizeof( int ), blockSize ) ||
+		 !IsArrayInBlock( header->areaFirstVisible,			areas + 1, sizeof( int ), blockSize ) ||
+		 !IsArrayInBlock( header->visibleArea,				header->visibleArea.count, sizeof( int ), blockSize ) ||
+		 !IsArrayInBlock( header->visibleAttributes,		header->visibleArea.count, sizeof( unsigned char ), blockSize ) ||
+		 !IsArrayInBlock( header->ladderID,					ladders, sizeof( unsigned int ), blockSize ) ||
+		 !IsArrayInBlock( header->ladderWidth,				ladders, sizeof( float ), blockSize ) ||
+		 !IsArrayInBlock( header->ladderLength,				ladders, sizeof( float ), blockSize ) ||
+		 !IsArrayInBlock( header->ladderTop,				ladders, sizeof( Vector ), blockSize ) ||
+		 !IsArrayInBlock( header->ladderBottom,				ladders, sizeof( Vector ), blockSize ) ||
+		 !IsArrayInBlock( header->ladderDir,				ladders, sizeof( int ), blockSize ) ||
+		 !IsArrayInBlock( header->ladderArea,				ladders * NAV_LADDER_AREAS, sizeof( int ), blockSize ) )
+	{
+		return false;
+	}
+
+	if ( CRC32_ProcessSingleBuffer( header + 1, header->dataSize ) != header->checksum )
+		return false;
+
+	m_header = header;
+
+	bool valid =
+		AreListStartsValid( Get< int >( &NavFlatHeader::areaFirstConnect ), areas * NUM_DIRECTIONS, header->connectArea.count ) &&
+		AreListStartsValid( Get< int >( &NavFlatHeader::areaFirstHidingSpot ), areas, spots ) &&
+		AreListStartsValid( Get< int >( &NavFlatHeader::areaFirstEncounter ), areas, encounters ) &&
+		AreListStartsValid( Get< int >( &NavFlatHeader::encounterFirstSpot ), encounters, header->encounterSpot.count ) &&
+		AreListStartsValid( Get< int >( &NavFlatHeader::areaFirstLadder ), areas * CNavLadder::NUM_LADDER_DIRECTIONS, header->ladderConnect.count ) &&
+		AreListStartsValid( Get< int >( &NavFlatHeader::areaFirstVisible ), areas, header->visibleArea.count ) &&
+		AreIndicesValid( Get< int >( &NavFlatHeader::areaInheritVisibility ), areas, -1, areas ) &&
+		AreIndicesValid( Get< int >( &NavFlatHeader::connectArea ), header->connectArea.count, 0, areas ) &&
+		AreIndicesValid( Get< int >( &NavFlatHeader::encounterFromArea ), encounters, -1, areas ) &&
+		AreIndicesValid( Get< int >( &NavFlatHeader::encounterToArea ), encounters, -1, areas ) &&
+		AreIndicesValid( Get< int >( &NavFlatHeader::encounterSpot ), header->encounterSpot.count, -1, spots ) &&
+		AreIndicesValid( Get< int >( &NavFlatHeader::ladderConnect ), header->ladderConnect.count, 0, ladders ) &&
+		AreIndicesValid( Get< int >( &NavFlatHeader::visibleArea ), header->visibleArea.count, -1, areas ) &&
+		AreIndicesValid( Get< int >( &NavFlatHeader::ladderArea ), ladders * NAV_LADDER_AREAS, -1, areas );
+
+	if ( !valid )
+	{
+		m_header = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Assign every area and hiding spot the index it will have in the file
+ */
+CNavMeshFileWriter::CNavMeshFileWriter( const CUtlVector< CNavArea * > &areas, const CUtlVector< CNavLadder * > &ladders ) :
+	m_areaIndex( DefLessFunc( const CNavArea * ) ),
+	m_hidingSpotIndex( DefLessFunc( const HidingSpot * ) ),
+	m_ladders( ladders )
+{
+	int spotCount = 0;
+	FOR_EACH_VEC( areas, it )
+	{
+		const CNavArea *area = areas[ it ];
+		m_areaIndex.Insert( area, it );
+
+		const HidingSpotVector *spots = area->GetHidingSpots();
+		FOR_EACH_VEC( (*spots), sit )
+		{
+			m_hidingSpotIndex.Insert( (*spots)[ sit ], spotCount++ );
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+int CNavMeshFileWriter::GetAreaIndex( const CNavArea *area ) const
+{
+	int i = m_areaIndex.Find( area );
+	return ( i != m_areaIndex.InvalidIndex() ) ? m_areaIndex[i] : -1;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+int CNavMeshFileWriter::GetHidingSpotIndex( const HidingSpot *spot ) const
+{
+	int i = m_hidingSpotIndex.Find( spot );
+	return ( i != m_hidingSpotIndex.InvalidIndex() ) ? m_hidingSpotIndex[i] : -1;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+int CNavMeshFileWriter::GetLadderIndex( const CNavLadder *ladder ) const
+{
+	return m_ladders.Find( const_cast< CNavLadder * >( ladder ) );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+struct NavFlatSource
+{
+	NavFlatArray NavFlatHeader::*array;
+	const void *data;
+	int count;
+	int elementSize;
+};
+
+template < typename T >
+static void AddFlatSource( CUtlVector< NavFlatSource > &sources, NavFlatArray NavFlatHeader::*array, const CUtlVector< T > &data )
+{
+	NavFlatSource &source = sources[ sources.AddToTail() ];
+	source.array = array;
+	source.data = data.Base();
+	source.count = data.Count();
+	source.elementSize = sizeof( T );
+}
+
+// the lists are written without their closing entry, which is the length of what they index
+static void CloseListStarts( CUtlVector< int > &closed, const CUtlVector< int > &first, int total )
+{
+	closed.AddVectorToTail( first );
+	closed.AddToTail( total );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavMeshFileWriter::Write( CUtlBuffer &fileBuffer ) const
+{
+	CUtlVector< float > earliestOccupyTime;
+	for( int i=0; i<MAX_NAV_TEAMS; ++i )
+	{
+		earliestOccupyTime.AddVectorToTail( m_areaEarliestOccupyTime[i] );
+	}
+
+	CUtlVector< float > lightIntensity;
+	for( int i=0; i<NUM_CORNERS; ++i )
+	{
+		lightIntensity.AddVectorToTail( m_areaLightIntensity[i] );
+	}
+
+	CUtlVector< int > firstConnect, firstHidingSpot, firstEncounter, firstSpot, firstLadder, firstVisible;
+	CloseListStarts( firstConnect, m_areaFirstConnect, m_connectArea.Count() );
+	CloseListStarts( firstHidingSpot, m_areaFirstHidingSpot, m_hidingSpotID.Count() );
+	CloseListStarts( firstEncounter, m_areaFirstEncounter, m_encounterFromArea.Count() );
+	CloseListStarts( firstSpot, m_encounterFirstSpot, m_encounterSpot.Count() );
+	CloseListStarts( firstLadder, m_areaFirstLadder, m_ladderConnect.Count() );
+	CloseListStarts( firstVisible, m_areaFirstVisible, m_visibleArea.Count() );
+
+	CUtlVector< NavFlatSource > sources;
+	AddFlatSource( sources, &NavFlatHeader::areaID, m_areaID );
+	AddFlatSource( sources, &NavFlatHeader::areaAttributes, m_areaAttributes );
+	AddFlatSource( sources, &NavFlatHeader::areaNWCorner, m_areaNWCorner );
+	AddFlatSource( sources, &NavFlatHeader::areaSECorner, m_areaSECorner );
+	AddFlatSource( sources, &NavFlatHeader::areaNEZ, m_areaNEZ );
+	AddFlatSource( sources, &NavFlatHeader::areaSWZ, m_areaSWZ );
+	AddFlatSource( sources, &NavFlatHeader::areaPlace, m_areaPlace );
+	AddFlatSource( sources, &NavFlatHeader::areaEarliestOccupyTime, earliestOccupyTime );
+	AddFlatSource( sources, &NavFlatHeader::areaLightIntensity, lightIntensity );
+	AddFlatSource( sources, &NavFlatHeader::areaInheritVisibility, m_areaInheritVisibility );
+	AddFlatSource( sources, &NavFlatHeader::areaFirstConnect, firstConnect );
+	AddFlatSource( sources, &NavFlatHeader::connectArea, m_connectArea );
+	AddFlatSource( sources, &NavFlatHeader::areaFirstHidingSpot, firstHidingSpot );
+	AddFlatSource( sources, &NavFlatHeader::hidingSpotID, m_hidingSpotID );
+	AddFlatSource( sources, &NavFlatHeader::hidingSpotPos, m_hidingSpotPos );
+	AddFlatSource( sources, &NavFlatHeader::hidingSpotFlags, m_hidingSpotFlags );
+	AddFlatSource( sources, &NavFlatHeader::areaFirstEncounter, firstEncounter );
+	AddFlatSource( sources, &NavFlatHeader::encounterFromArea, m_encounterFromArea );
+	AddFlatSource( sources, &NavFlatHeader::encounterFromDir, m_encounterFromDir );
+	AddFlatSource( sources, &NavFlatHeader::encounterToArea, m_encounterToArea );
+	AddFlatSource( sources, &NavFlatHeader::encounterToDir, m_encounterToDir );
+	AddFlatSource( sources, &NavFlatHeader::encounterFirstSpot, firstSpot );
+	AddFlatSource( sources, &NavFlatHeader::encounterSpot, m_encounterSpot );
+	AddFlatSource( sources, &NavFlatHeader::encounterSpotT, m_encounterSpotT );
+	AddFlatSource( sources, &NavFlatHeader::areaFirstLadder, firstLadder );
+	AddFlatSource( sources, &NavFlatHeader::ladderConnect, m_ladderConnect );
+	AddFlatSource( sources, &NavFlatHeader::areaFirstVisible, firstVisible );
+	AddFlatSource( sources, &NavFlatHeader::visibleArea, m_visibleArea );
+	AddFlatSource( sources, &NavFlatHeader::visibleAttributes, m_visibleAttributes );
+	AddFlatSource( sources, &NavFlatHeader::ladderID, m_ladderID );
+	AddFlatSource( sources, &NavFlatHeader::ladderWidth, m_ladderWidth );
+	AddFlatSource( sources, &NavFlatHeader::ladderLength, m_ladderLength );
+	AddFlatSource( sources, &NavFlatHeader::ladderTop, m_ladderTop );
+	AddFlatSource( sources, &NavFlatHeader::ladderBottom, m_ladderBottom );
+	AddFlatSource( sources, &NavFlatHeader::ladderDir, m_ladderDir );
+	AddFlatSource( sources, &NavFlatHeader::ladderArea, m_ladderArea );
+
+	// lay out the arrays
+	NavFlatHeader header;
+	memset( &header, 0, sizeof( header ) );
+	header.id = NAV_FLAT_ID;
+
+	int blockSize = AlignValue( (int)sizeof( header ), NAV_FLAT_ALIGN );
+	FOR_EACH_VEC( sources, it )
+	{
+		const NavFlatSource &source = sources[ it ];
+		NavFlatArray &array = header.*source.array;
+		array.offset = blockSize;
+		array.count = source.count;
+		blockSize = AlignValue( blockSize + source.count * source.elementSize, NAV_FLAT_ALIGN );
+	}
+	header.dataSize = blockSize - sizeof( header );
+
+	CUtlVector< byte > block;
+	block.SetCount( blockSize );
+	memset( block.Base(), 0, blockSize );
+
+	FOR_EACH_VEC( sources, it )
+	{
+		const NavFlatSource &source = sources[ it ];
+		if ( source.count )
+		{
+			memcpy( block.Base() + (header.*source.array).offset, source.data, source.count * source.elementSize );
+		}
+	}
+
+	header.checksum = CRC32_ProcessSingleBuffer( block.Base() + sizeof( header ), header.dataSize );
+	memcpy( block.Base(), &header, sizeof( header ) );
+
+	// pad so the block starts aligned in the file
+	while( fileBuffer.TellPut() % NAV_FLAT_ALIGN )
+	{
+		fileBuffer.PutUnsignedChar( 0 );
+	}
+
+	fileBuffer.Put( block.Base(), blockSize );
+}
@@ -0,0 +1,194 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose:
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+// nav_meshfile.h
+// Flat layout of the Navigation Mesh in version 17+ .nav files
+
+#ifndef _NAV_MESHFILE_H_
+#define _NAV_MESHFILE_H_
+
+#include "nav_area.h"
+#include "utlvector.h"
+#include "utlbuffer.h"
+#include "utlmap.h"
+
+#define NAV_FLAT_ID			MAKEID('N','A','V','F')
+#define NAV_FLAT_ALIGN		16
+#define NAV_LADDER_AREAS	5			// top forward, top left, top right, top behind, bottom
+
+
+//--------------------------------------------------------------------------------------------------------------
+struct NavFlatArray
+{
+	int offset;							// bytes from the start of the NavFlatHeader
+	int count;
+};
+
+/**
+ * Everything in a version 17+ .nav file after the place directory.
+ * Areas, hiding spots and ladders are stored a field at a time in arrays indexed by their position in the
+ * file, and refer to each other by those indices (-1 for none).  The lists each area owns are stored
+ * back to back, with a "first" array of one entry per list plus one giving where each list starts.
+ * Every array starts on a NAV_FLAT_ALIGN boundary, so the whole block can be used in place once read.
+ */
+struct NavFlatHeader
+{
+	unsigned int id;							// NAV_FLAT_ID
+	unsigned int checksum;						// CRC32 of everything after the header
+	int dataSize;								// bytes after the header
+
+	NavFlatArray areaID;						// unsigned int
+	NavFlatArray areaAttributes;				// int
+	NavFlatArray areaNWCorner;					// Vector
+	NavFlatArray areaSECorner;					// Vector
+	NavFlatArray areaNEZ;						// float
+	NavFlatArray areaSWZ;						// float
+	NavFlatArray areaPlace;						// PlaceDirectory::IndexType
+	NavFlatArray areaEarliestOccupyTime;		// float, all areas for team 0, then team 1, ...
+	NavFlatArray areaLightIntensity;			// float, all areas for corner 0, then corner 1, ...
+	NavFlatArray areaInheritVisibility;			// int area index
+
+	NavFlatArray areaFirstConnect;				// int, per area per direction
+	NavFlatArray connectArea;					// int area index
+
+	NavFlatArray areaFirstHidingSpot;			// int, per area
+	NavFlatArray hidingSpotID;					// unsigned int
+	NavFlatArray hidingSpotPos;					// Vector
+	NavFlatArray hidingSpotFlags;				// unsigned char
+
+	NavFlatArray areaFirstEncounter;			// int, per area
+	NavFlatArray encounterFromArea;				// int area index
+	NavFlatArray encounterFromDir;				// unsigned char
+	NavFlatArray encounterToArea;				// int area index
+	NavFlatArray encounterToDir;				// unsigned char
+	NavFlatArray encounterFirstSpot;			// int, per encounter
+	NavFlatArray encounterSpot;					// int hiding spot index
+	NavFlatArray encounterSpotT;				// unsigned char, 0..255 along the encounter path
+
+	NavFlatArray areaFirstLadder;				// int, per area per ladder direction
+	NavFlatArray ladderConnect;					// int ladder index
+
+	NavFlatArray areaFirstVisible;				// int, per area
+	NavFlatArray visibleArea;					// int area index
+	NavFlatArray visibleAttributes;				// unsigned char
+
+	NavFlatArray ladderID;						// unsigned int
+	NavFlatArray ladderWidth;					// float
+	NavFlatArray ladderLength;					// float
+	NavFlatArray ladderTop;						// Vector
+	NavFlatArray ladderBottom;					// Vector
+	NavFlatArray ladderDir;						// int
+	NavFlatArray ladderArea;					// int area index, NAV_LADDER_AREAS per ladder
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Validates a flat mesh block in memory and hands out its arrays.  Does not copy or own the data.
+ */
+class CNavMeshFileView
+{
+public:
+	CNavMeshFileView( void ) : m_header( NULL ) { }
+
+	bool Init( const void *data, int size );				// check bounds, indices and checksum. Returns false if the block can't be used.
+	int GetSize( void ) const							{ return sizeof( NavFlatHeader ) + m_header->dataSize; }
+
+	int GetAreaCount( void ) const						{ return m_header->areaID.count; }
+	int GetHidingSpotCount( void ) const				{ return m_header->hidingSpotID.count; }
+	int GetLadderCount( void ) const					{ return m_header->ladderID.count; }
+
+	template < typename T >
+	const T *Get( NavFlatArray NavFlatHeader::*array ) const
+	{
+		return (const T *)( (const byte *)m_header + (m_header->*array).offset );
+	}
+
+	// return the range [*first, *last) of a per-area list
+	void GetRange( NavFlatArray NavFlatHeader::*firstArray, int list, int *first, int *last ) const
+	{
+		const int *start = Get< int >( firstArray );
+		*first = start[ list ];
+		*last = start[ list+1 ];
+	}
+
+	unsigned int GetAreaID( int index ) const			{ return ( index >= 0 ) ? Get< unsigned int >( &NavFlatHeader::areaID )[ index ] : 0; }
+	unsigned int GetHidingSpotID( int index ) const		{ return ( index >= 0 ) ? Get< unsigned int >( &NavFlatHeader::hidingSpotID )[ index ] : 0; }
+	unsigned int GetLadderID( int index ) const			{ return ( index >= 0 ) ? Get< unsigned int >( &NavFlatHeader::ladderID )[ index ] : 0; }
+
+private:
+	const NavFlatHeader *m_header;
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Collects the mesh a field at a time and lays it out as a flat block.
+ * Areas and ladders must be written in the order they were given to the constructor.
+ */
+class CNavMeshFileWriter
+{
+public:
+	CNavMeshFileWriter( const CUtlVector< CNavArea * > &areas, const CUtlVector< CNavLadder * > &ladders );
+
+	int GetAreaIndex( const CNavArea *area ) const;
+	int GetHidingSpotIndex( const HidingSpot *spot ) const;
+	int GetLadderIndex( const CNavLadder *ladder ) const;
+
+	void Write( CUtlBuffer &fileBuffer ) const;			// append the block, padded to start on a NAV_FLAT_ALIGN boundary
+
+	CUtlVector< unsigned int > m_areaID;
+	CUtlVector< int > m_areaAttributes;
+	CUtlVector< Vector > m_areaNWCorner;
+	CUtlVector< Vector > m_areaSECorner;
+	CUtlVector< float > m_areaNEZ;
+	CUtlVector< float > m_areaSWZ;
+	CUtlVector< unsigned short > m_areaPlace;
+	CUtlVector< float > m_areaEarliestOccupyTime[ MAX_NAV_TEAMS ];
+	CUtlVector< float > m_areaLightIntensity[ NUM_CORNERS ];
+	CUtlVector< int > m_areaInheritVisibility;
+
+	CUtlVector< int > m_areaFirstConnect;
+	CUtlVector< int > m_connectArea;
+
+	CUtlVector< int > m_areaFirstHidingSpot;
+	CUtlVector< unsigned int > m_hidingSpotID;
+	CUtlVector< Vector > m_hidingSpotPos;
+	CUtlVector< unsigned char > m_hidingSpotFlags;
+
+	CUtlVector< int > m_areaFirstEncounter;
+	CUtlVector< int > m_encounterFromArea;
+	CUtlVector< unsigned char > m_encounterFromDir;
+	CUtlVector< int > m_encounterToArea;
+	CUtlVector< unsigned char > m_encounterToDir;
+	CUtlVector< int > m_encounterFirstSpot;
+	CUtlVector< int > m_encounterSpot;
+	CUtlVector< unsigned char > m_encounterSpotT;
+
+	CUtlVector< int > m_areaFirstLadder;
+	CUtlVector< int > m_ladderConnect;
+
+	CUtlVector< int > m_areaFirstVisible;
+	CUtlVector< int > m_visibleArea;
+	CUtlVector< unsigned char > m_visibleAttributes;
+
+	CUtlVector< unsigned int > m_ladderID;
+	CUtlVector< float > m_ladderWidth;
+	CUtlVector< float > m_ladderLength;
+	CUtlVector< Vector > m_ladderTop;
+	CUtlVector< Vector > m_ladderBottom;
+	CUtlVector< int > m_ladderDir;
+	CUtlVector< int > m_ladderArea;
+
+private:
+	CUtlMap< const CNavArea *, int > m_areaIndex;
+	CUtlMap< const HidingSpot *, int > m_hidingSpotIndex;
+	const CUtlVector< CNavLadder * > &m_ladders;
+};
+
+
+#endif // _NAV_MESHFILE_H_
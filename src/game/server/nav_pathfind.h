@@ -15,6 +15,7 @@
 #include "tier0/vprof.h"
 #include "mathlib/ssemath.h"
 #include "nav_area.h"
+#include "nav_hierarchy.h"
 
 extern int g_DebugPathfindCounter;
 
@@ -96,6 +97,8 @@ public:
  * If 'goalPos' is NULL, will use the center of 'goalArea' as the goal position.
  * If 'maxPathLength' is nonzero, path building will stop when this length is reached.
  * Returns true if a path exists.
+ * The parent pointers are kept in the calling thread's CNavAreaSearchContext.  Threads with their own contexts
+ * can search at the same time, as long as the mesh doesn't change and the cost functor is safe to call from them.
  */
 #define IGNORE_NAV_BLOCKERS true
 template< typename CostFunctor >
@@ -108,12 +111,15 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 		*closestArea = startArea;
 	}
 
-	bool isDebug = ( g_DebugPathfindCounter-- > 0 );
+	// debug drawing only works from the main thread
+	bool isDebug = ThreadInMainThread() && ( g_DebugPathfindCounter-- > 0 );
 
 	if (startArea == NULL)
 		return false;
 
-	startArea->SetParent( NULL );
+	CNavAreaSearchContext *search = CNavAreaSearchContext::GetCurrent();
+
+	search->SetParent( startArea, NULL );
 
 	if (goalArea != NULL && goalArea->IsBlocked( teamID, ignoreNavBlockers ))
 		goalArea = NULL;
@@ -131,28 +137,28 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 	Vector actualGoalPos = (goalPos) ? *goalPos : goalArea->GetCenter();
 
 	// start search
-	CNavArea::ClearSearchLists();
+	search->ClearSearchLists();
 
 	// compute estimate of path length
 	/// @todo Cost might work as "manhattan distance"
-	startArea->SetTotalCost( (startArea->GetCenter() - actualGoalPos).Length() );
+	search->SetTotalCost( startArea, (startArea->GetCenter() - actualGoalPos).Length() );
 
 	float initCost = costFunc( startArea, NULL, NULL, NULL, -1.0f );	
 	if (initCost < 0.0f)
 		return false;
-	startArea->SetCostSoFar( initCost );
-	startArea->SetPathLengthSoFar( 0.0 );
+	search->SetCostSoFar( startArea, initCost );
+	search->SetPathLengthSoFar( startArea, 0.0 );
 
-	startArea->AddToOpenList();
+	search->AddToOpenList( startArea );
 
 	// keep track of the area we visit that is closest to the goal
-	float closestAreaDist = startArea->GetTotalCost();
+	float closestAreaDist = search->GetTotalCost( startArea );
 
 	// do A* search
-	while( !CNavArea::IsOpenListEmpty() )
+	while( !search->IsOpenListEmpty() )
 	{
 		// get next area to check
-		CNavArea *area = CNavArea::PopOpenList();
+		CNavArea *area = search->PopOpenList();
 
 		if ( isDebug )
 		{
@@ -329,7 +335,7 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 
 			// don't backtrack
 			Assert( newArea );
-			if ( newArea == area->GetParent() )
+			if ( newArea == search->GetParent( area ) )
 				continue;
 			if ( newArea == area ) // self neighbor?
 				continue;
@@ -346,13 +352,13 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 
 			// Safety check against a bogus functor.  The cost of the path
 			// A...B, C should always be at least as big as the path A...B.
-			Assert( newCostSoFar >= area->GetCostSoFar() );
+			Assert( newCostSoFar >= search->GetCostSoFar( area ) );
 
 			// And now that we've asserted, let's be a bit more defensive.
 			// Make sure that any jump to a new area incurs some pathfinsing
 			// cost, to avoid us spinning our wheels over insignificant cost
 			// benefit, floating point precision bug, or busted cost functor.
-			float minNewCostSoFar = area->GetCostSoFar() * 1.00001 + 0.00001;
+			float minNewCostSoFar = search->GetCostSoFar( area ) * 1.00001 + 0.00001;
 			newCostSoFar = Max( newCostSoFar, minNewCostSoFar );
 				
 			// stop if path length limit reached
@@ -360,14 +366,14 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 			{
 				// keep track of path length so far
 				float deltaLength = ( newArea->GetCenter() - area->GetCenter() ).Length();
-				float newLengthSoFar = area->GetPathLengthSoFar() + deltaLength;
+				float newLengthSoFar = search->GetPathLengthSoFar( area ) + deltaLength;
 				if ( newLengthSoFar > maxPathLength )
 					continue;
 				
-				newArea->SetPathLengthSoFar( newLengthSoFar );
+				search->SetPathLengthSoFar( newArea, newLengthSoFar );
 			}
 
-			if ( ( newArea->IsOpen() || newArea->IsClosed() ) && newArea->GetCostSoFar() <= newCostSoFar )
+			if ( ( search->IsOpen( newArea ) || search->IsClosed( newArea ) ) && search->GetCostSoFar( newArea ) <= newCostSoFar )
 			{
 				// this is a worse path - skip it
 				continue;
@@ -385,36 +391,93 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 					closestAreaDist = newCostRemaining;
 				}
 				
-				newArea->SetCostSoFar( newCostSoFar );
-				newArea->SetTotalCost( newCostSoFar + newCostRemaining );
+				search->SetCostSoFar( newArea, newCostSoFar );
+				search->SetTotalCost( newArea, newCostSoFar + newCostRemaining );
 
-				if ( newArea->IsClosed() )
-				{
-					newArea->RemoveFromClosedList();
-				}
+				// since "closed" is defined as visited (marked) and not on open list, there is nothing to remove it from
 
-				if ( newArea->IsOpen() )
+				if ( search->IsOpen( newArea ) )
 				{
 					// area already on open list, update the list order to keep costs sorted
-					newArea->UpdateOnOpenList();
+					search->UpdateOnOpenList( newArea );
 				}
 				else
 				{
-					newArea->AddToOpenList();
+					search->AddToOpenList( newArea );
 				}
 
-				newArea->SetParent( area, how );
+				search->SetParent( newArea, area, how );
 			}
 		}
 
 		// we have searched this area
-		area->AddToClosedList();
+		search->AddToClosedList( area );
 	}
 
 	return false;
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Cost functor that passes costs through from another, but treats areas outside the clusters
+ * of the last CNavAreaHierarchy::FindCorridor() as dead ends.
+ */
+template< typename CostFunctor >
+class NavAreaCorridorCost
+{
+public:
+	NavAreaCorridorCost( const CNavAreaHierarchy &hierarchy, CostFunctor &costFunc ) : m_hierarchy( hierarchy ), m_costFunc( costFunc ) { }
+
+	float operator() ( CNavArea *area, CNavArea *fromArea, const CNavLadder *ladder, const CFuncElevator *elevator, float length )
+	{
+		if ( !m_hierarchy.IsInCorridor( area ) )
+			return -1.0f;
+
+		return m_costFunc( area, fromArea, ladder, elevator, length );
+	}
+
+private:
+	const CNavAreaHierarchy &m_hierarchy;
+	CostFunctor &m_costFunc;
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Find path from startArea to goalArea as above, but search the cluster graph in 'hierarchy' first
+ * and only let the A* search into the clusters along the route it finds.
+ * If that fails (the cost functor or a team-specific block can rule out the route), the whole mesh is searched.
+ * If there is no route at all, fails without searching the mesh unless 'closestArea' is wanted.
+ * With a NULL 'hierarchy' (see CNavMesh::GetAreaHierarchy()) or no 'goalArea', this is the same as the search above.
+ * The hierarchy keeps its own search state, so only one of these may run at a time.
+ */
+template< typename CostFunctor >
+bool NavAreaBuildPath( CNavAreaHierarchy *hierarchy, CNavArea *startArea, CNavArea *goalArea, const Vector *goalPos, CostFunctor &costFunc, CNavArea **closestArea = NULL, float maxPathLength = 0.0f, int teamID = TEAM_ANY, bool ignoreNavBlockers = false )
+{
+	VPROF_BUDGET( "NavAreaBuildPath [hierarchical]", "NextBotSpiky" );
+
+	if ( hierarchy && startArea && goalArea && !goalArea->IsBlocked( teamID, ignoreNavBlockers ) )
+	{
+		CNavAreaHierarchy::CorridorResult result = hierarchy->FindCorridor( startArea, goalArea, teamID, ignoreNavBlockers );
+
+		if ( result == CNavAreaHierarchy::CORRIDOR_FOUND )
+		{
+			NavAreaCorridorCost< CostFunctor > corridorCost( *hierarchy, costFunc );
+			if ( NavAreaBuildPath( startArea, goalArea, goalPos, corridorCost, closestArea, maxPathLength, teamID, ignoreNavBlockers ) )
+				return true;
+		}
+		else if ( result == CNavAreaHierarchy::CORRIDOR_UNREACHABLE && closestArea == NULL )
+		{
+			startArea->SetParent( NULL );
+			return false;
+		}
+	}
+
+	return NavAreaBuildPath( startArea, goalArea, goalPos, costFunc, closestArea, maxPathLength, teamID, ignoreNavBlockers );
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Compute distance between two areas. Return -1 if can't reach 'endArea' from 'startArea'.
@@ -119,6 +119,7 @@ void CNavMesh::RemoveNodes( void )
 
 	// destroy navigation nodes created during map generation
 	CNavNode::CleanupGeneration();
+	m_sampleFrontier.RemoveAll();
 }
 
 
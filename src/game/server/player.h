@@ -1214,6 +1214,7 @@ private:
 
 	friend class CPlayerMove;
 	friend class CPlayerClass;
+	friend struct MovementPlayerState_t;
 
 	// Player name
 	char					m_szNetname[MAX_PLAYER_NAME_LENGTH];
@@ -315,6 +315,8 @@ void CPlayerMove::RunPostThink( CBasePlayer *player )
 }
 
 void CommentarySystem_PePlayerRunCommand( CBasePlayer *player, CUserCmd *ucmd );
+void MovementRecorder_PrePlayerMove( CBasePlayer *player, CUserCmd *ucmd, CMoveData *move );
+void MovementRecorder_PostPlayerMove( CBasePlayer *player, CMoveData *move );
 
 //-----------------------------------------------------------------------------
 // Purpose: Runs movement commands for the player
@@ -450,7 +452,9 @@ void CPlayerMove::RunCommand ( CBasePlayer *player, CUserCmd *ucmd, IMoveHelper
 	{
 		VPROF( "g_pGameMovement->ProcessMovement()" );
 		Assert( g_pGameMovement );
+		MovementRecorder_PrePlayerMove( player, ucmd, g_pMoveData );
 		g_pGameMovement->ProcessMovement( player, g_pMoveData );
+		MovementRecorder_PostPlayerMove( player, g_pMoveData );
 	}
 	else
 	{
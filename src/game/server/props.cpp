@@ -3066,6 +3066,7 @@ void CPhysicsProp::Spawn( )
 	{
 #ifdef MAPBASE
 		m_iClassname = gm_isz_class_PropPhysics;
+		gEntList.ReportEntityNameChanged( this );
 #else
 		SetClassname( "prop_physics" );
 #endif
@@ -3081,6 +3082,7 @@ void CPhysicsProp::Spawn( )
 	if ( EntIsClass( this, gm_isz_class_PropPhysicsOverride ) )
 	{
 		m_iClassname = gm_isz_class_PropPhysics;
+		gEntList.ReportEntityNameChanged( this );
 	}
 #else
 	if ( FClassnameIs( this, "prop_physics_override") )
@@ -53,6 +53,10 @@ ConVar hl2_episodic( "hl2_episodic", "0", FCVAR_REPLICATED );
 #include "tf_weaponbase.h"
 #endif // TF_DLL
 
+#ifdef MAPBASE
+#include "tier1/mapbase_matchers_base.h"
+#endif
+
 #ifdef MAPBASE_VSCRIPT
 #include "mapbase/vscript_funcs_shared.h"
 #endif
@@ -316,6 +320,15 @@ void CBaseEntity::ParseMapData( CEntityMapData *mapData )
 	{
 		do 
 		{
+#ifdef MAPBASE
+			// Compile regex targets now instead of on the first search that uses them.
+			// Outputs are skipped here; CEventAction handles their targets.
+			if ( value[0] == '@' && value[1] == '/' && !strchr( value, ',' ) )
+			{
+				Matcher_PrecacheRegex( value + 2 );
+			}
+#endif
+
 			KeyValue( keyName, value );
 		} 
 		while ( mapData->GetNextKey(keyName, value) );
@@ -461,7 +474,7 @@ bool CBaseEntity::KeyValue( const char *szKeyName, const char *szValue )
 	
 	if ( FStrEq( szKeyName, "targetname" ) )
 	{
-		m_iName = AllocPooledString( szValue );
+		SetName( AllocPooledString( szValue ) );
 		return true;
 	}
 
@@ -32,6 +32,7 @@
 	#include "doors.h"
 	#include "ai_basenpc.h"
 	#include "env_zoom.h"
+	#include "movehelper_server.h"
 
 	extern int TrainSpeed(int iSpeed, int iMax);
 	
@@ -678,6 +679,10 @@ void CBasePlayer::PlayStepSound( Vector &vecOrigin, surfacedata_t *psurface, flo
 	// during prediction play footstep sounds only once
 	if ( prediction->InPrediction() && !prediction->IsFirstTimePredicted() )
 		return;
+#else
+	// nor again for commands being replayed, even landings and jumps that force them
+	if ( MoveHelperServer()->IsReplaying() )
+		return;
 #endif
 
 	if ( !psurface )
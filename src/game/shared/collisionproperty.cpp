@@ -1366,6 +1366,11 @@ void CCollisionProperty::MarkPartitionHandleDirty()
 		s_DirtyKDTree.AddEntity( m_pOuter );
 	}
 
+#ifndef CLIENT_DLL
+	// The name search grid is keyed on origin, keep it up to date
+	gEntList.ReportEntityMoved( m_pOuter );
+#endif
+
 #ifdef CLIENT_DLL
 	GetOuter()->MarkRenderHandleDirty();
 	g_pClientShadowMgr->AddToDirtyShadowList( GetOuter() );
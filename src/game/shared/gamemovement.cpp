@@ -68,6 +68,8 @@ ConVar debug_latch_reset_onduck( "debug_latch_reset_onduck", "1", FCVAR_CHEAT );
 // [MD] I'll remove this eventually. For now, I want the ability to A/B the optimizations.
 bool g_bMovementOptimizations = true;
 
+static ConVar sv_movement_batch_traces( "sv_movement_batch_traces", "1", FCVAR_REPLICATED | FCVAR_DEVELOPMENTONLY, "Run the traces of a step or slide move against one list of nearby world leaves and entities" );
+
 // Roughly how often we want to update the info about the ground surface we're on.
 // We don't need to do this very often.
 #define CATEGORIZE_GROUND_SURFACE_INTERVAL			0.3f
@@ -629,6 +631,13 @@ CGameMovement::CGameMovement( void )
 	mv					= NULL;
 
 	memset( m_flStuckCheckTime, 0, sizeof(m_flStuckCheckTime) );
+
+	for ( int i = 0; i < PC_CELL_CACHE_SIZE; ++i )
+	{
+		m_PointContentsCells[ i ].framecount = -1;
+	}
+
+	m_bInTraceBatch		= false;
 }
 
 //-----------------------------------------------------------------------------
@@ -1529,6 +1538,11 @@ void CGameMovement::StepMove( Vector &vecDestination, trace_t &trace )
 	VectorCopy( mv->GetAbsOrigin(), vecPos );
 	VectorCopy( mv->m_vecVelocity, vecVel );
 
+	// Both slide moves stay within a frame's travel of here, plus a stair height up or down
+	float flReach = vecVel.Length() * gpGlobals->frametime;
+	Vector vecReach( flReach, flReach, flReach + player->m_Local.m_flStepSize + DIST_EPSILON );
+	bool bTraceBatch = BeginTraceBatch( vecPos + GetPlayerMins() - vecReach, vecPos + GetPlayerMaxs() + vecReach );
+
 	// Slide move down.
 	TryPlayerMove( &vecEndPos, &trace );
 	
@@ -1566,6 +1580,11 @@ void CGameMovement::StepMove( Vector &vecDestination, trace_t &trace )
 		
 	TracePlayerBBox( mv->GetAbsOrigin(), vecEndPos, PlayerSolidMask(), COLLISION_GROUP_PLAYER_MOVEMENT, trace );
 	
+	if ( bTraceBatch )
+	{
+		EndTraceBatch();
+	}
+
 	// If we are not on the ground any more then use the original movement attempt.
 	if ( trace.plane.normal[2] < 0.7 )
 	{
@@ -2589,6 +2608,15 @@ int CGameMovement::TryPlayerMove( Vector *pFirstDest, trace_t *pFirstTrace )
 
 	new_velocity.Init();
 
+	// Clipping against planes doesn't speed the player up, so the bumps stay within a frame's travel of here
+	bool bTraceBatch = false;
+	float flReach = primal_velocity.Length() * time_left;
+	if ( flReach > 0.0f )
+	{
+		Vector vecReach( flReach, flReach, flReach );
+		bTraceBatch = BeginTraceBatch( mv->GetAbsOrigin() + GetPlayerMins() - vecReach, mv->GetAbsOrigin() + GetPlayerMaxs() + vecReach );
+	}
+
 	for (bumpcount=0 ; bumpcount < numbumps; bumpcount++)
 	{
 		if ( mv->m_vecVelocity.Length() == 0.0 )
@@ -2631,6 +2659,10 @@ int CGameMovement::TryPlayerMove( Vector *pFirstDest, trace_t *pFirstTrace )
 		{	
 			// entity is trapped in another solid
 			VectorCopy (vec3_origin, mv->m_vecVelocity);
+			if ( bTraceBatch )
+			{
+				EndTraceBatch();
+			}
 			return 4;
 		}
 
@@ -2794,6 +2826,11 @@ int CGameMovement::TryPlayerMove( Vector *pFirstDest, trace_t *pFirstTrace )
 		}
 	}
 
+	if ( bTraceBatch )
+	{
+		EndTraceBatch();
+	}
+
 	if ( allFraction == 0 )
 	{
 		VectorCopy (vec3_origin, mv->m_vecVelocity);
@@ -3494,7 +3531,18 @@ int CGameMovement::GetPointContentsCached( const Vector &point, int slot )
 
 		if ( m_CachedGetPointContents[ idx ][ slot ] == -9999 || point.DistToSqr( m_CachedGetPointContentsPoint[ idx ][ slot ] ) > 1 )
 		{
-			m_CachedGetPointContents[ idx ][ slot ] = enginetrace->GetPointContents ( point );
+			// See if anyone looked up a point this close in the same cell this frame.  Brush entities
+			// only move between frames, so older lookups are ignored.
+			unsigned int hash = (unsigned int)Floor2Int( point.x ) * 73856093u ^ (unsigned int)Floor2Int( point.y ) * 19349663u ^ (unsigned int)Floor2Int( point.z ) * 83492791u;
+			PointContentsCell_t &cell = m_PointContentsCells[ hash & ( PC_CELL_CACHE_SIZE - 1 ) ];
+			if ( cell.framecount != gpGlobals->framecount || point.DistToSqr( cell.point ) > 1 )
+			{
+				cell.point = point;
+				cell.contents = enginetrace->GetPointContents ( point );
+				cell.framecount = gpGlobals->framecount;
+			}
+
+			m_CachedGetPointContents[ idx ][ slot ] = cell.contents;
 			m_CachedGetPointContentsPoint[ idx ][ slot ] = point;
 		}
 		
@@ -3848,7 +3896,12 @@ void CGameMovement::CategorizePosition( void )
 		if ( !pm.m_pEnt || pm.plane.normal[2] < 0.7 )
 		{
 			// Test four sub-boxes, to see if any of them would have found shallower slope we could actually stand on
+			bool bTraceBatch = BeginTraceBatch( point + GetPlayerMins(), bumpOrigin + GetPlayerMaxs() );
 			TryTouchGroundInQuadrants( bumpOrigin, point, MASK_PLAYERSOLID, COLLISION_GROUP_PLAYER_MOVEMENT, pm );
+			if ( bTraceBatch )
+			{
+				EndTraceBatch();
+			}
 
 			if ( !pm.m_pEnt || pm.plane.normal[2] < 0.7 )
 			{
@@ -4926,8 +4979,66 @@ void CGameMovement::TracePlayerBBox( const Vector& start, const Vector& end, uns
 
 	Ray_t ray;
 	ray.Init( start, end, GetPlayerMins(), GetPlayerMaxs() );
-	UTIL_TraceRay( ray, fMask, mv->m_nPlayerHandle.Get(), collisionGroup, &pm );
+	TraceMovementRay( ray, fMask, collisionGroup, pm );
+}
 
+//-----------------------------------------------------------------------------
+// Purpose: Gather the world leaves and entities in a box for the traces that follow.
+//			A little extra is gathered so rays touching the sides of the box don't
+//			depend on how the partition rounds.
+//-----------------------------------------------------------------------------
+bool CGameMovement::BeginTraceBatch( const Vector &vecMins, const Vector &vecMaxs )
+{
+	if ( m_bInTraceBatch || !g_bMovementOptimizations || !sv_movement_batch_traces.GetBool() )
+		return false;
+
+	Vector vecBloat( 1.0f, 1.0f, 1.0f );
+	m_TraceListData.Reset();
+	enginetrace->SetupLeafAndEntityListBox( vecMins - vecBloat, vecMaxs + vecBloat, m_TraceListData );
+
+	m_vecTraceBatchMins = vecMins;
+	m_vecTraceBatchMaxs = vecMaxs;
+	m_bInTraceBatch = true;
+	return true;
+}
+
+void CGameMovement::EndTraceBatch( void )
+{
+	Assert( m_bInTraceBatch );
+	m_TraceListData.Reset();
+	m_bInTraceBatch = false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Trace against the open batch if the ray's swept bounds are inside its box, else the whole world
+//-----------------------------------------------------------------------------
+void CGameMovement::TraceMovementRay( const Ray_t &ray, unsigned int fMask, int collisionGroup, trace_t &pm )
+{
+	if ( m_bInTraceBatch )
+	{
+		Vector vecStart = ray.m_Start;
+		Vector vecEnd = vecStart + ray.m_Delta;
+		Vector vecMins, vecMaxs;
+		VectorMin( vecStart, vecEnd, vecMins );
+		VectorMax( vecStart, vecEnd, vecMaxs );
+		vecMins -= ray.m_Extents;
+		vecMaxs += ray.m_Extents;
+
+		if ( vecMins.x >= m_vecTraceBatchMins.x && vecMins.y >= m_vecTraceBatchMins.y && vecMins.z >= m_vecTraceBatchMins.z &&
+			 vecMaxs.x <= m_vecTraceBatchMaxs.x && vecMaxs.y <= m_vecTraceBatchMaxs.y && vecMaxs.z <= m_vecTraceBatchMaxs.z )
+		{
+			CTraceFilterSimple traceFilter( mv->m_nPlayerHandle.Get(), collisionGroup );
+			enginetrace->TraceRayAgainstLeafAndEntityList( ray, m_TraceListData, fMask, &traceFilter, &pm );
+
+			if ( r_visualizetraces.GetBool() )
+			{
+				DebugDrawLine( pm.startpos, pm.endpos, 255, 0, 0, true, -1.0f );
+			}
+			return;
+		}
+	}
+
+	UTIL_TraceRay( ray, fMask, mv->m_nPlayerHandle.Get(), collisionGroup, &pm );
 }
 
 
@@ -4941,6 +5052,6 @@ void  CGameMovement::TryTouchGround( const Vector& start, const Vector& end, con
 
 	Ray_t ray;
 	ray.Init( start, end, mins, maxs );
-	UTIL_TraceRay( ray, fMask, mv->m_nPlayerHandle.Get(), collisionGroup, &pm );
+	TraceMovementRay( ray, fMask, collisionGroup, pm );
 }
 
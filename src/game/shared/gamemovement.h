@@ -217,6 +217,12 @@ protected:
 	void ResetGetPointContentsCache();
 	int GetPointContentsCached( const Vector &point, int slot );
 
+	// Traces between these gather the world leaves and entities in the box once, so
+	// each one doesn't search the world again.  Returns false if a batch is already open.
+	bool			BeginTraceBatch( const Vector &vecMins, const Vector &vecMaxs );
+	void			EndTraceBatch( void );
+	void			TraceMovementRay( const Ray_t &ray, unsigned int fMask, int collisionGroup, trace_t &pm );
+
 	// Ducking
 	virtual void	Duck( void );
 	virtual void	HandleDuckingSpeedCrop();
@@ -275,6 +281,25 @@ protected:
 	int m_CachedGetPointContents[ MAX_PLAYERS ][ MAX_PC_CACHE_SLOTS ];
 	Vector m_CachedGetPointContentsPoint[ MAX_PLAYERS ][ MAX_PC_CACHE_SLOTS ];	
 
+	enum
+	{
+		PC_CELL_CACHE_SIZE = 64,	// power of two
+	};
+
+	// Contents of points looked up this frame by any player, hashed by the unit cell they are in
+	struct PointContentsCell_t
+	{
+		Vector	point;
+		int		contents;
+		int		framecount;
+	};
+	PointContentsCell_t m_PointContentsCells[ PC_CELL_CACHE_SIZE ];
+
+	CTraceListData	m_TraceListData;
+	bool			m_bInTraceBatch;
+	Vector			m_vecTraceBatchMins;
+	Vector			m_vecTraceBatchMaxs;
+
 	Vector			m_vecProximityMins;		// Used to be globals in sv_user.cpp.
 	Vector			m_vecProximityMaxs;
 
@@ -21,6 +21,8 @@
 #include "predictioncopy.h"
 #include "engine/ivmodelinfo.h"
 #include "tier1/fmtstr.h"
+#include "utlmap.h"
+#include "mathlib/ssemath.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -1373,6 +1375,372 @@ void CPredictionCopy::DetermineWatchField( const char *operation, int entindex,
 	m_pWatchField = FindFieldByName( pwatchvar.GetString(), dmap );
 }
 
+static ConVar cl_pred_copyplan( "cl_pred_copyplan", "1", 0, "Copy and check prediction data with precompiled per-datamap plans instead of walking the field descriptions." );
+
+//-----------------------------------------------------------------------------
+// Purpose: The fields TransferData would visit for one datamap and copy type,
+//  flattened into byte ranges.  Adjacent fields are merged, so most of a
+//  class's prediction data copies with a handful of memcpys.
+//-----------------------------------------------------------------------------
+class CPredictionCopyPlan
+{
+public:
+	struct Span_t
+	{
+		int		destOffset;
+		int		srcOffset;
+		int		size;
+		bool	isFloat;		// compared as floats, so +0 and -0 match as they do in CompareFloat
+	};
+
+	CPredictionCopyPlan() : m_bValid( false ) {}
+
+	bool Build( datamap_t *dmap, int type, int destOffsetIndex, int srcOffsetIndex );
+
+	void Copy( void *dest, void const *src ) const;
+	bool IsIdentical( void const *dest, void const *src ) const;
+
+	bool IsValid() const { return m_bValid; }
+
+private:
+	bool AddFields_R( int chain_count, typedescription_t *pFields, int fieldCount, int destBase, int srcBase );
+	static void AddSpan( CUtlVector< Span_t > &spans, int destOffset, int srcOffset, int size, bool isFloat );
+	static void MergeSpans( CUtlVector< Span_t > &spans );
+
+	bool	m_bValid;
+	int		m_nType;
+	int		m_nDestOffsetIndex;
+	int		m_nSrcOffsetIndex;
+
+	CUtlVector< Span_t >	m_CopySpans;
+	CUtlVector< Span_t >	m_CompareSpans;		// fields that are error checked
+};
+
+void CPredictionCopyPlan::AddSpan( CUtlVector< Span_t > &spans, int destOffset, int srcOffset, int size, bool isFloat )
+{
+	if ( size <= 0 )
+		return;
+
+	Span_t &span = spans[ spans.AddToTail() ];
+	span.destOffset = destOffset;
+	span.srcOffset = srcOffset;
+	span.size = size;
+	span.isFloat = isFloat;
+}
+
+static int __cdecl SpanCompare( const CPredictionCopyPlan::Span_t *lhs, const CPredictionCopyPlan::Span_t *rhs )
+{
+	if ( lhs->destOffset != rhs->destOffset )
+		return lhs->destOffset - rhs->destOffset;
+	return lhs->srcOffset - rhs->srcOffset;
+}
+
+void CPredictionCopyPlan::MergeSpans( CUtlVector< Span_t > &spans )
+{
+	if ( spans.Count() < 2 )
+		return;
+
+	// Fields don't overlap, so the order they're copied in doesn't matter
+	spans.Sort( SpanCompare );
+
+	int nMerged = 0;
+	for ( int i = 1; i < spans.Count(); i++ )
+	{
+		Span_t &last = spans[ nMerged ];
+		const Span_t &span = spans[ i ];
+		if ( span.isFloat == last.isFloat &&
+			span.destOffset == last.destOffset + last.size &&
+			span.srcOffset == last.srcOffset + last.size )
+		{
+			last.size += span.size;
+			continue;
+		}
+
+		spans[ ++nMerged ] = span;
+	}
+
+	spans.SetCountNonDestructively( nMerged + 1 );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Walk the fields the way CopyFields does and record what it would copy.
+// Output : false if a field needs more than a memcpy (strings, or embedded pointers
+//  that have to be followed), in which case TransferData keeps walking the fields.
+//-----------------------------------------------------------------------------
+bool CPredictionCopyPlan::AddFields_R( int chain_count, typedescription_t *pFields, int fieldCount, int destBase, int srcBase )
+{
+	for ( int i = 0; i < fieldCount; i++ )
+	{
+		typedescription_t *pField = &pFields[ i ];
+		int flags = pField->flags;
+
+		// Mark any subchains first
+		if ( pField->override_field != NULL )
+		{
+			pField->override_field->override_count = chain_count;
+		}
+
+		// Skip this field?
+		if ( pField->override_count == chain_count )
+			continue;
+
+		if ( pField->fieldType != FIELD_EMBEDDED )
+		{
+			if ( flags & FTYPEDESC_PRIVATE )
+				continue;
+
+			if ( m_nType == PC_NON_NETWORKED_ONLY && ( flags & FTYPEDESC_INSENDTABLE ) )
+				continue;
+
+			if ( m_nType == PC_NETWORKED_ONLY && !( flags & FTYPEDESC_INSENDTABLE ) )
+				continue;
+		}
+
+		int destOffset = destBase + pField->fieldOffset[ m_nDestOffsetIndex ];
+		int srcOffset = srcBase + pField->fieldOffset[ m_nSrcOffsetIndex ];
+		int fieldSize = pField->fieldSize;
+
+		int size = 0;
+		bool isFloat = false;
+
+		switch( pField->fieldType )
+		{
+		case FIELD_EMBEDDED:
+			// Unpacked data holds a pointer to the embedded object
+			if ( ( flags & FTYPEDESC_PTR ) && ( m_nDestOffsetIndex == TD_OFFSET_NORMAL || m_nSrcOffsetIndex == TD_OFFSET_NORMAL ) )
+				return false;
+
+			if ( !AddFields_R( chain_count, pField->td->dataDesc, pField->td->dataNumFields, destOffset, srcOffset ) )
+				return false;
+			continue;
+
+		case FIELD_FLOAT:
+			size = sizeof( float ) * fieldSize;
+			isFloat = true;
+			break;
+		case FIELD_VECTOR:
+			size = sizeof( Vector ) * fieldSize;
+			isFloat = true;
+			break;
+		case FIELD_QUATERNION:
+			size = sizeof( Quaternion ) * fieldSize;
+			isFloat = true;
+			break;
+		case FIELD_COLOR32:
+			size = 4 * fieldSize;
+			break;
+		case FIELD_BOOLEAN:
+			size = sizeof( bool ) * fieldSize;
+			break;
+		case FIELD_INTEGER:
+			size = sizeof( int ) * fieldSize;
+			break;
+		case FIELD_SHORT:
+			size = sizeof( short ) * fieldSize;
+			break;
+		case FIELD_CHARACTER:
+			size = fieldSize;
+			break;
+		case FIELD_EHANDLE:
+			size = sizeof( EHANDLE ) * fieldSize;
+			break;
+
+		// Not copied by CopyFields either
+		case FIELD_VOID:
+		case FIELD_TIME:
+		case FIELD_TICK:
+		case FIELD_MODELINDEX:
+		case FIELD_MODELNAME:
+		case FIELD_SOUNDNAME:
+		case FIELD_CUSTOM:
+		case FIELD_CLASSPTR:
+		case FIELD_EDICT:
+		case FIELD_POSITION_VECTOR:
+		case FIELD_FUNCTION:
+			continue;
+
+		case FIELD_STRING:
+		default:
+			return false;
+		}
+
+		AddSpan( m_CopySpans, destOffset, srcOffset, size, isFloat );
+
+		if ( !( flags & FTYPEDESC_NOERRORCHECK ) )
+		{
+			AddSpan( m_CompareSpans, destOffset, srcOffset, size, isFloat );
+		}
+	}
+
+	return true;
+}
+
+bool CPredictionCopyPlan::Build( datamap_t *dmap, int type, int destOffsetIndex, int srcOffsetIndex )
+{
+	m_nType = type;
+	m_nDestOffsetIndex = destOffsetIndex;
+	m_nSrcOffsetIndex = srcOffsetIndex;
+	m_CopySpans.RemoveAll();
+	m_CompareSpans.RemoveAll();
+
+	// Marks overrides the same way TransferData does, on a chain of its own
+	int chain_count = ++g_nChainCount;
+
+	m_bValid = true;
+	for ( datamap_t *pMap = dmap; pMap && m_bValid; pMap = pMap->baseMap )
+	{
+		m_bValid = AddFields_R( chain_count, pMap->dataDesc, pMap->dataNumFields, 0, 0 );
+	}
+
+	if ( !m_bValid )
+	{
+		m_CopySpans.Purge();
+		m_CompareSpans.Purge();
+		return false;
+	}
+
+	MergeSpans( m_CopySpans );
+	MergeSpans( m_CompareSpans );
+	return true;
+}
+
+void CPredictionCopyPlan::Copy( void *dest, void const *src ) const
+{
+	for ( int i = 0; i < m_CopySpans.Count(); i++ )
+	{
+		const Span_t &span = m_CopySpans[ i ];
+		memcpy( (char *)dest + span.destOffset, (const char *)src + span.srcOffset, span.size );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns true if every error checked field matches exactly, with floats
+//  compared four at a time.  Anything else needs the full field by field check.
+//-----------------------------------------------------------------------------
+bool CPredictionCopyPlan::IsIdentical( void const *dest, void const *src ) const
+{
+	for ( int i = 0; i < m_CompareSpans.Count(); i++ )
+	{
+		const Span_t &span = m_CompareSpans[ i ];
+		const char *pDest = (const char *)dest + span.destOffset;
+		const char *pSrc = (const char *)src + span.srcOffset;
+
+		if ( !span.isFloat )
+		{
+			if ( memcmp( pDest, pSrc, span.size ) )
+				return false;
+			continue;
+		}
+
+		const float *pDestFloats = (const float *)pDest;
+		const float *pSrcFloats = (const float *)pSrc;
+		int nFloats = span.size / sizeof( float );
+
+		int j = 0;
+		for ( ; j + 4 <= nFloats; j += 4 )
+		{
+			fltx4 equal = CmpEqSIMD( LoadUnalignedSIMD( pDestFloats + j ), LoadUnalignedSIMD( pSrcFloats + j ) );
+			if ( TestSignSIMD( equal ) != 0xf )
+				return false;
+		}
+
+		for ( ; j < nFloats; j++ )
+		{
+			if ( pDestFloats[ j ] != pSrcFloats[ j ] )
+				return false;
+		}
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Plans are built the first time each datamap is copied a particular way and
+// kept for the life of the dll.
+//-----------------------------------------------------------------------------
+struct PredictionCopyPlanKey_t
+{
+	datamap_t	*dmap;
+	int			mode;		// copy type and offset indices
+};
+
+static bool PredictionCopyPlanKeyLessFunc( const PredictionCopyPlanKey_t &lhs, const PredictionCopyPlanKey_t &rhs )
+{
+	if ( lhs.dmap != rhs.dmap )
+		return lhs.dmap < rhs.dmap;
+	return lhs.mode < rhs.mode;
+}
+
+class CPredictionCopyPlans
+{
+public:
+	CPredictionCopyPlans() : m_Plans( 0, 0, PredictionCopyPlanKeyLessFunc ) {}
+	~CPredictionCopyPlans()
+	{
+		FOR_EACH_MAP_FAST( m_Plans, i )
+		{
+			delete m_Plans[ i ];
+		}
+	}
+
+	const CPredictionCopyPlan *Find( datamap_t *dmap, int type, int destOffsetIndex, int srcOffsetIndex )
+	{
+		PredictionCopyPlanKey_t key;
+		key.dmap = dmap;
+		key.mode = ( type << 2 ) | ( destOffsetIndex << 1 ) | srcOffsetIndex;
+
+		int i = m_Plans.Find( key );
+		if ( i == m_Plans.InvalidIndex() )
+		{
+			CPredictionCopyPlan *pPlan = new CPredictionCopyPlan;
+			pPlan->Build( dmap, type, destOffsetIndex, srcOffsetIndex );
+			i = m_Plans.Insert( key, pPlan );
+		}
+
+		return m_Plans[ i ];
+	}
+
+private:
+	CUtlMap< PredictionCopyPlanKey_t, CPredictionCopyPlan * > m_Plans;
+};
+
+static CPredictionCopyPlans g_PredictionCopyPlans;
+
+//-----------------------------------------------------------------------------
+// Purpose: Handles the two common cases, a plain copy and an error check that
+//  finds nothing, with the datamap's plan.
+// Output : false if the fields have to be walked instead.
+//-----------------------------------------------------------------------------
+bool CPredictionCopy::TransferDataByPlan( datamap_t *dmap )
+{
+	// Describing and watching fields need the walk
+	if ( m_pWatchField || m_bDescribeFields || m_FieldCompareFunc )
+		return false;
+
+	// Packed offsets are only there once the entity has its intermediate data
+	if ( ( m_nDestOffsetIndex == TD_OFFSET_PACKED || m_nSrcOffsetIndex == TD_OFFSET_PACKED ) && !dmap->packed_offsets_computed )
+		return false;
+
+	const CPredictionCopyPlan *pPlan = g_PredictionCopyPlans.Find( dmap, m_nType, m_nDestOffsetIndex, m_nSrcOffsetIndex );
+	if ( !pPlan->IsValid() )
+		return false;
+
+	if ( !m_bErrorCheck )
+	{
+		if ( m_bPerformCopy )
+		{
+			pPlan->Copy( m_pDest, m_pSrc );
+		}
+		return true;
+	}
+
+	// Copying only what differs, or reporting what differs, is left to the walk
+	if ( m_bPerformCopy )
+		return false;
+
+	return pPlan->IsIdentical( m_pDest, m_pSrc );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : *operation - 
@@ -1391,6 +1759,9 @@ int CPredictionCopy::TransferData( const char *operation, int entindex, datamap_
 	
 	DetermineWatchField( operation, entindex, dmap );
 
+	if ( cl_pred_copyplan.GetBool() && TransferDataByPlan( dmap ) )
+		return m_nErrorCount;
+
 	TransferData_R( g_nChainCount, dmap );
 
 	return m_nErrorCount;
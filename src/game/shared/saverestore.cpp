@@ -24,6 +24,8 @@
 #include "vphysics/object_hash.h"
 #include "datacache/imdlcache.h"
 #include "tier0/vprof.h"
+#include "tier0/tslist.h"
+#include "vstdlib/jobthread.h"
 
 #if !defined( CLIENT_DLL )
 
@@ -182,6 +184,249 @@ inputfunc_t *UTIL_FunctionFromName( datamap_t *pMap, const char *pName )
 	return NULL;
 }
 
+//-----------------------------------------------------------------------------
+//
+// CSaveRestorePlan
+//
+// A flattened form of a typedescription_t array, built the first time the
+// array is saved or restored.  Saved fields of plain data types that lie back
+// to back in memory are merged into runs, which are checked for being empty
+// and cleared in one pass over their bytes.  Embedded structures without base
+// classes carry their own plan, so they don't go back through the datamap.
+// Everything else takes the per-field path.  The bytes written are the same
+// either way.
+//
+// Plans are cached by the contents of the fields, not their address, and keep
+// a copy of them: the utl* save/restore ops describe their elements with
+// arrays built on the stack.
+//
+//-----------------------------------------------------------------------------
+
+ConVar save_plans( "save_plans", "1", 0, "Save and restore datamaps using cached field plans" );
+
+//-------------------------------------
+// Purpose: A lone field has nothing to merge, and the utl* ops describe all
+//			their elements with one field sized to the current count, which
+//			would add a plan for every count seen
+
+static bool ShouldUseSavePlan( int fieldCount )
+{
+	return ( fieldCount > 1 && save_plans.GetBool() );
+}
+
+struct SavePlanStep_t
+{
+	enum
+	{
+		STEP_RUN,				// plain data fields, back to back in memory
+		STEP_EMBEDDED,			// embedded structure with its own plan
+		STEP_FIELD,				// anything else
+	};
+
+	int						type;
+	int						iField;			// first field
+	int						nFields;		// STEP_RUN, fields from iField up to the last one in the run
+	int						offset;			// STEP_RUN
+	int						nBytes;			// STEP_RUN
+};
+
+class CSaveRestorePlan
+{
+public:
+	static const CSaveRestorePlan *Get( typedescription_t *pFields, int fieldCount );
+
+	typedescription_t		*m_pFields;			// m_Fields.Base()
+	int						m_nFields;
+	CUtlVector<typedescription_t> m_Fields;
+	CUtlVector<SavePlanStep_t> m_Steps;
+	CUtlVector<int>			m_FieldBytes;		// per field, the size of its data if it is read and written as is, else 0
+	CUtlVector<const CSaveRestorePlan *> m_FieldPlans;	// per field, the plan of an embedded structure with one, else NULL
+
+private:
+	CSaveRestorePlan( typedescription_t *pFields, int fieldCount );
+};
+
+//-------------------------------------
+
+static bool IsPlainDataField( const typedescription_t *pField )
+{
+	switch ( pField->fieldType )
+	{
+	case FIELD_FLOAT:
+	case FIELD_INTEGER:
+	case FIELD_BOOLEAN:
+	case FIELD_SHORT:
+	case FIELD_CHARACTER:
+	case FIELD_COLOR32:
+	case FIELD_VECTOR:
+	case FIELD_QUATERNION:
+	case FIELD_VMATRIX:
+	case FIELD_INTERVAL:
+		// Fields with the wrong size go the long way, to get the warning
+		return ( pField->fieldSize > 0 && pField->fieldSizeInBytes == pField->fieldSize * gSizes[pField->fieldType] );
+
+	default:
+		return false;
+	}
+}
+
+//-------------------------------------
+// Purpose: Same result as CSave::DataEmpty, a word at a time
+
+static bool IsZeroData( const char *pData, int size )
+{
+	int i = 0;
+	for ( ; i + (int)sizeof( int ) <= size; i += sizeof( int ) )
+	{
+		int word;
+		memcpy( &word, pData + i, sizeof( int ) );
+		if ( word )
+			return false;
+	}
+
+	for ( ; i < size; i++ )
+	{
+		if ( pData[i] )
+			return false;
+	}
+	return true;
+}
+
+//-------------------------------------
+
+CSaveRestorePlan::CSaveRestorePlan( typedescription_t *pFields, int fieldCount )
+ :	m_nFields( fieldCount )
+{
+	m_Fields.CopyArray( pFields, fieldCount );
+	m_pFields = m_Fields.Base();
+	pFields = m_pFields;
+
+	m_FieldBytes.SetCount( fieldCount );
+	m_FieldPlans.SetCount( fieldCount );
+
+	for ( int i = 0; i < fieldCount; i++ )
+	{
+		typedescription_t *pField = &pFields[i];
+
+		m_FieldBytes[i] = IsPlainDataField( pField ) ? pField->fieldSizeInBytes : 0;
+		m_FieldPlans[i] = NULL;
+		if ( pField->fieldType == FIELD_EMBEDDED && !( pField->flags & FTYPEDESC_PTR ) && pField->td && !pField->td->baseMap )
+		{
+			m_FieldPlans[i] = Get( pField->td->dataDesc, pField->td->dataNumFields );
+		}
+
+		if ( !( pField->flags & FTYPEDESC_SAVE ) || pField->fieldType == FIELD_VOID )
+			continue;
+
+		// Global fields are left alone on some restores, so they can't be cleared with the fields around them
+		int offset = pField->fieldOffset[ TD_OFFSET_NORMAL ];
+		if ( m_FieldBytes[i] && !( pField->flags & FTYPEDESC_GLOBAL ) )
+		{
+			SavePlanStep_t *pLast = m_Steps.Count() ? &m_Steps.Tail() : NULL;
+			if ( pLast && pLast->type == SavePlanStep_t::STEP_RUN && pLast->offset + pLast->nBytes == offset )
+			{
+				pLast->nFields = i - pLast->iField + 1;
+				pLast->nBytes += m_FieldBytes[i];
+				continue;
+			}
+		}
+
+		SavePlanStep_t &step = m_Steps[ m_Steps.AddToTail() ];
+		step.iField = i;
+		step.nFields = 1;
+		step.offset = offset;
+		step.nBytes = m_FieldBytes[i];
+
+		if ( m_FieldBytes[i] && !( pField->flags & FTYPEDESC_GLOBAL ) )
+		{
+			step.type = SavePlanStep_t::STEP_RUN;
+		}
+		else if ( m_FieldPlans[i] )
+		{
+			step.type = SavePlanStep_t::STEP_EMBEDDED;
+		}
+		else
+		{
+			step.type = SavePlanStep_t::STEP_FIELD;
+		}
+	}
+}
+
+//-------------------------------------
+
+struct SavePlanKey_t
+{
+	const typedescription_t	*pFields;
+	int						nFields;
+};
+
+//-------------------------------------
+// Purpose: Orders fields by everything a plan or the per-field path reads from them
+
+#define SAVEPLAN_COMPARE( member ) \
+	if ( lhs.member != rhs.member ) \
+		return ( lhs.member < rhs.member ) ? -1 : 1
+
+static int SavePlanCompareField( const typedescription_t &lhs, const typedescription_t &rhs )
+{
+	SAVEPLAN_COMPARE( fieldType );
+	SAVEPLAN_COMPARE( fieldOffset[ TD_OFFSET_NORMAL ] );
+	SAVEPLAN_COMPARE( fieldSize );
+	SAVEPLAN_COMPARE( flags );
+	SAVEPLAN_COMPARE( fieldSizeInBytes );
+	SAVEPLAN_COMPARE( fieldName );
+	SAVEPLAN_COMPARE( pSaveRestoreOps );
+	SAVEPLAN_COMPARE( td );
+	return 0;
+}
+
+#undef SAVEPLAN_COMPARE
+
+static bool SavePlanKeyLessFunc( const SavePlanKey_t &lhs, const SavePlanKey_t &rhs )
+{
+	if ( lhs.nFields != rhs.nFields )
+		return lhs.nFields < rhs.nFields;
+
+	for ( int i = 0; i < lhs.nFields; i++ )
+	{
+		int result = SavePlanCompareField( lhs.pFields[i], rhs.pFields[i] );
+		if ( result )
+			return result < 0;
+	}
+	return false;
+}
+
+class CSaveRestorePlanCache
+{
+public:
+	CSaveRestorePlanCache() : m_Plans( SavePlanKeyLessFunc ) {}
+	~CSaveRestorePlanCache() { m_Plans.PurgeAndDeleteElements(); }
+
+	CThreadFastMutex		m_Mutex;
+	CUtlMap<SavePlanKey_t, CSaveRestorePlan *> m_Plans;
+};
+
+static CSaveRestorePlanCache g_SaveRestorePlans;
+
+//-------------------------------------
+
+const CSaveRestorePlan *CSaveRestorePlan::Get( typedescription_t *pFields, int fieldCount )
+{
+	// Staged saves get here from a worker thread as well. The lock is taken again for embedded structures.
+	AUTO_LOCK( g_SaveRestorePlans.m_Mutex );
+
+	SavePlanKey_t key = { pFields, fieldCount };
+	unsigned short i = g_SaveRestorePlans.m_Plans.Find( key );
+	if ( i != g_SaveRestorePlans.m_Plans.InvalidIndex() )
+		return g_SaveRestorePlans.m_Plans[i];
+
+	// Keyed on the plan's own copy, the caller's fields may not outlive the call
+	CSaveRestorePlan *pPlan = new CSaveRestorePlan( pFields, fieldCount );
+	key.pFields = pPlan->m_pFields;
+	g_SaveRestorePlans.m_Plans.Insert( key, pPlan );
+	return pPlan;
+}
+
 //-----------------------------------------------------------------------------
 //
 // CSave
@@ -191,7 +436,8 @@ inputfunc_t *UTIL_FunctionFromName( datamap_t *pMap, const char *pName )
 CSave::CSave( CSaveRestoreData *pdata )
  :	m_pData(pdata),
 	m_pGameInfo( pdata ),
-	m_bAsync( pdata->bAsync )
+	m_bAsync( pdata->bAsync ),
+	m_pSymbolMutex( NULL )
 {
 	m_BlockStartStack.EnsureCapacity( 32 );
 
@@ -816,6 +1062,12 @@ bool CSave::WriteField( const char *pname, void *pData, datamap_t *pRootMap, typ
 
 int CSave::WriteFields( const char *pname, const void *pBaseData, datamap_t *pRootMap, typedescription_t *pFields, int fieldCount )
 {
+	if ( ShouldUseSavePlan( fieldCount ) )
+	{
+		WritePlannedFields( pname, (const char *)pBaseData, pRootMap, CSaveRestorePlan::Get( pFields, fieldCount ) );
+		return 1;
+	}
+
 	typedescription_t *pTest;
 	int iHeaderPos = m_pData->GetCurPos();
 	int count = -1;
@@ -848,14 +1100,148 @@ int CSave::WriteFields( const char *pname, const void *pBaseData, datamap_t *pRo
 		count++;
 	}
 
+	WriteFieldCount( pname, iHeaderPos, count );
+
+	return 1;
+}
+
+//-------------------------------------
+// Purpose: Same as the loop in WriteFields, a step of the plan at a time
+
+void CSave::WritePlannedFields( const char *pname, const char *pBaseData, datamap_t *pRootMap, const CSaveRestorePlan *pPlan )
+{
+	int iHeaderPos = m_pData->GetCurPos();
+	int count = -1;
+	WriteInt( pname, &count, 1 );
+
+	count = 0;
+
+	typedescription_t *pFields = pPlan->m_pFields;
+	bool bFailed = false;
+
+	for ( int i = 0; i < pPlan->m_Steps.Count() && !bFailed; i++ )
+	{
+		const SavePlanStep_t &step = pPlan->m_Steps[i];
+		switch ( step.type )
+		{
+		case SavePlanStep_t::STEP_RUN:
+			{
+				if ( IsZeroData( pBaseData + step.offset, step.nBytes ) )
+					break;
+
+				for ( int j = step.iField; j < step.iField + step.nFields; j++ )
+				{
+					typedescription_t *pField = &pFields[j];
+					if ( !pPlan->m_FieldBytes[j] || !( pField->flags & FTYPEDESC_SAVE ) )
+						continue;
+
+					const char *pData = pBaseData + pField->fieldOffset[ TD_OFFSET_NORMAL ];
+					if ( IsZeroData( pData, pPlan->m_FieldBytes[j] ) )
+						continue;
+
+#ifdef _DEBUG
+					Log( pname, (fieldtype_t)pField->fieldType, (void *)pData, pField->fieldSize );
+#endif
+					BufferField( pField->fieldName, pPlan->m_FieldBytes[j], pData );
+					count++;
+				}
+			}
+			break;
+
+		case SavePlanStep_t::STEP_EMBEDDED:
+			{
+				typedescription_t *pField = &pFields[ step.iField ];
+				const CSaveRestorePlan *pEmbeddedPlan = pPlan->m_FieldPlans[ step.iField ];
+				const char *pData = pBaseData + pField->fieldOffset[ TD_OFFSET_NORMAL ];
+
+				bool bEmpty = true;
+				for ( int j = 0; j < pField->fieldSize && bEmpty; j++ )
+				{
+					bEmpty = PlannedFieldsEmpty( pData + j * pField->fieldSizeInBytes, pEmbeddedPlan );
+				}
+				if ( bEmpty )
+					break;
+
+#ifdef _DEBUG
+				Log( pname, (fieldtype_t)pField->fieldType, (void *)pData, pField->fieldSize );
+#endif
+				StartBlock( pField->fieldName );
+				for ( int j = 0; j < pField->fieldSize; j++ )
+				{
+					WritePlannedFields( pField->td->dataClassName, pData + j * pField->fieldSizeInBytes, pField->td, pEmbeddedPlan );
+				}
+				EndBlock();
+				count++;
+			}
+			break;
+
+		case SavePlanStep_t::STEP_FIELD:
+			{
+				typedescription_t *pField = &pFields[ step.iField ];
+				void *pData = (void *)( pBaseData + pField->fieldOffset[ TD_OFFSET_NORMAL ] );
+
+				if ( !ShouldSaveField( pData, pField ) )
+					break;
+
+				if ( !WriteField( pname, pData, pRootMap, pField ) )
+				{
+					bFailed = true;
+					break;
+				}
+				count++;
+			}
+			break;
+		}
+	}
+
+	WriteFieldCount( pname, iHeaderPos, count );
+}
+
+//-------------------------------------
+// Purpose: Same as ShouldSaveField for each field of an embedded structure
+
+bool CSave::PlannedFieldsEmpty( const char *pBaseData, const CSaveRestorePlan *pPlan )
+{
+	for ( int i = 0; i < pPlan->m_Steps.Count(); i++ )
+	{
+		const SavePlanStep_t &step = pPlan->m_Steps[i];
+		typedescription_t *pField = &pPlan->m_pFields[ step.iField ];
+
+		switch ( step.type )
+		{
+		case SavePlanStep_t::STEP_RUN:
+			if ( !IsZeroData( pBaseData + step.offset, step.nBytes ) )
+				return false;
+			break;
+
+		case SavePlanStep_t::STEP_EMBEDDED:
+			for ( int j = 0; j < pField->fieldSize; j++ )
+			{
+				if ( !PlannedFieldsEmpty( pBaseData + pField->fieldOffset[ TD_OFFSET_NORMAL ] + j * pField->fieldSizeInBytes, pPlan->m_FieldPlans[ step.iField ] ) )
+					return false;
+			}
+			break;
+
+		case SavePlanStep_t::STEP_FIELD:
+			if ( ShouldSaveField( pBaseData + pField->fieldOffset[ TD_OFFSET_NORMAL ], pField ) )
+				return false;
+			break;
+		}
+	}
+	return true;
+}
+
+//-------------------------------------
+// Purpose: Replaces the placeholder count written at iHeaderPos by WriteFields
+
+void CSave::WriteFieldCount( const char *pname, int iHeaderPos, int count )
+{
 	int iCurPos = m_pData->GetCurPos();
 	int iRewind = iCurPos - iHeaderPos;
 	m_pData->Rewind( iRewind );
 	WriteInt( pname, &count, 1 );
 	iCurPos = m_pData->GetCurPos();
 	m_pData->MoveCurPos( iRewind - ( iCurPos - iHeaderPos ) );
-
-	return 1;
 }
 
 //-------------------------------------
@@ -930,7 +1316,17 @@ void CSave::BufferField( const char *pname, int size, const char *pdata )
 void CSave::WriteHeader( const char *pname, int size )
 {
 	short shortSize = size;
-	short hashvalue = m_pData->FindCreateSymbol( pname );
+	short hashvalue;
+	if ( m_pSymbolMutex )
+	{
+		m_pSymbolMutex->Lock();
+		hashvalue = m_pData->FindCreateSymbol( pname );
+		m_pSymbolMutex->Unlock();
+	}
+	else
+	{
+		hashvalue = m_pData->FindCreateSymbol( pname );
+	}
 	if ( size > SHRT_MAX || size < 0 )
 	{
 		Warning( "CSave::WriteHeader() size parameter exceeds 'short'!\n" );
@@ -1548,45 +1944,88 @@ void CRestore::EmptyFields( void *pBaseData, typedescription_t *pFields, int fie
 		if ( !ShouldEmptyField( pField ) )
 			continue;
 
-		void *pFieldData = (char *)pBaseData + pField->fieldOffset[ TD_OFFSET_NORMAL ];
-		switch( pField->fieldType )
+		EmptyField( pBaseData, pField );
+	}
+}
+
+//-------------------------------------
+
+void CRestore::EmptyField( void *pBaseData, typedescription_t *pField )
+{
+	void *pFieldData = (char *)pBaseData + pField->fieldOffset[ TD_OFFSET_NORMAL ];
+	switch( pField->fieldType )
+	{
+	case FIELD_CUSTOM:
+		{
+			SaveRestoreFieldInfo_t fieldInfo =
+			{
+				pFieldData,
+				pBaseData,
+				pField
+			};
+			pField->pSaveRestoreOps->MakeEmpty( fieldInfo );
+		}
+		break;
+
+	case FIELD_EMBEDDED:
 		{
-		case FIELD_CUSTOM:
+			if ( (pField->flags & FTYPEDESC_PTR) && !*((void **)pFieldData) )
+				break;
+
+			int nFieldCount = pField->fieldSize;
+			char *pFieldMemory = (char *)( ( !(pField->flags & FTYPEDESC_PTR) ) ? pFieldData : *((void **)pFieldData) );
+			while ( --nFieldCount >= 0 )
 			{
-				SaveRestoreFieldInfo_t fieldInfo =
-				{
-					pFieldData,
-					pBaseData,
-					pField
-				};
-				pField->pSaveRestoreOps->MakeEmpty( fieldInfo );
+				EmptyFields( pFieldMemory, pField->td->dataDesc, pField->td->dataNumFields );
+				pFieldMemory += pField->fieldSizeInBytes;
 			}
+		}
+		break;
+
+	default:
+		// NOTE: If you hit this assertion, you've got a bug where you're using 
+		// the wrong field type for your field
+		if ( pField->fieldSizeInBytes != pField->fieldSize * gSizes[pField->fieldType] )
+		{
+			Warning("WARNING! Field %s is using the wrong FIELD_ type!\nFix this or you'll see a crash.\n", pField->fieldName );
+			Assert( 0 );
+		}
+		memset( pFieldData, (pField->fieldType != FIELD_EHANDLE) ? 0 : 0xFF, pField->fieldSize * gSizes[pField->fieldType] );
+		break;
+	}
+}
+
+//-------------------------------------
+// Purpose: Same as EmptyFields, a step of the plan at a time
+
+void CRestore::EmptyPlannedFields( char *pBaseData, const CSaveRestorePlan *pPlan )
+{
+	for ( int i = 0; i < pPlan->m_Steps.Count(); i++ )
+	{
+		const SavePlanStep_t &step = pPlan->m_Steps[i];
+		typedescription_t *pField = &pPlan->m_pFields[ step.iField ];
+
+		switch ( step.type )
+		{
+		case SavePlanStep_t::STEP_RUN:
+			memset( pBaseData + step.offset, 0, step.nBytes );
 			break;
 
-		case FIELD_EMBEDDED:
-			{
-				if ( (pField->flags & FTYPEDESC_PTR) && !*((void **)pFieldData) )
-					break;
+		case SavePlanStep_t::STEP_EMBEDDED:
+			if ( !ShouldEmptyField( pField ) )
+				break;
 
-				int nFieldCount = pField->fieldSize;
-				char *pFieldMemory = (char *)( ( !(pField->flags & FTYPEDESC_PTR) ) ? pFieldData : *((void **)pFieldData) );
-				while ( --nFieldCount >= 0 )
-				{
-					EmptyFields( pFieldMemory, pField->td->dataDesc, pField->td->dataNumFields );
-					pFieldMemory += pField->fieldSizeInBytes;
-				}
+			for ( int j = 0; j < pField->fieldSize; j++ )
+			{
+				EmptyPlannedFields( pBaseData + pField->fieldOffset[ TD_OFFSET_NORMAL ] + j * pField->fieldSizeInBytes, pPlan->m_FieldPlans[ step.iField ] );
 			}
 			break;
 
-		default:
-			// NOTE: If you hit this assertion, you've got a bug where you're using 
-			// the wrong field type for your field
-			if ( pField->fieldSizeInBytes != pField->fieldSize * gSizes[pField->fieldType] )
+		case SavePlanStep_t::STEP_FIELD:
+			if ( ShouldEmptyField( pField ) )
 			{
-				Warning("WARNING! Field %s is using the wrong FIELD_ type!\nFix this or you'll see a crash.\n", pField->fieldName );
-				Assert( 0 );
+				EmptyField( pBaseData, pField );
 			}
-			memset( pFieldData, (pField->fieldType != FIELD_EHANDLE) ? 0 : 0xFF, pField->fieldSize * gSizes[pField->fieldType] );
 			break;
 		}
 	}
@@ -1629,6 +2068,16 @@ void CRestore::EndBlock()
 //-------------------------------------
 
 int CRestore::ReadFields( const char *pname, void *pBaseData, datamap_t *pRootMap, typedescription_t *pFields, int fieldCount )
+{
+	const CSaveRestorePlan *pPlan = ShouldUseSavePlan( fieldCount ) ? CSaveRestorePlan::Get( pFields, fieldCount ) : NULL;
+	return ReadPlannedFields( pname, pBaseData, pRootMap, pFields, fieldCount, pPlan );
+}
+
+//-------------------------------------
+// Purpose: Reads the fields written by WriteFields, using the plan for them if
+//			there is one
+
+int CRestore::ReadPlannedFields( const char *pname, void *pBaseData, datamap_t *pRootMap, typedescription_t *pFields, int fieldCount, const CSaveRestorePlan *pPlan )
 {
 	static int lastName = -1;
 	Verify( ReadShort() == sizeof(int) );			// First entry should be an int
@@ -1648,10 +2097,17 @@ int CRestore::ReadFields( const char *pname, void *pBaseData, datamap_t *pRootMa
 	lastName = symName;
 
 	// Clear out base data
-	EmptyFields( pBaseData, pFields, fieldCount );
-	
-	// Skip over the struct name
-	int i;
+	if ( pPlan )
+	{
+		EmptyPlannedFields( (char *)pBaseData, pPlan );
+	}
+	else
+	{
+		EmptyFields( pBaseData, pFields, fieldCount );
+	}
+	
+	// Skip over the struct name
+	int i;
 	int nFieldsSaved = ReadInt();						// Read field count
 	int searchCookie = 0;								// Make searches faster, most data is read/written in the same order
 	SaveRestoreRecordHeader_t header;
@@ -1663,7 +2119,31 @@ int CRestore::ReadFields( const char *pname, void *pBaseData, datamap_t *pRootMa
 		typedescription_t *pField = FindField( m_pData->StringFromSymbol( header.symbol ), pFields, fieldCount, &searchCookie);
 		if ( pField && ShouldReadField( pField ) )
 		{
-			ReadField( header, ((char *)pBaseData + pField->fieldOffset[ TD_OFFSET_NORMAL ]), pRootMap, pField );
+			char *pDest = (char *)pBaseData + pField->fieldOffset[ TD_OFFSET_NORMAL ];
+			int iField = pField - pFields;
+
+			if ( pPlan && pPlan->m_FieldBytes[iField] )
+			{
+				// Plain data is read as is
+				ReadData( pDest, pPlan->m_FieldBytes[iField], header.size );
+			}
+			else if ( pPlan && pPlan->m_FieldPlans[iField] )
+			{
+				// Same as ReadBasicField, without going back through the datamap
+#ifdef DBGFLAG_ASSERT
+				int startPos = GetReadPos();
+#endif
+				datamap_t *pEmbeddedMap = pField->td;
+				for ( int j = 0; j < pField->fieldSize; j++ )
+				{
+					ReadPlannedFields( pEmbeddedMap->dataClassName, pDest + j * pField->fieldSizeInBytes, pEmbeddedMap, pEmbeddedMap->dataDesc, pEmbeddedMap->dataNumFields, pPlan->m_FieldPlans[iField] );
+				}
+				Assert( GetReadPos() - startPos == header.size );
+			}
+			else
+			{
+				ReadField( header, pDest, pRootMap, pField );
+			}
 		}
 		else
 		{
@@ -2336,6 +2816,508 @@ void CEntitySaveUtils::AddLevelTransitionSaveDependency( CBaseEntity *pEntity1,
 }
 
 
+//-----------------------------------------------------------------------------
+//
+// CStagedSave
+//
+// Writes the entity block of async saves in two stages, so encoding overlaps
+// the rest of the save on the main thread.  Each datamap written through this
+// ISave is copied into a staging arena as it is, and a worker thread encodes
+// the copies into the save buffer while the main thread moves on to the next
+// entity.  Everything else an entity writes, along with the fields whose
+// encoding calls out to other systems (custom types, embedded pointers, model
+// and material indices), is encoded on the main thread when it is met, and the
+// worker copies the bytes into place in order.
+//
+//-----------------------------------------------------------------------------
+
+ConVar save_staged_entities( "save_staged_entities", "1", 0, "Encode entity data for async saves on a worker thread" );
+
+#define STAGING_BLOCK_SIZE	( 256 * 1024 )
+
+class CStagedSave : public CSave
+{
+public:
+	CStagedSave( CSaveRestoreData *pdata );
+	~CStagedSave();
+
+	void			BeginEntity( entitytable_t *pEntInfo );
+	void			EndEntity( entitytable_t *pEntInfo );
+	void			Finish();			// wait for the worker to encode everything written so far
+
+	int				WriteFields( const char *pname, const void *pBaseData, datamap_t *pMap, typedescription_t *pFields, int fieldCount );
+
+	void			StartBlock( const char *pszBlockName );
+	void			StartBlock();
+	void			EndBlock();
+
+private:
+	enum StagedOpType_t
+	{
+		STAGED_RAW,				// bytes already encoded on the main thread
+		STAGED_FIELDS,			// a copy of a datamap's fields
+		STAGED_START_BLOCK,
+		STAGED_END_BLOCK,
+		STAGED_BEGIN_ENTITY,
+		STAGED_END_ENTITY,
+	};
+
+	struct StagedField_t
+	{
+		int				iField;
+		const char		*pData;
+		int				nBytes;			// 0 if the field was empty, -1 if it failed to write
+	};
+
+	struct StagedOp_t
+	{
+		StagedOp_t		*pNext;
+		StagedOpType_t	type;
+		const char		*pszName;
+
+		// STAGED_RAW, and the copied fields for STAGED_FIELDS
+		const char		*pData;
+		int				nBytes;
+
+		// STAGED_FIELDS
+		datamap_t		*pRootMap;
+		typedescription_t *pFields;
+		int				fieldCount;
+		StagedField_t	*pMainThreadFields;		// fields encoded on the main thread, in field order
+		int				nMainThreadFields;
+
+		// STAGED_BEGIN_ENTITY, STAGED_END_ENTITY
+		entitytable_t	*pEntInfo;
+	};
+
+	void			*Alloc( int nBytes );
+	StagedOp_t		*AddOp( StagedOpType_t type );
+	const char		*TakeScratch( int *pnBytes );
+	void			FlushScratch();
+
+	bool			MustEncodeOnMainThread( typedescription_t *pField );
+	bool			MustEncodeOnMainThread( datamap_t *pMap );
+
+	void			EncodeThread();
+	void			EncodeFields( CSave &encoder, const StagedOp_t *pOp );
+
+	CSaveRestoreData			*m_pSaveData;
+	CSaveRestoreSegment			m_Scratch;				// where the main thread encodes, shares the save's symbol table
+	CUtlMemory<char>			m_ScratchMemory;
+	int							m_nDirect;				// > 0 while encoding on the main thread
+
+	CUtlVector<char *>			m_Blocks;
+	char						*m_pBlockCur;
+	int							m_nBlockFree;
+
+	StagedOp_t					*m_pHead;
+	StagedOp_t					*m_pTail;
+
+	CUtlMap<datamap_t *, bool>	m_MainThreadMaps;
+
+	CThreadFastMutex			m_SymbolMutex;
+	CTSQueue<StagedOp_t *>		m_Queue;				// op lists, one per entity, NULL when done
+	CThreadEvent				m_QueueEvent;
+	CJob						*m_pJob;
+};
+
+//-------------------------------------
+
+CStagedSave::CStagedSave( CSaveRestoreData *pdata )
+ :	CSave( pdata ),
+	m_pSaveData( pdata ),
+	m_nDirect( 0 ),
+	m_pBlockCur( NULL ),
+	m_nBlockFree( 0 ),
+	m_pHead( NULL ),
+	m_pTail( NULL ),
+	m_MainThreadMaps( DefLessFunc( datamap_t * ) )
+{
+	// Anything that fits in what's left of the save fits in the scratch buffer. Only the pages used are touched.
+	m_ScratchMemory.EnsureCapacity( pdata->BytesAvailable() );
+	m_Scratch = *pdata;
+	m_Scratch.Init( m_ScratchMemory.Base(), m_ScratchMemory.NumAllocated() );
+
+	m_pData = &m_Scratch;
+	m_pSymbolMutex = &m_SymbolMutex;
+
+	m_pJob = g_pThreadPool->QueueCall( this, &CStagedSave::EncodeThread );
+}
+
+//-------------------------------------
+
+CStagedSave::~CStagedSave()
+{
+	Assert( !m_pJob );
+
+	for ( int i = 0; i < m_Blocks.Count(); i++ )
+	{
+		delete [] m_Blocks[i];
+	}
+}
+
+//-------------------------------------
+
+void *CStagedSave::Alloc( int nBytes )
+{
+	nBytes = AlignValue( nBytes, 16 );
+	if ( nBytes > m_nBlockFree )
+	{
+		int nBlockSize = MAX( nBytes, STAGING_BLOCK_SIZE );
+		m_pBlockCur = new char[ nBlockSize + 15 ];
+		m_Blocks.AddToTail( m_pBlockCur );
+		m_pBlockCur = (char *)AlignValue( m_pBlockCur, 16 );
+		m_nBlockFree = nBlockSize;
+	}
+
+	void *pResult = m_pBlockCur;
+	m_pBlockCur += nBytes;
+	m_nBlockFree -= nBytes;
+	return pResult;
+}
+
+//-------------------------------------
+
+CStagedSave::StagedOp_t *CStagedSave::AddOp( StagedOpType_t type )
+{
+	StagedOp_t *pOp = (StagedOp_t *)Alloc( sizeof( StagedOp_t ) );
+	memset( pOp, 0, sizeof( StagedOp_t ) );
+	pOp->type = type;
+
+	if ( m_pTail )
+	{
+		m_pTail->pNext = pOp;
+	}
+	else
+	{
+		m_pHead = pOp;
+	}
+	m_pTail = pOp;
+
+	return pOp;
+}
+
+//-------------------------------------
+// Purpose: Moves whatever has been encoded into the scratch buffer to the arena
+
+const char *CStagedSave::TakeScratch( int *pnBytes )
+{
+	*pnBytes = m_Scratch.GetCurPos();
+	if ( !*pnBytes )
+		return NULL;
+
+	char *pData = (char *)Alloc( *pnBytes );
+	memcpy( pData, m_Scratch.GetBuffer(), *pnBytes );
+	m_Scratch.Init( m_ScratchMemory.Base(), m_ScratchMemory.NumAllocated() );
+	return pData;
+}
+
+//-------------------------------------
+
+void CStagedSave::FlushScratch()
+{
+	int nBytes;
+	const char *pData = TakeScratch( &nBytes );
+	if ( pData )
+	{
+		StagedOp_t *pOp = AddOp( STAGED_RAW );
+		pOp->pData = pData;
+		pOp->nBytes = nBytes;
+	}
+}
+
+//-------------------------------------
+
+void CStagedSave::BeginEntity( entitytable_t *pEntInfo )
+{
+	Assert( !m_pHead );
+	AddOp( STAGED_BEGIN_ENTITY )->pEntInfo = pEntInfo;
+}
+
+//-------------------------------------
+
+void CStagedSave::EndEntity( entitytable_t *pEntInfo )
+{
+	FlushScratch();
+	AddOp( STAGED_END_ENTITY )->pEntInfo = pEntInfo;
+
+	m_Queue.PushItem( m_pHead );
+	m_QueueEvent.Set();
+	m_pHead = m_pTail = NULL;
+}
+
+//-------------------------------------
+
+void CStagedSave::Finish()
+{
+	Assert( !m_pHead );
+
+	m_Queue.PushItem( NULL );
+	m_QueueEvent.Set();
+
+	m_pJob->WaitForFinishAndRelease();
+	m_pJob = NULL;
+}
+
+//-------------------------------------
+
+bool CStagedSave::MustEncodeOnMainThread( typedescription_t *pField )
+{
+	switch ( pField->fieldType )
+	{
+	case FIELD_CUSTOM:
+	case FIELD_MODELINDEX:
+	case FIELD_MATERIALINDEX:
+		return true;
+
+	case FIELD_EMBEDDED:
+		return ( pField->flags & FTYPEDESC_PTR ) || !pField->td || MustEncodeOnMainThread( pField->td );
+
+	default:
+		return false;
+	}
+}
+
+//-------------------------------------
+
+bool CStagedSave::MustEncodeOnMainThread( datamap_t *pMap )
+{
+	unsigned short i = m_MainThreadMaps.Find( pMap );
+	if ( i != m_MainThreadMaps.InvalidIndex() )
+		return m_MainThreadMaps[i];
+
+	bool bResult = false;
+	for ( datamap_t *pCurMap = pMap; pCurMap && !bResult; pCurMap = pCurMap->baseMap )
+	{
+		for ( int j = 0; j < pCurMap->dataNumFields; j++ )
+		{
+			if ( ( pCurMap->dataDesc[j].flags & FTYPEDESC_SAVE ) && MustEncodeOnMainThread( &pCurMap->dataDesc[j] ) )
+			{
+				bResult = true;
+				break;
+			}
+		}
+	}
+
+	m_MainThreadMaps.Insert( pMap, bResult );
+	return bResult;
+}
+
+//-------------------------------------
+
+int CStagedSave::WriteFields( const char *pname, const void *pBaseData, datamap_t *pRootMap, typedescription_t *pFields, int fieldCount )
+{
+	if ( m_nDirect )
+		return CSave::WriteFields( pname, pBaseData, pRootMap, pFields, fieldCount );
+
+	FlushScratch();
+
+	// Encode the fields the worker can't, and find the range of the object to copy for the rest
+	CUtlVectorFixedGrowable<StagedField_t, 32> mainThreadFields;
+	int nCopyStart = INT_MAX;
+	int nCopyEnd = 0;
+
+	m_nDirect++;
+	for ( int i = 0; i < fieldCount; i++ )
+	{
+		typedescription_t *pTest = &pFields[i];
+		if ( !( pTest->flags & FTYPEDESC_SAVE ) )
+			continue;
+
+		if ( !MustEncodeOnMainThread( pTest ) )
+		{
+			// Embedded arrays give the size of one element, and WriteField walks fieldSize of them
+			int nFieldBytes = pTest->fieldSizeInBytes;
+			if ( pTest->fieldType == FIELD_EMBEDDED )
+			{
+				nFieldBytes *= pTest->fieldSize;
+			}
+
+			nCopyStart = MIN( nCopyStart, pTest->fieldOffset[ TD_OFFSET_NORMAL ] );
+			nCopyEnd = MAX( nCopyEnd, pTest->fieldOffset[ TD_OFFSET_NORMAL ] + nFieldBytes );
+			continue;
+		}
+
+		StagedField_t &field = mainThreadFields[ mainThreadFields.AddToTail() ];
+		field.iField = i;
+		field.pData = NULL;
+		field.nBytes = 0;
+
+		void *pOutputData = ( (char *)pBaseData + pTest->fieldOffset[ TD_OFFSET_NORMAL ] );
+		if ( !ShouldSaveField( pOutputData, pTest ) )
+			continue;
+
+		if ( !WriteField( pname, pOutputData, pRootMap, pTest ) )
+		{
+			field.nBytes = -1;
+			break;
+		}
+		field.pData = TakeScratch( &field.nBytes );
+	}
+	m_nDirect--;
+
+	StagedOp_t *pOp = AddOp( STAGED_FIELDS );
+	pOp->pszName = pname;
+	pOp->pRootMap = pRootMap;
+	pOp->pFields = pFields;
+	pOp->fieldCount = fieldCount;
+
+	// Copy the rest at the same alignment as the original, so the worker reads them just as it would in place
+	if ( nCopyEnd > nCopyStart )
+	{
+		const char *pCopySource = (const char *)pBaseData + nCopyStart;
+		int nMisalign = (int)( (uintp)pCopySource & 15 );
+		char *pCopy = (char *)Alloc( nMisalign + nCopyEnd - nCopyStart ) + nMisalign;
+		memcpy( pCopy, pCopySource, nCopyEnd - nCopyStart );
+		pOp->pData = pCopy - nCopyStart;
+		pOp->nBytes = nCopyEnd - nCopyStart;
+	}
+
+	if ( mainThreadFields.Count() )
+	{
+		pOp->nMainThreadFields = mainThreadFields.Count();
+		pOp->pMainThreadFields = (StagedField_t *)Alloc( mainThreadFields.Count() * sizeof( StagedField_t ) );
+		memcpy( pOp->pMainThreadFields, mainThreadFields.Base(), mainThreadFields.Count() * sizeof( StagedField_t ) );
+	}
+
+	return 1;
+}
+
+//-------------------------------------
+
+void CStagedSave::StartBlock( const char *pszBlockName )
+{
+	if ( m_nDirect )
+	{
+		CSave::StartBlock( pszBlockName );
+		return;
+	}
+
+	FlushScratch();
+	AddOp( STAGED_START_BLOCK )->pszName = pszBlockName;
+}
+
+//-------------------------------------
+
+void CStagedSave::StartBlock()
+{
+	StartBlock( "" );
+}
+
+//-------------------------------------
+
+void CStagedSave::EndBlock()
+{
+	if ( m_nDirect )
+	{
+		CSave::EndBlock();
+		return;
+	}
+
+	FlushScratch();
+	AddOp( STAGED_END_BLOCK );
+}
+
+//-------------------------------------
+// Purpose: Worker thread, encodes each entity's ops into the save as the main
+//			thread finishes with them
+
+void CStagedSave::EncodeThread()
+{
+	CSave encoder( m_pSaveData );
+	encoder.m_pSymbolMutex = &m_SymbolMutex;
+
+	for (;;)
+	{
+		StagedOp_t *pOp;
+		if ( !m_Queue.PopItem( &pOp ) )
+		{
+			m_QueueEvent.Wait();
+			continue;
+		}
+
+		if ( !pOp )
+			break;
+
+		for ( ; pOp; pOp = pOp->pNext )
+		{
+			switch ( pOp->type )
+			{
+			case STAGED_RAW:
+				encoder.BufferData( pOp->pData, pOp->nBytes );
+				break;
+
+			case STAGED_FIELDS:
+				EncodeFields( encoder, pOp );
+				break;
+
+			case STAGED_START_BLOCK:
+				encoder.StartBlock( pOp->pszName );
+				break;
+
+			case STAGED_END_BLOCK:
+				encoder.EndBlock();
+				break;
+
+			case STAGED_BEGIN_ENTITY:
+				pOp->pEntInfo->location = encoder.GetWritePos();
+				break;
+
+			case STAGED_END_ENTITY:
+				pOp->pEntInfo->size = encoder.GetWritePos() - pOp->pEntInfo->location;
+				break;
+			}
+		}
+	}
+}
+
+//-------------------------------------
+// Purpose: Same as CSave::WriteFields, reading from the copy and dropping in
+//			the fields that were encoded on the main thread
+
+void CStagedSave::EncodeFields( CSave &encoder, const StagedOp_t *pOp )
+{
+	int iHeaderPos = encoder.GetWritePos();
+	int count = -1;
+	encoder.WriteInt( pOp->pszName, &count, 1 );
+
+	count = 0;
+
+	const StagedField_t *pMainThreadField = pOp->pMainThreadFields;
+	const StagedField_t *pMainThreadLimit = pOp->pMainThreadFields + pOp->nMainThreadFields;
+
+	for ( int i = 0; i < pOp->fieldCount; i++ )
+	{
+		if ( pMainThreadField < pMainThreadLimit && pMainThreadField->iField == i )
+		{
+			int nBytes = pMainThreadField->nBytes;
+			if ( nBytes < 0 )
+				break;
+
+			if ( nBytes > 0 )
+			{
+				encoder.BufferData( pMainThreadField->pData, nBytes );
+				count++;
+			}
+			++pMainThreadField;
+			continue;
+		}
+
+		typedescription_t *pTest = &pOp->pFields[ i ];
+		void *pOutputData = ( (char *)pOp->pData + pTest->fieldOffset[ TD_OFFSET_NORMAL ] );
+
+		if ( !encoder.ShouldSaveField( pOutputData, pTest ) )
+			continue;
+
+		if ( !encoder.WriteField( pOp->pszName, pOutputData, pOp->pRootMap, pTest ) )
+			break;
+		count++;
+	}
+
+	encoder.WriteFieldCount( pOp->pszName, iHeaderPos, count );
+}
+
+
 //-----------------------------------------------------------------------------
 // Block handler for save/restore of entities
 //-----------------------------------------------------------------------------
@@ -2456,13 +3438,28 @@ void CEntitySaveRestoreBlockHandler::PreSave( CSaveRestoreData *pSaveData )
 void CEntitySaveRestoreBlockHandler::Save( ISave *pSave )
 {
 	CGameSaveRestoreInfo *pSaveData = pSave->GetGameSaveRestoreInfo();
+
+	// Async saves hand the encoding to a worker thread
+	CStagedSave *pStagedSave = NULL;
+	if ( pSave->IsAsync() && save_staged_entities.GetBool() && g_pThreadPool->NumIdleThreads() )
+	{
+		pStagedSave = new CStagedSave( static_cast<CSaveRestoreData *>( pSaveData ) );
+	}
+	ISave &save = pStagedSave ? *pStagedSave : *pSave;
 	
 	// write entity list that was previously built by SaveInitEntities()
 	for ( int i = 0; i < pSaveData->NumEntities(); i++ )
 	{
 		entitytable_t *pEntInfo = pSaveData->GetEntityInfo( i );
-		pEntInfo->location = pSave->GetWritePos();
 		pEntInfo->size = 0;
+		if ( pStagedSave )
+		{
+			pStagedSave->BeginEntity( pEntInfo );
+		}
+		else
+		{
+			pEntInfo->location = pSave->GetWritePos();
+		}
 
 		CBaseEntity *pEnt = pEntInfo->hEnt;
 		if ( pEnt && !( pEnt->ObjectCaps() & FCAP_DONT_SAVE ) )
@@ -2476,10 +3473,13 @@ void CEntitySaveRestoreBlockHandler::Save( ISave *pSave )
 #endif
 
 			pSaveData->SetCurrentEntityContext( pEnt );
-			pEnt->Save( *pSave );
+			pEnt->Save( save );
 			pSaveData->SetCurrentEntityContext( NULL );
 
-			pEntInfo->size = pSave->GetWritePos() - pEntInfo->location;	// Size of entity block is data size written to block
+			if ( !pStagedSave )
+			{
+				pEntInfo->size = pSave->GetWritePos() - pEntInfo->location;	// Size of entity block is data size written to block
+			}
 
 			pEntInfo->classname = pEnt->m_iClassname;	// Remember entity class for respawn
 
@@ -2494,6 +3494,17 @@ void CEntitySaveRestoreBlockHandler::Save( ISave *pSave )
 			}
 #endif
 		}
+
+		if ( pStagedSave )
+		{
+			pStagedSave->EndEntity( pEntInfo );
+		}
+	}
+
+	if ( pStagedSave )
+	{
+		pStagedSave->Finish();
+		delete pStagedSave;
 	}
 }
 
@@ -3440,3 +4451,363 @@ int CreateEntityTransitionList( CSaveRestoreData *pSaveData, int levelMask )
 	return movedCount;
 }
 #endif
+
+#if !defined( CLIENT_DLL )
+
+//-----------------------------------------------------------------------------
+// Purpose: A made up map of objects with datamaps shaped like those of real
+//			entities, for timing saves and restores with and without plans.
+//			Live entities can't be restored in place, so these stand in for them.
+//-----------------------------------------------------------------------------
+
+struct SaveBenchOutput_t
+{
+	string_t	m_iszTarget;
+	string_t	m_iszInput;
+	float		m_flDelay;
+	int			m_nTimesToFire;
+
+	DECLARE_SIMPLE_DATADESC();
+};
+
+struct SaveBenchBase_t
+{
+	string_t	m_iName;
+	string_t	m_iParent;
+	Vector		m_vecOrigin;
+	Vector		m_vecAngles;
+	Vector		m_vecVelocity;
+	int			m_fFlags;
+	int			m_iHealth;
+	int			m_iMaxHealth;
+	float		m_flSpeed;
+	float		m_flNextThink;
+	int			m_nNextThinkTick;
+	bool		m_bDisabled;
+	short		m_nSkin;
+	color32		m_clrRender;
+	EHANDLE		m_hOwner;
+	char		m_szNote[16];
+
+	DECLARE_SIMPLE_DATADESC();
+};
+
+struct SaveBenchLogic_t : public SaveBenchBase_t
+{
+	int					m_nState;
+	float				m_flValues[8];
+	SaveBenchOutput_t	m_Outputs[4];
+	CUtlVector<int>		m_Counters;
+	CUtlVector<float>	m_Weights;
+	CUtlVector<EHANDLE>	m_hTargets;
+
+	DECLARE_SIMPLE_DATADESC();
+};
+
+struct SaveBenchMover_t : public SaveBenchBase_t
+{
+	Vector				m_vecPath[16];
+	float				m_flPathSpeed[16];
+	Quaternion			m_qRotation;
+	int					m_iPathIndex;
+	bool				m_bLoop;
+	SaveBenchOutput_t	m_OnArrive;
+	CUtlVector<Vector>	m_vecCorners;
+	CUtlVector<SaveBenchOutput_t> m_Waypoints;
+
+	DECLARE_SIMPLE_DATADESC();
+};
+
+BEGIN_SIMPLE_DATADESC( SaveBenchOutput_t )
+	DEFINE_FIELD( m_iszTarget, FIELD_STRING ),
+	DEFINE_FIELD( m_iszInput, FIELD_STRING ),
+	DEFINE_FIELD( m_flDelay, FIELD_FLOAT ),
+	DEFINE_FIELD( m_nTimesToFire, FIELD_INTEGER ),
+END_DATADESC()
+
+BEGIN_SIMPLE_DATADESC( SaveBenchBase_t )
+	DEFINE_FIELD( m_iName, FIELD_STRING ),
+	DEFINE_FIELD( m_iParent, FIELD_STRING ),
+	DEFINE_FIELD( m_vecOrigin, FIELD_POSITION_VECTOR ),
+	DEFINE_FIELD( m_vecAngles, FIELD_VECTOR ),
+	DEFINE_FIELD( m_vecVelocity, FIELD_VECTOR ),
+	DEFINE_FIELD( m_fFlags, FIELD_INTEGER ),
+	DEFINE_FIELD( m_iHealth, FIELD_INTEGER ),
+	DEFINE_FIELD( m_iMaxHealth, FIELD_INTEGER ),
+	DEFINE_FIELD( m_flSpeed, FIELD_FLOAT ),
+	DEFINE_FIELD( m_flNextThink, FIELD_TIME ),
+	DEFINE_FIELD( m_nNextThinkTick, FIELD_TICK ),
+	DEFINE_FIELD( m_bDisabled, FIELD_BOOLEAN ),
+	DEFINE_FIELD( m_nSkin, FIELD_SHORT ),
+	DEFINE_FIELD( m_clrRender, FIELD_COLOR32 ),
+	DEFINE_FIELD( m_hOwner, FIELD_EHANDLE ),
+	DEFINE_AUTO_ARRAY( m_szNote, FIELD_CHARACTER ),
+END_DATADESC()
+
+BEGIN_SIMPLE_DATADESC_( SaveBenchLogic_t, SaveBenchBase_t )
+	DEFINE_FIELD( m_nState, FIELD_INTEGER ),
+	DEFINE_AUTO_ARRAY( m_flValues, FIELD_FLOAT ),
+	DEFINE_EMBEDDED_AUTO_ARRAY( m_Outputs ),
+	DEFINE_UTLVECTOR( m_Counters, FIELD_INTEGER ),
+	DEFINE_UTLVECTOR( m_Weights, FIELD_FLOAT ),
+	DEFINE_UTLVECTOR( m_hTargets, FIELD_EHANDLE ),
+END_DATADESC()
+
+BEGIN_SIMPLE_DATADESC_( SaveBenchMover_t, SaveBenchBase_t )
+	DEFINE_AUTO_ARRAY( m_vecPath, FIELD_VECTOR ),
+	DEFINE_AUTO_ARRAY( m_flPathSpeed, FIELD_FLOAT ),
+	DEFINE_FIELD( m_qRotation, FIELD_QUATERNION ),
+	DEFINE_FIELD( m_iPathIndex, FIELD_INTEGER ),
+	DEFINE_FIELD( m_bLoop, FIELD_BOOLEAN ),
+	DEFINE_EMBEDDED( m_OnArrive ),
+	DEFINE_UTLVECTOR( m_vecCorners, FIELD_VECTOR ),
+	DEFINE_UTLVECTOR( m_Waypoints, FIELD_EMBEDDED ),
+END_DATADESC()
+
+//-------------------------------------
+
+static string_t g_SaveBenchNames[8];
+
+// About a quarter of the values are left empty, as many are in real entities
+static float SaveBenchFloat( CUniformRandomStream &random )
+{
+	return ( random.RandomInt( 0, 3 ) == 0 ) ? 0.0f : random.RandomFloat( -4096.0f, 4096.0f );
+}
+
+static int SaveBenchInt( CUniformRandomStream &random )
+{
+	return ( random.RandomInt( 0, 3 ) == 0 ) ? 0 : random.RandomInt( 1, 1000 );
+}
+
+static string_t SaveBenchString( CUniformRandomStream &random )
+{
+	return ( random.RandomInt( 0, 3 ) == 0 ) ? NULL_STRING : g_SaveBenchNames[ random.RandomInt( 0, ARRAYSIZE( g_SaveBenchNames ) - 1 ) ];
+}
+
+static void SaveBenchVector( CUniformRandomStream &random, Vector *pVec )
+{
+	pVec->Init( SaveBenchFloat( random ), SaveBenchFloat( random ), SaveBenchFloat( random ) );
+}
+
+static void SaveBenchOutput( CUniformRandomStream &random, SaveBenchOutput_t *pOutput )
+{
+	pOutput->m_iszTarget = SaveBenchString( random );
+	pOutput->m_iszInput = SaveBenchString( random );
+	pOutput->m_flDelay = SaveBenchFloat( random );
+	pOutput->m_nTimesToFire = SaveBenchInt( random );
+}
+
+static void SaveBenchFill( CUniformRandomStream &random, SaveBenchBase_t *pObject )
+{
+	pObject->m_iName = SaveBenchString( random );
+	pObject->m_iParent = SaveBenchString( random );
+	SaveBenchVector( random, &pObject->m_vecOrigin );
+	SaveBenchVector( random, &pObject->m_vecAngles );
+	SaveBenchVector( random, &pObject->m_vecVelocity );
+	pObject->m_fFlags = SaveBenchInt( random );
+	pObject->m_iHealth = SaveBenchInt( random );
+	pObject->m_iMaxHealth = SaveBenchInt( random );
+	pObject->m_flSpeed = SaveBenchFloat( random );
+	pObject->m_flNextThink = SaveBenchFloat( random );
+	pObject->m_nNextThinkTick = SaveBenchInt( random );
+	pObject->m_bDisabled = ( random.RandomInt( 0, 1 ) != 0 );
+	pObject->m_nSkin = (short)SaveBenchInt( random );
+	pObject->m_clrRender.r = pObject->m_clrRender.g = pObject->m_clrRender.b = pObject->m_clrRender.a = (unsigned char)random.RandomInt( 0, 255 );
+	pObject->m_hOwner = NULL;
+	memset( pObject->m_szNote, 0, sizeof( pObject->m_szNote ) );
+	if ( random.RandomInt( 0, 1 ) )
+	{
+		Q_snprintf( pObject->m_szNote, sizeof( pObject->m_szNote ), "note%d", random.RandomInt( 0, 9999 ) );
+	}
+}
+
+static void SaveBenchFill( CUniformRandomStream &random, SaveBenchLogic_t *pObject )
+{
+	SaveBenchFill( random, (SaveBenchBase_t *)pObject );
+	pObject->m_nState = SaveBenchInt( random );
+	for ( int i = 0; i < (int)ARRAYSIZE( pObject->m_flValues ); i++ )
+	{
+		pObject->m_flValues[i] = SaveBenchFloat( random );
+	}
+	for ( int i = 0; i < (int)ARRAYSIZE( pObject->m_Outputs ); i++ )
+	{
+		SaveBenchOutput( random, &pObject->m_Outputs[i] );
+	}
+
+	// Vectors of many sizes, so their element fields differ from one save to the next
+	pObject->m_Counters.SetCount( random.RandomInt( 0, 8 ) );
+	for ( int i = 0; i < pObject->m_Counters.Count(); i++ )
+	{
+		pObject->m_Counters[i] = SaveBenchInt( random );
+	}
+	pObject->m_Weights.SetCount( random.RandomInt( 0, 64 ) );
+	for ( int i = 0; i < pObject->m_Weights.Count(); i++ )
+	{
+		pObject->m_Weights[i] = SaveBenchFloat( random );
+	}
+
+	// There's no entity table to save handles against, so any entity saves the same as none
+	pObject->m_hTargets.SetCount( random.RandomInt( 0, 4 ) );
+	for ( int i = 0; i < pObject->m_hTargets.Count(); i++ )
+	{
+		pObject->m_hTargets[i] = NULL;
+	}
+}
+
+static void SaveBenchFill( CUniformRandomStream &random, SaveBenchMover_t *pObject )
+{
+	SaveBenchFill( random, (SaveBenchBase_t *)pObject );
+	for ( int i = 0; i < (int)ARRAYSIZE( pObject->m_vecPath ); i++ )
+	{
+		SaveBenchVector( random, &pObject->m_vecPath[i] );
+		pObject->m_flPathSpeed[i] = SaveBenchFloat( random );
+	}
+	pObject->m_qRotation.Init( SaveBenchFloat( random ), SaveBenchFloat( random ), SaveBenchFloat( random ), SaveBenchFloat( random ) );
+	pObject->m_iPathIndex = SaveBenchInt( random );
+	pObject->m_bLoop = ( random.RandomInt( 0, 1 ) != 0 );
+	SaveBenchOutput( random, &pObject->m_OnArrive );
+	pObject->m_vecCorners.SetCount( random.RandomInt( 0, 32 ) );
+	for ( int i = 0; i < pObject->m_vecCorners.Count(); i++ )
+	{
+		SaveBenchVector( random, &pObject->m_vecCorners[i] );
+	}
+	pObject->m_Waypoints.SetCount( random.RandomInt( 0, 6 ) );
+	for ( int i = 0; i < pObject->m_Waypoints.Count(); i++ )
+	{
+		SaveBenchOutput( random, &pObject->m_Waypoints[i] );
+	}
+}
+
+//-------------------------------------
+
+struct SaveBenchRun_t
+{
+	CSaveRestoreData	*pData;
+	CUtlMemory<char>	buffer;
+	char				*tokens[0xfff];
+	int					bytes;
+};
+
+// Write every object into a fresh buffer and symbol table, returning the time taken
+static double SaveBenchWrite( SaveBenchRun_t *pRun, const char *pObjects, int stride, int count, datamap_t *pMap )
+{
+	pRun->buffer.EnsureCapacity( count * ( 2 * stride + 1024 ) );
+	pRun->pData = new CSaveRestoreData;
+	pRun->pData->Init( pRun->buffer.Base(), pRun->buffer.Count() );
+	pRun->pData->InitSymbolTable( pRun->tokens, ARRAYSIZE( pRun->tokens ) );
+
+	CSave save( pRun->pData );
+
+	double start = Plat_FloatTime();
+	for ( int i = 0; i < count; i++ )
+	{
+		save.WriteAll( pObjects + i * stride, pMap );
+	}
+	double elapsed = Plat_FloatTime() - start;
+
+	pRun->bytes = pRun->pData->GetCurPos();
+	return elapsed;
+}
+
+// Read the run's objects back, returning the time taken
+static double SaveBenchRead( SaveBenchRun_t *pRun, char *pObjects, int stride, int count, datamap_t *pMap )
+{
+	pRun->pData->Seek( 0 );
+
+	CRestore restore( pRun->pData );
+
+	double start = Plat_FloatTime();
+	for ( int i = 0; i < count; i++ )
+	{
+		restore.ReadAll( pObjects + i * stride, pMap );
+	}
+	return Plat_FloatTime() - start;
+}
+
+static bool SaveBenchSame( const SaveBenchRun_t &a, const SaveBenchRun_t &b )
+{
+	return a.bytes == b.bytes && !memcmp( a.buffer.Base(), b.buffer.Base(), a.bytes );
+}
+
+//-------------------------------------
+// Purpose: Save and restore 'count' objects of one class with plans off and on,
+//			and check both ways write and read the same thing.
+
+template <class T>
+static void SaveBenchClass( CUniformRandomStream &random, int count )
+{
+	datamap_t *pMap = &T::m_DataMap;
+
+	T *pObjects = new T[count];
+	T *pRestored[2] = { new T[count], new T[count] };
+	for ( int i = 0; i < count; i++ )
+	{
+		SaveBenchFill( random, &pObjects[i] );
+	}
+
+	SaveBenchRun_t *pRuns = new SaveBenchRun_t[4];
+	double saveTime[2], restoreTime[2];
+	for ( int iPlans = 0; iPlans < 2; iPlans++ )
+	{
+		save_plans.SetValue( iPlans );
+		saveTime[iPlans] = SaveBenchWrite( &pRuns[iPlans], (const char *)pObjects, sizeof( T ), count, pMap );
+		restoreTime[iPlans] = SaveBenchRead( &pRuns[iPlans], (char *)pRestored[iPlans], sizeof( T ), count, pMap );
+	}
+
+	// What was restored should save the same again
+	for ( int iPlans = 0; iPlans < 2; iPlans++ )
+	{
+		SaveBenchWrite( &pRuns[2 + iPlans], (const char *)pRestored[iPlans], sizeof( T ), count, pMap );
+	}
+
+	Msg( "%-20s %6d %10d %10.2f %10.2f %10.2f %10.2f\n", pMap->dataClassName, count, pRuns[1].bytes,
+		saveTime[0] * 1000.0, saveTime[1] * 1000.0, restoreTime[0] * 1000.0, restoreTime[1] * 1000.0 );
+
+	if ( !SaveBenchSame( pRuns[0], pRuns[1] ) )
+	{
+		Warning( "save_plan_benchmark: %s saved %d bytes with plans and %d without, or the bytes differ\n", pMap->dataClassName, pRuns[1].bytes, pRuns[0].bytes );
+	}
+	if ( !SaveBenchSame( pRuns[0], pRuns[2] ) || !SaveBenchSame( pRuns[0], pRuns[3] ) )
+	{
+		Warning( "save_plan_benchmark: %s restored with plans %s differently\n", pMap->dataClassName, SaveBenchSame( pRuns[0], pRuns[3] ) ? "off" : "on" );
+	}
+
+	for ( int i = 0; i < 4; i++ )
+	{
+		delete pRuns[i].pData;
+	}
+	delete [] pRuns;
+	delete [] pRestored[0];
+	delete [] pRestored[1];
+	delete [] pObjects;
+}
+
+//-------------------------------------
+
+CON_COMMAND_F( save_plan_benchmark, "Saves and restores a made up map of objects with and without field plans, and reports bytes and milliseconds per class.\nUsage: save_plan_benchmark [objects]", FCVAR_GAMEDLL | FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int count = ( args.ArgC() > 1 ) ? MAX( atoi( args[1] ), 3 ) : 4096;
+
+	for ( int i = 0; i < (int)ARRAYSIZE( g_SaveBenchNames ); i++ )
+	{
+		g_SaveBenchNames[i] = AllocPooledString( UTIL_VarArgs( "save_bench_%d", i ) );
+	}
+
+	// the same objects every run
+	CUniformRandomStream random;
+	random.SetSeed( 1 );
+
+	bool bPlans = save_plans.GetBool();
+
+	Msg( "%-20s %6s %10s %10s %10s %10s %10s\n", "class", "count", "bytes", "save off", "save on", "restore off", "restore on" );
+	SaveBenchClass<SaveBenchBase_t>( random, count / 4 );
+	SaveBenchClass<SaveBenchLogic_t>( random, count / 2 );
+	SaveBenchClass<SaveBenchMover_t>( random, count - count / 4 - count / 2 );
+
+	save_plans.SetValue( bPlans );
+}
+
+#endif // !defined( CLIENT_DLL )
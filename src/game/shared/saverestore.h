@@ -28,6 +28,8 @@ struct edict_t;
 struct datamap_t;
 class CBaseEntity;
 struct interval_t;
+class CThreadFastMutex;
+class CSaveRestorePlan;
 
 //-----------------------------------------------------------------------------
 //
@@ -138,6 +140,7 @@ public:
 	CGameSaveRestoreInfo *GetGameSaveRestoreInfo()	{ return m_pGameInfo; }
 
 private:
+	friend class CStagedSave;
 
 	//---------------------------------
 	bool			IsLogging( void );
@@ -151,6 +154,9 @@ private:
 
 	int				DoWriteAll( const void *pLeafObject, datamap_t *pLeafMap, datamap_t *pCurMap );
 	bool 			WriteField( const char *pname, void *pData, datamap_t *pRootMap, typedescription_t *pField );
+	void			WriteFieldCount( const char *pname, int iHeaderPos, int count );
+	void			WritePlannedFields( const char *pname, const char *pBaseData, datamap_t *pRootMap, const CSaveRestorePlan *pPlan );
+	bool			PlannedFieldsEmpty( const char *pBaseData, const CSaveRestorePlan *pPlan );
 	
 	bool 			WriteBasicField( const char *pname, void *pData, datamap_t *pRootMap, typedescription_t *pField );
 	
@@ -179,6 +185,9 @@ private:
 
 	FileHandle_t		m_hLogFile;
 	bool				m_bAsync;
+
+	// Held around symbol table changes when more than one CSave writes at once
+	CThreadFastMutex	*m_pSymbolMutex;
 };
 
 //-----------------------------------------------------------------------------
@@ -276,6 +285,9 @@ private:
 	int				DoReadAll( void *pLeafObject, datamap_t *pLeafMap, datamap_t *pCurMap );
 	
 	typedescription_t *FindField( const char *pszFieldName, typedescription_t *pFields, int fieldCount, int *pIterator );
+	int				ReadPlannedFields( const char *pname, void *pBaseData, datamap_t *pRootMap, typedescription_t *pFields, int fieldCount, const CSaveRestorePlan *pPlan );
+	void			EmptyPlannedFields( char *pBaseData, const CSaveRestorePlan *pPlan );
+	void			EmptyField( void *pBaseData, typedescription_t *pField );
 	void			ReadField( const SaveRestoreRecordHeader_t &header, void *pDest, datamap_t *pRootMap, typedescription_t *pField );
 	
 	void 			ReadBasicField( const SaveRestoreRecordHeader_t &header, void *pDest, datamap_t *pRootMap, typedescription_t *pField );
@@ -20,6 +20,8 @@
 #include "datamanager.h"
 #include "convar.h"
 #include "tier0/tslist.h"
+#include "tier1/generichash.h"
+#include "utlmap.h"
 #include "vphysics_interface.h"
 #ifdef CLIENT_DLL
 	#include "posedebugger.h"
@@ -243,6 +245,209 @@ void Studio_InvalidateBoneCache( memhandle_t cacheHandle )
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: shared local poses
+//-----------------------------------------------------------------------------
+CPoseCacheKey::CPoseCacheKey( int steps ) : m_nSteps( steps ), m_nCount( 0 ), m_bOverflow( false )
+{
+	// the same inputs quantized differently are different poses
+	AddInt( steps );
+}
+
+void CPoseCacheKey::AddInt( int value )
+{
+	if ( m_nCount >= MAX_KEY_INTS )
+	{
+		m_bOverflow = true;
+		return;
+	}
+	m_nData[m_nCount++] = value;
+}
+
+void CPoseCacheKey::AddPointer( const void *p )
+{
+	uintp value = (uintp)p;
+	AddInt( (int)( value & 0xffffffff ) );
+#ifdef PLATFORM_64BITS
+	AddInt( (int)( value >> 32 ) );
+#endif
+}
+
+void CPoseCacheKey::AddFloat( float value )
+{
+	int bits;
+	memcpy( &bits, &value, sizeof( bits ) );
+	AddInt( bits );
+}
+
+void CPoseCacheKey::AddQuantized( float value )
+{
+	AddInt( (int)floorf( value * m_nSteps + 0.5f ) );
+}
+
+unsigned int CPoseCacheKey::GetHash( void ) const
+{
+	return HashBlock( m_nData, m_nCount * sizeof( int ) );
+}
+
+bool CPoseCacheKey::operator==( const CPoseCacheKey &other ) const
+{
+	return m_nCount == other.m_nCount && !memcmp( m_nData, other.m_nData, m_nCount * sizeof( int ) );
+}
+
+struct posecacheparams_t
+{
+	const CPoseCacheKey	*pKey;
+	int					numbones;
+	const Vector		*pos;
+	const Quaternion	*q;
+};
+
+class CPoseCache
+{
+public:
+	// you must implement these static functions for the ResourceManager
+	// -----------------------------------------------------------
+	static CPoseCache *CreateResource( const posecacheparams_t &params );
+	static unsigned int EstimatedSize( const posecacheparams_t &params );
+	// -----------------------------------------------------------
+	// member functions that must be present for the ResourceManager
+	void			DestroyResource() { free( this ); }
+	CPoseCache		*GetData() { return this; }
+	unsigned int	Size() { return m_size; }
+	// -----------------------------------------------------------
+
+	Quaternion		*Quaternions() { return (Quaternion *)( this + 1 ); }
+	Vector			*Positions() { return (Vector *)( Quaternions() + m_numbones ); }
+
+	CPoseCacheKey	m_key;
+	int				m_numbones;
+	unsigned int	m_size;
+};
+
+CPoseCache *CPoseCache::CreateResource( const posecacheparams_t &params )
+{
+	unsigned int size = EstimatedSize( params );
+
+	CPoseCache *pMem = (CPoseCache *)malloc( size );
+	pMem->m_key = *params.pKey;
+	pMem->m_numbones = params.numbones;
+	pMem->m_size = size;
+	memcpy( pMem->Quaternions(), params.q, params.numbones * sizeof( Quaternion ) );
+	memcpy( pMem->Positions(), params.pos, params.numbones * sizeof( Vector ) );
+	return pMem;
+}
+
+unsigned int CPoseCache::EstimatedSize( const posecacheparams_t &params )
+{
+	return sizeof( CPoseCache ) + params.numbones * ( sizeof( Quaternion ) + sizeof( Vector ) );
+}
+
+static CDataManager<CPoseCache, posecacheparams_t, CPoseCache *, CThreadFastMutex> g_StudioPoseCache( 1024 * 1024L );
+
+// key hash to pose, guarded by the pose cache's mutex.  Entries whose pose has been dropped are removed as they're found.
+static CUtlMap< unsigned int, memhandle_t > g_StudioPoseIndex( DefLessFunc( unsigned int ) );
+static int g_nSharedPoseHits;
+static int g_nSharedPoseMisses;
+
+#define MAX_SHARED_POSE_INDEX	4096
+
+bool Studio_GetSharedPose( const CPoseCacheKey &key, int numbones, Vector pos[], Quaternion q[] )
+{
+	AUTO_LOCK( g_StudioPoseCache.AccessMutex() );
+
+	unsigned short i = g_StudioPoseIndex.Find( key.GetHash() );
+	if ( g_StudioPoseIndex.IsValidIndex( i ) )
+	{
+		CPoseCache *pPose = g_StudioPoseCache.GetResource_NoLock( g_StudioPoseIndex[i] );
+		if ( !pPose )
+		{
+			g_StudioPoseIndex.RemoveAt( i );
+		}
+		else if ( pPose->m_numbones == numbones && pPose->m_key == key )
+		{
+			memcpy( q, pPose->Quaternions(), numbones * sizeof( Quaternion ) );
+			memcpy( pos, pPose->Positions(), numbones * sizeof( Vector ) );
+			g_nSharedPoseHits++;
+			return true;
+		}
+	}
+
+	g_nSharedPoseMisses++;
+	return false;
+}
+
+static void PruneSharedPoseIndex( void )
+{
+	unsigned short i = g_StudioPoseIndex.FirstInorder();
+	while ( g_StudioPoseIndex.IsValidIndex( i ) )
+	{
+		unsigned short next = g_StudioPoseIndex.NextInorder( i );
+		if ( !g_StudioPoseCache.GetResource_NoLockNoLRUTouch( g_StudioPoseIndex[i] ) )
+		{
+			g_StudioPoseIndex.RemoveAt( i );
+		}
+		i = next;
+	}
+}
+
+void Studio_AddSharedPose( const CPoseCacheKey &key, int numbones, const Vector pos[], const Quaternion q[] )
+{
+	if ( !key.IsValid() )
+		return;
+
+	AUTO_LOCK( g_StudioPoseCache.AccessMutex() );
+
+	unsigned int hash = key.GetHash();
+	unsigned short i = g_StudioPoseIndex.Find( hash );
+	if ( g_StudioPoseIndex.IsValidIndex( i ) )
+	{
+		// replace whatever pose had the same hash
+		g_StudioPoseCache.DestroyResource( g_StudioPoseIndex[i] );
+	}
+	else
+	{
+		if ( g_StudioPoseIndex.Count() >= MAX_SHARED_POSE_INDEX )
+		{
+			PruneSharedPoseIndex();
+		}
+		i = g_StudioPoseIndex.Insert( hash );
+	}
+
+	posecacheparams_t params;
+	params.pKey = &key;
+	params.numbones = numbones;
+	params.pos = pos;
+	params.q = q;
+	g_StudioPoseIndex[i] = g_StudioPoseCache.CreateResource( params );
+}
+
+void Studio_FlushSharedPoses( void )
+{
+	AUTO_LOCK( g_StudioPoseCache.AccessMutex() );
+	g_StudioPoseCache.FlushAll();
+	g_StudioPoseIndex.RemoveAll();
+}
+
+void Studio_GetSharedPoseStats( sharedposestats_t &stats, bool bReset )
+{
+	AUTO_LOCK( g_StudioPoseCache.AccessMutex() );
+
+	PruneSharedPoseIndex();
+
+	stats.hits = g_nSharedPoseHits;
+	stats.misses = g_nSharedPoseMisses;
+	stats.poses = g_StudioPoseIndex.Count();
+	stats.usedBytes = g_StudioPoseCache.UsedSize();
+	stats.targetBytes = g_StudioPoseCache.TargetSize();
+
+	if ( bReset )
+	{
+		g_nSharedPoseHits = 0;
+		g_nSharedPoseMisses = 0;
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
@@ -492,6 +697,396 @@ inline void CalcBoneQuaternion( int frame, float s,
 
 
 
+//-----------------------------------------------------------------------------
+// Four bones at a time.  Each fltx4 of a BoneQuaternionSoA_t holds one component
+// of four bones, so the quaternion functions can run on four bones at once with
+// their branches turned into lane masks.  The per-bone code stays as the
+// reference, and anim_simd_bones 0 goes back to it.
+//-----------------------------------------------------------------------------
+static ConVar anim_simd_bones( "anim_simd_bones", "1", FCVAR_REPLICATED, "Decode and blend animations four bones at a time." );
+
+struct BoneQuaternionSoA_t
+{
+	fltx4 x, y, z, w;
+};
+
+struct BonePositionSoA_t
+{
+	fltx4 x, y, z;
+};
+
+FORCEINLINE void LoadQuaternionSoA( const Quaternion * const pQ[4], BoneQuaternionSoA_t &q )
+{
+	q.x = LoadUnalignedSIMD( pQ[0]->Base() );
+	q.y = LoadUnalignedSIMD( pQ[1]->Base() );
+	q.z = LoadUnalignedSIMD( pQ[2]->Base() );
+	q.w = LoadUnalignedSIMD( pQ[3]->Base() );
+	TransposeSIMD( q.x, q.y, q.z, q.w );
+}
+
+FORCEINLINE void StoreQuaternionSoA( Quaternion * const pQ[4], const BoneQuaternionSoA_t &q )
+{
+	fltx4 a = q.x, b = q.y, c = q.z, d = q.w;
+	TransposeSIMD( a, b, c, d );
+	StoreUnalignedSIMD( pQ[0]->Base(), a );
+	StoreUnalignedSIMD( pQ[1]->Base(), b );
+	StoreUnalignedSIMD( pQ[2]->Base(), c );
+	StoreUnalignedSIMD( pQ[3]->Base(), d );
+}
+
+// Vectors are 12 bytes, so they are gathered a float at a time rather than risk reading past the last bone
+FORCEINLINE void LoadPositionSoA( const Vector * const pPos[4], BonePositionSoA_t &pos )
+{
+	for ( int i = 0; i < 4; i++ )
+	{
+		SubFloat( pos.x, i ) = pPos[i]->x;
+		SubFloat( pos.y, i ) = pPos[i]->y;
+		SubFloat( pos.z, i ) = pPos[i]->z;
+	}
+}
+
+FORCEINLINE void StorePositionSoA( Vector * const pPos[4], const BonePositionSoA_t &pos )
+{
+	for ( int i = 0; i < 4; i++ )
+	{
+		pPos[i]->x = SubFloat( pos.x, i );
+		pPos[i]->y = SubFloat( pos.y, i );
+		pPos[i]->z = SubFloat( pos.z, i );
+	}
+}
+
+FORCEINLINE fltx4 QuaternionDotSoA( const BoneQuaternionSoA_t &p, const BoneQuaternionSoA_t &q )
+{
+	fltx4 dot = MulSIMD( p.x, q.x );
+	dot = AddSIMD( dot, MulSIMD( p.y, q.y ) );
+	dot = AddSIMD( dot, MulSIMD( p.z, q.z ) );
+	dot = AddSIMD( dot, MulSIMD( p.w, q.w ) );
+	return dot;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: QuaternionNormalize, leaving zero length lanes alone
+//-----------------------------------------------------------------------------
+FORCEINLINE void QuaternionNormalizeSoA( BoneQuaternionSoA_t &q )
+{
+	fltx4 radius = QuaternionDotSoA( q, q );
+	fltx4 iradius = DivSIMD( Four_Ones, SqrtSIMD( radius ) );
+	iradius = MaskedAssign( CmpGtSIMD( radius, Four_Zeros ), iradius, Four_Ones );
+
+	q.x = MulSIMD( q.x, iradius );
+	q.y = MulSIMD( q.y, iradius );
+	q.z = MulSIMD( q.z, iradius );
+	q.w = MulSIMD( q.w, iradius );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: QuaternionAlign of q to p, in place, for the lanes set in alignMask
+//-----------------------------------------------------------------------------
+FORCEINLINE void QuaternionAlignSoA( const BoneQuaternionSoA_t &p, BoneQuaternionSoA_t &q, const fltx4 &alignMask )
+{
+	fltx4 d, a, b;
+
+	d = SubSIMD( p.x, q.x );	a = MulSIMD( d, d );
+	d = SubSIMD( p.y, q.y );	a = AddSIMD( a, MulSIMD( d, d ) );
+	d = SubSIMD( p.z, q.z );	a = AddSIMD( a, MulSIMD( d, d ) );
+	d = SubSIMD( p.w, q.w );	a = AddSIMD( a, MulSIMD( d, d ) );
+
+	d = AddSIMD( p.x, q.x );	b = MulSIMD( d, d );
+	d = AddSIMD( p.y, q.y );	b = AddSIMD( b, MulSIMD( d, d ) );
+	d = AddSIMD( p.z, q.z );	b = AddSIMD( b, MulSIMD( d, d ) );
+	d = AddSIMD( p.w, q.w );	b = AddSIMD( b, MulSIMD( d, d ) );
+
+	fltx4 flip = AndSIMD( CmpGtSIMD( a, b ), alignMask );
+	q.x = MaskedAssign( flip, NegSIMD( q.x ), q.x );
+	q.y = MaskedAssign( flip, NegSIMD( q.y ), q.y );
+	q.z = MaskedAssign( flip, NegSIMD( q.z ), q.z );
+	q.w = MaskedAssign( flip, NegSIMD( q.w ), q.w );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: QuaternionBlend, or QuaternionBlendNoAlign for lanes not in alignMask
+//-----------------------------------------------------------------------------
+FORCEINLINE void QuaternionBlendSoA( const BoneQuaternionSoA_t &p, const BoneQuaternionSoA_t &q, const fltx4 &t, const fltx4 &alignMask, BoneQuaternionSoA_t &qt )
+{
+	BoneQuaternionSoA_t q2 = q;
+	QuaternionAlignSoA( p, q2, alignMask );
+
+	fltx4 sclp = SubSIMD( Four_Ones, t );
+	qt.x = AddSIMD( MulSIMD( sclp, p.x ), MulSIMD( t, q2.x ) );
+	qt.y = AddSIMD( MulSIMD( sclp, p.y ), MulSIMD( t, q2.y ) );
+	qt.z = AddSIMD( MulSIMD( sclp, p.z ), MulSIMD( t, q2.z ) );
+	qt.w = AddSIMD( MulSIMD( sclp, p.w ), MulSIMD( t, q2.w ) );
+	QuaternionNormalizeSoA( qt );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: QuaternionSlerp, or QuaternionSlerpNoAlign for lanes not in alignMask.
+//			The trig is only done when some lane needs it.
+//-----------------------------------------------------------------------------
+FORCEINLINE void QuaternionSlerpSoA( const BoneQuaternionSoA_t &p, const BoneQuaternionSoA_t &q, const fltx4 &t, const fltx4 &alignMask, BoneQuaternionSoA_t &qt )
+{
+	BoneQuaternionSoA_t q2 = q;
+	QuaternionAlignSoA( p, q2, alignMask );
+
+	fltx4 cosom = QuaternionDotSoA( p, q2 );
+	fltx4 epsilon = ReplicateX4( 0.000001f );
+	fltx4 notOpposite = CmpGtSIMD( AddSIMD( Four_Ones, cosom ), epsilon );
+	fltx4 notSame = AndSIMD( CmpGtSIMD( SubSIMD( Four_Ones, cosom ), epsilon ), notOpposite );
+
+	fltx4 sclp = SubSIMD( Four_Ones, t );
+	fltx4 sclq = t;
+	if ( !IsAllZeros( notSame ) )
+	{
+		fltx4 omega = ArcCosSIMD( MaxSIMD( MinSIMD( cosom, Four_Ones ), Four_NegativeOnes ) );
+		fltx4 sinom = SinSIMD( omega );
+		sinom = MaskedAssign( notSame, sinom, Four_Ones );
+		sclp = MaskedAssign( notSame, DivSIMD( SinSIMD( MulSIMD( sclp, omega ) ), sinom ), sclp );
+		sclq = MaskedAssign( notSame, DivSIMD( SinSIMD( MulSIMD( t, omega ) ), sinom ), sclq );
+	}
+
+	qt.x = AddSIMD( MulSIMD( sclp, p.x ), MulSIMD( sclq, q2.x ) );
+	qt.y = AddSIMD( MulSIMD( sclp, p.y ), MulSIMD( sclq, q2.y ) );
+	qt.z = AddSIMD( MulSIMD( sclp, p.z ), MulSIMD( sclq, q2.z ) );
+	qt.w = AddSIMD( MulSIMD( sclp, p.w ), MulSIMD( sclq, q2.w ) );
+
+	// opposite quaternions go through the perpendicular one, as QuaternionSlerpNoAlign does
+	if ( TestSignSIMD( notOpposite ) != 0xF )
+	{
+		fltx4 halfPi = ReplicateX4( 0.5f * M_PI );
+		fltx4 sclpo = SinSIMD( MulSIMD( SubSIMD( Four_Ones, t ), halfPi ) );
+		fltx4 sclqo = SinSIMD( MulSIMD( t, halfPi ) );
+
+		qt.x = MaskedAssign( notOpposite, qt.x, SubSIMD( MulSIMD( sclpo, p.x ), MulSIMD( sclqo, q2.y ) ) );
+		qt.y = MaskedAssign( notOpposite, qt.y, AddSIMD( MulSIMD( sclpo, p.y ), MulSIMD( sclqo, q2.x ) ) );
+		qt.z = MaskedAssign( notOpposite, qt.z, SubSIMD( MulSIMD( sclpo, p.z ), MulSIMD( sclqo, q2.w ) ) );
+		qt.w = MaskedAssign( notOpposite, qt.w, q2.z );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: QuaternionIdentityBlend
+//-----------------------------------------------------------------------------
+FORCEINLINE void QuaternionIdentityBlendSoA( const BoneQuaternionSoA_t &p, const fltx4 &t, BoneQuaternionSoA_t &qt )
+{
+	fltx4 sclp = SubSIMD( Four_Ones, t );
+	fltx4 w = MulSIMD( p.w, sclp );
+
+	qt.x = MulSIMD( p.x, sclp );
+	qt.y = MulSIMD( p.y, sclp );
+	qt.z = MulSIMD( p.z, sclp );
+	qt.w = MaskedAssign( CmpLtSIMD( p.w, Four_Zeros ), SubSIMD( w, t ), AddSIMD( w, t ) );
+	QuaternionNormalizeSoA( qt );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: AngleQuaternion of the x, y, z angles in 'angles'
+//-----------------------------------------------------------------------------
+FORCEINLINE void AngleQuaternionSoA( const fltx4 angles[3], BoneQuaternionSoA_t &q )
+{
+	fltx4 sr, sp, sy, cr, cp, cy;
+
+	SinCosSIMD( sy, cy, MulSIMD( angles[2], Four_PointFives ) );
+	SinCosSIMD( sp, cp, MulSIMD( angles[1], Four_PointFives ) );
+	SinCosSIMD( sr, cr, MulSIMD( angles[0], Four_PointFives ) );
+
+	fltx4 srXcp = MulSIMD( sr, cp ), crXsp = MulSIMD( cr, sp );
+	q.x = SubSIMD( MulSIMD( srXcp, cy ), MulSIMD( crXsp, sy ) );
+	q.y = AddSIMD( MulSIMD( crXsp, cy ), MulSIMD( srXcp, sy ) );
+
+	fltx4 crXcp = MulSIMD( cr, cp ), srXsp = MulSIMD( sr, sp );
+	q.z = SubSIMD( MulSIMD( crXcp, sy ), MulSIMD( srXsp, cy ) );
+	q.w = AddSIMD( MulSIMD( crXcp, cy ), MulSIMD( srXsp, sy ) );
+}
+
+FORCEINLINE void LerpPositionSoA( BonePositionSoA_t &pos1, const BonePositionSoA_t &pos2, const fltx4 &s1, const fltx4 &s2 )
+{
+	pos1.x = AddSIMD( MulSIMD( pos1.x, s1 ), MulSIMD( pos2.x, s2 ) );
+	pos1.y = AddSIMD( MulSIMD( pos1.y, s1 ), MulSIMD( pos2.y, s2 ) );
+	pos1.z = AddSIMD( MulSIMD( pos1.z, s1 ), MulSIMD( pos2.z, s2 ) );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: pad a list of bones out to a multiple of four by repeating the last
+//			one.  The repeated lanes compute and store the same values again.
+//-----------------------------------------------------------------------------
+static int PadBoneLanes( int *pBones, int nCount )
+{
+	if ( nCount == 0 )
+		return 0;
+
+	while ( nCount & 3 )
+	{
+		pBones[nCount] = pBones[nCount-1];
+		nCount++;
+	}
+	return nCount;
+}
+
+static fltx4 FixedAlignmentMask( const CStudioHdr *pStudioHdr, const int *pBones )
+{
+	fltx4 alignMask;
+	for ( int i = 0; i < 4; i++ )
+	{
+		SubInt( alignMask, i ) = ( pStudioHdr->boneFlags( pBones[i] ) & BONE_FIXED_ALIGNMENT ) ? 0 : ~0;
+	}
+	return alignMask;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: CalcBoneQuaternion, four bones at a time.  The anim values are run
+//			length encoded, so they are still read one bone at a time, but the
+//			euler to quaternion conversions, the blend between the two frames and
+//			the alignment to the unified bone are done on four bones at once.
+//			Raw and unanimated rotations are done as they are added.
+//-----------------------------------------------------------------------------
+class CBoneQuaternionDecoder
+{
+public:
+	CBoneQuaternionDecoder( bool bSIMD ) : m_bSIMD( bSIMD ), m_nCount( 0 ) {}
+
+	void Add( int frame, float s, const mstudiobone_t *pBone, const mstudiolinearbone_t *pLinearBones, const mstudioanim_t *panim, Quaternion &q );
+	void Flush( void );		// must be called before the quaternions are used
+
+private:
+	void Decode( void );
+
+	bool m_bSIMD;
+	int m_nCount;
+	Quaternion *m_pOut[4];
+
+	fltx4 m_Angle1[3];					// x, y, z of each lane's angles at the frame
+	fltx4 m_Angle2[3];					// and at the next frame
+	fltx4 m_Blend;						// weight of the next frame
+	fltx4 m_BlendMask;					// lanes whose angles differ between the frames
+	BoneQuaternionSoA_t m_Alignment;	// unified bone alignment
+	fltx4 m_AlignMask;					// lanes to align
+};
+
+void CBoneQuaternionDecoder::Add( int frame, float s, const mstudiobone_t *pBone, const mstudiolinearbone_t *pLinearBones, const mstudioanim_t *panim, Quaternion &q )
+{
+	if ( !m_bSIMD || ( panim->flags & ( STUDIO_ANIM_RAWROT | STUDIO_ANIM_RAWROT2 ) ) || !( panim->flags & STUDIO_ANIM_ANIMROT ) )
+	{
+		CalcBoneQuaternion( frame, s, pBone, pLinearBones, panim, q );
+		return;
+	}
+
+	RadianEuler baseRot;
+	Vector baseRotScale;
+	int iBaseFlags;
+	Quaternion baseAlignment;
+	if ( pLinearBones )
+	{
+		baseRot = pLinearBones->rot( panim->bone );
+		baseRotScale = pLinearBones->rotscale( panim->bone );
+		iBaseFlags = pLinearBones->flags( panim->bone );
+		baseAlignment = pLinearBones->qalignment( panim->bone );
+	}
+	else
+	{
+		baseRot = pBone->rot;
+		baseRotScale = pBone->rotscale;
+		iBaseFlags = pBone->flags;
+		baseAlignment = pBone->qAlignment;
+	}
+
+	mstudioanim_valueptr_t *pValuesPtr = panim->pRotV();
+	RadianEuler angle1, angle2;
+
+	if (s > 0.001f)
+	{
+		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 0 ), baseRotScale.x, angle1.x, angle2.x );
+		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 1 ), baseRotScale.y, angle1.y, angle2.y );
+		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 2 ), baseRotScale.z, angle1.z, angle2.z );
+	}
+	else
+	{
+		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 0 ), baseRotScale.x, angle1.x );
+		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 1 ), baseRotScale.y, angle1.y );
+		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 2 ), baseRotScale.z, angle1.z );
+		angle2 = angle1;
+	}
+
+	if (!(panim->flags & STUDIO_ANIM_DELTA))
+	{
+		angle1.x = angle1.x + baseRot.x;
+		angle1.y = angle1.y + baseRot.y;
+		angle1.z = angle1.z + baseRot.z;
+		angle2.x = angle2.x + baseRot.x;
+		angle2.y = angle2.y + baseRot.y;
+		angle2.z = angle2.z + baseRot.z;
+	}
+
+	Assert( angle1.IsValid() && angle2.IsValid() );
+
+	int i = m_nCount;
+	m_pOut[i] = &q;
+	SubFloat( m_Angle1[0], i ) = angle1.x;
+	SubFloat( m_Angle1[1], i ) = angle1.y;
+	SubFloat( m_Angle1[2], i ) = angle1.z;
+	SubFloat( m_Angle2[0], i ) = angle2.x;
+	SubFloat( m_Angle2[1], i ) = angle2.y;
+	SubFloat( m_Angle2[2], i ) = angle2.z;
+	SubFloat( m_Blend, i ) = s;
+	SubInt( m_BlendMask, i ) = ( angle1.x != angle2.x || angle1.y != angle2.y || angle1.z != angle2.z ) ? ~0 : 0;
+	SubFloat( m_Alignment.x, i ) = baseAlignment.x;
+	SubFloat( m_Alignment.y, i ) = baseAlignment.y;
+	SubFloat( m_Alignment.z, i ) = baseAlignment.z;
+	SubFloat( m_Alignment.w, i ) = baseAlignment.w;
+	SubInt( m_AlignMask, i ) = ( !(panim->flags & STUDIO_ANIM_DELTA) && (iBaseFlags & BONE_FIXED_ALIGNMENT) ) ? ~0 : 0;
+
+	if ( ++m_nCount == 4 )
+	{
+		Decode();
+	}
+}
+
+void CBoneQuaternionDecoder::Flush( void )
+{
+	if ( m_nCount == 0 )
+		return;
+
+	// fill the empty lanes with copies of the last bone
+	fltx4 *pLanes[] = { &m_Angle1[0], &m_Angle1[1], &m_Angle1[2], &m_Angle2[0], &m_Angle2[1], &m_Angle2[2], &m_Blend, &m_BlendMask,
+		&m_Alignment.x, &m_Alignment.y, &m_Alignment.z, &m_Alignment.w, &m_AlignMask };
+
+	int iLast = m_nCount - 1;
+	for ( int i = m_nCount; i < 4; i++ )
+	{
+		m_pOut[i] = m_pOut[iLast];
+		for ( int j = 0; j < (int)ARRAYSIZE( pLanes ); j++ )
+		{
+			SubInt( *pLanes[j], i ) = SubInt( *pLanes[j], iLast );
+		}
+	}
+
+	Decode();
+}
+
+void CBoneQuaternionDecoder::Decode( void )
+{
+	BoneQuaternionSoA_t q;
+	AngleQuaternionSoA( m_Angle1, q );
+
+	if ( !IsAllZeros( m_BlendMask ) )
+	{
+		BoneQuaternionSoA_t q2, qt;
+		AngleQuaternionSoA( m_Angle2, q2 );
+		QuaternionBlendSoA( q, q2, m_Blend, LoadAlignedSIMD( g_SIMD_AllOnesMask ), qt );
+
+		q.x = MaskedAssign( m_BlendMask, qt.x, q.x );
+		q.y = MaskedAssign( m_BlendMask, qt.y, q.y );
+		q.z = MaskedAssign( m_BlendMask, qt.z, q.z );
+		q.w = MaskedAssign( m_BlendMask, qt.w, q.w );
+	}
+
+	QuaternionAlignSoA( m_Alignment, q, m_AlignMask );
+	StoreQuaternionSoA( m_pOut, q );
+
+	m_nCount = 0;
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: return a sub frame position for a single bone
 //-----------------------------------------------------------------------------
@@ -965,6 +1560,8 @@ static void CalcVirtualAnimation( virtualmodel_t *pVModel, const CStudioHdr *pSt
 		return;
 	}
 
+	CBoneQuaternionDecoder decoder( anim_simd_bones.GetBool() );
+
 	// FIXME: change encoding so that bone -1 is never the case
 	while (panim && panim->bone < 255)
 	{
@@ -975,7 +1572,7 @@ static void CalcVirtualAnimation( virtualmodel_t *pVModel, const CStudioHdr *pSt
 
 			if (k >= 0 && pweight[k] > 0.0f)
 			{
-				CalcBoneQuaternion( iLocalFrame, s, &pAnimbone[panim->bone], pAnimLinearBones, panim, q[j] );
+				decoder.Add( iLocalFrame, s, &pAnimbone[panim->bone], pAnimLinearBones, panim, q[j] );
 				CalcBonePosition  ( iLocalFrame, s, &pAnimbone[panim->bone], pAnimLinearBones, panim, pos[j] );
 #ifdef STUDIO_ENABLE_PERF_COUNTERS
 				pStudioHdr->m_nPerfAnimatedBones++;
@@ -985,6 +1582,8 @@ static void CalcVirtualAnimation( virtualmodel_t *pVModel, const CStudioHdr *pSt
 		panim = panim->pNext();
 	}
 
+	decoder.Flush();
+
 	// cross fade in previous zeroframe data
 	if (flStall > 0.0f)
 	{
@@ -1095,6 +1694,8 @@ static void CalcAnimation( const CStudioHdr *pStudioHdr,	Vector *pos, Quaternion
 		return;
 	}
 
+	CBoneQuaternionDecoder decoder( anim_simd_bones.GetBool() );
+
 	// BUGBUG: the sequence, the anim, and the model can have all different bone mappings.
 	for (i = 0; i < pStudioHdr->numbones(); i++, pbone++, pweight++)
 	{
@@ -1102,7 +1703,7 @@ static void CalcAnimation( const CStudioHdr *pStudioHdr,	Vector *pos, Quaternion
 		{
 			if (*pweight > 0 && (pStudioHdr->boneFlags(i) & boneMask))
 			{
-				CalcBoneQuaternion( iLocalFrame, s, pbone, pLinearBones, panim, q[i] );
+				decoder.Add( iLocalFrame, s, pbone, pLinearBones, panim, q[i] );
 				CalcBonePosition  ( iLocalFrame, s, pbone, pLinearBones, panim, pos[i] );
 #ifdef STUDIO_ENABLE_PERF_COUNTERS
 				pStudioHdr->m_nPerfAnimatedBones++;
@@ -1129,6 +1730,8 @@ static void CalcAnimation( const CStudioHdr *pStudioHdr,	Vector *pos, Quaternion
 		}
 	}
 
+	decoder.Flush();
+
 	// cross fade in previous zeroframe data
 	if (flStall > 0.0f)
 	{
@@ -1370,6 +1973,62 @@ void WorldSpaceSlerp(
 
 
 
+//-----------------------------------------------------------------------------
+// Purpose: the non-delta blend of SlerpBones, four bones at a time
+//-----------------------------------------------------------------------------
+static void SlerpBonesSIMD(
+	const CStudioHdr *pStudioHdr,
+	Quaternion q1[MAXSTUDIOBONES], 
+	Vector pos1[MAXSTUDIOBONES], 
+	const QuaternionAligned q2[MAXSTUDIOBONES], 
+	const Vector pos2[MAXSTUDIOBONES], 
+	const float *pS2,
+	int nBoneCount )
+{
+	int *pBones = (int*)stackalloc( ( nBoneCount + 3 ) * sizeof(int) );
+	int nCount = 0;
+	for ( int i = 0; i < nBoneCount; i++ )
+	{
+		if ( pS2[i] > 0.0f )
+		{
+			pBones[nCount++] = i;
+		}
+	}
+	nCount = PadBoneLanes( pBones, nCount );
+
+	for ( int i = 0; i < nCount; i += 4 )
+	{
+		Quaternion *pQ1[4];
+		const Quaternion *pQ2[4];
+		Vector *pPos1[4];
+		const Vector *pPos2[4];
+		fltx4 s2;
+		for ( int j = 0; j < 4; j++ )
+		{
+			int iBone = pBones[i+j];
+			pQ1[j] = &q1[iBone];
+			pQ2[j] = &q2[iBone];
+			pPos1[j] = &pos1[iBone];
+			pPos2[j] = &pos2[iBone];
+			SubFloat( s2, j ) = pS2[iBone];
+		}
+		fltx4 s1 = SubSIMD( Four_Ones, s2 );
+
+		BoneQuaternionSoA_t qa, qb, qt;
+		LoadQuaternionSoA( pQ2, qa );
+		LoadQuaternionSoA( pQ1, qb );
+		QuaternionSlerpSoA( qa, qb, s1, FixedAlignmentMask( pStudioHdr, &pBones[i] ), qt );
+		StoreQuaternionSoA( pQ1, qt );
+
+		BonePositionSoA_t pa, pb;
+		LoadPositionSoA( pPos1, pa );
+		LoadPositionSoA( pPos2, pb );
+		LerpPositionSoA( pa, pb, s1, s2 );
+		StorePositionSoA( pPos1, pa );
+	}
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: blend together q1,pos1 with q2,pos2.  Return result in q1,pos1.  
 //			0 returns q1, pos1.  1 returns q2, pos2
@@ -1479,6 +2138,12 @@ void SlerpBones(
 		return;
 	}
 
+	if ( anim_simd_bones.GetBool() )
+	{
+		SlerpBonesSIMD( pStudioHdr, q1, pos1, q2, pos2, pS2, nBoneCount );
+		return;
+	}
+
 	QuaternionAligned q3;
 	for (i = 0; i < nBoneCount; i++)
 	{
@@ -1527,6 +2192,114 @@ void SlerpBones(
 
 
 
+//-----------------------------------------------------------------------------
+// Purpose: list the bones BlendBones and ScaleBones change, padded for SIMD
+//-----------------------------------------------------------------------------
+static int WeightedBoneLanes( const CStudioHdr *pStudioHdr, mstudioseqdesc_t &seqdesc, const virtualgroup_t *pSeqGroup, int boneMask, int *pBones )
+{
+	int nCount = 0;
+	for ( int i = 0; i < pStudioHdr->numbones(); i++ )
+	{
+		// skip unused bones
+		if (!(pStudioHdr->boneFlags(i) & boneMask))
+		{
+			continue;
+		}
+
+		int j = pSeqGroup ? pSeqGroup->boneMap[i] : i;
+		if (j >= 0 && seqdesc.weight( j ) > 0.0)
+		{
+			pBones[nCount++] = i;
+		}
+	}
+	return PadBoneLanes( pBones, nCount );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: the blend of BlendBones, four bones at a time
+//-----------------------------------------------------------------------------
+static void BlendBonesSIMD(
+	const CStudioHdr *pStudioHdr,
+	Quaternion q1[MAXSTUDIOBONES], 
+	Vector pos1[MAXSTUDIOBONES], 
+	const Quaternion q2[MAXSTUDIOBONES], 
+	const Vector pos2[MAXSTUDIOBONES], 
+	float s,
+	const int *pBones,
+	int nCount )
+{
+	fltx4 s2 = ReplicateX4( s );
+	fltx4 s1 = SubSIMD( Four_Ones, s2 );
+
+	for ( int i = 0; i < nCount; i += 4 )
+	{
+		Quaternion *pQ1[4];
+		const Quaternion *pQ2[4];
+		Vector *pPos1[4];
+		const Vector *pPos2[4];
+		for ( int j = 0; j < 4; j++ )
+		{
+			int iBone = pBones[i+j];
+			pQ1[j] = &q1[iBone];
+			pQ2[j] = &q2[iBone];
+			pPos1[j] = &pos1[iBone];
+			pPos2[j] = &pos2[iBone];
+		}
+
+		BoneQuaternionSoA_t qa, qb, qt;
+		LoadQuaternionSoA( pQ2, qa );
+		LoadQuaternionSoA( pQ1, qb );
+		QuaternionBlendSoA( qa, qb, s1, FixedAlignmentMask( pStudioHdr, &pBones[i] ), qt );
+		StoreQuaternionSoA( pQ1, qt );
+
+		BonePositionSoA_t pa, pb;
+		LoadPositionSoA( pPos1, pa );
+		LoadPositionSoA( pPos2, pb );
+		LerpPositionSoA( pa, pb, s1, s2 );
+		StorePositionSoA( pPos1, pa );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: the scale of ScaleBones, four bones at a time
+//-----------------------------------------------------------------------------
+static void ScaleBonesSIMD(
+	Quaternion q1[MAXSTUDIOBONES], 
+	Vector pos1[MAXSTUDIOBONES], 
+	float s,
+	const int *pBones,
+	int nCount )
+{
+	fltx4 s2 = ReplicateX4( s );
+	fltx4 s1 = SubSIMD( Four_Ones, s2 );
+
+	for ( int i = 0; i < nCount; i += 4 )
+	{
+		Quaternion *pQ1[4];
+		Vector *pPos1[4];
+		for ( int j = 0; j < 4; j++ )
+		{
+			pQ1[j] = &q1[pBones[i+j]];
+			pPos1[j] = &pos1[pBones[i+j]];
+		}
+
+		BoneQuaternionSoA_t q;
+		LoadQuaternionSoA( pQ1, q );
+		QuaternionIdentityBlendSoA( q, s1, q );
+		StoreQuaternionSoA( pQ1, q );
+
+		BonePositionSoA_t pos;
+		LoadPositionSoA( pPos1, pos );
+		pos.x = MulSIMD( pos.x, s2 );
+		pos.y = MulSIMD( pos.y, s2 );
+		pos.z = MulSIMD( pos.z, s2 );
+		StorePositionSoA( pPos1, pos );
+	}
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: Inter-animation blend.  Assumes both types are identical.
 //			blend together q1,pos1 with q2,pos2.  Return result in q1,pos1.  
@@ -1587,6 +2360,14 @@ void BlendBones(
 		return;
 	}
 
+	if ( anim_simd_bones.GetBool() )
+	{
+		int *pBones = (int*)stackalloc( ( pStudioHdr->numbones() + 3 ) * sizeof(int) );
+		int nCount = WeightedBoneLanes( pStudioHdr, seqdesc, pSeqGroup, boneMask, pBones );
+		BlendBonesSIMD( pStudioHdr, q1, pos1, q2, pos2, s, pBones, nCount );
+		return;
+	}
+
 	float s2 = s;
 	float s1 = 1.0 - s2;
 
@@ -1653,6 +2434,14 @@ void ScaleBones(
 		pSeqGroup = pVModel->pSeqGroup( sequence );
 	}
 
+	if ( anim_simd_bones.GetBool() )
+	{
+		int *pBones = (int*)stackalloc( ( pStudioHdr->numbones() + 3 ) * sizeof(int) );
+		int nCount = WeightedBoneLanes( pStudioHdr, seqdesc, pSeqGroup, boneMask, pBones );
+		ScaleBonesSIMD( q1, pos1, s, pBones, nCount );
+		return;
+	}
+
 	float s2 = s;
 	float s1 = 1.0 - s2;
 
@@ -6044,3 +6833,123 @@ void Studio_RunBoneFlexDrivers( float *pflFlexControllerWeights, const CStudioHd
 		}
 	}
 }
+
+
+//-----------------------------------------------------------------------------
+// Purpose: time CalcAnimation, SlerpBones, BlendBones and ScaleBones on every
+//			sequence of a model, one bone at a time and four at a time, and
+//			report nanoseconds per bone.  Both paths start from the same poses,
+//			and the largest difference between their results is reported too.
+//-----------------------------------------------------------------------------
+void Studio_BenchmarkPoseKernels( const CStudioHdr *pStudioHdr, int nPasses )
+{
+	enum
+	{
+		POSE_DECODE,
+		POSE_SLERP,
+		POSE_BLEND,
+		POSE_SCALE,
+		POSE_KERNEL_COUNT
+	};
+	static const char *s_pKernelName[POSE_KERNEL_COUNT] = { "decode", "slerp", "blend", "scale" };
+
+	int nBoneCount = pStudioHdr->numbones();
+	int nSeqCount = pStudioHdr->GetNumSeq();
+	if ( nBoneCount == 0 || nSeqCount == 0 || nPasses <= 0 )
+		return;
+
+	Vector pos1[MAXSTUDIOBONES], pos2[MAXSTUDIOBONES], pos[2][MAXSTUDIOBONES];
+	QuaternionAligned q1[MAXSTUDIOBONES], q2[MAXSTUDIOBONES], q[2][MAXSTUDIOBONES];
+
+	double flTime[POSE_KERNEL_COUNT][2];
+	float flQuatError[POSE_KERNEL_COUNT];
+	float flPosError[POSE_KERNEL_COUNT];
+	for ( int k = 0; k < POSE_KERNEL_COUNT; k++ )
+	{
+		flTime[k][0] = flTime[k][1] = 0.0;
+		flQuatError[k] = flPosError[k] = 0.0f;
+	}
+
+	bool bSIMD = anim_simd_bones.GetBool();
+
+	// the same cycles and weights every run
+	CUniformRandomStream random;
+	random.SetSeed( 1 );
+
+	for ( int iSeq = 0; iSeq < nSeqCount; iSeq++ )
+	{
+		mstudioseqdesc_t &seqdesc = ((CStudioHdr *)pStudioHdr)->pSeqdesc( iSeq );
+		int iAnim = seqdesc.anim( 0, 0 );
+		float flCycle1 = random.RandomFloat( 0.0f, 1.0f );
+		float flCycle2 = random.RandomFloat( 0.0f, 1.0f );
+		float s = random.RandomFloat( 0.1f, 0.9f );
+
+		// the poses each kernel starts from
+		InitPose( pStudioHdr, pos1, q1, BONE_USED_BY_ANYTHING );
+		InitPose( pStudioHdr, pos2, q2, BONE_USED_BY_ANYTHING );
+		CalcAnimation( pStudioHdr, pos1, q1, seqdesc, iSeq, iAnim, flCycle1, BONE_USED_BY_ANYTHING );
+		CalcAnimation( pStudioHdr, pos2, q2, seqdesc, iSeq, iAnim, flCycle2, BONE_USED_BY_ANYTHING );
+
+		for ( int k = 0; k < POSE_KERNEL_COUNT; k++ )
+		{
+			for ( int m = 0; m < 2; m++ )
+			{
+				anim_simd_bones.SetValue( m );
+
+				double flStart = Plat_FloatTime();
+				for ( int n = 0; n < nPasses; n++ )
+				{
+					// every pass starts over from the same pose
+					memcpy( pos[m], pos1, nBoneCount * sizeof( Vector ) );
+					memcpy( q[m], q1, nBoneCount * sizeof( QuaternionAligned ) );
+
+					switch( k )
+					{
+					case POSE_DECODE:
+						CalcAnimation( pStudioHdr, pos[m], q[m], seqdesc, iSeq, iAnim, flCycle2, BONE_USED_BY_ANYTHING );
+						break;
+					case POSE_SLERP:
+						SlerpBones( pStudioHdr, q[m], pos[m], seqdesc, iSeq, q2, pos2, s, BONE_USED_BY_ANYTHING );
+						break;
+					case POSE_BLEND:
+						BlendBones( pStudioHdr, q[m], pos[m], seqdesc, iSeq, q2, pos2, s, BONE_USED_BY_ANYTHING );
+						break;
+					case POSE_SCALE:
+						ScaleBones( pStudioHdr, q[m], pos[m], iSeq, s, BONE_USED_BY_ANYTHING );
+						break;
+					}
+				}
+				flTime[k][m] += Plat_FloatTime() - flStart;
+			}
+
+			for ( int i = 0; i < nBoneCount; i++ )
+			{
+				for ( int j = 0; j < 4; j++ )
+				{
+					flQuatError[k] = MAX( flQuatError[k], fabs( q[0][i][j] - q[1][i][j] ) );
+				}
+				for ( int j = 0; j < 3; j++ )
+				{
+					flPosError[k] = MAX( flPosError[k], fabs( pos[0][i][j] - pos[1][i][j] ) );
+				}
+			}
+		}
+	}
+
+	anim_simd_bones.SetValue( bSIMD );
+
+	double flScale = 1.0e9 / ( (double)nPasses * nSeqCount * nBoneCount );
+
+	Msg( "%s: %d bones, %d sequences, %d passes, times include restoring the pose\n", pStudioHdr->pszName(), nBoneCount, nSeqCount, nPasses );
+	Msg( "  %-8s %14s %14s %8s %12s %12s\n", "", "per bone ns", "4 bones ns", "speedup", "quat error", "pos error" );
+	for ( int k = 0; k < POSE_KERNEL_COUNT; k++ )
+	{
+		Msg( "  %-8s %14.2f %14.2f %7.2fx %12g %12g\n", s_pKernelName[k], flTime[k][0] * flScale, flTime[k][1] * flScale,
+			flTime[k][1] > 0.0 ? flTime[k][0] / flTime[k][1] : 0.0, flQuatError[k], flPosError[k] );
+
+		if ( flQuatError[k] > 1.0e-4f || flPosError[k] > 1.0e-3f )
+		{
+			Warning( "%s: %s differs between the per bone and four bone paths\n", pStudioHdr->pszName(), s_pKernelName[k] );
+		}
+	}
+}
@@ -436,6 +436,50 @@ memhandle_t Studio_CreateBoneCache( bonecacheparams_t &params );
 void Studio_DestroyBoneCache( memhandle_t cacheHandle );
 void Studio_InvalidateBoneCache( memhandle_t cacheHandle );
 
+//-----------------------------------------------------------------------------
+// Purpose: names a local pose by everything that went into it, so entities that
+//			animate identically can share one instead of each decoding it.
+//			Floats are quantized to 'steps' per unit, so inputs within a step of
+//			each other get the same pose.
+//-----------------------------------------------------------------------------
+class CPoseCacheKey
+{
+public:
+	CPoseCacheKey( int steps );
+
+	void AddInt( int value );
+	void AddPointer( const void *p );
+	void AddFloat( float value );						// exactly
+	void AddQuantized( float value );					// to the nearest step
+
+	bool IsValid( void ) const { return m_nCount > 0 && !m_bOverflow; }
+	unsigned int GetHash( void ) const;
+	bool operator==( const CPoseCacheKey &other ) const;
+
+private:
+	enum { MAX_KEY_INTS = 96 };
+
+	int m_nSteps;
+	int m_nCount;
+	bool m_bOverflow;
+	int m_nData[MAX_KEY_INTS];
+};
+
+struct sharedposestats_t
+{
+	int hits;
+	int misses;
+	int poses;
+	unsigned int usedBytes;
+	unsigned int targetBytes;
+};
+
+// Local poses (before the root transform) shared between entities, dropped least recently used first
+bool Studio_GetSharedPose( const CPoseCacheKey &key, int numbones, Vector pos[], Quaternion q[] );
+void Studio_AddSharedPose( const CPoseCacheKey &key, int numbones, const Vector pos[], const Quaternion q[] );
+void Studio_FlushSharedPoses( void );
+void Studio_GetSharedPoseStats( sharedposestats_t &stats, bool bReset );
+
 // Given a ray, trace for an intersection with this studiomodel.  Get the array of bones from StudioSetupHitboxBones
 bool TraceToStudio( class IPhysicsSurfaceProps *pProps, const Ray_t& ray, CStudioHdr *pStudioHdr, mstudiohitboxset_t *set, matrix3x4_t **hitboxbones, int fContentsMask, const Vector &vecOrigin, float flScale, trace_t &trace );
 
@@ -446,4 +490,7 @@ bool Studio_PrefetchSequence( const CStudioHdr *pStudioHdr, int iSequence );
 
 void Studio_RunBoneFlexDrivers( float *pFlexController, const CStudioHdr *pStudioHdr, const Vector *pPositions, const matrix3x4_t *pBoneToWorld, const matrix3x4_t &mRootToWorld );
 
+// Time animation decode and blending one bone at a time against four at a time, on every sequence of the model
+void Studio_BenchmarkPoseKernels( const CStudioHdr *pStudioHdr, int nPasses );
+
 #endif // BONE_SETUP_H
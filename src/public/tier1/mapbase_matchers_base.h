@@ -18,8 +18,13 @@
 // Regular expressions based off of the std library.
 // pszQuery = The regex text.
 // szValue = The value that should be matched.
+// Compiled patterns are kept in a bounded LRU cache (see mapbase_regex_cache_size).
 bool Matcher_Regex( const char *pszQuery, const char *szValue );
 
+// Compiles a regex into the cache ahead of time, e.g. when a map's keyvalues are parsed.
+// pszQuery = The regex text, without the "@/" prefix.
+void Matcher_PrecacheRegex( const char *pszQuery );
+
 // Compares two strings with support for wildcards or regex. This code is an expanded version of baseentity.cpp's NamesMatch().
 // pszQuery = The value that should have the wildcard.
 // szValue = The value tested against the query.
@@ -7,6 +7,11 @@
 
 #include "mapbase_matchers_base.h"
 #include "convar.h"
+#include "utlstring.h"
+#include "utllinkedlist.h"
+#include "utlhashtable.h"
+#include "tier0/threadtools.h"
+#include "tier0/platform.h"
 
 // glibc (Linux) uses these tokens when including <regex>, so we must not #define them
 #undef max
@@ -18,6 +23,7 @@
 ConVar mapbase_wildcards_enabled("mapbase_wildcards_enabled", "1", FCVAR_NONE, "Toggles Mapbase's '?' wildcard and true '*' features. Useful for maps that have '?' in their targetnames.");
 ConVar mapbase_wildcards_lazy_hack("mapbase_wildcards_lazy_hack", "1", FCVAR_NONE, "Toggles a hack which prevents Mapbase's lazy '?' wildcards from picking up \"???\", the default instance parameter.");
 ConVar mapbase_regex_enabled("mapbase_regex_enabled", "1", FCVAR_NONE, "Toggles Mapbase's regex matching handover.");
+ConVar mapbase_regex_cache_size("mapbase_regex_cache_size", "128", FCVAR_NONE, "Maximum number of compiled regex patterns Mapbase keeps around. The least recently used pattern is dropped first.", true, 1, false, 0);
 
 //=============================================================================
 // These are the "matchers" that compare with wildcards ("any*" for text starting with "any")
@@ -29,8 +35,10 @@ ConVar mapbase_regex_enabled("mapbase_regex_enabled", "1", FCVAR_NONE, "Toggles
 // AppearsToBeANumber - Response System-based function which checks if the string might be a number.
 //=============================================================================
 
-// The recursive part of Mapbase's modified version of Valve's NamesMatch().
-bool Matcher_RunCharCompare(const char *pszQuery, const char *szValue)
+// The original recursive form of Mapbase's modified version of Valve's NamesMatch().
+// Still used when the value itself contains a '*', since a literal '*' in the value
+// is matched as a character instead of being treated as a wildcard.
+static bool Matcher_RunCharCompare_Recursive(const char *pszQuery, const char *szValue)
 {
 	// This matching model is based off of the ASW SDK
 	while ( *szValue && *pszQuery )
@@ -56,7 +64,7 @@ bool Matcher_RunCharCompare(const char *pszQuery, const char *szValue)
 							++pszQuery;
 							for (int i = 0; i < vlen; i++)
 							{
-								if (Matcher_RunCharCompare(pszQuery, szValue + i))
+								if (Matcher_RunCharCompare_Recursive(pszQuery, szValue + i))
 									return true;
 							}
 						}
@@ -78,9 +86,196 @@ bool Matcher_RunCharCompare(const char *pszQuery, const char *szValue)
 	return ( ( *pszQuery == 0 && *szValue == 0 ) || *pszQuery == '*' );
 }
 
+// Iterative version of the above. Instead of recursing for every '*', this tracks the set of
+// query positions that are still alive as it walks the value, one bit per position, so it runs
+// in O(query * value) with no backtracking. Gives the same results as the recursive version.
+bool Matcher_RunCharCompare(const char *pszQuery, const char *szValue)
+{
+	// A literal '*' in the value is compared as a character by the recursive version, and
+	// the bit set only has room for so many query characters
+	int nQueryLen = Q_strlen( pszQuery );
+	if ( !mapbase_wildcards_enabled.GetBool() || nQueryLen >= 64 || strchr( szValue, '*' ) != NULL )
+		return Matcher_RunCharCompare_Recursive( pszQuery, szValue );
+
+	uint64 active = 1;	// query positions matched up to the current value character
+	uint64 sticky = 0;	// positions after a '*', which stay alive for every remaining character
+
+	for ( ; *szValue; ++szValue )
+	{
+		active |= sticky;
+		if ( !active )
+			return false;
+
+		// A '*' can swallow nothing, so the position after it is alive right away
+		for ( int i = 0; i < nQueryLen; i++ )
+		{
+			if ( (active & (1ull << i)) && pszQuery[i] == '*' )
+			{
+				// Return true at classic trailing *
+				if ( pszQuery[i+1] == 0 )
+					return true;
+
+				active |= (1ull << (i+1));
+				sticky |= (1ull << (i+1));
+			}
+		}
+
+		char cName = *szValue;
+		uint64 next = 0;
+		for ( int i = 0; i < nQueryLen; i++ )
+		{
+			if ( !(active & (1ull << i)) )
+				continue;
+
+			char cQuery = pszQuery[i];
+			if ( cQuery == '*' )
+				continue;
+
+			if ( cName == cQuery || tolower(cName) == tolower(cQuery) || cQuery == '?' )
+				next |= (1ull << (i+1));
+		}
+
+		active = next;
+	}
+
+	// Include a classic trailing * check for when szValue is something like "value" and pszQuery is "value*"
+	for ( int i = 0; i <= nQueryLen; i++ )
+	{
+		if ( (active & (1ull << i)) && (pszQuery[i] == 0 || pszQuery[i] == '*') )
+			return true;
+	}
+
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Compiled regex cache
+// 
+// Compiling a std::regex is far more expensive than running it, and the same few
+// patterns are queried over and over by entity searches and filters.
+//-----------------------------------------------------------------------------
+struct MatcherRegexEntry_t
+{
+	CUtlString m_Pattern;
+	std::regex *m_pRegex;	// NULL if the pattern didn't compile
+};
+
+class CMatcherRegexCache
+{
+public:
+	CMatcherRegexCache() : m_Lookup( 64 ), m_nHits( 0 ), m_nMisses( 0 ) {}
+	~CMatcherRegexCache() { Purge(); }
+
+	// Returns the entry for the pattern, compiling it if needed. Call with the mutex held.
+	MatcherRegexEntry_t &Get( const char *pszPattern );
+
+	void Purge();
+
+	CThreadFastMutex &GetMutex() { return m_Mutex; }
+	int Count() const { return m_LRU.Count(); }
+	int Hits() const { return m_nHits; }
+	int Misses() const { return m_nMisses; }
+
+private:
+	// Head is the most recently used entry
+	CUtlLinkedList<MatcherRegexEntry_t, unsigned short> m_LRU;
+	CUtlHashtable<const char *, unsigned short> m_Lookup;	// keys point into m_LRU's strings
+	CThreadFastMutex m_Mutex;
+
+	int m_nHits;
+	int m_nMisses;
+};
+
+static CMatcherRegexCache g_MatcherRegexCache;
+
+MatcherRegexEntry_t &CMatcherRegexCache::Get( const char *pszPattern )
+{
+	UtlHashHandle_t h = m_Lookup.Find( pszPattern );
+	if ( h != m_Lookup.InvalidHandle() )
+	{
+		unsigned short i = m_Lookup[h];
+		if ( i != m_LRU.Head() )
+		{
+			m_LRU.Unlink( i );
+			m_LRU.LinkToHead( i );
+		}
+
+		m_nHits++;
+		return m_LRU[i];
+	}
+
+	m_nMisses++;
+
+	// Make room
+	int nMaxSize = MIN( mapbase_regex_cache_size.GetInt(), m_LRU.InvalidIndex() - 1 );
+	while ( m_LRU.Count() >= nMaxSize )
+	{
+		unsigned short iTail = m_LRU.Tail();
+		m_Lookup.Remove( m_LRU[iTail].m_Pattern.Get() );
+		delete m_LRU[iTail].m_pRegex;
+		m_LRU.Remove( iTail );
+	}
+
+	unsigned short i = m_LRU.AddToHead();
+	MatcherRegexEntry_t &entry = m_LRU[i];
+	entry.m_Pattern = pszPattern;
+	entry.m_pRegex = NULL;
+
+	// Since I can't find any other way to check for valid regex,
+	// use a try-catch here to see if it throws an exception.
+	try { entry.m_pRegex = new std::regex( pszPattern ); }
+	catch (std::regex_error &e)
+	{
+		// Bad patterns stay cached so they're only reported once
+		Msg("Invalid regex \"%s\" (%s)\n", pszPattern, e.what());
+	}
+
+	m_Lookup.Insert( entry.m_Pattern.Get(), i );
+	return entry;
+}
+
+void CMatcherRegexCache::Purge()
+{
+	m_Lookup.Purge();
+
+	FOR_EACH_LL( m_LRU, i )
+	{
+		delete m_LRU[i].m_pRegex;
+	}
+	m_LRU.Purge();
+}
+
+// Compiles a regex ahead of time so the first real query doesn't pay for it.
+void Matcher_PrecacheRegex( const char *pszQuery )
+{
+	if ( !pszQuery || !mapbase_regex_enabled.GetBool() )
+		return;
+
+	AUTO_LOCK( g_MatcherRegexCache.GetMutex() );
+	g_MatcherRegexCache.Get( pszQuery );
+}
+
 // Regular expressions based off of the std library.
 // The C++ is strong in this one.
 bool Matcher_Regex(const char *pszQuery, const char *szValue)
+{
+	AUTO_LOCK( g_MatcherRegexCache.GetMutex() );
+
+	MatcherRegexEntry_t &entry = g_MatcherRegexCache.Get( pszQuery );
+	if ( !entry.m_pRegex )
+		return false;
+
+	std::match_results<const char*> results;
+	bool bMatch = std::regex_match( szValue, results, *entry.m_pRegex );
+	if (!bMatch)
+		return false;
+
+	// Only match the *whole* string
+	return Q_strlen(results.str(0).c_str()) == Q_strlen(szValue);
+}
+
+// The uncached original, kept for comparison in mapbase_matchers_benchmark.
+static bool Matcher_Regex_Uncached(const char *pszQuery, const char *szValue)
 {
 	std::regex regex;
 	
@@ -241,3 +436,76 @@ bool Matcher_Compare(const char *pszQuery, const char *szValue)
 #endif
 }
 */
+
+//-----------------------------------------------------------------------------
+// Compares the old and new matcher paths on a generated list of typical map names.
+//-----------------------------------------------------------------------------
+CON_COMMAND( mapbase_matchers_benchmark, "Times Mapbase's wildcard and regex matchers against their old implementations. Optional argument: number of passes." )
+{
+	int nPasses = args.ArgC() > 1 ? MAX( atoi( args[1] ), 1 ) : 20;
+
+	static const char *s_pszPrefixes[] = { "door", "relay", "npc_combine", "wave", "trigger", "lift", "light", "snd", "math", "case" };
+	static const char *s_pszSuffixes[] = { "start", "stop", "spawner", "alpha", "bravo", "counter", "branch", "template" };
+
+	CUtlVector<CUtlString> names;
+	for ( int i = 0; i < (int)ARRAYSIZE( s_pszPrefixes ); i++ )
+	{
+		for ( int j = 0; j < (int)ARRAYSIZE( s_pszSuffixes ); j++ )
+		{
+			for ( int k = 0; k < 25; k++ )
+			{
+				char szName[64];
+				V_snprintf( szName, sizeof( szName ), "%s_%s_%02d", s_pszPrefixes[i], s_pszSuffixes[j], k );
+				names.AddToTail( szName );
+			}
+		}
+	}
+
+	static const char *s_pszWildcards[] = { "door_*", "*_spawner_0?", "wave_*_1*", "npc_*_alpha_*", "*relay*", "light_???????_2?", "*_*_*_*" };
+	static const char *s_pszRegexes[] = { "relay_(alpha|bravo)_[0-9]+", "wave_.*_0[0-4]", "(door|lift)_st(art|op)_.*" };
+
+	int nOldMatches = 0, nNewMatches = 0;
+
+	double flStart = Plat_FloatTime();
+	for ( int p = 0; p < nPasses; p++ )
+		for ( int q = 0; q < (int)ARRAYSIZE( s_pszWildcards ); q++ )
+			for ( int n = 0; n < names.Count(); n++ )
+				nOldMatches += Matcher_RunCharCompare_Recursive( s_pszWildcards[q], names[n] ) ? 1 : 0;
+	double flOldWildcard = Plat_FloatTime() - flStart;
+
+	flStart = Plat_FloatTime();
+	for ( int p = 0; p < nPasses; p++ )
+		for ( int q = 0; q < (int)ARRAYSIZE( s_pszWildcards ); q++ )
+			for ( int n = 0; n < names.Count(); n++ )
+				nNewMatches += Matcher_RunCharCompare( s_pszWildcards[q], names[n] ) ? 1 : 0;
+	double flNewWildcard = Plat_FloatTime() - flStart;
+
+	int nWildcardTests = nPasses * (int)ARRAYSIZE( s_pszWildcards ) * names.Count();
+	Msg( "Wildcards: %d tests, recursive %.3f ms, iterative %.3f ms (%d / %d matches)\n",
+		nWildcardTests, flOldWildcard * 1000.0, flNewWildcard * 1000.0, nOldMatches, nNewMatches );
+
+	// Regex compilation dominates, so fewer passes are needed to see the difference
+	int nRegexPasses = MAX( nPasses / 10, 1 );
+	nOldMatches = nNewMatches = 0;
+
+	flStart = Plat_FloatTime();
+	for ( int p = 0; p < nRegexPasses; p++ )
+		for ( int q = 0; q < (int)ARRAYSIZE( s_pszRegexes ); q++ )
+			for ( int n = 0; n < names.Count(); n++ )
+				nOldMatches += Matcher_Regex_Uncached( s_pszRegexes[q], names[n] ) ? 1 : 0;
+	double flOldRegex = Plat_FloatTime() - flStart;
+
+	flStart = Plat_FloatTime();
+	for ( int p = 0; p < nRegexPasses; p++ )
+		for ( int q = 0; q < (int)ARRAYSIZE( s_pszRegexes ); q++ )
+			for ( int n = 0; n < names.Count(); n++ )
+				nNewMatches += Matcher_Regex( s_pszRegexes[q], names[n] ) ? 1 : 0;
+	double flNewRegex = Plat_FloatTime() - flStart;
+
+	int nRegexTests = nRegexPasses * (int)ARRAYSIZE( s_pszRegexes ) * names.Count();
+	Msg( "Regex: %d tests, uncached %.3f ms, cached %.3f ms (%d / %d matches)\n",
+		nRegexTests, flOldRegex * 1000.0, flNewRegex * 1000.0, nOldMatches, nNewMatches );
+
+	Msg( "Regex cache: %d patterns, %d hits, %d misses\n",
+		g_MatcherRegexCache.Count(), g_MatcherRegexCache.Hits(), g_MatcherRegexCache.Misses() );
+}